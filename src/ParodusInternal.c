@@ -32,11 +32,13 @@ char* getWebpaConveyHeader()
 {
     cJSON *response = cJSON_CreateObject();
     char *buffer = NULL;
-    static char encodedData[1024];
+    char encodedData[1024];
     int  encodedDataSize = 1024;
     char * reconnect_reason = get_global_reconnect_reason();
     int i =0, j=0;
 
+    encodedData[0] = '\0';
+
     if(strlen(get_parodus_cfg()->hw_model)!=0)
     {
 	    cJSON_AddStringToObject(response, HW_MODELNAME, get_parodus_cfg()->hw_model);
@@ -120,7 +122,7 @@ char* getWebpaConveyHeader()
     cJSON_Delete(response);
 
     if( 0 < strlen(encodedData) ) {
-        return encodedData;
+        return strdup(encodedData);
     }
 
     return NULL;
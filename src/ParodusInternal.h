@@ -46,6 +46,7 @@
 #include <wrp-c.h>
 
 #include "parodus_log.h"
+#include "backoff.h"
 /*----------------------------------------------------------------------------*/
 /*                                   Macros                                   */
 /*----------------------------------------------------------------------------*/
@@ -107,26 +108,28 @@ typedef struct {
 //--- Used in connection.c for backoff delay timer
 typedef struct {
   int max_delay;
-  int delay;
+  int delay;			// seconds, rounded up
+  unsigned int retry_after;	// seconds asked for by the server, used once
+  backoff_state_t state;
 } backoff_timer_t;
 
 //--- Used in connection.c for init_header_info
 typedef struct {
-  char *conveyHeader;	// Do not free
+  char *conveyHeader;	// Need to free
   char *device_id;	// Need to free
   char *user_agent;	// Need to free
 } header_info_t;
 
-// connection context which is defined in createNopollConnection
-// and passed into functions keep_retrying_connect, connect_and_wait,
+// connection context which is kept by the connection state machine
+// and passed into functions connect_and_wait,
 // wait_connection_ready, and nopoll_connect 
 typedef struct {
   noPollCtx *nopoll_ctx;
   server_list_t server_list;
   server_t *current_server;
-  header_info_t header_info;
-  char *extra_headers;		// need to be freed
+  char *extra_headers;		// owned by the header cache, do not free
   expire_timer_t connect_timer;
+  unsigned int retry_after;	// seconds, from a 429/503 response
 } create_connection_ctx_t;
 
 /*----------------------------------------------------------------------------*/
@@ -146,9 +149,12 @@ int checkHostIp(char * serverIP);
 
 void parStrncpy(char *destStr, const char *srcStr, size_t destSize);
 
+/* result must be freed */
 char* getWebpaConveyHeader();
 
 void *CRUDHandlerTask();
+void *CRUDRetrieveTask();
+void *CRUDNotifyTask();
 void addCRUDmsgToQueue(wrp_msg_t *crudMsg);
 
 void timespec_diff(struct timespec *start, struct timespec *stop,
@@ -0,0 +1,154 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/**
+ * @file backoff.c
+ *
+ * @description Reconnect backoff policies.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+
+#include "backoff.h"
+
+/*----------------------------------------------------------------------------*/
+/*                                   Macros                                   */
+/*----------------------------------------------------------------------------*/
+
+#define RETRY_AFTER_HDR		"Retry-After:"
+
+/*----------------------------------------------------------------------------*/
+/*                             Internal functions                             */
+/*----------------------------------------------------------------------------*/
+
+/* uniform in [lo, hi] */
+static unsigned int uniform (backoff_state_t *state, unsigned int lo, unsigned int hi)
+{
+	unsigned long long r;
+
+	if (hi <= lo)
+		return lo;
+	// two draws, RAND_MAX may be only 2^15
+	r = ((unsigned long long) rand_r (&state->seed) << 31) ^ rand_r (&state->seed);
+	return lo + (unsigned int) (r % ((unsigned long long) hi - lo + 1));
+}
+
+static unsigned int cap (backoff_state_t *state, unsigned long long ms)
+{
+	return (ms > state->max_ms) ? state->max_ms : (unsigned int) ms;
+}
+
+/*----------------------------------------------------------------------------*/
+/*                             External Functions                             */
+/*----------------------------------------------------------------------------*/
+
+void backoff_init (backoff_state_t *state, int policy, unsigned int max_ms,
+	unsigned int seed)
+{
+	state->policy = policy;
+	state->max_ms = max_ms;
+	state->envelope_ms = BACKOFF_BASE_MS;
+	state->delay_ms = 0;
+	state->seed = seed;
+}
+
+unsigned int backoff_next (backoff_state_t *state)
+{
+	unsigned long long prev;
+
+	// 3, 7, 15, 31 ...
+	if (state->envelope_ms < state->max_ms)
+		state->envelope_ms = cap (state,
+			2ULL * state->envelope_ms + BACKOFF_BASE_MS);
+	state->envelope_ms = cap (state, state->envelope_ms);
+
+	switch (state->policy) {
+	case BACKOFF_FULL_JITTER:
+		state->delay_ms = uniform (state, 0, state->envelope_ms);
+		break;
+	case BACKOFF_DECORRELATED_JITTER:
+		prev = (state->delay_ms < BACKOFF_BASE_MS) ? BACKOFF_BASE_MS : state->delay_ms;
+		state->delay_ms = cap (state,
+			uniform (state, BACKOFF_BASE_MS, cap (state, 3 * prev)));
+		break;
+	default:
+		state->delay_ms = state->envelope_ms;
+		break;
+	}
+	return state->delay_ms;
+}
+
+unsigned int backoff_after_hint (backoff_state_t *state, unsigned int retry_after)
+{
+	unsigned int hint_ms;
+
+	if (retry_after > BACKOFF_RETRY_AFTER_MAX)
+		retry_after = BACKOFF_RETRY_AFTER_MAX;
+	hint_ms = retry_after * 1000;
+	state->delay_ms = hint_ms;
+	if (BACKOFF_EXPONENTIAL != state->policy)
+		state->delay_ms += uniform (state, 0, hint_ms / 10);
+	return state->delay_ms;
+}
+
+unsigned int backoff_device_hash (const char *device_id)
+{
+	unsigned int hash = 2166136261U;
+
+	if (NULL == device_id)
+		return hash;
+	while ('\0' != *device_id) {
+		hash ^= (unsigned char) *device_id++;
+		hash *= 16777619U;
+	}
+	return hash;
+}
+
+unsigned int backoff_spread (const char *device_id, unsigned int window_ms)
+{
+	if (0 == window_ms)
+		return 0;
+	return backoff_device_hash (device_id) % window_ms;
+}
+
+unsigned int backoff_parse_retry_after (const char *message)
+{
+	size_t hdr_len = strlen (RETRY_AFTER_HDR);
+	unsigned long seconds = 0;
+	const char *ptr;
+
+	if (NULL == message)
+		return 0;
+	for (ptr = message; '\0' != *ptr; ptr++) {
+		if (strncasecmp (ptr, RETRY_AFTER_HDR, hdr_len) == 0)
+			break;
+	}
+	if ('\0' == *ptr)
+		return 0;
+	ptr += hdr_len;
+	while ((' ' == *ptr) || ('\t' == *ptr))
+		ptr++;
+	// only delta seconds, an http date is ignored
+	if (!isdigit ((unsigned char) *ptr))
+		return 0;
+	while (isdigit ((unsigned char) *ptr) && (seconds <= BACKOFF_RETRY_AFTER_MAX))
+		seconds = seconds * 10 + (*ptr++ - '0');
+	return (seconds > BACKOFF_RETRY_AFTER_MAX) ? BACKOFF_RETRY_AFTER_MAX : (unsigned int) seconds;
+}
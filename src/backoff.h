@@ -0,0 +1,105 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/**
+ * @file backoff.h
+ *
+ * @description Reconnect backoff policies.
+ *
+ *              The exponential policy is the original 3, 7, 15, 31 ...
+ *              second sequence. The jittered ones keep a fleet that lost its
+ *              connections at the same moment from coming back in lockstep
+ *              waves: full jitter picks a delay in [0, exponential value],
+ *              decorrelated jitter one in [base, 3 * previous delay].
+ *
+ */
+
+#ifndef _BACKOFF_H_
+#define _BACKOFF_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*----------------------------------------------------------------------------*/
+/*                                   Macros                                   */
+/*----------------------------------------------------------------------------*/
+
+#define BACKOFF_EXPONENTIAL		0
+#define BACKOFF_FULL_JITTER		1
+#define BACKOFF_DECORRELATED_JITTER	2
+
+#define BACKOFF_BASE_MS			1000
+#define BACKOFF_RETRY_AFTER_MAX		3600	// seconds, longest server hint honoured
+
+/*----------------------------------------------------------------------------*/
+/*                               Data Structures                              */
+/*----------------------------------------------------------------------------*/
+
+typedef struct {
+	int policy;
+	unsigned int max_ms;
+	unsigned int envelope_ms;	// exponential value: 1, 3, 7, 15 ... s
+	unsigned int delay_ms;		// last delay returned
+	unsigned int seed;		// rand_r state
+} backoff_state_t;
+
+/*----------------------------------------------------------------------------*/
+/*                             Function Prototypes                            */
+/*----------------------------------------------------------------------------*/
+
+void backoff_init (backoff_state_t *state, int policy, unsigned int max_ms,
+	unsigned int seed);
+
+/**
+ * @return the next delay in ms, never more than max_ms
+ */
+unsigned int backoff_next (backoff_state_t *state);
+
+/**
+ * Delay for a server that asked to be retried after retry_after seconds
+ * (at most BACKOFF_RETRY_AFTER_MAX). The jittered policies add up to a
+ * tenth on top so the fleet does not come back at the same second.
+ *
+ * @return the delay in ms
+ */
+unsigned int backoff_after_hint (backoff_state_t *state, unsigned int retry_after);
+
+/**
+ * FNV-1a hash of a device id, for seeding and spreading.
+ */
+unsigned int backoff_device_hash (const char *device_id);
+
+/**
+ * Fixed offset of a device within a window, so a fleet starting together
+ * spreads its first attempts evenly.
+ *
+ * @return ms in [0, window_ms)
+ */
+unsigned int backoff_spread (const char *device_id, unsigned int window_ms);
+
+/**
+ * Find a Retry-After header (delta seconds) in a handshake status message.
+ *
+ * @return seconds, 0 if there is none
+ */
+unsigned int backoff_parse_retry_after (const char *message);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _BACKOFF_H_ */
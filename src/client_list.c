@@ -24,12 +24,15 @@
 #include "ParodusInternal.h"
 #include "connection.h"
 #include "client_list.h"
+#include "crud_subscribe.h"
 
 /*----------------------------------------------------------------------------*/
 /*                            File Scoped Variables                           */
 /*----------------------------------------------------------------------------*/
 static int numOfClients = 0;
 static reg_list_item_t * g_head = NULL;
+static struct timespec registration_clock;
+static bool first_registration_logged = false;
 
 /*----------------------------------------------------------------------------*/
 /*                             External functions                             */
@@ -44,6 +47,28 @@ int get_numOfClients()
 {
     return numOfClients;
 }
+
+void start_registration_clock(void)
+{
+    clock_gettime(CLOCK_MONOTONIC, &registration_clock);
+    first_registration_logged = false;
+}
+
+// time to first registration, and whether the cloud was up by then
+static void log_first_registration(const char *service_name)
+{
+    struct timespec now;
+    long elapsed_ms;
+
+    if(first_registration_logged)
+        return;
+    first_registration_logged = true;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    elapsed_ms = (now.tv_sec - registration_clock.tv_sec) * 1000 +
+        (now.tv_nsec - registration_clock.tv_nsec) / 1000000;
+    ParodusInfo("First client %s registered %ld ms after start, connection state %s\n",
+        service_name, elapsed_ms, get_conn_state_name(get_conn_state()));
+}
 /** To add clients to registered list ***/
 
 int addToList( wrp_msg_t **msg)
@@ -112,6 +137,7 @@ int addToList( wrp_msg_t **msg)
 	                if((strcmp(new_node->service_name, (*msg)->u.reg.service_name)==0)&& (strcmp(new_node->url, (*msg)->u.reg.url)==0))
 	                {
 	                	numOfClients = numOfClients + 1;
+	                        log_first_registration(new_node->service_name);
 	                        ParodusInfo("sending auth status to reg client\n");
 	                        retStatus = sendAuthStatus(new_node);
 	                }
@@ -209,6 +235,8 @@ int deleteFromList(char* service_name)
 			 	prev_node->next = curr_node->next;
 			}
 			
+			// a client that comes back subscribes again
+			crud_unsubscribe_service(curr_node->service_name);
 			ParodusPrint("Deleting the node\n");
 			free( curr_node );
 			curr_node = NULL;
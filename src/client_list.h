@@ -50,6 +50,12 @@ int sendAuthStatus(reg_list_item_t *new_node);
 
 int deleteFromList(char* service_name);
 int get_numOfClients();
+
+/**
+ * @brief Start timing from here to the first client registration, which
+ * is logged with the state of the cloud connection at the time.
+ */
+void start_registration_clock(void);
 int sendMsgtoRegisteredClients(char *dest,const char **Msg,size_t msgSize);
 
 reg_list_item_t * get_global_node(void);
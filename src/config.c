@@ -25,6 +25,10 @@
 #include <fcntl.h> 
 #include "config.h"
 #include "ParodusInternal.h"
+#include "crud_store.h"
+#include "uplink_shards.h"
+#include "socket_tuning.h"
+#include "conn_hints.h"
 #include <cjwt/cjwt.h>
 
 #define MAX_BUF_SIZE	128
@@ -37,6 +41,12 @@ static ParodusCfg parodusCfg;
 static unsigned int rsa_algorithms = 
 	(1<<alg_rs256) | (1<<alg_rs384) | (1<<alg_rs512);
 
+/* {"cloud-status":"<status>"}, rebuilt whenever cloud_status changes */
+static char cloudStatusPayload[64];
+static size_t cloudStatusPayloadLen = 0;
+static const char *cloudStatusCached = NULL;
+static pthread_mutex_t cloud_status_mut = PTHREAD_MUTEX_INITIALIZER;
+
 /*----------------------------------------------------------------------------*/
 /*                             External Functions                             */
 /*----------------------------------------------------------------------------*/
@@ -61,6 +71,47 @@ void reset_cloud_disconnect_reason(ParodusCfg *cfg)
 	cfg->cloud_disconnect = NULL;
 }
 
+/* Called with cloud_status_mut held */
+static void refresh_cloud_status_payload(void)
+{
+	int len = 0;
+
+	cloudStatusCached = parodusCfg.cloud_status;
+	if(cloudStatusCached != NULL)
+	{
+		len = snprintf(cloudStatusPayload, sizeof(cloudStatusPayload), "{\"%s\":\"%s\"}",
+			CLOUD_STATUS, cloudStatusCached);
+	}
+	cloudStatusPayloadLen = (len > 0 && (size_t) len < sizeof(cloudStatusPayload)) ? (size_t) len : 0;
+}
+
+void set_cloud_status(char *status)
+{
+	pthread_mutex_lock(&cloud_status_mut);
+	parodusCfg.cloud_status = status;
+	refresh_cloud_status_payload();
+	pthread_mutex_unlock(&cloud_status_mut);
+}
+
+size_t get_cloud_status_payload(char *buf, size_t buflen)
+{
+	size_t len;
+
+	pthread_mutex_lock(&cloud_status_mut);
+	if(cloudStatusCached != parodusCfg.cloud_status)
+	{
+		refresh_cloud_status_payload();
+	}
+	len = cloudStatusPayloadLen;
+	if(len >= buflen)
+	{
+		len = 0;
+	}
+	memcpy(buf, cloudStatusPayload, len);
+	pthread_mutex_unlock(&cloud_status_mut);
+	return len;
+}
+
 
 const char *get_tok (const char *src, int delim, char *result, int resultsize)
 {
@@ -390,6 +441,26 @@ int parseCommandLine(int argc,char **argv,ParodusCfg * cfg)
         {"boot-time-retry-wait",    required_argument, 0, 'w'},
 	{"token-acquisition-script",     required_argument, 0, 'J'},
 	{"crud-config-file",        required_argument, 0, 'C'},
+	{"crud-store-format",       required_argument, 0, 'F'},
+	{"connection-attempt-delay", required_argument, 0, 'A'},
+	{"dns-cache-ttl",           required_argument, 0, 'N'},
+	{"tls-session-cache",       required_argument, 0, 'R'},
+	{"tls-session-file",        required_argument, 0, 'S'},
+	{"tls13-resumption",        no_argument,       0, '3'},
+	{"backoff-policy",          required_argument, 0, 'B'},
+	{"reconnect-spread",        required_argument, 0, 'W'},
+	{"server-pool",             required_argument, 0, 'P'},
+	{"drain-timeout",           required_argument, 0, 'G'},
+	{"warm-standby",            no_argument,       0, 'H'},
+	{"uplink-shards",           required_argument, 0, 'U'},
+	{"ping-interval",           required_argument, 0, 'I'},
+	{"socket-tuning",           required_argument, 0, 'K'},
+	{"link-monitor",            no_argument,       0, 'L'},
+	{"webpa-interfaces",        required_argument, 0, 'M'},
+	{"conn-hints-file",         required_argument, 0, 'O'},
+	{"conn-hints-ttl",          required_argument, 0, 'Q'},
+	{"handover-socket",         required_argument, 0, 'g'},
+	{"ktls",                    no_argument,       0, 'V'},
         {0, 0, 0, 0}
     };
     int c;
@@ -405,15 +476,35 @@ int parseCommandLine(int argc,char **argv,ParodusCfg * cfg)
 	cfg->jwt_algo = 0;
 	parStrncpy (cfg->jwt_key, "", sizeof(cfg->jwt_key));
 	cfg->crud_config_file = NULL;
+	cfg->crud_store_format = CRUD_STORE_FORMAT_JSON;
 	cfg->cloud_status = NULL;
 	cfg->cloud_disconnect = NULL;
+	cfg->connection_attempt_delay = 0;
+	cfg->dns_cache_ttl = 0;
+	cfg->tls_session_cache = 0;
+	cfg->tls_session_file = NULL;
+	cfg->tls13_resumption = 0;
+	cfg->backoff_policy = BACKOFF_EXPONENTIAL;
+	cfg->reconnect_spread = 0;
+	cfg->server_pool = NULL;
+	cfg->drain_timeout = 0;
+	cfg->warm_standby = 0;
+	cfg->uplink_shards = 0;
+	cfg->ping_interval = 0;
+	cfg->socket_tuning = NULL;
+	cfg->link_monitor = 0;
+	cfg->webpa_interfaces = NULL;
+	cfg->conn_hints_file = NULL;
+	cfg->handover_socket = NULL;
+	cfg->ktls = 0;
+	cfg->conn_hints_ttl = CONN_HINTS_TTL;
 	optind = 1;  /* We need this if parseCommandLine is called again */
     while (1)
     {
 
       /* getopt_long stores the option index here. */
       int option_index = 0;
-      c = getopt_long (argc, argv, "m:s:f:d:r:n:b:u:t:o:i:l:p:e:D:j:a:k:c:T:w:J:46:C",
+      c = getopt_long (argc, argv, "m:s:f:d:r:n:b:u:t:o:i:l:p:e:D:j:a:k:c:T:w:J:46:CF:A:N:R:S:3B:W:P:G:HU:I:K:LM:O:Q:g:V",
 				long_options, &option_index);
 
       /* Detect the end of the options. */
@@ -564,6 +655,157 @@ int parseCommandLine(int argc,char **argv,ParodusCfg * cfg)
 		  ParodusInfo("crud_config_file is %s\n", cfg->crud_config_file);
 		  break;
 
+		case 'F':
+		  if (strcmp(optarg, "json") == 0) {
+		    cfg->crud_store_format = CRUD_STORE_FORMAT_JSON;
+		  } else if (strcmp(optarg, "msgpack") == 0) {
+		    cfg->crud_store_format = CRUD_STORE_FORMAT_MSGPACK;
+		  } else {
+		    ParodusError("Invalid crud-store-format %s\n", optarg);
+		    return -1;
+		  }
+		  ParodusInfo("crud_store_format is %s\n", optarg);
+		  break;
+
+		case 'A':
+		  cfg->connection_attempt_delay = parse_num_arg (optarg, "connection-attempt-delay");
+		  if (cfg->connection_attempt_delay == (unsigned int) -1) {
+		    return -1;
+		  }
+		  ParodusInfo("connection_attempt_delay is %u ms\n", cfg->connection_attempt_delay);
+		  break;
+
+		case 'N':
+		  cfg->dns_cache_ttl = parse_num_arg (optarg, "dns-cache-ttl");
+		  if (cfg->dns_cache_ttl == (unsigned int) -1) {
+		    return -1;
+		  }
+		  ParodusInfo("dns_cache_ttl is %u s\n", cfg->dns_cache_ttl);
+		  break;
+
+		case 'R':
+		  cfg->tls_session_cache = parse_num_arg (optarg, "tls-session-cache");
+		  if (cfg->tls_session_cache == (unsigned int) -1) {
+		    return -1;
+		  }
+		  ParodusInfo("tls_session_cache is %u\n", cfg->tls_session_cache);
+		  break;
+
+		case 'S':
+		  cfg->tls_session_file = strdup(optarg);
+		  ParodusInfo("tls_session_file is %s\n", cfg->tls_session_file);
+		  break;
+
+		case '3':
+		  ParodusInfo("TLS 1.3 resumption\n");
+		  cfg->tls13_resumption = 1;
+		  break;
+
+		case 'B':
+		  if (strcmp(optarg, "exponential") == 0) {
+		    cfg->backoff_policy = BACKOFF_EXPONENTIAL;
+		  } else if (strcmp(optarg, "full-jitter") == 0) {
+		    cfg->backoff_policy = BACKOFF_FULL_JITTER;
+		  } else if (strcmp(optarg, "decorrelated-jitter") == 0) {
+		    cfg->backoff_policy = BACKOFF_DECORRELATED_JITTER;
+		  } else {
+		    ParodusError("Invalid backoff-policy %s\n", optarg);
+		    return -1;
+		  }
+		  ParodusInfo("backoff_policy is %s\n", optarg);
+		  break;
+
+		case 'W':
+		  cfg->reconnect_spread = parse_num_arg (optarg, "reconnect-spread");
+		  if (cfg->reconnect_spread == (unsigned int) -1) {
+		    return -1;
+		  }
+		  ParodusInfo("reconnect_spread is %u s\n", cfg->reconnect_spread);
+		  break;
+
+		case 'P':
+		  cfg->server_pool = strdup(optarg);
+		  ParodusInfo("server_pool is %s\n", cfg->server_pool);
+		  break;
+
+		case 'G':
+		  cfg->drain_timeout = parse_num_arg (optarg, "drain-timeout");
+		  if (cfg->drain_timeout == (unsigned int) -1) {
+		    return -1;
+		  }
+		  ParodusInfo("drain_timeout is %u ms\n", cfg->drain_timeout);
+		  break;
+
+		case 'H':
+		  ParodusInfo("warm standby connection\n");
+		  cfg->warm_standby = 1;
+		  break;
+
+		case 'U':
+		  cfg->uplink_shards = parse_num_arg (optarg, "uplink-shards");
+		  if (cfg->uplink_shards == (unsigned int) -1) {
+		    return -1;
+		  }
+		  if (cfg->uplink_shards > UPLINK_SHARDS_MAX) {
+		    ParodusError("uplink-shards is at most %d\n", UPLINK_SHARDS_MAX);
+		    return -1;
+		  }
+		  ParodusInfo("uplink_shards is %u\n", cfg->uplink_shards);
+		  break;
+
+		case 'I':
+		  cfg->ping_interval = parse_num_arg (optarg, "ping-interval");
+		  if (cfg->ping_interval == (unsigned int) -1) {
+		    return -1;
+		  }
+		  ParodusInfo("ping_interval is %u\n", cfg->ping_interval);
+		  break;
+
+		case 'K':
+		{
+		  socket_tuning_t tuning;
+		  if (socket_tuning_parse (optarg, &tuning) < 0) {
+		    ParodusError("Invalid socket-tuning %s\n", optarg);
+		    return -1;
+		  }
+		  cfg->socket_tuning = strdup(optarg);
+		  ParodusInfo("socket_tuning is %s\n", cfg->socket_tuning);
+		  break;
+		}
+
+		case 'L':
+		  ParodusInfo("link monitor\n");
+		  cfg->link_monitor = 1;
+		  break;
+
+		case 'M':
+		  cfg->webpa_interfaces = strdup(optarg);
+		  ParodusInfo("webpa_interfaces is %s\n", cfg->webpa_interfaces);
+		  break;
+
+		case 'O':
+		  cfg->conn_hints_file = strdup(optarg);
+		  ParodusInfo("conn_hints_file is %s\n", cfg->conn_hints_file);
+		  break;
+
+		case 'Q':
+		  cfg->conn_hints_ttl = parse_num_arg (optarg, "conn-hints-ttl");
+		  if (cfg->conn_hints_ttl == (unsigned int) -1) {
+		    return -1;
+		  }
+		  ParodusInfo("conn_hints_ttl is %u s\n", cfg->conn_hints_ttl);
+		  break;
+
+		case 'g':
+		  cfg->handover_socket = strdup(optarg);
+		  ParodusInfo("handover_socket is %s\n", cfg->handover_socket);
+		  break;
+
+		case 'V':
+		  ParodusInfo("kernel tls\n");
+		  cfg->ktls = 1;
+		  break;
+
         case '?':
           /* getopt_long already printed an error message. */
           break;
@@ -869,6 +1111,68 @@ void loadParodusCfg(ParodusCfg * config,ParodusCfg *cfg)
     {
         ParodusPrint("crud_config_file is NULL. set to empty\n");
     }
+    cfg->crud_store_format = config->crud_store_format;
+    cfg->connection_attempt_delay = config->connection_attempt_delay;
+    cfg->dns_cache_ttl = config->dns_cache_ttl;
+    cfg->tls_session_cache = config->tls_session_cache;
+    if(config->tls_session_file != NULL)
+    {
+        cfg->tls_session_file = strdup(config->tls_session_file);
+    }
+    else
+    {
+        cfg->tls_session_file = NULL;
+    }
+    cfg->tls13_resumption = config->tls13_resumption;
+    cfg->backoff_policy = config->backoff_policy;
+    cfg->reconnect_spread = config->reconnect_spread;
+    if(config->server_pool != NULL)
+    {
+        cfg->server_pool = strdup(config->server_pool);
+    }
+    else
+    {
+        cfg->server_pool = NULL;
+    }
+    cfg->drain_timeout = config->drain_timeout;
+    cfg->warm_standby = config->warm_standby;
+    cfg->uplink_shards = config->uplink_shards;
+    cfg->ping_interval = config->ping_interval;
+    if(config->socket_tuning != NULL)
+    {
+        cfg->socket_tuning = strdup(config->socket_tuning);
+    }
+    else
+    {
+        cfg->socket_tuning = NULL;
+    }
+    cfg->link_monitor = config->link_monitor;
+    if(config->webpa_interfaces != NULL)
+    {
+        cfg->webpa_interfaces = strdup(config->webpa_interfaces);
+    }
+    else
+    {
+        cfg->webpa_interfaces = NULL;
+    }
+    if(config->conn_hints_file != NULL)
+    {
+        cfg->conn_hints_file = strdup(config->conn_hints_file);
+    }
+    else
+    {
+        cfg->conn_hints_file = NULL;
+    }
+    cfg->conn_hints_ttl = config->conn_hints_ttl;
+    if(config->handover_socket != NULL)
+    {
+        cfg->handover_socket = strdup(config->handover_socket);
+    }
+    else
+    {
+        cfg->handover_socket = NULL;
+    }
+    cfg->ktls = config->ktls;
 }
 
 
@@ -100,9 +100,29 @@ typedef struct
     char token_acquisition_script[64];
     char token_read_script[64];
 	char *crud_config_file;
+	unsigned int crud_store_format;
 	char *cloud_status;
 	char *cloud_disconnect;
 	unsigned int boot_retry_wait;
+	unsigned int connection_attempt_delay;	// ms, 0 to try ipv6 then ipv4 in turn
+	unsigned int dns_cache_ttl;	// seconds, 0 disables the dns cache
+	unsigned int tls_session_cache;	// resume tls sessions across reconnects
+	char *tls_session_file;	// where resumable sessions are saved
+	unsigned int tls13_resumption;	// allow TLS 1.3 psk resumption
+	unsigned int backoff_policy;	// BACKOFF_*
+	unsigned int reconnect_spread;	// seconds, window for the first connect attempt
+	char *server_pool;	// more server urls, comma separated, ranked with webpa_url
+	unsigned int drain_timeout;	// ms to flush queues before a forced disconnect
+	unsigned int warm_standby;	// keep an idle second connection to fail over to
+	unsigned int uplink_shards;	// connections upstream is spread over, 0 for one
+	unsigned int ping_interval;	// seconds between our pings, 0 for none
+	char *socket_tuning;	// kernel socket options profile, see socket_tuning.h
+	unsigned int link_monitor;	// reconnect on link and address changes
+	char *webpa_interfaces;	// interfaces to connect over, most preferred first
+	char *conn_hints_file;	// where the last server connected to is kept
+	unsigned int conn_hints_ttl;	// seconds a saved hint is good for
+	char *handover_socket;	// unix socket to hand the clients to a new binary over
+	unsigned int ktls;	// encrypt in the kernel after the tls handshake
 } ParodusCfg;
 
 #define FLAGS_IPV6_ONLY (1 << 0)
@@ -135,6 +155,17 @@ void set_parodus_cfg(ParodusCfg *);
 char *get_token_application(void) ;
 void set_cloud_disconnect_reason(ParodusCfg *cfg, char *disconn_reason);
 void reset_cloud_disconnect_reason(ParodusCfg *cfg);
+/**
+ * Set cloud_status in the global config and refresh the pre-rendered
+ * cloud-status retrieve payload.
+ */
+void set_cloud_status(char *status);
+/**
+ * Copy the {"cloud-status":"<status>"} payload into buf, not NUL terminated.
+ *
+ * @return payload length, 0 if cloud_status is not set or buf is too small
+ */
+size_t get_cloud_status_payload(char *buf, size_t buflen);
 /**
  * parse a webpa url. Extract the server address, the port
  * and return whether it's secure or not
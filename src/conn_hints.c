@@ -0,0 +1,120 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/**
+ * @file conn_hints.c
+ *
+ * @description Where the last connection ended up, kept in a file.
+ *
+ *              The file is one line:
+ *              origin host port allow_insecure addr expires
+ *              with "-" for an unknown addr.
+ *
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "conn_hints.h"
+#include "parodus_log.h"
+
+/*----------------------------------------------------------------------------*/
+/*                                   Macros                                   */
+/*----------------------------------------------------------------------------*/
+
+#define CONN_HINTS_LINE_MAX	(CONN_HINTS_URL_MAX + CONN_HINTS_HOST_MAX + INET6_ADDRSTRLEN + 64)
+
+/*----------------------------------------------------------------------------*/
+/*                             External Functions                             */
+/*----------------------------------------------------------------------------*/
+
+int conn_hints_load (const char *file, const char *origin, conn_hint_t *hint)
+{
+	char line[CONN_HINTS_LINE_MAX];
+	long long expires;
+	FILE *fp;
+	int fields = 0;
+
+	memset (hint, 0, sizeof(conn_hint_t));
+	if ((NULL == file) || (NULL == origin))
+		return -1;
+	fp = fopen (file, "r");
+	if (NULL == fp)
+		return -1;
+	if (NULL != fgets (line, sizeof(line), fp))
+		fields = sscanf (line, "%127s %255s %u %d %45s %lld", hint->origin,
+			hint->host, &hint->port, &hint->allow_insecure, hint->addr, &expires);
+	fclose (fp);
+	if (6 != fields) {
+		ParodusError ("Ignoring malformed connection hint in %s\n", file);
+		return -1;
+	}
+	if (strcmp (hint->addr, "-") == 0)
+		hint->addr[0] = '\0';
+	hint->expires = (time_t) expires;
+	if (strcmp (hint->origin, origin) != 0) {
+		ParodusInfo ("Connection hint is for %s, not %s\n", hint->origin, origin);
+		return -1;
+	}
+	if (hint->expires <= time (NULL)) {
+		ParodusInfo ("Connection hint for %s expired\n", hint->host);
+		return -1;
+	}
+	return 0;
+}
+
+int conn_hints_save (const char *file, const conn_hint_t *hint)
+{
+	char *tmp_file;
+	FILE *fp;
+	int fd, rtn = 0;
+
+	if ((NULL == file) || (strchr (hint->origin, ' ') != NULL) ||
+	    ('\0' == hint->origin[0]) || ('\0' == hint->host[0]))
+		return -1;
+	tmp_file = (char *) malloc (strlen (file) + 5);
+	if (NULL == tmp_file)
+		return -1;
+	sprintf (tmp_file, "%s.tmp", file);
+	fd = open (tmp_file, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if ((fd < 0) || (NULL == (fp = fdopen (fd, "w")))) {
+		ParodusError ("Unable to write connection hint file %s\n", tmp_file);
+		if (fd >= 0)
+			close (fd);
+		free (tmp_file);
+		return -1;
+	}
+	fprintf (fp, "%s %s %u %d %s %lld\n", hint->origin, hint->host, hint->port,
+		hint->allow_insecure, ('\0' != hint->addr[0]) ? hint->addr : "-",
+		(long long) hint->expires);
+	// renamed into place, so a crash leaves the old hint or the new one
+	if ((fclose (fp) != 0) || (rename (tmp_file, file) != 0)) {
+		ParodusError ("Unable to save connection hint file %s\n", file);
+		unlink (tmp_file);
+		rtn = -1;
+	}
+	free (tmp_file);
+	return rtn;
+}
+
+void conn_hints_drop (const char *file)
+{
+	if ((NULL != file) && (unlink (file) == 0))
+		ParodusInfo ("Dropped connection hint %s\n", file);
+}
@@ -0,0 +1,90 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/**
+ * @file conn_hints.h
+ *
+ * @description Where the last connection ended up, kept in a file so the
+ *              next start can go there first.
+ *
+ *              A hint is the server that accepted the connection (the
+ *              redirect target or jwt server, or the default server) and
+ *              the address it was reached at. It is tied to the url it was
+ *              learned from, so a changed webpa url ignores it, and it
+ *              expires so the discovery chain still runs now and then.
+ *
+ */
+
+#ifndef _CONN_HINTS_H_
+#define _CONN_HINTS_H_
+
+#include <arpa/inet.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*----------------------------------------------------------------------------*/
+/*                                   Macros                                   */
+/*----------------------------------------------------------------------------*/
+
+#define CONN_HINTS_TTL		86400	// seconds, default
+#define CONN_HINTS_URL_MAX	128
+#define CONN_HINTS_HOST_MAX	256
+
+/*----------------------------------------------------------------------------*/
+/*                               Data Structures                              */
+/*----------------------------------------------------------------------------*/
+
+typedef struct {
+	char origin[CONN_HINTS_URL_MAX];	// url the server was found from
+	char host[CONN_HINTS_HOST_MAX];
+	unsigned int port;
+	int allow_insecure;
+	char addr[INET6_ADDRSTRLEN];		// empty if not known
+	time_t expires;
+} conn_hint_t;
+
+/*----------------------------------------------------------------------------*/
+/*                             Function Prototypes                            */
+/*----------------------------------------------------------------------------*/
+
+/**
+ * Read the hint saved in file.
+ *
+ * @param origin only a hint learned from this url is returned
+ * @return 0 if hint holds one that has not expired, -1 otherwise
+ */
+int conn_hints_load (const char *file, const char *origin, conn_hint_t *hint);
+
+/**
+ * Replace the hint saved in file.
+ *
+ * @return 0 on success
+ */
+int conn_hints_save (const char *file, const conn_hint_t *hint);
+
+/**
+ * Remove the saved hint, e.g. once it failed.
+ */
+void conn_hints_drop (const char *file);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _CONN_HINTS_H_ */
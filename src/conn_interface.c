@@ -35,7 +35,11 @@
 #include "seshat_interface.h"
 #include "crud_interface.h"
 #include "heartBeat.h"
+#include "link_monitor.h"
 #include "close_retry.h"
+#include "client_list.h"
+#include "handover.h"
+#include "token.h"
 #ifdef FEATURE_DNS_QUERY
 #include <ucresolv_log.h>
 #endif
@@ -46,7 +50,7 @@
 /*----------------------------------------------------------------------------*/
 
 #define HEARTBEAT_RETRY_SEC                         	30      /* Heartbeat (ping/pong) timeout in seconds */
-#define CLOUD_RECONNECT_TIME                       		5		/* Cloud disconnect max time in minutes */
+#define OFFLINE_WAIT_MS                             	1000    /* Longest sleep between steps while offline */
 
 /*----------------------------------------------------------------------------*/
 /*                            File Scoped Variables                           */
@@ -58,6 +62,81 @@ bool g_shutdown  = false;
 /*----------------------------------------------------------------------------*/
 void timespec_diff(struct timespec *start, struct timespec *stop,
                    struct timespec *result);
+
+/*----------------------------------------------------------------------------*/
+/*                             Internal functions                             */
+/*----------------------------------------------------------------------------*/
+
+// while offline, sleep until the next connection step is due, but wake at
+// least every OFFLINE_WAIT_MS so shutdown and seshat retries are not held up
+static void offline_wait (int wait_ms)
+{
+    struct timespec ts;
+
+    if (wait_ms <= 0)
+        return;
+    if (wait_ms > OFFLINE_WAIT_MS)
+        wait_ms = OFFLINE_WAIT_MS;
+    ts.tv_sec = wait_ms / 1000;
+    ts.tv_nsec = (long) (wait_ms % 1000) * 1000000;
+    nanosleep (&ts, NULL);
+}
+
+// waits on the connection, accounting for the heartbeat, and drains it
+// when it has to be closed
+static void service_connection (noPollCtx *ctx, unsigned int webpa_ping_timeout_ms)
+{
+    struct timespec start, stop, diff;
+    unsigned int heartBeatTimer = 0;
+    int time_taken_ms;
+    int ping_ms;
+    long wait_us = 5000000;
+
+    // wake up in time for the next ping or pong deadline
+    ping_ms = conn_machine_ping();
+    if((0 <= ping_ms) && (ping_ms < 5000))
+    {
+        wait_us = (ping_ms + 1) * 1000;
+    }
+
+    clock_gettime(CLOCK_REALTIME, &start);
+    nopoll_loop_wait(ctx, wait_us);
+    clock_gettime(CLOCK_REALTIME, &stop);
+
+    timespec_diff(&start, &stop, &diff);
+    time_taken_ms = diff.tv_sec * 1000 + (diff.tv_nsec / 1000000);
+
+    // ParodusInfo("nopoll_loop_wait() time %d msec\n", time_taken_ms);
+	heartBeatTimer = get_heartBeatTimer();
+    if(heartBeatTimer >= webpa_ping_timeout_ms)
+    {
+        ParodusInfo("heartBeatTimer %d webpa_ping_timeout_ms %d\n", heartBeatTimer, webpa_ping_timeout_ms);
+
+        if(!get_close_retry())
+        {
+            ParodusError("ping wait time > %d . Terminating the connection with WebPA server and retrying\n", webpa_ping_timeout_ms / 1000);
+            ParodusInfo("Reconnect detected, setting Ping_Miss reason for Reconnect\n");
+            set_global_reconnect_reason("Ping_Miss");
+            set_global_reconnect_status(true);
+            set_close_retry();
+        }
+        else
+        {
+				ParodusPrint("heartBeatHandler - close_retry set to %d, hence resetting the heartBeatTimer\n",get_close_retry());
+        }
+        reset_heartBeatTimer();
+    }
+    else {
+        increment_heartBeatTimer(time_taken_ms);
+    }
+
+    if(get_close_retry())
+    {
+        ParodusInfo("close_retry is %d, hence closing the connection and retrying\n", get_close_retry());
+        conn_machine_drain();
+    }
+}
+
 /*----------------------------------------------------------------------------*/
 /*                             External Functions                             */
 /*----------------------------------------------------------------------------*/
@@ -67,12 +146,16 @@ void createSocketConnection(void (* initKeypress)())
     //ParodusCfg *tmpCfg = (ParodusCfg*)config_in;
     noPollCtx *ctx;
     bool seshat_registered = false;
+    bool online_once = false;
     unsigned int webpa_ping_timeout_ms = 1000 * get_parodus_cfg()->webpa_ping_timeout;
-    unsigned int heartBeatTimer = 0;
+    int state;
+    int i;
     
     //loadParodusCfg(tmpCfg,get_parodus_cfg());
 #ifdef FEATURE_DNS_QUERY
 	register_ucresolv_logger (__cimplog);
+	if (get_parodus_cfg()->acquire_jwt)
+		StartThread(JWTRefreshTask);
 #endif
     ParodusPrint("Configure nopoll thread handlers in Parodus\n");
     nopoll_thread_handlers(&createMutex, &destroyMutex, &lockMutex, &unlockMutex);
@@ -86,12 +169,14 @@ void createSocketConnection(void (* initKeypress)())
     nopoll_log_set_handler (ctx, __report_log, NULL);
     #endif
 
-    if(!createNopollConnection(ctx))
-    {
-		ParodusError("Unrecovered error, terminating the process\n");
-		abort();
-    }
+    // a running parodus being upgraded hands its clients over and exits
+    handover_take(get_parodus_cfg()->handover_socket);
+
+    // local services come up first; the cloud connection is made by the
+    // loop below, so clients can register while the device is offline
+    start_registration_clock();
     packMetaData();
+    handover_restore();
     
     UpStreamMsgQ = NULL;
     StartThread(handle_upstream);
@@ -100,6 +185,11 @@ void createSocketConnection(void (* initKeypress)())
     StartThread(messageHandlerTask);
     StartThread(serviceAliveTask);
 	StartThread(CRUDHandlerTask);
+	for(i = 0; i < CRUD_RETRIEVE_THREADS; i++)
+	{
+		StartThread(CRUDRetrieveTask);
+	}
+	StartThread(CRUDNotifyTask);
 
     if (NULL != initKeypress) 
     {
@@ -107,71 +197,50 @@ void createSocketConnection(void (* initKeypress)())
     }
 
     seshat_registered = __registerWithSeshat();
-    
+    handover_listen(get_parodus_cfg()->handover_socket);
+
+    conn_machine_init(ctx);
     do
     {
-        struct timespec start, stop, diff;
-        int time_taken_ms;
-
-        clock_gettime(CLOCK_REALTIME, &start);
-        nopoll_loop_wait(ctx, 5000000);
-        clock_gettime(CLOCK_REALTIME, &stop);
-
-        timespec_diff(&start, &stop, &diff);
-        time_taken_ms = diff.tv_sec * 1000 + (diff.tv_nsec / 1000000);
-
-        // ParodusInfo("nopoll_loop_wait() time %d msec\n", time_taken_ms);
-	heartBeatTimer = get_heartBeatTimer();
-        if(heartBeatTimer >= webpa_ping_timeout_ms)
+        state = get_conn_state();
+        if(CONN_STATE_ONLINE == state)
         {
-            ParodusInfo("heartBeatTimer %d webpa_ping_timeout_ms %d\n", heartBeatTimer, webpa_ping_timeout_ms);
-
-            if(!get_close_retry())
+            if(!online_once)
             {
-                ParodusError("ping wait time > %d . Terminating the connection with WebPA server and retrying\n", webpa_ping_timeout_ms / 1000);
-                ParodusInfo("Reconnect detected, setting Ping_Miss reason for Reconnect\n");
-                set_global_reconnect_reason("Ping_Miss");
-                set_global_reconnect_status(true);
-                set_close_retry();
+                online_once = true;
+                ParodusInfo("Connected to the cloud, %d clients registered while offline\n", get_numOfClients());
             }
-            else
-            {
-				ParodusPrint("heartBeatHandler - close_retry set to %d, hence resetting the heartBeatTimer\n",get_close_retry());
-            }
-            reset_heartBeatTimer();
+            service_connection(ctx, webpa_ping_timeout_ms);
+            conn_machine_tend();
         }
-        else {
-            increment_heartBeatTimer(time_taken_ms);
+        else if(CONN_STATE_FAILED != state)
+        {
+            // reconnecting: step the connection, keep servicing the rest
+            offline_wait(conn_machine_step());
         }
 
         if( false == seshat_registered ) {
             seshat_registered = __registerWithSeshat();
         }
+       } while((CONN_STATE_FAILED != state) && !g_shutdown);
 
-        if(get_close_retry())
-        {
-            ParodusInfo("close_retry is %d, hence closing the connection and retrying\n", get_close_retry());
-            close_and_unref_connection(get_global_conn());
-            set_global_conn(NULL);
-
-            get_parodus_cfg()->cloud_status = CLOUD_STATUS_OFFLINE;
-            ParodusInfo("cloud_status set as %s after connection close\n", get_parodus_cfg()->cloud_status);
-            if(get_parodus_cfg()->cloud_disconnect !=NULL)
-            {
-				ParodusPrint("get_parodus_cfg()->cloud_disconnect is %s\n", get_parodus_cfg()->cloud_disconnect);
-				set_cloud_disconnect_time(CLOUD_RECONNECT_TIME);
-				ParodusInfo("Waiting for %d minutes for reconnecting .. \n", get_cloud_disconnect_time());
-
-				sleep( get_cloud_disconnect_time() * 60 );
-				ParodusInfo("cloud-disconnect reason reset after %d minutes\n", get_cloud_disconnect_time());
-				free(get_parodus_cfg()->cloud_disconnect);
-				reset_cloud_disconnect_reason(get_parodus_cfg());
-            }
-            createNopollConnection(ctx);
-        }
-       } while(!get_close_retry() && !g_shutdown);
+    if((CONN_STATE_FAILED == state) && !online_once)
+    {
+		ParodusError("Unrecovered error, terminating the process\n");
+		abort();
+    }
 
+    if(handover_pending())
+    {
+        conn_machine_flush();
+        handover_send();
+    }
+    handover_stop();
+    conn_machine_stop();
+    close_side_connections();	// queued shard messages go out on the primary
+    link_monitor_stop();
     close_and_unref_connection(get_global_conn());
+    free_header_cache();
     nopoll_ctx_unref(ctx);
     nopoll_cleanup_library();
 }
@@ -0,0 +1,348 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/**
+ * @file conn_race.c
+ *
+ * @description Staggered, parallel connection attempts (Happy Eyeballs).
+ *
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include "conn_race.h"
+#include "dns_cache.h"
+#include "parodus_log.h"
+
+/*----------------------------------------------------------------------------*/
+/*                               Data Structures                              */
+/*----------------------------------------------------------------------------*/
+
+/* Shared by conn_race_run and its attempt threads, freed by whoever drops
+   the last reference */
+typedef struct {
+	pthread_mutex_t mut;
+	pthread_cond_t con;
+	int refs;
+	int active;
+	int decided;		// index of the deciding attempt, -1 while racing
+	int decided_rc;
+	int last_status;
+	volatile int cancelled;
+	conn_race_result_t result;
+	conn_race_attempt_fn attempt;
+	conn_race_release_fn release;
+	void *arg;
+	void (*free_arg)(void *);
+} race_t;
+
+typedef struct {
+	race_t *race;
+	int index;
+} race_slot_t;
+
+/*----------------------------------------------------------------------------*/
+/*                             Internal functions                             */
+/*----------------------------------------------------------------------------*/
+
+/* Called with race->mut held, releases it */
+static void race_unref(race_t *race)
+{
+	int last = (0 == --race->refs);
+
+	pthread_mutex_unlock(&race->mut);
+	if(last)
+	{
+		if(NULL != race->free_arg)
+		{
+			race->free_arg(race->arg);
+		}
+		pthread_cond_destroy(&race->con);
+		pthread_mutex_destroy(&race->mut);
+		free(race);
+	}
+}
+
+static void *race_thread(void *data)
+{
+	race_slot_t *slot = (race_slot_t *) data;
+	race_t *race = slot->race;
+	int index = slot->index;
+	conn_race_result_t result;
+	void *late = NULL;
+	int rc;
+
+	free(slot);
+	memset(&result, 0, sizeof(result));
+	rc = race->attempt(race->arg, index, &result, &race->cancelled);
+
+	pthread_mutex_lock(&race->mut);
+	race->active--;
+	if((CONN_RACE_FAIL != rc) && (race->decided < 0))
+	{
+		ParodusPrint("connection attempt %d decided the race\n", index);
+		race->decided = index;
+		race->decided_rc = rc;
+		race->result = result;
+		race->cancelled = 1;
+	}
+	else
+	{
+		if(CONN_RACE_SUCCESS == rc)
+		{
+			ParodusInfo("connection attempt %d finished after the race, closing it\n", index);
+			late = result.handle;
+		}
+		else if(CONN_RACE_FAIL == rc)
+		{
+			race->last_status = result.status;
+		}
+		free(result.message);
+	}
+	pthread_cond_signal(&race->con);
+
+	if((NULL != late) && (NULL != race->release))
+	{
+		// arg stays valid, this thread still holds a reference
+		pthread_mutex_unlock(&race->mut);
+		race->release(race->arg, late);
+		pthread_mutex_lock(&race->mut);
+	}
+	race_unref(race);
+	return NULL;
+}
+
+/* Called with race->mut held */
+static int start_attempt(race_t *race, int index)
+{
+	race_slot_t *slot;
+	pthread_attr_t attr;
+	pthread_t threadId;
+	int err;
+
+	slot = (race_slot_t *) malloc(sizeof(race_slot_t));
+	if(NULL == slot)
+	{
+		ParodusError("Unable to allocate connection attempt %d\n", index);
+		return -1;
+	}
+	slot->race = race;
+	slot->index = index;
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	err = pthread_create(&threadId, &attr, race_thread, slot);
+	pthread_attr_destroy(&attr);
+	if(0 != err)
+	{
+		ParodusError("Error creating connection attempt thread :[%s]\n", strerror(err));
+		free(slot);
+		return -1;
+	}
+	race->refs++;
+	race->active++;
+	return 0;
+}
+
+static void add_ms(struct timespec *ts, unsigned int ms)
+{
+	ts->tv_sec += ms / 1000;
+	ts->tv_nsec += (long) (ms % 1000) * 1000000L;
+	if(ts->tv_nsec >= 1000000000L)
+	{
+		ts->tv_sec++;
+		ts->tv_nsec -= 1000000000L;
+	}
+}
+
+static int add_addr(conn_race_addr_t *list, int count, int max,
+	const struct sockaddr *sa)
+{
+	conn_race_addr_t addr;
+	int i;
+
+	memset(&addr, 0, sizeof(addr));
+	if(AF_INET6 == sa->sa_family)
+	{
+		addr.is_ipv6 = 1;
+		inet_ntop(AF_INET6, &((const struct sockaddr_in6 *) sa)->sin6_addr,
+			addr.ip, sizeof(addr.ip));
+	}
+	else if(AF_INET == sa->sa_family)
+	{
+		inet_ntop(AF_INET, &((const struct sockaddr_in *) sa)->sin_addr,
+			addr.ip, sizeof(addr.ip));
+	}
+	else
+	{
+		return count;
+	}
+
+	for(i = 0; i < count; i++)
+	{
+		if(strcmp(list[i].ip, addr.ip) == 0)
+		{
+			return count;
+		}
+	}
+	if(count < max)
+	{
+		list[count++] = addr;
+	}
+	return count;
+}
+
+/*----------------------------------------------------------------------------*/
+/*                             External Functions                             */
+/*----------------------------------------------------------------------------*/
+
+int conn_race_run(int count, unsigned int delay_ms,
+	conn_race_attempt_fn attempt, conn_race_release_fn release,
+	void *arg, void (*free_arg)(void *), conn_race_result_t *result)
+{
+	race_t *race;
+	struct timespec deadline;
+	int started = 0, due = 0;
+	int rc;
+
+	memset(result, 0, sizeof(conn_race_result_t));
+	race = (race_t *) calloc(1, sizeof(race_t));
+	if((NULL == race) || (count <= 0) || (NULL == attempt))
+	{
+		free(race);
+		if(NULL != free_arg)
+		{
+			free_arg(arg);
+		}
+		return CONN_RACE_FAIL;
+	}
+	pthread_mutex_init(&race->mut, NULL);
+	pthread_cond_init(&race->con, NULL);
+	race->refs = 1;
+	race->decided = -1;
+	race->attempt = attempt;
+	race->release = release;
+	race->arg = arg;
+	race->free_arg = free_arg;
+
+	pthread_mutex_lock(&race->mut);
+	while(race->decided < 0)
+	{
+		if((started < count) && (due || (0 == race->active)))
+		{
+			ParodusPrint("Starting connection attempt %d\n", started);
+			start_attempt(race, started);
+			started++;
+			due = 0;
+			clock_gettime(CLOCK_REALTIME, &deadline);
+			add_ms(&deadline, delay_ms);
+			continue;
+		}
+		if(started == count)
+		{
+			if(0 == race->active)
+			{
+				break;
+			}
+			pthread_cond_wait(&race->con, &race->mut);
+		}
+		else if(ETIMEDOUT == pthread_cond_timedwait(&race->con, &race->mut, &deadline))
+		{
+			due = 1;
+		}
+	}
+
+	if(race->decided >= 0)
+	{
+		rc = race->decided_rc;
+		*result = race->result;
+	}
+	else
+	{
+		rc = CONN_RACE_FAIL;
+		result->status = race->last_status;
+	}
+	race->cancelled = 1;
+	race_unref(race);
+	return rc;
+}
+
+int conn_race_sort_addrs(const struct sockaddr_storage *list, int n,
+	conn_race_addr_t *addrs, int max)
+{
+	conn_race_addr_t all[DNS_CACHE_MAX_ADDRS];
+	int total = 0, count = 0, i;
+	int taken[DNS_CACHE_MAX_ADDRS];
+	int want_ipv6;
+
+	for(i = 0; i < n; i++)
+	{
+		total = add_addr(all, total, DNS_CACHE_MAX_ADDRS,
+			(const struct sockaddr *) &list[i]);
+	}
+	if(0 == total)
+	{
+		return 0;
+	}
+
+	// Alternate families, starting with the resolver's first choice
+	memset(taken, 0, sizeof(taken));
+	want_ipv6 = all[0].is_ipv6;
+	while(count < max)
+	{
+		for(i = 0; i < total; i++)
+		{
+			if(!taken[i] && (all[i].is_ipv6 == want_ipv6))
+			{
+				break;
+			}
+		}
+		if(i == total)
+		{
+			// this family is used up, take the next of any family
+			for(i = 0; (i < total) && taken[i]; i++)
+				;
+			if(i == total)
+			{
+				break;
+			}
+		}
+		taken[i] = 1;
+		addrs[count++] = all[i];
+		want_ipv6 = !all[i].is_ipv6;
+	}
+	return count;
+}
+
+int conn_race_resolve(const char *host, conn_race_addr_t *addrs, int max)
+{
+	struct sockaddr_storage list[DNS_CACHE_MAX_ADDRS];
+	int count, i;
+
+	count = dns_cache_lookup(host, AF_UNSPEC, list, DNS_CACHE_MAX_ADDRS);
+	count = conn_race_sort_addrs(list, count, addrs, max);
+	for(i = 0; i < count; i++)
+	{
+		ParodusPrint("%s address %d: %s\n", host, i, addrs[i].ip);
+	}
+	return count;
+}
@@ -0,0 +1,121 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/**
+ * @file conn_race.h
+ *
+ * @description Staggered, parallel connection attempts (Happy Eyeballs,
+ *              RFC 8305).
+ *
+ *              Attempt i is started when attempt i-1 fails, or delay_ms after
+ *              it was started, whichever comes first. The first attempt to
+ *              succeed wins and the others are cancelled. Attempts run on
+ *              detached threads, so one stuck in a blocking connect does not
+ *              hold up the caller; it cleans up after itself when it returns.
+ *
+ */
+
+#ifndef _CONN_RACE_H_
+#define _CONN_RACE_H_
+
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*----------------------------------------------------------------------------*/
+/*                                   Macros                                   */
+/*----------------------------------------------------------------------------*/
+
+#define CONN_RACE_MAX_ATTEMPTS	4
+
+/* Return codes for an attempt and for conn_race_run */
+#define CONN_RACE_SUCCESS	0
+#define CONN_RACE_FINAL		1	// not connected, but stop the race (e.g. redirect)
+#define CONN_RACE_FAIL		2
+
+/*----------------------------------------------------------------------------*/
+/*                               Data Structures                              */
+/*----------------------------------------------------------------------------*/
+
+typedef struct {
+	void *handle;	// the connection, set by a successful attempt
+	int status;	// attempt specific status when not successful
+	char *message;	// optional, released with free()
+} conn_race_result_t;
+
+typedef struct {
+	char ip[INET6_ADDRSTRLEN];
+	int is_ipv6;
+} conn_race_addr_t;
+
+/**
+ * Make one connection attempt. Runs on its own thread and may block; should
+ * give up early when *cancelled becomes non zero.
+ *
+ * @return CONN_RACE_SUCCESS, CONN_RACE_FINAL or CONN_RACE_FAIL
+ */
+typedef int (*conn_race_attempt_fn)(void *arg, int index,
+	conn_race_result_t *result, const volatile int *cancelled);
+
+/**
+ * Release the handle of a successful attempt that finished after the race
+ * was decided.
+ */
+typedef void (*conn_race_release_fn)(void *arg, void *handle);
+
+/*----------------------------------------------------------------------------*/
+/*                             Function Prototypes                            */
+/*----------------------------------------------------------------------------*/
+
+/**
+ * Run up to count attempts, staggered by delay_ms.
+ *
+ * @param arg passed to every attempt, released with free_arg once the last
+ *            attempt has returned (which may be after conn_race_run returns)
+ * @param result on CONN_RACE_SUCCESS or CONN_RACE_FINAL the result of the
+ *               deciding attempt, on CONN_RACE_FAIL the status of the last
+ *               attempt to fail
+ * @return CONN_RACE_SUCCESS, CONN_RACE_FINAL or CONN_RACE_FAIL
+ */
+int conn_race_run(int count, unsigned int delay_ms,
+	conn_race_attempt_fn attempt, conn_race_release_fn release,
+	void *arg, void (*free_arg)(void *), conn_race_result_t *result);
+
+/**
+ * Order resolved addresses for racing: duplicates dropped, families
+ * interleaved starting with the first one listed.
+ *
+ * @return number of addresses copied to addrs
+ */
+int conn_race_sort_addrs(const struct sockaddr_storage *list, int n,
+	conn_race_addr_t *addrs, int max);
+
+/**
+ * Resolve host through the dns cache and order the addresses with
+ * conn_race_sort_addrs().
+ *
+ * @return number of addresses, 0 if the host did not resolve
+ */
+int conn_race_resolve(const char *host, conn_race_addr_t *addrs, int max);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _CONN_RACE_H_ */
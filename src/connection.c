@@ -21,6 +21,7 @@
  *
  */
  
+#include <errno.h>
 #include "connection.h"
 #include "time.h"
 #include "token.h"
@@ -31,12 +32,30 @@
 #include "ParodusInternal.h"
 #include "heartBeat.h"
 #include "close_retry.h"
+#include "conn_race.h"
+#include "dns_cache.h"
+#include "tls_session.h"
+#include "backoff.h"
+#include "server_pool.h"
+#include "upstream.h"
+#include "thread_tasks.h"
+#include "standby.h"
+#include "uplink_shards.h"
+#include "ping_monitor.h"
+#include "socket_tuning.h"
+#include "link_monitor.h"
+#include "iface_pool.h"
+#include "conn_hints.h"
+#include "crud_subscribe.h"
 /*----------------------------------------------------------------------------*/
 /*                                   Macros                                   */
 /*----------------------------------------------------------------------------*/
 
 #define HTTP_CUSTOM_HEADER_COUNT                    	5
 #define INITIAL_CJWT_RETRY                    	-2
+#define CLOUD_RECONNECT_TIME                       	5	/* Cloud disconnect max time in minutes */
+#define DRAIN_WRITE_POLL_MS				10
+#define CONNECT_POLL_MS					100
 
 /*----------------------------------------------------------------------------*/
 /*                            File Scoped Variables                           */
@@ -46,9 +65,57 @@ static char *reconnect_reason = "webpa_process_starts";
 static int cloud_disconnect_max_time = 5;
 static noPollConn *g_conn = NULL;
 static bool LastReasonStatus = false;
-static noPollConnOpts * createConnOpts (char * extra_headers, bool secure);
+static noPollConnOpts * createConnOpts (char * extra_headers, bool secure,
+                                       const char *iface);
 static char* build_extra_headers( const char *auth, const char *device_id,
                                   const char *user_agent, const char *convey );
+static void conn_machine_restart (bool spread);
+
+// connection state machine, stepped from the main thread only
+typedef struct {
+  int max_retry_sleep;
+  create_connection_ctx_t conn_ctx;
+  backoff_timer_t backoff_timer;
+  struct timespec wake_time;	// end of the backoff wait, monotonic
+  int next_state;		// state after the backoff wait
+  bool cloud_disconnect_hold;	// backoff wait is the cloud-disconnect hold
+  int pool_index;		// server pool endpoint used as the default server
+  unsigned int pool_tried;	// endpoints failed since the last backoff
+  server_t online_server;	// where the primary connected, for the shards
+  int iface_index;		// interface list entry connected over
+  int standby_iface;		// interface the warm standby was built over
+  unsigned int iface_tried;	// interfaces failed since the last backoff
+  struct timespec probe_time;	// last probe of a preferred interface
+  int probe_next;		// preferred interface to probe next
+  bool failing_back;		// reconnecting to move to a preferred interface
+  bool hint_pending;		// the saved connection hint is yet to be tried
+  bool on_hint;			// this attempt goes where the hint says
+  char hint_addr[INET6_ADDRSTRLEN];	// from the hint, empty to resolve
+  bool connecting;		// connect_thread owns conn_ctx until joined
+  pthread_t connect_thread;
+  struct timespec connect_start;
+} conn_machine_t;
+
+static conn_machine_t machine;
+
+// result of the connect attempt, handed from connect_thread to the machine
+static struct {
+  pthread_mutex_t mut;
+  bool done;
+  int rtn;
+} connect_result = { PTHREAD_MUTEX_INITIALIZER, false, 0 };
+
+// connection headers, kept across connects; connection thread only
+static struct {
+  header_info_t info;
+  char *block;			// extra headers handed to nopoll
+  uint64_t key;			// hash of the inputs block was built from
+} header_cache;
+static int conn_state = CONN_STATE_IDLE;
+static pthread_mutex_t conn_state_mut = PTHREAD_MUTEX_INITIALIZER;
+static const char *conn_state_names[] = {
+  "idle", "resolve", "connect", "upgrade", "online", "draining", "backoff", "failed"
+};
 
 /*----------------------------------------------------------------------------*/
 /*                             External Functions                             */
@@ -93,18 +160,53 @@ void set_cloud_disconnect_time(int disconnTime)
     cloud_disconnect_max_time = disconnTime;
 }
 
+int get_conn_state (void)
+{
+  int state;
+
+  pthread_mutex_lock (&conn_state_mut);
+  state = conn_state;
+  pthread_mutex_unlock (&conn_state_mut);
+  return state;
+}
+
+const char *get_conn_state_name (int state)
+{
+  if ((state < CONN_STATE_IDLE) || (state > CONN_STATE_FAILED))
+    return "unknown";
+  return conn_state_names[state];
+}
+
+static void set_conn_state (int state)
+{
+  int old_state;
+
+  pthread_mutex_lock (&conn_state_mut);
+  old_state = conn_state;
+  conn_state = state;
+  pthread_mutex_unlock (&conn_state_mut);
+  if (old_state != state)
+    ParodusPrint("Connection state %s -> %s\n", get_conn_state_name (old_state),
+      get_conn_state_name (state));
+}
+
 
 //--------------------------------------------------------------------
 // createNopollConnection_logic:
 
 // call stack:
 
-//  createNopollConnection
-//    find_servers
-//    keep_trying_connect     // keep trying till success or need to requery dns
+//  createNopollConnection   // steps the machine, sleeping through waits
+//  conn_machine_step        // main loop steps it, so waits do not block
+//    step_resolve
+//      find_servers
+//    step_connect            // polls connect_thread; on failure, backoff then connect or resolve
 //      connect_and_wait      // tries both ipv6 and ipv4, if necessary
 //        nopoll_connect
 //        wait_connection_ready
+//        race_connect_and_wait // with --connection-attempt-delay
+//    step_backoff
+//    step_drain              // flush queues, close, then the warm standby or the cloud-disconnect hold
 
 
 //--------------------------------------------------------------------
@@ -194,34 +296,48 @@ int check_timer_expired (expire_timer_t *timer, long timeout_ms)
 //--------------------------------------------------------------------
 void init_backoff_timer (backoff_timer_t *timer, int max_delay)
 {
+  unsigned int seed;
+
   timer->max_delay = max_delay;
   timer->delay = 1;
+  timer->retry_after = 0;
+  // devices must not share a jitter sequence
+  seed = backoff_device_hash (get_parodus_cfg()->hw_mac) ^
+    (unsigned int) time(NULL) ^ (unsigned int) getpid();
+  backoff_init (&timer->state, (int) get_parodus_cfg()->backoff_policy,
+    (max_delay > 0) ? (unsigned int) max_delay * 1000 : 0, seed);
 }
 
 int update_backoff_delay (backoff_timer_t *timer)
 {
-  if (timer->delay < timer->max_delay)
-    timer->delay = timer->delay + timer->delay + 1;
-    // 3,7,15,31 ..
-  if (timer->delay > timer->max_delay)
-    timer->delay = timer->max_delay;
+  unsigned int delay_ms;
+
+  if (0 < timer->retry_after) {
+    delay_ms = backoff_after_hint (&timer->state, timer->retry_after);
+    timer->retry_after = 0;
+  } else {
+    delay_ms = backoff_next (&timer->state);  // 3,7,15,31 .. or jittered
+  }
+  timer->delay = (int) ((delay_ms + 999) / 1000);
   return timer->delay;
 }  
 
-static void backoff_delay (backoff_timer_t *timer)
+static void sleep_ms (unsigned int ms)
 {
-  update_backoff_delay (timer);
-  ParodusInfo("Waiting with backoffRetryTime %d seconds\n", timer->delay);
-  sleep (timer->delay);
-}  
+  struct timespec ts;
+
+  ts.tv_sec = ms / 1000;
+  ts.tv_nsec = (long) (ms % 1000) * 1000000;
+  while ((nanosleep (&ts, &ts) != 0) && (EINTR == errno))
+    ;
+}
 
 //--------------------------------------------------------------------
 void free_header_info (header_info_t *header_info)
 {
   FREE_PTR_VAR (header_info->user_agent)
   FREE_PTR_VAR (header_info->device_id)
-  // Don't free header_info->conveyHeader, because it's static
-  header_info->conveyHeader = NULL;
+  FREE_PTR_VAR (header_info->conveyHeader)
 }
 
 void set_header_info_null (header_info_t *header_info)
@@ -267,7 +383,7 @@ int init_header_info (header_info_t *header_info)
   snprintf(header_info->device_id, device_id_len, "mac:%s", cfg->hw_mac);
   
   ParodusInfo("User-Agent: %s\n",header_info->user_agent);
-  header_info->conveyHeader = getWebpaConveyHeader();  // ptr to static variable returned
+  header_info->conveyHeader = getWebpaConveyHeader();
   if (NULL == header_info->conveyHeader) {
     ParodusError ("getWebpaConveyHeader error\n");
     free_header_info (header_info);
@@ -287,6 +403,39 @@ char *build_extra_hdrs (header_info_t *header_info)
 }
 
 
+// FNV-1a, over everything that goes into the header block
+static uint64_t hash_bytes (uint64_t hash, const void *data, size_t len)
+{
+  const unsigned char *p = (const unsigned char *) data;
+
+  while (len-- > 0) {
+    hash ^= *p++;
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+static uint64_t header_inputs_key (void)
+{
+  ParodusCfg *cfg = get_parodus_cfg();
+  const char *reason = get_global_reconnect_reason ();
+  const char *inputs[] = {
+    cfg->hw_model, cfg->hw_serial_number, cfg->hw_manufacturer, cfg->fw_name,
+    cfg->webpa_protocol, cfg->webpa_interface_used, cfg->hw_last_reboot_reason,
+    cfg->hw_mac, cfg->webpa_auth_token, (NULL != reason) ? reason : ""
+  };
+  char has_reason = (NULL != reason);
+  uint64_t hash = 14695981039346656037ULL;
+  size_t i;
+
+  for (i = 0; i < sizeof(inputs) / sizeof(inputs[0]); i++)
+    hash = hash_bytes (hash, inputs[i], strlen (inputs[i]) + 1);
+  hash = hash_bytes (hash, &cfg->boot_time, sizeof(cfg->boot_time));
+  hash = hash_bytes (hash, &cfg->boot_retry_wait, sizeof(cfg->boot_retry_wait));
+  hash = hash_bytes (hash, &has_reason, sizeof(has_reason));
+  return hash;
+}
+
 //--------------------------------------------------------------------
 void set_current_server (create_connection_ctx_t *ctx)
 {
@@ -295,24 +444,41 @@ void set_current_server (create_connection_ctx_t *ctx)
 
 void set_extra_headers (create_connection_ctx_t *ctx, int reauthorize)
 {
+  uint64_t key;
+
   if (reauthorize && (strlen(get_parodus_cfg()->token_acquisition_script) >0))
   {
     createNewAuthToken(get_parodus_cfg()->webpa_auth_token,
       sizeof(get_parodus_cfg()->webpa_auth_token));
   }
   
-  ctx->extra_headers = build_extra_hdrs (&ctx->header_info);
+  // rebuilt only when an input changed since the last connect
+  key = header_inputs_key ();
+  if ((NULL == header_cache.block) || (key != header_cache.key)) {
+    FREE_PTR_VAR (header_cache.block)
+    free_header_info (&header_cache.info);
+    if (init_header_info (&header_cache.info) == 0) {
+      header_cache.block = build_extra_hdrs (&header_cache.info);
+      header_cache.key = key;
+    }
+  }
+  ctx->extra_headers = header_cache.block;
 }
 
 void free_extra_headers (create_connection_ctx_t *ctx)
 {
-  FREE_PTR_VAR (ctx->extra_headers)
+  ctx->extra_headers = NULL;	// owned by the header cache
+}
+
+void free_header_cache (void)
+{
+  FREE_PTR_VAR (header_cache.block)
+  free_header_info (&header_cache.info);
 }
 
 void free_connection_ctx (create_connection_ctx_t *ctx)
 {
   free_extra_headers (ctx);
-  free_header_info (&ctx->header_info);
   free_server_list (&ctx->server_list);
 }
 
@@ -324,13 +490,23 @@ void free_connection_ctx (create_connection_ctx_t *ctx)
 // populate server_list
 // return values defined in ParodusInternal.h
 
+// the ranked pool endpoint chosen by the connection machine, if there is a pool
+static const char *default_server_url (void)
+{
+  const char *url = NULL;
+
+  if (0 < server_pool_count ())
+    url = server_pool_url (machine.pool_index);
+  return (NULL != url) ? url : get_parodus_cfg()->webpa_url;
+}
+
 int find_servers (server_list_t *server_list)
 {
   server_t *default_server = &server_list->defaults;
 
   free_server_list (server_list);
   // parse default server URL
-  if (parse_server_url (get_parodus_cfg()->webpa_url, default_server) < 0)
+  if (parse_server_url (default_server_url (), default_server) < 0)
      return FIND_INVALID_DEFAULT;	// must have valid default url
   ParodusInfo("default server_Address %s\n", default_server->server_addr);
   ParodusInfo("default port %u\n", default_server->port);
@@ -350,6 +526,66 @@ int find_servers (server_list_t *server_list)
 }
 
 
+// Goes where the saved hint says, skipping the jwt lookup and the redirect.
+// The hint server takes the redirect slot, so a real redirect replaces it.
+static bool use_hint (server_list_t *server_list)
+{
+  const char *file = get_parodus_cfg()->conn_hints_file;
+  conn_hint_t hint;
+
+  if ((NULL == file) || (conn_hints_load (file, default_server_url (), &hint) != 0))
+    return false;
+  free_server_list (server_list);
+  if (parse_server_url (default_server_url (), &server_list->defaults) < 0)
+    return false;
+  server_list->redirect.server_addr = strdup (hint.host);
+  if (NULL == server_list->redirect.server_addr)
+    return false;
+  server_list->redirect.port = hint.port;
+  server_list->redirect.allow_insecure = hint.allow_insecure;
+  strcpy (machine.hint_addr, hint.addr);
+  ParodusInfo("Connecting to %s:%u at %s from the saved connection hint\n",
+    hint.host, hint.port, ('\0' != hint.addr[0]) ? hint.addr : "its resolved address");
+  return true;
+}
+
+// the address from the hint, if this attempt goes where it says and the
+// family fits (AF_UNSPEC for any)
+static const char *hint_addr (create_connection_ctx_t *ctx, int family)
+{
+  const char *addr = machine.hint_addr;
+  bool is_ipv6 = (NULL != strchr (addr, ':'));
+
+  if (!machine.on_hint || (ctx != &machine.conn_ctx) || ('\0' == addr[0]) ||
+      (ctx->current_server != &ctx->server_list.redirect))
+    return NULL;
+  if ((AF_UNSPEC != family) && (is_ipv6 != (AF_INET6 == family)))
+    return NULL;
+  return addr;
+}
+
+//--------------------------------------------------------------------
+// called when a connection could not be made
+static void check_host_ip (create_connection_ctx_t *ctx)
+{
+  if((checkHostIp(ctx->current_server->server_addr) == -2)) {
+    if (check_timer_expired (&ctx->connect_timer, 15*60*1000)) {
+      ParodusError("WebPA unable to connect due to DNS resolving to 10.0.0.1 for over 15 minutes; crashing service.\n");
+      set_global_reconnect_reason("Dns_Res_webpa_reconnect");
+      set_global_reconnect_status(true);
+
+      kill(getpid(),SIGTERM);
+    }
+  }
+}
+
+// applies the socket-tuning profile, once the tcp connect is done
+static void tune_socket (noPollConn *connection)
+{
+  if (NULL != get_parodus_cfg()->socket_tuning)
+    socket_tuning_apply (nopoll_conn_socket (connection));
+}
+
 //--------------------------------------------------------------------
 // connect to current server
 int nopoll_connect (create_connection_ctx_t *ctx, int is_ipv6)
@@ -360,39 +596,50 @@ int nopoll_connect (create_connection_ctx_t *ctx, int is_ipv6)
    noPollConnOpts * opts;
    char *default_url = get_parodus_cfg()->webpa_path_url; 
    char port_buf[8];
+   char addr_buf[INET6_ADDRSTRLEN];
+   const char *host_ip = server->server_addr;
+   const char *host_name = NULL;
+   int family = ((server->allow_insecure <= 0) && is_ipv6) ? AF_INET6 : AF_INET;
+
+   // with a hint or the dns cache, connect to the known address; host_name
+   // keeps the Host header on the server name
+   if (NULL != hint_addr (ctx, family)) {
+      host_ip = hint_addr (ctx, family);
+      host_name = server->server_addr;
+   } else if ((0 < dns_cache_get_ttl()) &&
+       dns_cache_lookup_ip (server->server_addr, family, addr_buf, sizeof(addr_buf))) {
+      host_ip = addr_buf;
+      host_name = server->server_addr;
+   }
 
    sprintf (port_buf, "%u", server->port);
    if (server->allow_insecure > 0) {
       ParodusPrint("secure false\n");
-      opts = createConnOpts(ctx->extra_headers, false); 
+      opts = createConnOpts(ctx->extra_headers, false,
+        get_parodus_cfg()->webpa_interface_used);
       connection = nopoll_conn_new_opts (nopoll_ctx, opts, 
-        server->server_addr, port_buf,
-        NULL, default_url,NULL,NULL);// WEBPA-787
+        host_ip, port_buf,
+        host_name, default_url,NULL,NULL);// WEBPA-787
    } else {
       ParodusPrint("secure true\n");
-      opts = createConnOpts(ctx->extra_headers, true);
+      opts = createConnOpts(ctx->extra_headers, true,
+        get_parodus_cfg()->webpa_interface_used);
       if (is_ipv6) {
          ParodusInfo("Connecting in Ipv6 mode\n");
          connection = nopoll_conn_tls_new6 (nopoll_ctx, opts, 
-           server->server_addr, port_buf,
-           NULL, default_url,NULL,NULL);
+           host_ip, port_buf,
+           host_name, default_url,NULL,NULL);
       } else {      
          ParodusInfo("Connecting in Ipv4 mode\n");
          connection = nopoll_conn_tls_new (nopoll_ctx, opts, 
-           server->server_addr, port_buf,
-           NULL, default_url,NULL,NULL);
+           host_ip, port_buf,
+           host_name, default_url,NULL,NULL);
       }      
    }
    if (NULL == connection) {
-     if((checkHostIp(server->server_addr) == -2)) {
-       if (check_timer_expired (&ctx->connect_timer, 15*60*1000)) {
-  	 ParodusError("WebPA unable to connect due to DNS resolving to 10.0.0.1 for over 15 minutes; crashing service.\n");
-	 set_global_reconnect_reason("Dns_Res_webpa_reconnect");
-	 set_global_reconnect_status(true);
-						
-	 kill(getpid(),SIGTERM);						
-       }
-     }
+     check_host_ip (ctx);
+   } else {
+     tune_socket (connection);
    }
            
    set_global_conn(connection);
@@ -404,15 +651,13 @@ int nopoll_connect (create_connection_ctx_t *ctx, int is_ipv6)
 #define WAIT_SUCCESS	0
 #define WAIT_ACTION_RETRY	1	// if wait_status is 307, 302, 303 or 403
 #define WAIT_FAIL 	2
+#define WAIT_RETRY_LATER	3	// if wait_status is 429 or 503
 
-int wait_connection_ready (create_connection_ctx_t *ctx)
+// act on the status of a connection that did not become ready
+// redirectURL is freed
+static int handle_wait_status (create_connection_ctx_t *ctx,
+	int wait_status, char *redirectURL)
 {
-  int wait_status;
-  char *redirectURL = NULL;
-
-  if(nopoll_conn_wait_for_status_until_connection_ready(get_global_conn(), 10, 
-	&wait_status, &redirectURL)) 
-     return WAIT_SUCCESS;
   if(wait_status == 307 || wait_status == 302 || wait_status == 303)    // only when there is a http redirect
   {
 	char *redirect_ptr = redirectURL;
@@ -430,6 +675,16 @@ int wait_connection_ready (create_connection_ctx_t *ctx)
 	set_current_server (ctx); // set current server to redirect server
 	return WAIT_ACTION_RETRY;
   }
+  if(wait_status == 429 || wait_status == 503)
+  {
+	// the nopoll status message may carry a Retry-After header
+	ctx->retry_after = backoff_parse_retry_after (redirectURL);
+	ParodusError("Server busy with status %d, retry after %u seconds\n",
+	  wait_status, ctx->retry_after);
+	if (NULL != redirectURL)
+	  free (redirectURL);
+	return WAIT_RETRY_LATER;
+  }
   if (NULL != redirectURL) {
     free (redirectURL);
   }
@@ -445,6 +700,18 @@ int wait_connection_ready (create_connection_ctx_t *ctx)
   return WAIT_FAIL;
 }
 
+int wait_connection_ready (create_connection_ctx_t *ctx)
+{
+  int wait_status = 0;
+  char *redirectURL = NULL;
+
+  set_conn_state (CONN_STATE_UPGRADE);
+  if(nopoll_conn_wait_for_status_until_connection_ready(get_global_conn(), 10, 
+	&wait_status, &redirectURL)) 
+     return WAIT_SUCCESS;
+  return handle_wait_status (ctx, wait_status, redirectURL);
+}
+
  
 //--------------------------------------------------------------------
 // Return codes for connect_and_wait
@@ -452,6 +719,314 @@ int wait_connection_ready (create_connection_ctx_t *ctx)
 #define CONN_WAIT_ACTION_RETRY	1	// if wait_status is 307, 302, 303 or 403
 #define CONN_WAIT_RETRY_DNS 	2
 
+//--------------------------------------------------------------------
+// Happy Eyeballs: race the resolved addresses of the current server,
+// staggered by connection_attempt_delay. Everything an attempt needs is
+// copied, since a losing attempt can outlive the connection context.
+
+#define RACE_WAIT_SLICES	10	// one second each, same total as wait_connection_ready
+
+typedef struct {
+  noPollCtx *nopoll_ctx;
+  char *server_name;
+  char port_buf[8];
+  char *extra_headers;
+  char iface[sizeof(((ParodusCfg *) 0)->webpa_interface_used)];	// at build time
+  int shard;			// uplink shard, 0 for the primary and the standby
+  conn_race_addr_t addrs[CONN_RACE_MAX_ATTEMPTS];
+} race_arg_t;
+
+static void race_free (void *arg)
+{
+  race_arg_t *race = (race_arg_t *) arg;
+
+  free (race->server_name);
+  free (race->extra_headers);
+  free (race);
+}
+
+static void race_release (void *arg, void *handle)
+{
+  (void) arg;
+  close_and_unref_connection ((noPollConn *) handle);
+}
+
+static int race_attempt (void *arg, int index, conn_race_result_t *result,
+	const volatile int *cancelled)
+{
+  race_arg_t *race = (race_arg_t *) arg;
+  conn_race_addr_t *addr = &race->addrs[index];
+  noPollConnOpts *opts;
+  noPollConn *connection;
+  int i;
+
+  if (*cancelled)
+    return CONN_RACE_FAIL;
+  ParodusInfo("Connecting to %s in %s mode\n", addr->ip,
+    addr->is_ipv6 ? "Ipv6" : "Ipv4");
+  opts = createConnOpts (race->extra_headers, true, race->iface);
+  // host_name keeps the Host header on the server name
+  if (addr->is_ipv6) {
+    connection = nopoll_conn_tls_new6 (race->nopoll_ctx, opts,
+      addr->ip, race->port_buf, race->server_name,
+      get_parodus_cfg()->webpa_path_url, NULL, NULL);
+  } else {
+    connection = nopoll_conn_tls_new (race->nopoll_ctx, opts,
+      addr->ip, race->port_buf, race->server_name,
+      get_parodus_cfg()->webpa_path_url, NULL, NULL);
+  }
+  if (NULL == connection)
+    return CONN_RACE_FAIL;
+  tune_socket (connection);
+
+  for (i = 0; (i < RACE_WAIT_SLICES) && !*cancelled && nopoll_conn_is_ok (connection); i++)
+  {
+    result->status = 0;
+    if (nopoll_conn_wait_for_status_until_connection_ready (connection, 1,
+          &result->status, &result->message)) {
+      result->handle = connection;
+      return CONN_RACE_SUCCESS;
+    }
+    if (0 != result->status)
+      break;
+  }
+  close_and_unref_connection (connection);
+  if (result->status == 307 || result->status == 302 ||
+      result->status == 303 || result->status == 403 ||
+      result->status == 429 || result->status == 503)
+    return CONN_RACE_FINAL;
+  ParodusError("Connection to %s failed, status %d\n", addr->ip, result->status);
+  return CONN_RACE_FAIL;
+}
+
+static int race_connect_and_wait (create_connection_ctx_t *ctx)
+{
+  server_t *server = ctx->current_server;
+  conn_race_result_t result;
+  race_arg_t *race;
+  const char *hinted = hint_addr (ctx, AF_UNSPEC);
+  int count, rtn;
+
+  race = (race_arg_t *) calloc (1, sizeof(race_arg_t));
+  if (NULL == race) {
+    ParodusError ("connection race allocation failed.\n");
+    return CONN_WAIT_RETRY_DNS;
+  }
+  if (NULL != hinted) {
+    parStrncpy (race->addrs[0].ip, hinted, sizeof(race->addrs[0].ip));
+    race->addrs[0].is_ipv6 = (NULL != strchr (hinted, ':'));
+    count = 1;
+  } else {
+    count = conn_race_resolve (server->server_addr, race->addrs, CONN_RACE_MAX_ATTEMPTS);
+  }
+  race->nopoll_ctx = ctx->nopoll_ctx;
+  race->server_name = strdup (server->server_addr);
+  race->extra_headers = (NULL != ctx->extra_headers) ? strdup (ctx->extra_headers) : NULL;
+  parStrncpy (race->iface, get_parodus_cfg()->webpa_interface_used, sizeof(race->iface));
+  snprintf (race->port_buf, sizeof(race->port_buf), "%u", server->port);
+  if ((0 == count) || (NULL == race->server_name)) {
+    race_free (race);
+    check_host_ip (ctx);
+    return CONN_WAIT_RETRY_DNS;
+  }
+
+  rtn = conn_race_run (count, get_parodus_cfg()->connection_attempt_delay,
+    race_attempt, race_release, race, race_free, &result);
+  if (CONN_RACE_SUCCESS == rtn) {
+    set_global_conn ((noPollConn *) result.handle);
+    free (result.message);
+    return CONN_WAIT_SUCCESS;
+  }
+  if (CONN_RACE_FINAL == rtn) {
+    if (handle_wait_status (ctx, result.status, result.message) == WAIT_ACTION_RETRY)
+      return CONN_WAIT_ACTION_RETRY;
+    return CONN_WAIT_RETRY_DNS;	// with ctx->retry_after if the server was busy
+  }
+  ParodusError("RDK-10037 - WebPA Connection Lost\n");
+  check_host_ip (ctx);
+  return CONN_WAIT_RETRY_DNS;
+}
+
+// Side connections are made next to the primary, on their own threads,
+// with the same race: the warm standby and the uplink shards. Pings on
+// them are answered by nopoll in the main loop.
+
+#define SIDE_ATTEMPT_DELAY_MS	250
+
+static void *side_connect (void *arg)
+{
+  race_arg_t *race = (race_arg_t *) arg;
+  unsigned int flags = get_parodus_cfg()->flags & FLAGS_IPV6_IPV4;
+  unsigned int delay_ms = get_parodus_cfg()->connection_attempt_delay;
+  conn_race_result_t result;
+  int count, i, n, rtn;
+
+  count = conn_race_resolve (race->server_name, race->addrs, CONN_RACE_MAX_ATTEMPTS);
+  for (i = 0, n = 0; i < count; i++) {
+    if ((0 == flags) ||
+        (flags & (race->addrs[i].is_ipv6 ? FLAGS_IPV6_ONLY : FLAGS_IPV4_ONLY)))
+      race->addrs[n++] = race->addrs[i];
+  }
+  if (0 == n) {
+    race_free (race);
+    return NULL;
+  }
+  rtn = conn_race_run (n, (0 < delay_ms) ? delay_ms : SIDE_ATTEMPT_DELAY_MS,
+    race_attempt, race_release, race, race_free, &result);
+  if (CONN_RACE_FAIL == rtn)
+    return NULL;
+  free (result.message);
+  // redirects and busy servers are left for the primary to follow
+  return (CONN_RACE_SUCCESS == rtn) ? result.handle : NULL;
+}
+
+static void side_release (void *handle)
+{
+  close_and_unref_connection ((noPollConn *) handle);
+}
+
+// the session key is global, so a side connection built while another is
+// may offer the wrong session; that only costs a full handshake
+static race_arg_t *side_race_arg (const char *server_addr, unsigned int port)
+{
+  race_arg_t *race;
+
+  if ((NULL == machine.conn_ctx.nopoll_ctx) || (NULL == header_cache.block))
+    return NULL;
+  race = (race_arg_t *) calloc (1, sizeof(race_arg_t));
+  if (NULL == race) {
+    ParodusError ("side connection allocation failed.\n");
+    return NULL;
+  }
+  race->nopoll_ctx = machine.conn_ctx.nopoll_ctx;
+  race->server_name = strdup (server_addr);
+  race->extra_headers = strdup (header_cache.block);
+  parStrncpy (race->iface, get_parodus_cfg()->webpa_interface_used, sizeof(race->iface));
+  snprintf (race->port_buf, sizeof(race->port_buf), "%u", port);
+  if ((NULL == race->server_name) || (NULL == race->extra_headers)) {
+    ParodusError ("side connection allocation failed.\n");
+    race_free (race);
+    return NULL;
+  }
+  // online, so no primary connect needs the session key until it drops
+  if (get_parodus_cfg()->tls_session_cache)
+    tls_session_set_server (server_addr, port);
+  return race;
+}
+
+// Warm standby: kept open and idle, to another pool endpoint when there is
+// one, so a dropped primary is replaced without a connect.
+static void start_standby (void)
+{
+  ParodusCfg *cfg = get_parodus_cfg();
+  const char *url = cfg->webpa_url;
+  int index = SERVER_POOL_NONE;
+  server_t server;
+  race_arg_t *race;
+
+  if (!cfg->warm_standby || (STANDBY_EMPTY != standby_state ()))
+    return;
+  if (1 < server_pool_count ()) {
+    index = server_pool_select ((SERVER_POOL_NONE != machine.pool_index) ?
+      1U << machine.pool_index : 0, true);
+    if (SERVER_POOL_NONE == index)
+      return;	// no other endpoint is up
+    url = server_pool_url (index);
+  }
+  set_server_null (&server);
+  if (parse_server_url (url, &server) != 0) {
+    ParodusPrint("No warm standby for %s, it needs https\n", url);
+    free_server (&server);
+    return;
+  }
+  race = side_race_arg (server.server_addr, server.port);
+  free_server (&server);
+  if (NULL == race)
+    return;
+  if (standby_build (side_connect, side_release, race, index) != 0) {
+    race_free (race);
+    return;
+  }
+  machine.standby_iface = machine.iface_index;
+  ParodusInfo("Building warm standby connection to %s\n", url);
+}
+
+// Uplink shards: more connections to the server the primary is on, that
+// upstream messages are spread over by source service.
+#ifdef FEATURE_UPLINK_SHARDS
+static noPollMsg *shard_fragments[UPLINK_SHARDS_MAX];
+
+static void *shard_connect (void *arg)
+{
+  int shard = ((race_arg_t *) arg)->shard;
+  noPollConn *conn = (noPollConn *) side_connect (arg);
+
+  if (NULL != conn)
+    setShardMessageHandlers (conn, &shard_fragments[shard]);
+  return conn;
+}
+
+static int shard_send (void *handle, void *msg, size_t len)
+{
+  return (sendResponse ((noPollConn *) handle, msg, len) == (int) len) ? 0 : -1;
+}
+
+// on a writer thread; sendMessage keeps its frames apart from upstream's
+static void shard_fallback (void *msg, size_t len)
+{
+  sendUpstreamMsgOnPrimary (msg, len);
+}
+#endif
+
+// every connection carries the same device name; this header tells the
+// server a shard from the primary and from the other shards
+static int shard_headers (race_arg_t *race, unsigned int shard, unsigned int count)
+{
+  char *headers = nopoll_strdup_printf ("%s\r\n" UPLINK_SHARD_HEADER ": %u/%u",
+    race->extra_headers, shard, count);
+
+  if (NULL == headers)
+    return -1;
+  free (race->extra_headers);
+  race->extra_headers = headers;
+  return 0;
+}
+
+static void start_shards (void)
+{
+  unsigned int count = uplink_shards_count ();
+  unsigned int i;
+  race_arg_t *race;
+
+  if (server_is_null (&machine.online_server) ||
+      (0 < machine.online_server.allow_insecure))
+    return;
+  for (i = 1; i < count; i++) {
+    if (NULL != uplink_shard_handle (i))
+      continue;
+    race = side_race_arg (machine.online_server.server_addr,
+      machine.online_server.port);
+    if (NULL == race)
+      return;
+    if (shard_headers (race, i, count) != 0) {
+      race_free (race);
+      return;
+    }
+    race->shard = (int) i;
+    if (uplink_shard_connect (i, race) != 0)
+      race_free (race);	// being built, or waiting to retry
+  }
+}
+
+static void stop_shards (void)
+{
+  unsigned int count = uplink_shards_count ();
+  unsigned int i;
+
+  for (i = 1; i < count; i++)
+    uplink_shard_down (i, true);
+}
+
 int connect_and_wait (create_connection_ctx_t *ctx)
 {
   unsigned int force_flags = get_parodus_cfg()->flags;
@@ -462,6 +1037,14 @@ int connect_and_wait (create_connection_ctx_t *ctx)
   if( FLAGS_IPV4_ONLY == (FLAGS_IPV4_ONLY & force_flags) ) {
     is_ipv6 = false;
   }
+
+  if (get_parodus_cfg()->tls_session_cache)
+    tls_session_set_server (ctx->current_server->server_addr,
+      ctx->current_server->port);
+
+  if ((0 < get_parodus_cfg()->connection_attempt_delay) && (0==force_flags)
+      && (0==ctx->current_server->allow_insecure))
+    return race_connect_and_wait (ctx);
   
   // This loop will be executed at most twice:
   // Once for ipv6 and once for ipv4
@@ -488,6 +1071,10 @@ int connect_and_wait (create_connection_ctx_t *ctx)
     if (wait_rtn == WAIT_ACTION_RETRY)
       return CONN_WAIT_ACTION_RETRY;
 
+    // the server is up but busy, the other address family would be too
+    if (wait_rtn == WAIT_RETRY_LATER)
+      return CONN_WAIT_RETRY_DNS;
+
     // try ipv4 if we need to      
     if ((0==force_flags) && (0==ctx->current_server->allow_insecure) && is_ipv6) {
       is_ipv6 = false;
@@ -499,73 +1086,196 @@ int connect_and_wait (create_connection_ctx_t *ctx)
 }
 
 //--------------------------------------------------------------------
-// Tries to connect until
-// a) success, or
-// b) need to requery dns
-int keep_trying_to_connect (create_connection_ctx_t *ctx, 
-	int max_retry_sleep)
-{
-    backoff_timer_t backoff_timer;
-    int rtn;
-    
-    init_backoff_timer (&backoff_timer, max_retry_sleep);
-
-    while (true)
-    {
-      rtn = connect_and_wait (ctx);
-      if (rtn == CONN_WAIT_SUCCESS)
-        return true;
-      if (rtn == CONN_WAIT_ACTION_RETRY) // if redirected or build_headers
-        continue;
-      backoff_delay (&backoff_timer); // 3,7,15,31 ..
-      if (rtn == CONN_WAIT_RETRY_DNS)
-        return false;  //find_server again
-      // else retry
-    }
+static unsigned int ms_until (struct timespec *when)
+{
+  struct timespec now;
+  long long ms;
+
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  ms = (long long) (when->tv_sec - now.tv_sec) * 1000 +
+    (when->tv_nsec - now.tv_nsec) / 1000000;
+  return (ms > 0) ? (unsigned int) ms : 0;
 }
 
+static int enter_backoff (unsigned int delay_ms, int next_state)
+{
+  clock_gettime (CLOCK_MONOTONIC, &machine.wake_time);
+  machine.wake_time.tv_sec += delay_ms / 1000;
+  machine.wake_time.tv_nsec += (long) (delay_ms % 1000) * 1000000;
+  if (machine.wake_time.tv_nsec >= 1000000000L) {
+    machine.wake_time.tv_sec++;
+    machine.wake_time.tv_nsec -= 1000000000L;
+  }
+  machine.next_state = next_state;
+  set_conn_state (CONN_STATE_BACKOFF);
+  return (int) delay_ms;
+}
 
-//--------------------------------------------------------------------
+static void free_machine_ctx (void)
+{
+  free_extra_headers (&machine.conn_ctx);
+  free_server_list (&machine.conn_ctx.server_list);
+}
 
-/**
- * @brief createNopollConnection interface to create WebSocket client connections.
- *Loads the WebPA config file and creates the intial connection and manages the connection wait, close mechanisms.
- */
-int createNopollConnection(noPollCtx *ctx)
+// the current server is a pool endpoint, not a jwt or redirect one
+static bool using_pool (void)
 {
-  create_connection_ctx_t conn_ctx;
-  int max_retry_sleep;
-  int query_dns_status;
-  
-  if(ctx == NULL) {
-        return nopoll_false;
+  return (0 < server_pool_count ()) && (SERVER_POOL_NONE != machine.pool_index) &&
+    (machine.conn_ctx.current_server == &machine.conn_ctx.server_list.defaults);
+}
+
+// connects go over the interface in webpa_interface_used, also what the
+// webpa-inteface-used key reports
+static void use_interface (int index)
+{
+  const char *name = iface_pool_name (index);
+
+  if (NULL == name)
+    return;
+  machine.iface_index = index;
+  if (strcmp (name, get_parodus_cfg()->webpa_interface_used) != 0)
+    ParodusInfo("Connecting over interface %s\n", name);
+  parStrncpy (get_parodus_cfg()->webpa_interface_used, name,
+    sizeof(get_parodus_cfg()->webpa_interface_used));
+}
+
+static unsigned int elapsed_ms (struct timespec *start)
+{
+  struct timespec now;
+
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  return (unsigned int) ((now.tv_sec - start->tv_sec) * 1000 +
+    (now.tv_nsec - start->tv_nsec) / 1000000);
+}
+
+static int step_resolve (void)
+{
+  set_conn_state (CONN_STATE_RESOLVE);
+  if ((0 < server_pool_count ()) && (SERVER_POOL_NONE == machine.pool_index))
+    machine.pool_index = server_pool_select (machine.pool_tried, false);
+  if ((0 < iface_pool_count ()) && (IFACE_POOL_NONE == machine.iface_index))
+    use_interface (iface_pool_select (machine.iface_tried, false));
+  machine.on_hint = machine.hint_pending && use_hint (&machine.conn_ctx.server_list);
+  machine.hint_pending = false;
+  if (!machine.on_hint &&
+      (find_servers (&machine.conn_ctx.server_list) == FIND_INVALID_DEFAULT)) {
+    free_machine_ctx ();
+    set_conn_state (CONN_STATE_FAILED);
+    return CONN_STEP_NONE;
   }
+  set_current_server (&machine.conn_ctx);
+  set_conn_state (CONN_STATE_CONNECT);
+  return 0;
+}
 
-	ParodusPrint("BootTime In sec: %d\n", get_parodus_cfg()->boot_time);
-	ParodusInfo("Received reboot_reason as:%s\n", get_parodus_cfg()->hw_last_reboot_reason);
-	ParodusInfo("Received reconnect_reason as:%s\n", reconnect_reason);
-	
-	max_retry_sleep = (int) get_parodus_cfg()->webpa_backoff_max;
-	ParodusPrint("max_retry_sleep is %d\n", max_retry_sleep );
-  
-	conn_ctx.nopoll_ctx = ctx;
-	init_expire_timer (&conn_ctx.connect_timer);
-	init_header_info (&conn_ctx.header_info);
-	set_extra_headers (&conn_ctx, false);
-        set_server_list_null (&conn_ctx.server_list);
-  
-	while (true)
-	{
-	  query_dns_status = find_servers (&conn_ctx.server_list);
-	  if (query_dns_status == FIND_INVALID_DEFAULT)
-		return nopoll_false;
-	  set_current_server (&conn_ctx);
-	  if (keep_trying_to_connect (&conn_ctx, max_retry_sleep))
-		break;
-	  // retry dns query
-	}
-      
-	if(conn_ctx.current_server->allow_insecure <= 0)
+// The link monitor reports on its own thread. A usable address seen while
+// offline ends the backoff; losing the address the connection is bound to
+// ends the connection.
+
+static pthread_mutex_t link_event_mut = PTHREAD_MUTEX_INITIALIZER;
+static char link_local_addr[INET6_ADDRSTRLEN];	// source address of the connection
+static bool link_usable = false;
+
+static void on_link_event (int event, const char *addr, void *arg)
+{
+  bool online = (CONN_STATE_ONLINE == get_conn_state ());
+  bool lost = false;
+
+  (void) arg;
+  pthread_mutex_lock (&link_event_mut);
+  if ((LINK_EVENT_UP == event) || (LINK_EVENT_ADDR_ADDED == event))
+    link_usable = !online;
+  if ((LINK_EVENT_ADDR_REMOVED == event) && (strcmp (addr, link_local_addr) == 0)) {
+    link_local_addr[0] = '\0';
+    lost = online;
+  }
+  pthread_mutex_unlock (&link_event_mut);
+
+  if (lost && !get_close_retry ()) {
+    ParodusError("Source address %s of the connection was removed, reconnecting\n", addr);
+    set_global_reconnect_reason("Address_Lost");
+    set_global_reconnect_status(true);
+    set_close_retry();
+  }
+}
+
+static bool take_link_usable (void)
+{
+  bool usable;
+
+  pthread_mutex_lock (&link_event_mut);
+  usable = link_usable;
+  link_usable = false;
+  pthread_mutex_unlock (&link_event_mut);
+  return usable;
+}
+
+// one end of the connection, in text; false if it could not be had
+static bool conn_addr (bool local, char *text, size_t size)
+{
+  struct sockaddr_storage sa;
+  socklen_t len = sizeof(sa);
+  int fd = nopoll_conn_socket (get_global_conn ());
+  const void *addr = NULL;
+  int family = AF_INET;
+
+  if ((local ? getsockname (fd, (struct sockaddr *) &sa, &len) :
+        getpeername (fd, (struct sockaddr *) &sa, &len)) == 0) {
+    if (AF_INET == sa.ss_family) {
+      addr = &((struct sockaddr_in *) &sa)->sin_addr;
+    } else if (AF_INET6 == sa.ss_family) {
+      struct in6_addr *addr6 = &((struct sockaddr_in6 *) &sa)->sin6_addr;
+      // ipv4 over an ipv6 socket shows up as an ipv4 address in netlink
+      if (IN6_IS_ADDR_V4MAPPED (addr6)) {
+        addr = &addr6->s6_addr[12];
+      } else {
+        addr = addr6;
+        family = AF_INET6;
+      }
+    }
+  }
+  return (NULL != addr) && (NULL != inet_ntop (family, addr, text, size));
+}
+
+// keeps the source address of the connection that just came online
+static void note_local_addr (void)
+{
+  char text[INET6_ADDRSTRLEN] = "";
+
+  if (!get_parodus_cfg()->link_monitor)
+    return;
+  if (!conn_addr (true, text, sizeof(text)))
+    ParodusError("Unable to get the source address of the connection\n");
+  pthread_mutex_lock (&link_event_mut);
+  strcpy (link_local_addr, text);
+  link_usable = false;
+  pthread_mutex_unlock (&link_event_mut);
+}
+
+static void log_ping_stats (void)
+{
+	ping_stats_t stats;
+
+	ping_monitor_get_stats (&stats);
+	if (0 == stats.pongs)
+		return;
+	ParodusInfo("Ping rtt p50 %u ms, p90 %u ms, p99 %u ms, srtt %u ms, pong wait %u ms, %u pongs to %u pings\n",
+		stats.p50_ms, stats.p90_ms, stats.p99_ms, stats.srtt_ms, stats.wait_ms,
+		stats.pongs, stats.sent);
+}
+
+// pings the connection that just came online, when ping-interval is set
+static void start_pings (void)
+{
+	ParodusCfg *cfg = get_parodus_cfg();
+
+	log_ping_stats ();	// of the connection before
+	ping_monitor_start (1000 * cfg->ping_interval, 1000 * cfg->webpa_ping_timeout);
+}
+
+static void connected (void)
+{
+	if(machine.conn_ctx.current_server->allow_insecure <= 0)
 	{
 		ParodusInfo("Connected to server over SSL\n");
 	}
@@ -574,12 +1284,13 @@ int createNopollConnection(noPollCtx *ctx)
 		ParodusInfo("Connected to server\n");
 	}
 	
-	get_parodus_cfg()->cloud_status = CLOUD_STATUS_ONLINE;
+	set_cloud_status(CLOUD_STATUS_ONLINE);
 	ParodusInfo("cloud_status set as %s after successful connection\n", get_parodus_cfg()->cloud_status);
 
-	free_extra_headers (&conn_ctx);
-        free_header_info (&conn_ctx.header_info);
-        free_server_list (&conn_ctx.server_list);
+	free_server (&machine.online_server);
+	machine.online_server = *machine.conn_ctx.current_server;
+	machine.online_server.server_addr = strdup (machine.conn_ctx.current_server->server_addr);
+	free_machine_ctx ();
         
 	// Reset close_retry flag and heartbeatTimer once the connection retry is successful
 	ParodusPrint("createNopollConnection(): reset_close_retry\n");
@@ -589,8 +1300,587 @@ int createNopollConnection(noPollCtx *ctx)
 	set_global_reconnect_status(false);
 	ParodusPrint("LastReasonStatus reset after successful connection\n");
 	setMessageHandlers();
+	set_conn_state (CONN_STATE_ONLINE);
+	note_local_addr ();
+	start_pings ();
+	start_standby ();
+	start_shards ();
+	// a preferred interface that just failed gets a while before a probe
+	machine.probe_next = IFACE_POOL_NONE;
+	clock_gettime (CLOCK_MONOTONIC, &machine.probe_time);
+}
+
+// swap in the warm standby, if one is ready and still open; from here on
+// the machine describes the standby's endpoint, as connected() does for a
+// connect. The reason for the drop is kept: the standby connected before it
+// was known, so it is left for the side connections made now and the next
+// connect to report.
+static bool take_standby (void)
+{
+  noPollConn *conn;
+  server_t *server = &machine.conn_ctx.server_list.defaults;
+  int index;
+
+  conn = (noPollConn *) standby_take (&index);
+  if (NULL == conn)
+    return false;
+  if (!nopoll_conn_is_ok (conn)) {
+    close_and_unref_connection (conn);
+    return false;
+  }
+  set_global_conn (conn);
+  // the shards are on the endpoint that was dropped
+  stop_shards ();
+  free_server_list (&machine.conn_ctx.server_list);
+  parse_server_url ((SERVER_POOL_NONE != index) ? server_pool_url (index) :
+    get_parodus_cfg()->webpa_url, server);
+  machine.conn_ctx.current_server = server;
+  machine.pool_index = index;
+  free_server (&machine.online_server);
+  machine.online_server = *server;
+  if (NULL != server->server_addr)
+    machine.online_server.server_addr = strdup (server->server_addr);
+  machine.iface_index = machine.standby_iface;
+  use_interface (machine.standby_iface);	// for webpa-interface-used
+  ParodusInfo("Failed over to the warm standby connection to %s\n",
+    (NULL != server->server_addr) ? server->server_addr : "");
+  // side connections built from here carry the reason in their headers
+  set_extra_headers (&machine.conn_ctx, false);
+  free_machine_ctx ();
+  reset_close_retry();
+  reset_heartBeatTimer();
+  set_global_reconnect_status(false);
+  setMessageHandlers();
+  set_conn_state (CONN_STATE_ONLINE);
+  note_local_addr ();
+  start_pings ();
+  start_standby ();
+  start_shards ();
+  machine.probe_next = IFACE_POOL_NONE;
+  clock_gettime (CLOCK_MONOTONIC, &machine.probe_time);
+  return true;
+}
+
+// keeps where the connection ended up, for the next start; a connection
+// made from the hint leaves it with the expiry it has
+static void save_hint (void)
+{
+  const char *file = get_parodus_cfg()->conn_hints_file;
+  server_t *server = machine.conn_ctx.current_server;
+  conn_hint_t hint;
+
+  if ((NULL == file) || machine.on_hint)
+    return;
+  memset (&hint, 0, sizeof(hint));
+  parStrncpy (hint.origin, default_server_url (), sizeof(hint.origin));
+  parStrncpy (hint.host, server->server_addr, sizeof(hint.host));
+  hint.port = server->port;
+  hint.allow_insecure = server->allow_insecure;
+  if (!conn_addr (false, hint.addr, sizeof(hint.addr)))
+    hint.addr[0] = '\0';
+  hint.expires = time (NULL) + get_parodus_cfg()->conn_hints_ttl;
+  conn_hints_save (file, &hint);
+}
+
+// connect_and_wait() blocks until the upgrade succeeds or the connect
+// timer runs out, about 10 s, so it runs on its own thread. The machine
+// leaves conn_ctx alone until the thread is joined.
+static void *connect_thread (void *arg)
+{
+  int rtn = connect_and_wait ((create_connection_ctx_t *) arg);
+
+  pthread_mutex_lock (&connect_result.mut);
+  connect_result.rtn = rtn;
+  connect_result.done = true;
+  pthread_mutex_unlock (&connect_result.mut);
+  return NULL;
+}
+
+// returns true once the attempt is over, with its connect_and_wait() code
+static bool connect_attempt (int *rtn)
+{
+  bool done;
+  int err;
+
+  if (!machine.connecting) {
+    set_conn_state (CONN_STATE_CONNECT);
+    clock_gettime (CLOCK_MONOTONIC, &machine.connect_start);
+    connect_result.done = false;
+    err = pthread_create (&machine.connect_thread, NULL, connect_thread,
+      &machine.conn_ctx);
+    if (0 != err) {
+      ParodusError("Error creating connect thread :[%s], connecting in the main loop\n",
+        strerror(err));
+      *rtn = connect_and_wait (&machine.conn_ctx);
+      return true;
+    }
+    machine.connecting = true;
+    return false;
+  }
+  pthread_mutex_lock (&connect_result.mut);
+  done = connect_result.done;
+  *rtn = connect_result.rtn;
+  pthread_mutex_unlock (&connect_result.mut);
+  if (done) {
+    pthread_join (machine.connect_thread, NULL);
+    machine.connecting = false;
+  }
+  return done;
+}
+
+// Tries to connect once, polling the attempt every CONNECT_POLL_MS.
+// Redirects and header rebuilds retry at once; other failures back off,
+// then retry or query dns again.
+static int step_connect (void)
+{
+  int rtn, next;
+
+  if (!connect_attempt (&rtn))
+    return CONNECT_POLL_MS;
+  if (rtn == CONN_WAIT_SUCCESS) {
+    if (using_pool ())
+      server_pool_report_connect (machine.pool_index, true,
+        elapsed_ms (&machine.connect_start));
+    iface_pool_report_connect (machine.iface_index, true,
+      elapsed_ms (&machine.connect_start));
+    machine.pool_tried = 0;
+    machine.iface_tried = 0;
+    save_hint ();
+    machine.on_hint = false;
+    connected ();
+    return CONN_STEP_NONE;
+  }
+  // a hint that did not work is gone; find the server the usual way
+  if (machine.on_hint) {
+    machine.on_hint = false;
+    if (rtn != CONN_WAIT_ACTION_RETRY) {
+      ParodusInfo("Saved connection hint failed, finding the server again\n");
+      conn_hints_drop (get_parodus_cfg()->conn_hints_file);
+      set_conn_state (CONN_STATE_RESOLVE);
+      return 0;
+    }
+  }
+  if (rtn == CONN_WAIT_ACTION_RETRY) { // if redirected or build_headers
+    set_conn_state (CONN_STATE_CONNECT);
+    return 0;
+  }
+  // fail over to the next endpoint that is up, back off once all have failed
+  if (using_pool ()) {
+    server_pool_report_connect (machine.pool_index, false, 0);
+    machine.pool_tried |= 1U << machine.pool_index;
+    next = server_pool_select (machine.pool_tried, true);
+    if (SERVER_POOL_NONE != next) {
+      machine.pool_index = next;
+      machine.conn_ctx.retry_after = 0;
+      ParodusInfo("Failing over to %s\n", server_pool_url (next));
+      set_conn_state (CONN_STATE_RESOLVE);
+      return 0;
+    }
+    machine.pool_tried = 0;
+    machine.pool_index = SERVER_POOL_NONE;
+  }
+  // then over the next interface that is up
+  if (IFACE_POOL_NONE != machine.iface_index) {
+    iface_pool_report_connect (machine.iface_index, false, 0);
+    machine.iface_tried |= 1U << machine.iface_index;
+    next = iface_pool_select (machine.iface_tried, true);
+    if (IFACE_POOL_NONE != next) {
+      use_interface (next);
+      machine.conn_ctx.retry_after = 0;
+      ParodusInfo("Failing over to interface %s\n", iface_pool_name (next));
+      set_conn_state (CONN_STATE_RESOLVE);
+      return 0;
+    }
+    machine.iface_tried = 0;
+    machine.iface_index = IFACE_POOL_NONE;
+  }
+  machine.backoff_timer.retry_after = machine.conn_ctx.retry_after;
+  machine.conn_ctx.retry_after = 0;
+  update_backoff_delay (&machine.backoff_timer); // 3,7,15,31 .. or jittered
+  ParodusInfo("Waiting with backoffRetryTime %u ms\n",
+    machine.backoff_timer.state.delay_ms);
+  return enter_backoff (machine.backoff_timer.state.delay_ms,
+    (rtn == CONN_WAIT_RETRY_DNS) ? CONN_STATE_RESOLVE : CONN_STATE_CONNECT);
+}
+
+static int step_backoff (void)
+{
+  unsigned int remaining_ms = ms_until (&machine.wake_time);
+
+  if ((0 < remaining_ms) && !machine.cloud_disconnect_hold && take_link_usable ()) {
+    ParodusInfo("Usable address on the interface, reconnecting now\n");
+    init_backoff_timer (&machine.backoff_timer, machine.max_retry_sleep);
+    remaining_ms = 0;
+  }
+  if (0 < remaining_ms)
+    return (int) remaining_ms;
+  if (machine.cloud_disconnect_hold) {
+    machine.cloud_disconnect_hold = false;
+    ParodusInfo("cloud-disconnect reason reset after %d minutes\n", get_cloud_disconnect_time());
+    free(get_parodus_cfg()->cloud_disconnect);
+    reset_cloud_disconnect_reason(get_parodus_cfg());
+    // subscribers were told of the reason, tell them it is gone
+    crud_notify_change(CRUD_NOTIFY_CLOUD_DISCONNECT, "null");
+    conn_machine_restart (true);
+    return 0;
+  }
+  set_conn_state (machine.next_state);
+  return 0;
+}
+
+static bool past (const struct timespec *deadline)
+{
+  struct timespec now;
+
+  clock_gettime (CLOCK_REALTIME, &now);
+  return (now.tv_sec > deadline->tv_sec) ||
+    ((now.tv_sec == deadline->tv_sec) && (now.tv_nsec >= deadline->tv_nsec));
+}
+
+// a connection dropped for these may be half-open, still ok to nopoll
+// while nothing written reaches the server
+static bool liveness_lost (void)
+{
+  const char *reason = get_global_reconnect_reason ();
+
+  return (strcmp (reason, "Ping_Miss") == 0) ||
+    (strcmp (reason, "Address_Lost") == 0);
+}
+
+// With drain-timeout, flush what is queued before a forced disconnect. The
+// main loop is not reading the socket while here, so no more arrives
+// downstream; upstream messages queued after the start wait for the next
+// connection.
+static void drain_queues (void)
+{
+  noPollConn *conn = get_global_conn();
+  unsigned int timeout_ms = get_parodus_cfg()->drain_timeout;
+  unsigned int down_done, down_left, up_done, up_left;
+  struct timespec deadline;
+  int unwritten;
+
+  if ((0 == timeout_ms) || (NULL == conn))
+    return;
+  if (liveness_lost ()) {
+    ParodusInfo("Not draining, the connection was dropped for %s\n",
+      get_global_reconnect_reason ());
+    return;
+  }
+  if (!nopoll_conn_is_ok (conn))
+    return;
+  clock_gettime (CLOCK_REALTIME, &deadline);
+  deadline.tv_sec += timeout_ms / 1000;
+  deadline.tv_nsec += (long) (timeout_ms % 1000) * 1000000;
+  if (deadline.tv_nsec >= 1000000000) {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000000000;
+  }
+  ParodusInfo("Draining queues for up to %u ms before closing\n", timeout_ms);
+
+  // downstream first, as handling it can queue responses upstream
+  down_done = drain_downstream (&deadline, &down_left);
+  up_done = drain_upstream (&deadline, &up_left);
+  while (((unwritten = nopoll_conn_pending_write_bytes (conn)) > 0) && !past (&deadline)) {
+    nopoll_conn_complete_pending_write (conn);
+    sleep_ms (DRAIN_WRITE_POLL_MS);
+  }
+  ParodusInfo("Drained upstream %u flushed, %u discarded; downstream %u flushed, "
+    "%u discarded; %d bytes unwritten\n", up_done, up_left, down_done, down_left,
+    (unwritten > 0) ? unwritten : 0);
+}
+
+void conn_machine_flush (void)
+{
+  if (CONN_STATE_ONLINE == get_conn_state ())
+    drain_queues ();
+}
+
+static int step_drain (void)
+{
+  drain_queues ();
+  close_and_unref_connection(get_global_conn());
+  set_global_conn(NULL);
+  if (machine.failing_back) {
+    // the side connections are on the interface being left
+    standby_discard (true);
+    stop_shards ();
+  } else if ((NULL == get_parodus_cfg()->cloud_disconnect) && take_standby ()) {
+    return CONN_STEP_NONE;
+  }
+
+  set_cloud_status(CLOUD_STATUS_OFFLINE);
+  ParodusInfo("cloud_status set as %s after connection close\n", get_parodus_cfg()->cloud_status);
+  if(get_parodus_cfg()->cloud_disconnect !=NULL)
+  {
+	standby_discard (true);
+	stop_shards ();
+	ParodusPrint("get_parodus_cfg()->cloud_disconnect is %s\n", get_parodus_cfg()->cloud_disconnect);
+	set_cloud_disconnect_time(CLOUD_RECONNECT_TIME);
+	ParodusInfo("Waiting for %d minutes for reconnecting .. \n", get_cloud_disconnect_time());
+	machine.cloud_disconnect_hold = true;
+	return enter_backoff ((unsigned int) get_cloud_disconnect_time() * 60 * 1000,
+	  CONN_STATE_RESOLVE);
+  }
+  conn_machine_restart (false);
+  return 0;
+}
+
+// the pool ranks webpa_url with the server-pool urls; scores carry over
+static void load_server_pool (void)
+{
+  ParodusCfg *cfg = get_parodus_cfg();
+  char *urls;
+
+  if (NULL == cfg->server_pool) {
+    server_pool_clear ();
+    return;
+  }
+  urls = (char *) malloc (strlen (cfg->webpa_url) + strlen (cfg->server_pool) + 2);
+  if (NULL == urls) {
+    ParodusError ("server pool allocation failed.\n");
+    server_pool_clear ();
+    return;
+  }
+  sprintf (urls, "%s,%s", cfg->webpa_url, cfg->server_pool);
+  server_pool_init (urls);
+  free (urls);
+}
+
+// before each connect sequence, at start and after a connection closes;
+// spread at start and after the cloud-disconnect hold
+static void conn_machine_restart (bool spread)
+{
+	noPollCtx *ctx = machine.conn_ctx.nopoll_ctx;
+
+	// a retry is in progress until connected(), so upstream senders hold
+	// off instead of writing to a connection that is not there yet
+	set_close_retry();
+	ParodusInfo("Received reconnect_reason as:%s\n", reconnect_reason);
+	memset (&machine.conn_ctx, 0, sizeof(machine.conn_ctx));
+	machine.conn_ctx.nopoll_ctx = ctx;
+	machine.conn_ctx.retry_after = 0;
+	init_expire_timer (&machine.conn_ctx.connect_timer);
+	set_extra_headers (&machine.conn_ctx, false);
+        set_server_list_null (&machine.conn_ctx.server_list);
+	// one backoff sequence across dns requeries, so the delay grows
+	init_backoff_timer (&machine.backoff_timer, machine.max_retry_sleep);
+	machine.cloud_disconnect_hold = false;
+	machine.pool_index = SERVER_POOL_NONE;
+	machine.pool_tried = 0;
+	machine.iface_index = IFACE_POOL_NONE;
+	machine.iface_tried = 0;
+	machine.failing_back = false;
+	machine.on_hint = false;
+
+	// a fleet that lost the cloud together should not come back together
+	if (spread && (0 < get_parodus_cfg()->reconnect_spread)) {
+	  unsigned int spread_ms = backoff_spread (get_parodus_cfg()->hw_mac,
+	    get_parodus_cfg()->reconnect_spread * 1000);
+	  ParodusInfo("Spreading first connect attempt by %u ms\n", spread_ms);
+	  enter_backoff (spread_ms, CONN_STATE_RESOLVE);
+	  return;
+	}
+	set_conn_state (CONN_STATE_RESOLVE);
+}
+
+void conn_machine_init (noPollCtx *ctx)
+{
+	if (NULL == ctx) {
+		ParodusError("No nopoll context to connect with\n");
+		set_conn_state (CONN_STATE_FAILED);
+		return;
+	}
+	ParodusPrint("BootTime In sec: %d\n", get_parodus_cfg()->boot_time);
+	ParodusInfo("Received reboot_reason as:%s\n", get_parodus_cfg()->hw_last_reboot_reason);
+	
+	machine.max_retry_sleep = (int) get_parodus_cfg()->webpa_backoff_max;
+	ParodusPrint("max_retry_sleep is %d\n", machine.max_retry_sleep );
+  
+	dns_cache_set_ttl (get_parodus_cfg()->dns_cache_ttl);
+	socket_tuning_init (get_parodus_cfg()->socket_tuning);
+	if (get_parodus_cfg()->link_monitor)
+		link_monitor_start ((NULL != get_parodus_cfg()->webpa_interfaces) ? "" :
+			get_parodus_cfg()->webpa_interface_used, on_link_event, NULL);
+	if (get_parodus_cfg()->tls_session_cache)
+		tls_session_init (ctx, get_parodus_cfg()->tls_session_file,
+			get_parodus_cfg()->tls13_resumption);
+	if (get_parodus_cfg()->ktls)
+		tls_session_ktls (ctx, get_parodus_cfg()->tls13_resumption);
+	load_server_pool ();
+	if (NULL != get_parodus_cfg()->webpa_interfaces)
+		iface_pool_init (get_parodus_cfg()->webpa_interfaces);
+	else
+		iface_pool_clear ();
+#ifdef FEATURE_UPLINK_SHARDS
+	uplink_shards_init (get_parodus_cfg()->uplink_shards, shard_connect,
+	  side_release, shard_send, shard_fallback);
+#else
+	if (1 < get_parodus_cfg()->uplink_shards)
+		ParodusError("uplink-shards ignored, built without FEATURE_UPLINK_SHARDS\n");
+#endif
+	// the saved hint is for the first connect only, a reconnect finds the
+	// server again
+	machine.hint_pending = (NULL != get_parodus_cfg()->conn_hints_file);
+	machine.conn_ctx.nopoll_ctx = ctx;
+	conn_machine_restart (true);
+}
+
+int conn_machine_step (void)
+{
+  switch (get_conn_state ()) {
+  case CONN_STATE_RESOLVE:
+    return step_resolve ();
+  case CONN_STATE_CONNECT:
+  case CONN_STATE_UPGRADE:
+    return step_connect ();
+  case CONN_STATE_BACKOFF:
+    return step_backoff ();
+  case CONN_STATE_DRAINING:
+    return step_drain ();
+  default:
+    return CONN_STEP_NONE;
+  }
+}
+
+void conn_machine_drain (void)
+{
+  if (get_conn_state () == CONN_STATE_ONLINE)
+    set_conn_state (CONN_STATE_DRAINING);
+}
+
+// While online over a backup interface, probes the preferred ones in turn.
+// True once one of them is healthy.
+static bool fail_back_due (void)
+{
+  if ((machine.iface_index <= 0) || (CONN_STATE_ONLINE != get_conn_state ()) ||
+      get_close_retry () || (NULL == machine.online_server.server_addr))
+    return false;
+  if (iface_pool_probing ())
+    return false;
+  if (iface_pool_healthy (machine.probe_next))
+    return true;
+  if (elapsed_ms (&machine.probe_time) < IFACE_PROBE_INTERVAL * 1000)
+    return false;
+  machine.probe_next = (machine.probe_next + 1) % machine.iface_index;
+  if (iface_pool_probe (machine.probe_next, machine.online_server.server_addr,
+        machine.online_server.port) == 0)
+    clock_gettime (CLOCK_MONOTONIC, &machine.probe_time);
+  return false;
+}
+
+void conn_machine_tend (void)
+{
+  unsigned int count = uplink_shards_count ();
+  noPollConn *conn;
+  unsigned int i;
+
+  if (fail_back_due ()) {
+    ParodusInfo("Interface %s is healthy again, moving the connection back from %s\n",
+      iface_pool_name (machine.probe_next), iface_pool_name (machine.iface_index));
+    machine.failing_back = true;
+    set_global_reconnect_reason("Interface_Failback");
+    set_global_reconnect_status(true);
+    set_close_retry();
+    return;
+  }
+  for (i = 1; i < count; i++) {
+    conn = (noPollConn *) uplink_shard_handle (i);
+    if ((NULL != conn) && !nopoll_conn_is_ok (conn))
+      uplink_shard_down (i, false);
+  }
+  start_shards ();
+
+  if (!get_parodus_cfg()->warm_standby)
+    return;
+  conn = (noPollConn *) standby_peek ();
+  if ((NULL != conn) && !nopoll_conn_is_ok (conn)) {
+    ParodusInfo("Warm standby connection closed\n");
+    standby_discard (false);
+  }
+  start_standby ();
+}
+
+int conn_machine_ping (void)
+{
+  ping_stats_t stats;
+
+  if (ping_monitor_due ()) {
+    if (!sendPing (get_global_conn ()))
+      ParodusError("Unable to send ping\n");
+    ping_monitor_sent ();	// a failed send is left to the pong deadline
+  }
+  if (ping_monitor_expired () && !get_close_retry ()) {
+    ping_monitor_get_stats (&stats);
+    ParodusError("No pong to %u pings in a row, each given %u ms. Terminating the connection with WebPA server and retrying\n",
+      stats.missed, stats.wait_ms);
+    log_ping_stats ();
+    set_global_reconnect_reason("Ping_Miss");
+    set_global_reconnect_status(true);
+    set_close_retry();
+  }
+  return ping_monitor_next_ms ();
+}
+
+void conn_machine_pong (void)
+{
+  ping_stats_t stats;
+  int rtt_ms = ping_monitor_pong ();
+
+  if (rtt_ms < 0)
+    return;
+  ParodusPrint("Pong in %d ms\n", rtt_ms);
+  server_pool_report_rtt (machine.pool_index, (unsigned int) rtt_ms);
+  iface_pool_report_rtt (machine.iface_index, (unsigned int) rtt_ms);
+  ping_monitor_get_stats (&stats);
+  if (0 == (stats.pongs % PING_REPORT_EVERY))
+    log_ping_stats ();
+}
+
+void conn_machine_stop (void)
+{
+  int rtn;
+
+  // the attempt cannot be cut short; its connection is closed with the
+  // global one
+  while (machine.connecting && !connect_attempt (&rtn))
+    sleep_ms (CONNECT_POLL_MS);
+}
+
+void close_side_connections (void)
+{
+  standby_discard (true);
+  uplink_shards_shutdown ();
+  iface_pool_clear ();	// waits for a probe in progress
+  free_server (&machine.online_server);
+}
+
+//--------------------------------------------------------------------
 
-	return nopoll_true;
+/**
+ * @brief createNopollConnection interface to create WebSocket client connections.
+ *Loads the WebPA config file and creates the intial connection and manages the connection wait, close mechanisms.
+ */
+int createNopollConnection(noPollCtx *ctx)
+{
+  int wait_ms;
+  int state;
+
+  if(ctx == NULL) {
+        return nopoll_false;
+  }
+
+  conn_machine_init (ctx);
+  while (true)
+  {
+    wait_ms = conn_machine_step ();
+    state = get_conn_state ();
+    if (state == CONN_STATE_ONLINE)
+      return nopoll_true;
+    if (state == CONN_STATE_FAILED)
+      return nopoll_false;
+    if (0 < wait_ms)
+      sleep_ms ((unsigned int) wait_ms);
+  }
 }          
 
 /* Build the extra headers string with any/all conditional logic in one place. */
@@ -613,7 +1903,10 @@ static char* build_extra_headers( const char *auth, const char *device_id,
 }
 
 
-static noPollConnOpts * createConnOpts (char * extra_headers, bool secure)
+// iface is a copy for attempts on other threads, use_interface() may
+// change webpa_interface_used under them
+static noPollConnOpts * createConnOpts (char * extra_headers, bool secure,
+                                        const char *iface)
 {
     noPollConnOpts * opts;
     
@@ -627,7 +1920,7 @@ static noPollConnOpts * createConnOpts (char * extra_headers, bool secure)
 	    nopoll_conn_opts_ssl_peer_verify (opts, nopoll_true);
 	    nopoll_conn_opts_set_ssl_protocol (opts, NOPOLL_METHOD_TLSV1_2);
 	}
-	nopoll_conn_opts_set_interface (opts,get_parodus_cfg()->webpa_interface_used);	
+	nopoll_conn_opts_set_interface (opts, iface);
 	nopoll_conn_opts_set_extra_headers (opts,extra_headers); 
 	return opts;   
 }
@@ -30,6 +30,24 @@
 extern "C" {
 #endif
 
+/*----------------------------------------------------------------------------*/
+/*                                   Macros                                   */
+/*----------------------------------------------------------------------------*/
+
+// Connection states. TCP connect and the TLS handshake are one nopoll
+// call, so CONN_STATE_CONNECT covers both.
+#define CONN_STATE_IDLE		0
+#define CONN_STATE_RESOLVE	1
+#define CONN_STATE_CONNECT	2
+#define CONN_STATE_UPGRADE	3
+#define CONN_STATE_ONLINE	4
+#define CONN_STATE_DRAINING	5
+#define CONN_STATE_BACKOFF	6
+#define CONN_STATE_FAILED	7
+
+// conn_machine_step() return when no step is due
+#define CONN_STEP_NONE		-1
+
 /*----------------------------------------------------------------------------*/
 /*                            File Scoped Variables                           */
 /*----------------------------------------------------------------------------*/
@@ -39,8 +57,75 @@ extern "C" {
 /*                             Function Prototypes                            */
 /*----------------------------------------------------------------------------*/
 
+/**
+ * @brief Connect to the server, blocking until connected.
+ *
+ * @return nopoll_true when connected, nopoll_false if the server url is invalid
+ */
 int createNopollConnection(noPollCtx *);
 
+/**
+ * @brief Set up from the configuration, once per process, and start
+ * connecting: the machine goes to CONN_STATE_RESOLVE, or to
+ * CONN_STATE_BACKOFF for the reconnect spread. Without a ctx it goes to
+ * CONN_STATE_FAILED. Reconnects restart the machine themselves.
+ */
+void conn_machine_init (noPollCtx *ctx);
+
+/**
+ * @brief Run the step due in the current state. Waits are not slept here,
+ * the caller steps again once the returned time has passed. A connect
+ * attempt runs on its own thread, and is polled until it is over.
+ *
+ * @return ms until the next step is due, 0 to step again at once, or
+ *         CONN_STEP_NONE when online, failed or idle
+ */
+int conn_machine_step (void);
+
+/**
+ * @brief Drop an online connection. The next step closes it and starts
+ * reconnecting, after the cloud-disconnect hold if one was asked for.
+ */
+void conn_machine_drain (void);
+
+/**
+ * @brief While online, flush the queues as before a forced disconnect,
+ * within drain-timeout. Used when handing over to a new parodus.
+ */
+void conn_machine_flush (void);
+
+/**
+ * @brief Keep the warm standby and uplink shard connections, if configured:
+ * replace those that have closed. Called from the main loop while online.
+ */
+void conn_machine_tend (void);
+
+/**
+ * @brief Send a ping when one is due, and flag the connection for a
+ * reconnect when a pong is late. Called from the main loop while online.
+ * @return ms until it needs calling again, -1 when pinging is off
+ */
+int conn_machine_ping (void);
+
+/**
+ * @brief Record the pong answering our ping.
+ */
+void conn_machine_pong (void);
+
+/**
+ * @brief Wait for a connect attempt in progress to end, at shutdown. A
+ * connection it made is left as the global one.
+ */
+void conn_machine_stop (void);
+
+/**
+ * @brief Close the warm standby and the uplink shards, at shutdown.
+ */
+void close_side_connections (void);
+
+int get_conn_state (void);
+const char *get_conn_state_name (int state);
+
 /**
  * @brief Interface to terminate WebSocket client connections and clean up resources.
  */
@@ -57,6 +142,11 @@ void set_global_reconnect_status(bool status);
 
 int get_cloud_disconnect_time();
 void set_cloud_disconnect_time(int disconnTime);
+
+/**
+ * Free the cached connection headers, rebuilt on the next connect.
+ */
+void free_header_cache (void);
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,83 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/**
+ * @file crud_export.c
+ *
+ * @description Debug tool that dumps a CRUD config file, JSON or msgpack
+ *              store, as JSON.
+ *
+ *              parodus_crud_export <crud-config-file> [<output-json-file>]
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cJSON.h>
+#include "crud_store.h"
+
+int main(int argc, char **argv)
+{
+	char *data = NULL;
+	char *out = NULL;
+	cJSON *json;
+	FILE *fp = stdout;
+	int rv = 1;
+
+	if(argc < 2 || argc > 3)
+	{
+		fprintf(stderr, "usage: %s <crud-config-file> [<output-json-file>]\n", argv[0]);
+		return 2;
+	}
+
+	if(!crud_store_read(argv[1], &data, CRUD_STORE_FORMAT_JSON))
+	{
+		fprintf(stderr, "Failed to read %s\n", argv[1]);
+		return 1;
+	}
+
+	json = cJSON_Parse(data);
+	if(json != NULL)
+	{
+		out = cJSON_Print(json);
+		cJSON_Delete(json);
+	}
+
+	if(argc == 3)
+	{
+		fp = fopen(argv[2], "w");
+		if(fp == NULL)
+		{
+			fprintf(stderr, "Failed to open %s\n", argv[2]);
+			free(out);
+			free(data);
+			return 1;
+		}
+	}
+
+	if(fprintf(fp, "%s\n", (out != NULL) ? out : data) > 0)
+	{
+		rv = 0;
+	}
+	if(fp != stdout)
+	{
+		fclose(fp);
+	}
+	free(out);
+	free(data);
+	return rv;
+}
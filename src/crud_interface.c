@@ -23,6 +23,7 @@
 
 #include "ParodusInternal.h"
 #include "crud_tasks.h"
+#include "crud_internal.h"
 #include "crud_interface.h"
 #include "upstream.h"
 
@@ -33,12 +34,48 @@
 pthread_mutex_t crud_mut=PTHREAD_MUTEX_INITIALIZER;
 pthread_cond_t crud_con=PTHREAD_COND_INITIALIZER;
 
+pthread_mutex_t crud_retrieve_mut=PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t crud_retrieve_con=PTHREAD_COND_INITIALIZER;
+
 
 /*----------------------------------------------------------------------------*/
 /*                             Internal variables                             */
 /*----------------------------------------------------------------------------*/
 
 CrudMsg *crudMsgQ = NULL;
+CrudMsg *crudRetrieveMsgQ = NULL;
+
+/*----------------------------------------------------------------------------*/
+/*                             Internal functions                             */
+/*----------------------------------------------------------------------------*/
+
+static void processCrudMessage(CrudMsg *message)
+{
+	int ret = 0;
+	ssize_t resp_size = 0;
+	void *resp_bytes;
+	wrp_msg_t *crud_response = NULL;
+
+	ret = processCrudRequest(message->msg, &crud_response);
+	wrp_free_struct(message->msg);
+	free(message);
+
+	if(ret == 0)
+	{
+		ParodusInfo("CRUD processed successfully\n");
+	}
+	else
+	{
+		ParodusError("Failure in CRUD request processing !!\n");
+	}
+	ParodusPrint("msgpack encode to send to upstream\n");
+	resp_size = wrp_struct_to( crud_response, WRP_BYTES, &resp_bytes );
+	ParodusPrint("Encoded CRUD resp_size :%lu\n", resp_size);
+
+	ParodusPrint("Adding CRUD response to upstreamQ\n");
+	addCRUDresponseToUpstreamQ(resp_bytes, resp_size, crud_response->msg_type);
+	wrp_free_struct(crud_response);
+}
 
 /*----------------------------------------------------------------------------*/
 /*                             External functions                             */
@@ -47,46 +84,55 @@ CrudMsg *crudMsgQ = NULL;
 void addCRUDmsgToQueue(wrp_msg_t *crudMsg)
 {
 	CrudMsg * crudMessage;
+	CrudMsg **queue = &crudMsgQ;
+	pthread_mutex_t *mut = &crud_mut;
+	pthread_cond_t *con = &crud_con;
+
 	crudMessage = (CrudMsg *)malloc(sizeof(CrudMsg));
 	if(crudMessage && crudMsg!=NULL)
 	{
+		// Retrieves only read the store snapshot, so they bypass the writer queue
+		if(crudMsg->msg_type == WRP_MSG_TYPE__RETREIVE)
+		{
+			queue = &crudRetrieveMsgQ;
+			mut = &crud_retrieve_mut;
+			con = &crud_retrieve_con;
+		}
 		crudMessage->msg = crudMsg;
 		crudMessage->next = NULL;
 		ParodusPrint("Inside addCRUDmsgToQueue : mutex lock in producer \n");
-		pthread_mutex_lock(&crud_mut);
-		if(crudMsgQ ==NULL)
+		pthread_mutex_lock(mut);
+		if(*queue ==NULL)
 		{
-			crudMsgQ = crudMessage;
+			*queue = crudMessage;
 			ParodusPrint("Producer added message\n");
-			pthread_cond_signal(&crud_con);
-			pthread_mutex_unlock(&crud_mut);
+			pthread_cond_signal(con);
+			pthread_mutex_unlock(mut);
 			ParodusPrint("Inside addCRUDmsgToQueue : mutex unlock in producer \n");
 		}
 		else
 		{
-			CrudMsg *temp = crudMsgQ;
+			CrudMsg *temp = *queue;
 			while(temp->next)
 			{
 				temp = temp->next;
 			}
 			temp->next = crudMessage;
-			pthread_mutex_unlock(&crud_mut);
+			pthread_mutex_unlock(mut);
 		}
 	}
 	else
 	{
 		ParodusError("Memory allocation failed for CRUD\n");
+		free(crudMessage);
 	}
 }
 
 
 void *CRUDHandlerTask()
 {
-	int ret = 0;
-	ssize_t resp_size = 0;
-	void *resp_bytes;
-	wrp_msg_t *crud_response = NULL;
-
+	// the one writer converts an old JSON store, retrieves only ever read
+	migrateCrudStore();
 	while(FOREVER())
 	{
 		pthread_mutex_lock(&crud_mut);
@@ -99,26 +145,7 @@ void *CRUDHandlerTask()
 			pthread_mutex_unlock(&crud_mut);
 			ParodusPrint("Mutex unlock in CRUD consumer thread\n");
 
-			ret = processCrudRequest(message->msg, &crud_response);
-			wrp_free_struct(message->msg);
-			free(message);
-			message = NULL;
-
-			if(ret == 0)
-			{
-				ParodusInfo("CRUD processed successfully\n");
-			}
-			else
-			{
-				ParodusError("Failure in CRUD request processing !!\n");
-			}
-			ParodusPrint("msgpack encode to send to upstream\n");
-			resp_size = wrp_struct_to( crud_response, WRP_BYTES, &resp_bytes );
-			ParodusPrint("Encoded CRUD resp_size :%lu\n", resp_size);
-
-			ParodusPrint("Adding CRUD response to upstreamQ\n");
-			addCRUDresponseToUpstreamQ(resp_bytes, resp_size);
-			wrp_free_struct(crud_response);
+			processCrudMessage(message);
 		}
 		else
 		{
@@ -129,9 +156,34 @@ void *CRUDHandlerTask()
 	return 0;
 }
 
+void *CRUDRetrieveTask()
+{
+	while(FOREVER())
+	{
+		pthread_mutex_lock(&crud_retrieve_mut);
+		ParodusPrint("Mutex lock in CRUD retrieve consumer thread\n");
+
+		if(crudRetrieveMsgQ !=NULL)
+		{
+			CrudMsg *message = crudRetrieveMsgQ;
+			crudRetrieveMsgQ = crudRetrieveMsgQ->next;
+			pthread_mutex_unlock(&crud_retrieve_mut);
+			ParodusPrint("Mutex unlock in CRUD retrieve consumer thread\n");
+
+			processCrudMessage(message);
+		}
+		else
+		{
+			pthread_cond_wait(&crud_retrieve_con, &crud_retrieve_mut);
+			pthread_mutex_unlock (&crud_retrieve_mut);
+		}
+	}
+	return 0;
+}
+
 
 //CRUD Producer adds the response into common UpStreamQ
-void addCRUDresponseToUpstreamQ(void *response_bytes, ssize_t response_size)
+void addCRUDresponseToUpstreamQ(void *response_bytes, ssize_t response_size, int msg_type)
 {
 	UpStreamMsg *response;
 
@@ -140,6 +192,8 @@ void addCRUDresponseToUpstreamQ(void *response_bytes, ssize_t response_size)
 	{
 		response->msg =(void *)response_bytes;
 		response->len =(int)response_size;
+		response->msg_type = msg_type;
+		response->drain = 0;
 		response->next=NULL;
 		pthread_mutex_lock (get_global_nano_mut());
 		ParodusPrint("Mutex lock in CRUD response producer\n");
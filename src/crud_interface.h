@@ -29,6 +29,13 @@ extern "C" {
 #endif
 
 
+/*----------------------------------------------------------------------------*/
+/*                                   Macros                                   */
+/*----------------------------------------------------------------------------*/
+
+/* Number of threads serving RETRIEVE requests concurrently with the writer */
+#define CRUD_RETRIEVE_THREADS		2
+
 /*----------------------------------------------------------------------------*/
 /*                               Data Structures                              */
 /*----------------------------------------------------------------------------*/
@@ -42,7 +49,7 @@ typedef struct CrudMsg__
 /*                             Function Prototypes                            */
 /*----------------------------------------------------------------------------*/
 
-void addCRUDresponseToUpstreamQ(void *response_bytes, ssize_t response_size);
+void addCRUDresponseToUpstreamQ(void *response_bytes, ssize_t response_size, int msg_type);
 
 #ifdef __cplusplus
 }
@@ -23,57 +23,42 @@
 #include <wrp-c.h>
 #include "crud_tasks.h"
 #include "crud_internal.h"
+#include "crud_store.h"
 #include "config.h"
 #include "connection.h"
 #include "close_retry.h"
+#include "wrp_locator.h"
+#include "crud_subscribe.h"
+
+/* Longest dest accepted for a CRUD request */
+#define CRUD_DEST_MAX_LEN	256
 
-static void freeObjArray(char *(*obj)[], int size);
 static int writeIntoCrudJson(cJSON *res_obj, char * object, cJSON *objValue, int freeFlag);
-static int parse_dest_elements_to_string(wrp_msg_t *reqMsg, char *(*obj)[]);
-static char* strdupptr( const char *s, const char *e );
+static int parse_dest_elements_to_string(wrp_msg_t *reqMsg, char *(*obj)[], char *buf, size_t buflen);
 static int ConnDisconnectFromCloud(char *reason);
 static int validateDisconnectString(char *reason);
 
 int writeToJSON(char *data)
 {
-	FILE *fp;
-	fp = fopen(get_parodus_cfg()->crud_config_file , "w+");
-	if (fp == NULL)
-	{
-		ParodusError("Failed to open file %s\n", get_parodus_cfg()->crud_config_file );
-		return 0;
-	}
-	if(data !=NULL)
-	{
-		fwrite(data, strlen(data), 1, fp);
-		fclose(fp);
-		return 1;
-	}
-	else
+	if(data == NULL)
 	{
 		ParodusError("WriteToJson failed, Data is NULL\n");
 		return 0;
 	}
+	return crud_store_write(get_parodus_cfg()->crud_config_file, data,
+				get_parodus_cfg()->crud_store_format);
 }
 
 int readFromJSON(char **data)
 {
-	FILE *fp;
-	int ch_count = 0;
-	fp = fopen(get_parodus_cfg()->crud_config_file, "r+");
-	if (fp == NULL)
-	{
-		ParodusError("Failed to open file %s\n", get_parodus_cfg()->crud_config_file);
-		return 0;
-	}
-	fseek(fp, 0, SEEK_END);
-	ch_count = ftell(fp);
-	fseek(fp, 0, SEEK_SET);
-	*data = (char *) malloc(sizeof(char) * (ch_count + 1));
-	fread(*data, 1, ch_count,fp);
-	(*data)[ch_count] ='\0';
-	fclose(fp);
-	return 1;
+	return crud_store_read(get_parodus_cfg()->crud_config_file, data,
+			       get_parodus_cfg()->crud_store_format);
+}
+
+int migrateCrudStore(void)
+{
+	return crud_store_migrate(get_parodus_cfg()->crud_config_file,
+				  get_parodus_cfg()->crud_store_format);
 }
 /*
 *	@res_obj 	json object to add it in crud config json file
@@ -110,6 +95,7 @@ int createObject( wrp_msg_t *reqMsg , wrp_msg_t **response)
 {
 	cJSON *json, *jsonPayload = NULL;
 	char *obj[5];
+	char objbuf[CRUD_DEST_MAX_LEN];
 	int objlevel = 0, j=0, i =0;
 	char *jsonData = NULL;
 	cJSON *testObj1 = NULL;
@@ -169,7 +155,7 @@ int createObject( wrp_msg_t *reqMsg , wrp_msg_t **response)
 	{
 		ParodusInfo("reqMsg->u.crud.dest is %s\n", reqMsg->u.crud.dest);
 
-		objlevel = parse_dest_elements_to_string(reqMsg, &obj);
+		objlevel = parse_dest_elements_to_string(reqMsg, &obj, objbuf, sizeof(objbuf));
 		if(objlevel < 0)
 		{
 			(*response)->u.crud.status = 400;
@@ -214,7 +200,6 @@ int createObject( wrp_msg_t *reqMsg , wrp_msg_t **response)
 										jsonPayload = NULL;
 										cJSON_Delete(json);
 										json = NULL;
-										freeObjArray(&obj, objlevel);
 										return -1;
 									}
 									else
@@ -238,7 +223,6 @@ int createObject( wrp_msg_t *reqMsg , wrp_msg_t **response)
 							jsonPayload = NULL;
 							cJSON_Delete(json);
 							json = NULL;
-							freeObjArray(&obj, objlevel);
 							return -1;
 						}
 
@@ -253,7 +237,6 @@ int createObject( wrp_msg_t *reqMsg , wrp_msg_t **response)
 								jsonPayload = NULL;
 								cJSON_Delete(json);
 								json = NULL;
-								freeObjArray(&obj, objlevel);
 								return -1;
 							}
 							else
@@ -268,7 +251,6 @@ int createObject( wrp_msg_t *reqMsg , wrp_msg_t **response)
 										jsonPayload = NULL;
 										cJSON_Delete(json);
 										json = NULL;
-										freeObjArray(&obj, objlevel);
 										return -1;
 									}
 									else
@@ -303,7 +285,6 @@ int createObject( wrp_msg_t *reqMsg , wrp_msg_t **response)
 										jsonPayload = NULL;
 										cJSON_Delete(json);
 										json = NULL;
-										freeObjArray(&obj, objlevel);
 										return -1;
 									}
 									else
@@ -339,7 +320,6 @@ int createObject( wrp_msg_t *reqMsg , wrp_msg_t **response)
 										jsonPayload = NULL;
 										cJSON_Delete(json);
 										json = NULL;
-										freeObjArray(&obj, objlevel);
 										return -1;
 									}
 								}
@@ -400,7 +380,6 @@ int createObject( wrp_msg_t *reqMsg , wrp_msg_t **response)
 									jsonPayload = NULL;
 									cJSON_Delete(json);
 									json = NULL;
-									freeObjArray(&obj, objlevel);
 									return -1;
 								}
 							}
@@ -418,11 +397,11 @@ int createObject( wrp_msg_t *reqMsg , wrp_msg_t **response)
 						jsonPayload = NULL;
 						cJSON_Delete(json);
 						json = NULL;
-						freeObjArray(&obj, objlevel);
 
 						if(create_status == 1)
 						{
 							ParodusPrint("Data is successfully added to JSON\n");
+							crud_notify_change(obj[objlevel], NULL);
 						}
 						else
 						{
@@ -435,7 +414,6 @@ int createObject( wrp_msg_t *reqMsg , wrp_msg_t **response)
 					{
 						ParodusError("Invalid CREATE request, payload size is 0\n");
 						(*response)->u.crud.status = 400;
-						freeObjArray(&obj, objlevel);
 						cJSON_Delete( jsonPayload );
 						jsonPayload = NULL;
 						cJSON_Delete( json);
@@ -446,7 +424,6 @@ int createObject( wrp_msg_t *reqMsg , wrp_msg_t **response)
 				{
 					ParodusError("Invalid CREATE request, payload is not json\n");
 					(*response)->u.crud.status = 400;
-					freeObjArray(&obj, objlevel);
 					cJSON_Delete( json);
 					return -1;
 				}
@@ -455,7 +432,6 @@ int createObject( wrp_msg_t *reqMsg , wrp_msg_t **response)
 			{
 				ParodusError("Invalid CREATE request, payload is NULL\n");
 				(*response)->u.crud.status = 400;
-				freeObjArray(&obj, objlevel);
 				cJSON_Delete( json );
 				return -1;
 			}
@@ -465,7 +441,6 @@ int createObject( wrp_msg_t *reqMsg , wrp_msg_t **response)
 			//  Return error for request format other than parodus/tag/${name}
 			ParodusError("Invalid CREATE request\n");
 			(*response)->u.crud.status = 400;
-			freeObjArray(&obj, objlevel);
 			cJSON_Delete( json );
 			return -1;
 		}
@@ -635,6 +610,7 @@ int retrieveObject( wrp_msg_t *reqMsg, wrp_msg_t **response )
 	cJSON *json = NULL, *childObj = NULL, *subitemObj =NULL;
 	char *jsonData = NULL;
 	char *obj[5];
+	char objbuf[CRUD_DEST_MAX_LEN];
 	int objlevel = 0, i = 0, j=0, found = 0, status;
 	cJSON *inMemResponse = NULL;
 	int inMemStatus = -1, itemSize =0;
@@ -645,7 +621,7 @@ int retrieveObject( wrp_msg_t *reqMsg, wrp_msg_t **response )
 	{
 		ParodusInfo("reqMsg->u.crud.dest is %s\n", reqMsg->u.crud.dest);
 
-		objlevel = parse_dest_elements_to_string(reqMsg, &obj);
+		objlevel = parse_dest_elements_to_string(reqMsg, &obj, objbuf, sizeof(objbuf));
 		if(objlevel < 0)
 		{
 			(*response)->u.crud.status = 400;
@@ -668,14 +644,38 @@ int retrieveObject( wrp_msg_t *reqMsg, wrp_msg_t **response )
 				(*response)->u.crud.payload = inmem_str;
 				(*response)->u.crud.payload_size = strlen(inmem_str);
 				cJSON_Delete( inMemResponse );
-				freeObjArray(&obj, objlevel);
 			}
 			else
 			{
 				ParodusError("Failed to retrieve inMemory value \n");
 				(*response)->u.crud.status = 400;
 				cJSON_Delete( inMemResponse );
-				freeObjArray(&obj, objlevel);
+				return -1;
+			}
+		}
+		else if(objlevel == 4 && (obj[3] != NULL) && (strcmp(obj[3], "tag") == 0) &&
+			get_parodus_cfg()->crud_store_format == CRUD_STORE_FORMAT_MSGPACK)
+		{
+			// Indexed store, decode only the requested tag
+			status = crud_store_get_tag(get_parodus_cfg()->crud_config_file,
+						    obj[objlevel], &str1);
+			if(status > 0)
+			{
+				ParodusInfo( "jsonResponse %s\n", str1 );
+				(*response)->u.crud.status = 200;
+				(*response)->u.crud.payload = str1;
+				(*response)->u.crud.payload_size = strlen(str1);
+			}
+			else if(status == 0)
+			{
+				ParodusError("Unable to retrieve requested object\n");
+				(*response)->u.crud.status = 400;
+				return -1;
+			}
+			else
+			{
+				ParodusError("CRUD config %s is not available\n", get_parodus_cfg()->crud_config_file);
+				(*response)->u.crud.status = 500;
 				return -1;
 			}
 		}
@@ -704,7 +704,6 @@ int retrieveObject( wrp_msg_t *reqMsg, wrp_msg_t **response )
 							ParodusError("Parse Error before: %s\n", parse_error);
 						}
 						(*response)->u.crud.status = 500;
-						freeObjArray(&obj, objlevel);
 						return -1;
 					}
 					else
@@ -721,7 +720,6 @@ int retrieveObject( wrp_msg_t *reqMsg, wrp_msg_t **response )
 								(*response)->u.crud.status = 400;
 								cJSON_Delete( jsonresponse );
 								cJSON_Delete( json );
-								freeObjArray(&obj, objlevel);
 								return -1;
 							}
 							else
@@ -800,7 +798,6 @@ int retrieveObject( wrp_msg_t *reqMsg, wrp_msg_t **response )
 											(*response)->u.crud.status = 400;
 											cJSON_Delete( jsonresponse );
 											cJSON_Delete( json );
-											freeObjArray(&obj, objlevel);
 											return -1;
 										}
 
@@ -817,7 +814,6 @@ int retrieveObject( wrp_msg_t *reqMsg, wrp_msg_t **response )
 										(*response)->u.crud.status = 400;
 										cJSON_Delete( jsonresponse );
 										cJSON_Delete( json );
-										freeObjArray(&obj, objlevel);
 										return -1;
 									}
 								}
@@ -829,7 +825,6 @@ int retrieveObject( wrp_msg_t *reqMsg, wrp_msg_t **response )
 							(*response)->u.crud.status = 400;
 							cJSON_Delete( jsonresponse );
 							cJSON_Delete( json );
-							freeObjArray(&obj, objlevel);
 							return -1;
 						}
 						cJSON_Delete( jsonresponse );
@@ -840,7 +835,6 @@ int retrieveObject( wrp_msg_t *reqMsg, wrp_msg_t **response )
 				{
 					ParodusError("CRUD config %s is empty\n", get_parodus_cfg()->crud_config_file);
 					(*response)->u.crud.status = 500;
-					freeObjArray(&obj, objlevel);
 					return -1;
 				}
 			}
@@ -848,10 +842,8 @@ int retrieveObject( wrp_msg_t *reqMsg, wrp_msg_t **response )
 			{
 				ParodusError("CRUD config %s is not available\n", get_parodus_cfg()->crud_config_file);
 				(*response)->u.crud.status = 500;
-				freeObjArray(&obj, objlevel);
 				return -1;
 			}
-			freeObjArray(&obj, objlevel);
 		}
 	}
 	else
@@ -867,6 +859,7 @@ int updateObject( wrp_msg_t *reqMsg, wrp_msg_t **response )
 {
 	cJSON *json, *jsonPayload = NULL;
 	char *obj[5];
+	char objbuf[CRUD_DEST_MAX_LEN];
 	int objlevel = 0, j=0, i =0;
 	char *jsonData = NULL;
 	cJSON *testObj1 = NULL, *testObj2 = NULL;
@@ -924,7 +917,7 @@ int updateObject( wrp_msg_t *reqMsg, wrp_msg_t **response )
 	if(reqMsg->u.crud.dest !=NULL)
 	{
 		ParodusInfo("reqMsg->u.crud.dest is %s\n", reqMsg->u.crud.dest);
-		objlevel = parse_dest_elements_to_string(reqMsg, &obj);
+		objlevel = parse_dest_elements_to_string(reqMsg, &obj, objbuf, sizeof(objbuf));
 		if(objlevel < 0)
 		{
 			(*response)->u.crud.status = 400;
@@ -967,7 +960,6 @@ int updateObject( wrp_msg_t *reqMsg, wrp_msg_t **response )
 										jsonPayload = NULL;
 										cJSON_Delete(json);
 										json = NULL;
-										freeObjArray(&obj, objlevel);
 										return -1;
 									}
 									else
@@ -991,7 +983,6 @@ int updateObject( wrp_msg_t *reqMsg, wrp_msg_t **response )
 							jsonPayload = NULL;
 							cJSON_Delete(json);
 							json = NULL;
-							freeObjArray(&obj, objlevel);
 							return -1;
 						}
 
@@ -1006,7 +997,6 @@ int updateObject( wrp_msg_t *reqMsg, wrp_msg_t **response )
 								jsonPayload = NULL;
 								cJSON_Delete(json);
 								json = NULL;
-								freeObjArray(&obj, objlevel);
 								return -1;
 							}
 							else
@@ -1021,7 +1011,6 @@ int updateObject( wrp_msg_t *reqMsg, wrp_msg_t **response )
 										jsonPayload = NULL;
 										cJSON_Delete(json);
 										json = NULL;
-										freeObjArray(&obj, objlevel);
 										return -1;
 									}
 									else
@@ -1078,7 +1067,6 @@ int updateObject( wrp_msg_t *reqMsg, wrp_msg_t **response )
 												jsonPayload = NULL;
 												cJSON_Delete(json);
 												json = NULL;
-												freeObjArray(&obj, objlevel);
 												return -1;
 											}
 										}
@@ -1118,7 +1106,6 @@ int updateObject( wrp_msg_t *reqMsg, wrp_msg_t **response )
 										jsonPayload = NULL;
 										cJSON_Delete(json);
 										json = NULL;
-										freeObjArray(&obj, objlevel);
 										return -1;
 									}
 								}
@@ -1156,7 +1143,6 @@ int updateObject( wrp_msg_t *reqMsg, wrp_msg_t **response )
 									jsonPayload = NULL;
 									cJSON_Delete(json);
 									json = NULL;
-									freeObjArray(&obj, objlevel);
 									return -1;
 								}
 							}
@@ -1169,10 +1155,10 @@ int updateObject( wrp_msg_t *reqMsg, wrp_msg_t **response )
 						jsonPayload = NULL;
 						cJSON_Delete(json);
 						json = NULL;
-						freeObjArray(&obj, objlevel);
 						if(update_status == 1)
 						{
 							ParodusPrint("Data is successfully added to JSON\n");
+							crud_notify_change(obj[objlevel], NULL);
 						}
 						else
 						{
@@ -1185,7 +1171,6 @@ int updateObject( wrp_msg_t *reqMsg, wrp_msg_t **response )
 					{
 						ParodusError("Invalid UPDATE request, payload size is 0\n");
 						(*response)->u.crud.status = 400;
-						freeObjArray(&obj, objlevel);
 						cJSON_Delete( jsonPayload );
 						jsonPayload = NULL;
 						cJSON_Delete( json);
@@ -1196,7 +1181,6 @@ int updateObject( wrp_msg_t *reqMsg, wrp_msg_t **response )
 				{
 					ParodusError("Invalid UPDATE request, payload is not json\n");
 					(*response)->u.crud.status = 400;
-					freeObjArray(&obj, objlevel);
 					cJSON_Delete( json);
 					return -1;
 				}
@@ -1205,7 +1189,6 @@ int updateObject( wrp_msg_t *reqMsg, wrp_msg_t **response )
 			{
 				ParodusError("Invalid UPDATE request, payload is NULL\n");
 				(*response)->u.crud.status = 400;
-				freeObjArray(&obj, objlevel);
 				cJSON_Delete( json );
 				return -1;
 			}
@@ -1233,7 +1216,6 @@ int updateObject( wrp_msg_t *reqMsg, wrp_msg_t **response )
 									jsonPayload = NULL;
 									cJSON_Delete(json);
 									json = NULL;
-									freeObjArray(&obj, objlevel);
 									return -1;
 								}
 								else
@@ -1256,7 +1238,6 @@ int updateObject( wrp_msg_t *reqMsg, wrp_msg_t **response )
 										jsonPayload = NULL;
 										cJSON_Delete(json);
 										json = NULL;
-										freeObjArray(&obj, objlevel);
 										return -1;
 									}
 								}
@@ -1269,7 +1250,6 @@ int updateObject( wrp_msg_t *reqMsg, wrp_msg_t **response )
 								jsonPayload = NULL;
 								cJSON_Delete(json);
 								json = NULL;
-								freeObjArray(&obj, objlevel);
 								return -1;
 							}
 						}
@@ -1277,7 +1257,6 @@ int updateObject( wrp_msg_t *reqMsg, wrp_msg_t **response )
 						{
 							ParodusError("Invalid cloud-disconnect request, disconnection-reason not found\n");
 							(*response)->u.crud.status = 400;
-							freeObjArray(&obj, objlevel);
 							cJSON_Delete( jsonPayload );
 							jsonPayload = NULL;
 							cJSON_Delete( json);
@@ -1290,7 +1269,6 @@ int updateObject( wrp_msg_t *reqMsg, wrp_msg_t **response )
 					{
 						ParodusError("Invalid cloud-disconnect request, payload is not json\n");
 						(*response)->u.crud.status = 400;
-						freeObjArray(&obj, objlevel);
 						cJSON_Delete( json);
 						return -1;
 					}
@@ -1299,22 +1277,26 @@ int updateObject( wrp_msg_t *reqMsg, wrp_msg_t **response )
 				{
 					ParodusInfo("cloud-disconnect failed as payload is NULL\n");
 					(*response)->u.crud.status = 400;
-					freeObjArray(&obj, objlevel);
 					return -1;
 				}
 				char *reason = strdup(get_parodus_cfg()->cloud_disconnect);
+				cJSON *reasonObj = cJSON_CreateString(reason);
+				char *reasonValue = cJSON_PrintUnformatted(reasonObj);
+				cJSON_Delete(reasonObj);
 				disconnStatus = ConnDisconnectFromCloud(reason);
-				freeObjArray(&obj, objlevel);
 				cJSON_Delete( json );
 				if (disconnStatus >0)
 				{
 					ParodusInfo("Sending update response for cloud-disconnect\n");
 					(*response)->u.crud.status = 200;
+					crud_notify_change(CRUD_NOTIFY_CLOUD_DISCONNECT, reasonValue);
+					free(reasonValue);
 				}
 				else
 				{
 					ParodusInfo("Failure in disconnecting from cloud ..\n");
 					(*response)->u.crud.status = 500;
+					free(reasonValue);
 					return -1;
 				}
 			}
@@ -1323,7 +1305,6 @@ int updateObject( wrp_msg_t *reqMsg, wrp_msg_t **response )
 				//  Return error for request format other than parodus/tag/${name}
 				ParodusError("Invalid UPDATE request\n");
 				(*response)->u.crud.status = 400;
-				freeObjArray(&obj, objlevel);
 				cJSON_Delete( json );
 				return -1;
 			}
@@ -1363,6 +1344,7 @@ int deleteObject( wrp_msg_t *reqMsg, wrp_msg_t **response )
 	cJSON *paramArray = NULL, *json = NULL;
 	char *jsonData = NULL;
 	char *obj[5], *out = NULL;
+	char objbuf[CRUD_DEST_MAX_LEN];
 	int i = 0, status =0, objlevel=0, found =0;
 	int itemSize = 0, delete_status = 0;
 	const char *parse_error = NULL;
@@ -1394,7 +1376,7 @@ int deleteObject( wrp_msg_t *reqMsg, wrp_msg_t **response )
 				if(reqMsg->u.crud.dest !=NULL)
 				{
 					ParodusInfo("reqMsg->u.crud.dest is %s\n", reqMsg->u.crud.dest);
-					objlevel = parse_dest_elements_to_string(reqMsg, &obj);
+					objlevel = parse_dest_elements_to_string(reqMsg, &obj, objbuf, sizeof(objbuf));
 					if(objlevel < 0)
 					{
 						(*response)->u.crud.status = 400;
@@ -1416,7 +1398,6 @@ int deleteObject( wrp_msg_t *reqMsg, wrp_msg_t **response )
 							{
 								ParodusInfo("Invalid delete, tags object is empty in json\n");
 								(*response)->u.crud.status = 400;
-								freeObjArray(&obj, objlevel);
 								cJSON_Delete( json );
 								return -1;
 							}
@@ -1427,7 +1408,6 @@ int deleteObject( wrp_msg_t *reqMsg, wrp_msg_t **response )
 								{
 									ParodusInfo("Top level tags object delete not supported\n");
 									(*response)->u.crud.status = 400;
-									freeObjArray(&obj, objlevel);
 									cJSON_Delete( json );
 									return -1;
 								}
@@ -1450,7 +1430,6 @@ int deleteObject( wrp_msg_t *reqMsg, wrp_msg_t **response )
 									{
 										ParodusError("requested object not found\n");
 										(*response)->u.crud.status = 400;
-										freeObjArray(&obj, objlevel);
 										cJSON_Delete( json );
 										return -1;
 									}
@@ -1461,7 +1440,6 @@ int deleteObject( wrp_msg_t *reqMsg, wrp_msg_t **response )
 						{
 							ParodusError("Failed to DELETE object from json\n");
 							(*response)->u.crud.status = 400;
-							freeObjArray(&obj, objlevel);
 							cJSON_Delete( json );
 							return -1;
 						}
@@ -1471,11 +1449,9 @@ int deleteObject( wrp_msg_t *reqMsg, wrp_msg_t **response )
 						//  Return error for request format other than parodus/tag/${name}
 						ParodusError("Invalid DELETE request\n");
 						(*response)->u.crud.status = 400;
-						freeObjArray(&obj, objlevel);
 						cJSON_Delete( json );
 						return -1;
 					}
-					freeObjArray(&obj, objlevel);
 				}
 				else
 				{
@@ -1505,6 +1481,7 @@ int deleteObject( wrp_msg_t *reqMsg, wrp_msg_t **response )
 	if(delete_status == 1)
 	{
 		ParodusPrint("Deleted Data is successfully updated to JSON\n");
+		crud_notify_change(obj[objlevel], NULL);
 	}
 	else
 	{
@@ -1518,90 +1495,57 @@ int deleteObject( wrp_msg_t *reqMsg, wrp_msg_t **response )
 	return 0;
 }
 
-static void freeObjArray(char *(*obj)[], int size){
-	int i;
-	for (i = 0; i <= size; i++)
-	{
-		ParodusPrint("Freeing Object: %s\n",(*obj)[i]);
-		free((*obj)[i]);
-		(*obj)[i] = NULL;
-	}
-}
-
-static int parse_dest_elements_to_string(wrp_msg_t *reqMsg, char *(*obj)[])
+static int parse_dest_elements_to_string(wrp_msg_t *reqMsg, char *(*obj)[], char *buf, size_t buflen)
 {
 		int i =0, rv = -1;
-		char *start = NULL, *end = NULL;
-
-		/* To extract dest elements till wrp application field (mac:44aaf59b18xx/parodus/tags)
-		and store it in obj array */
+		size_t off = 0;
+		wrp_locator_t loc;
+		const wrp_slice_t *elem[5];
 
-		for( i = 0; i <= WRP_ID_ELEMENT__APPLICATION; i++ )
+		for( i = 0; i < 5; i++ )
 		{
-			(*obj)[i] =  wrp_get_msg_element(i, reqMsg, DEST);
-			if((*obj)[i] ==NULL)
-			{
-				break;
-			}
-			ParodusPrint("(*obj)[%d] is %s \n", i, (*obj)[i]);
-			rv = i;
+			(*obj)[i] = NULL;
 		}
 
-	   /* To break down individual dest elements from application field if any.
-	   e.g. application element tags/test to tags and test & store it in obj array. */
+		/* Dest elements (mac:44aaf59b18xx/parodus/tag/test) are copied NUL
+		   terminated into buf, one after the other, and pointed to by obj */
 
-		start = (*obj)[rv];
-		end = strchr(start, '/');
-		if (NULL != end)
+		if(wrp_locator_parse(reqMsg->u.crud.dest, &loc) != 0)
 		{
-			char *testElem = NULL;
-			char *tagElem = NULL;
-
-			tagElem = strdupptr(start, end);
-			ParodusPrint("tagElem is %s\n",tagElem);
-
-			start = end;
-			start++;
+			return -1;
+		}
+		elem[0] = &loc.scheme;
+		elem[1] = &loc.device;
+		elem[2] = &loc.service;
+		elem[3] = &loc.application;
+		elem[4] = &loc.sub_path;
 
-			end = strchr(start, '/');
-			if (NULL == end)
+		for( i = 0; i < 5; i++ )
+		{
+			if(elem[i]->len == 0)
 			{
-				testElem = strdup(start);
-				ParodusPrint("testElem is %s\n", testElem);
+				break;
 			}
-			else
+			if(off + elem[i]->len + 1 > buflen)
 			{
-				ParodusError("Unsupported dest format for CRUD\n");
-				freeObjArray(obj, rv);
-				rv = -1;
+				ParodusError("CRUD dest is too long\n");
+				return -1;
 			}
+			(*obj)[i] = buf + off;
+			off += wrp_slice_copy(elem[i], buf + off, buflen - off) + 1;
+			ParodusPrint("(*obj)[%d] is %s \n", i, (*obj)[i]);
+			rv = i;
+		}
 
-			if(rv != -1)
-			{
-				//Reuse array of pointer
-				free((*obj)[rv]);
-				(*obj)[rv] = NULL;
-				(*obj)[rv] = tagElem;
-				(*obj)[++rv] = testElem;
-			}
-			else if (tagElem != NULL)
-			{
-				free(tagElem);
-			}
+		if(rv == 4 && memchr(loc.sub_path.ptr, '/', loc.sub_path.len) != NULL)
+		{
+			ParodusError("Unsupported dest format for CRUD\n");
+			rv = -1;
 		}
 
 		return rv;
 }
 
-static char* strdupptr( const char *s, const char *e )
-{
-    if (s == e) {
-        return NULL;
-    }
-
-    return strndup(s, (size_t) (((uintptr_t)e) - ((uintptr_t)s)));
-}
-
 static int validateDisconnectString(char *reason)
 {
 	int k=0, rv =1;
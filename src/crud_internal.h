@@ -24,4 +24,6 @@ int deleteObject(wrp_msg_t *reqMsg, wrp_msg_t **response);
 
 int writeToJSON(char *data);
 int readFromJSON(char **data);
+/* converts a JSON store to msgpack; call from the writer thread only */
+int migrateCrudStore(void);
 int retrieveFromMemory(char *keyName, cJSON **jsonresponse);
@@ -0,0 +1,854 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/**
+ * @file crud_store.c
+ *
+ * @description Snapshot based access to the CRUD config file.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <cJSON.h>
+#include <msgpack.h>
+#include "ParodusInternal.h"
+#include "crud_store.h"
+
+/*----------------------------------------------------------------------------*/
+/*                                   Macros                                   */
+/*----------------------------------------------------------------------------*/
+
+#define STORE_HEADER_LEN		12
+#define STORE_FLAG_HAS_TAGS		0x01
+
+/*----------------------------------------------------------------------------*/
+/*                               Data Structures                              */
+/*----------------------------------------------------------------------------*/
+
+typedef struct crud_snapshot__
+{
+	int refcount;
+	char *path;
+	dev_t dev;
+	ino_t ino;
+	off_t size;
+	struct timespec mtime;
+	size_t len;
+	char *data;		/* JSON rendering, built on first use for msgpack stores */
+	size_t bin_len;
+	char *bin;		/* raw msgpack store, NULL for JSON files */
+} crud_snapshot_t;
+
+/*----------------------------------------------------------------------------*/
+/*                            File Scoped Variables                           */
+/*----------------------------------------------------------------------------*/
+
+static crud_snapshot_t *g_snapshot = NULL;
+
+/* Guards g_snapshot and the refcounts, held only for pointer swaps */
+static pthread_mutex_t snapshot_mut = PTHREAD_MUTEX_INITIALIZER;
+
+/* Serializes writers so renames are published in order */
+static pthread_mutex_t write_mut = PTHREAD_MUTEX_INITIALIZER;
+
+/*----------------------------------------------------------------------------*/
+/*                             Internal Functions                             */
+/*----------------------------------------------------------------------------*/
+
+static void snapshot_release(crud_snapshot_t *snap)
+{
+	int refcount;
+
+	if(snap == NULL)
+	{
+		return;
+	}
+	pthread_mutex_lock(&snapshot_mut);
+	refcount = --snap->refcount;
+	pthread_mutex_unlock(&snapshot_mut);
+
+	if(refcount == 0)
+	{
+		free(snap->path);
+		free(snap->data);
+		free(snap->bin);
+		free(snap);
+	}
+}
+
+static crud_snapshot_t *snapshot_new(const char *path, const struct stat *st)
+{
+	crud_snapshot_t *snap = (crud_snapshot_t *) calloc(1, sizeof(crud_snapshot_t));
+
+	if(snap == NULL)
+	{
+		return NULL;
+	}
+	snap->path = strdup(path);
+	if(snap->path == NULL)
+	{
+		free(snap);
+		return NULL;
+	}
+	snap->refcount = 1;
+	snap->dev = st->st_dev;
+	snap->ino = st->st_ino;
+	snap->size = st->st_size;
+	snap->mtime = st->st_mtim;
+	return snap;
+}
+
+static int snapshot_matches(const crud_snapshot_t *snap, const char *path,
+			    const struct stat *st)
+{
+	return (snap != NULL) &&
+		(strcmp(snap->path, path) == 0) &&
+		(snap->dev == st->st_dev) &&
+		(snap->ino == st->st_ino) &&
+		(snap->size == st->st_size) &&
+		(snap->mtime.tv_sec == st->st_mtim.tv_sec) &&
+		(snap->mtime.tv_nsec == st->st_mtim.tv_nsec);
+}
+
+/* Takes ownership of the caller's reference on snap */
+static void snapshot_publish(crud_snapshot_t *snap)
+{
+	crud_snapshot_t *old;
+
+	pthread_mutex_lock(&snapshot_mut);
+	old = g_snapshot;
+	g_snapshot = snap;
+	pthread_mutex_unlock(&snapshot_mut);
+
+	snapshot_release(old);
+}
+
+static crud_snapshot_t *snapshot_acquire(const char *path, const struct stat *st)
+{
+	crud_snapshot_t *snap = NULL;
+
+	pthread_mutex_lock(&snapshot_mut);
+	if(snapshot_matches(g_snapshot, path, st))
+	{
+		snap = g_snapshot;
+		snap->refcount++;
+	}
+	pthread_mutex_unlock(&snapshot_mut);
+	return snap;
+}
+
+static char *read_file(const char *path, size_t *len)
+{
+	FILE *fp;
+	long ch_count = 0;
+	char *buf;
+
+	fp = fopen(path, "r");
+	if(fp == NULL)
+	{
+		ParodusError("Failed to open file %s\n", path);
+		return NULL;
+	}
+	fseek(fp, 0, SEEK_END);
+	ch_count = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	if(ch_count < 0)
+	{
+		fclose(fp);
+		return NULL;
+	}
+	buf = (char *) malloc(sizeof(char) * (ch_count + 1));
+	if(buf != NULL)
+	{
+		*len = fread(buf, 1, ch_count, fp);
+		buf[*len] = '\0';
+	}
+	fclose(fp);
+	return buf;
+}
+
+static int write_file(const char *path, const char *buf, size_t len)
+{
+	FILE *fp;
+	char *tmp_path = NULL;
+	size_t written;
+
+	if(asprintf(&tmp_path, "%s.tmp", path) < 0)
+	{
+		return 0;
+	}
+	fp = fopen(tmp_path, "w");
+	if(fp == NULL)
+	{
+		ParodusError("Failed to open file %s\n", tmp_path);
+		free(tmp_path);
+		return 0;
+	}
+	written = fwrite(buf, 1, len, fp);
+	fflush(fp);
+	fsync(fileno(fp));
+	fclose(fp);
+
+	if(written != len || rename(tmp_path, path) != 0)
+	{
+		ParodusError("Failed to write file %s\n", path);
+		unlink(tmp_path);
+		free(tmp_path);
+		return 0;
+	}
+	free(tmp_path);
+	return 1;
+}
+
+/*----------------------------------------------------------------------------*/
+/*                         msgpack store encode/decode                        */
+/*----------------------------------------------------------------------------*/
+
+static int is_binary_store(const char *buf, size_t len)
+{
+	return (len >= STORE_HEADER_LEN) &&
+		(memcmp(buf, CRUD_STORE_MAGIC, 4) == 0);
+}
+
+static void pack_json(msgpack_packer *pk, const cJSON *item)
+{
+	const cJSON *child;
+	size_t n = 0;
+
+	switch(item->type & 0xFF)
+	{
+		case cJSON_False:
+			msgpack_pack_false(pk);
+			break;
+		case cJSON_True:
+			msgpack_pack_true(pk);
+			break;
+		case cJSON_Number:
+			if(item->valuedouble > -9.2e18 && item->valuedouble < 9.2e18 &&
+			   item->valuedouble == (double) (int64_t) item->valuedouble)
+			{
+				msgpack_pack_int64(pk, (int64_t) item->valuedouble);
+			}
+			else
+			{
+				msgpack_pack_double(pk, item->valuedouble);
+			}
+			break;
+		case cJSON_String:
+			n = strlen(item->valuestring);
+			msgpack_pack_str(pk, n);
+			msgpack_pack_str_body(pk, item->valuestring, n);
+			break;
+		case cJSON_Array:
+		case cJSON_Object:
+			for(child = item->child; child != NULL; child = child->next)
+			{
+				n++;
+			}
+			if((item->type & 0xFF) == cJSON_Array)
+			{
+				msgpack_pack_array(pk, n);
+			}
+			else
+			{
+				msgpack_pack_map(pk, n);
+			}
+			for(child = item->child; child != NULL; child = child->next)
+			{
+				if((item->type & 0xFF) == cJSON_Object)
+				{
+					size_t klen = strlen(child->string);
+					msgpack_pack_str(pk, klen);
+					msgpack_pack_str_body(pk, child->string, klen);
+				}
+				pack_json(pk, child);
+			}
+			break;
+		default:
+			msgpack_pack_nil(pk);
+			break;
+	}
+}
+
+static cJSON *unpack_json(const msgpack_object *obj)
+{
+	cJSON *item = NULL, *child;
+	char *str;
+	uint32_t i;
+
+	switch(obj->type)
+	{
+		case MSGPACK_OBJECT_BOOLEAN:
+			return cJSON_CreateBool(obj->via.boolean);
+		case MSGPACK_OBJECT_POSITIVE_INTEGER:
+			return cJSON_CreateNumber((double) obj->via.u64);
+		case MSGPACK_OBJECT_NEGATIVE_INTEGER:
+			return cJSON_CreateNumber((double) obj->via.i64);
+		case MSGPACK_OBJECT_FLOAT32:
+		case MSGPACK_OBJECT_FLOAT64:
+			return cJSON_CreateNumber(obj->via.f64);
+		case MSGPACK_OBJECT_STR:
+			str = strndup(obj->via.str.ptr, obj->via.str.size);
+			if(str != NULL)
+			{
+				item = cJSON_CreateString(str);
+				free(str);
+			}
+			return item;
+		case MSGPACK_OBJECT_ARRAY:
+			item = cJSON_CreateArray();
+			for(i = 0; item != NULL && i < obj->via.array.size; i++)
+			{
+				child = unpack_json(&obj->via.array.ptr[i]);
+				if(child == NULL)
+				{
+					cJSON_Delete(item);
+					return NULL;
+				}
+				cJSON_AddItemToArray(item, child);
+			}
+			return item;
+		case MSGPACK_OBJECT_MAP:
+			item = cJSON_CreateObject();
+			for(i = 0; item != NULL && i < obj->via.map.size; i++)
+			{
+				const msgpack_object *key = &obj->via.map.ptr[i].key;
+
+				child = NULL;
+				str = NULL;
+				if(key->type == MSGPACK_OBJECT_STR)
+				{
+					str = strndup(key->via.str.ptr, key->via.str.size);
+					child = unpack_json(&obj->via.map.ptr[i].val);
+				}
+				if(str == NULL || child == NULL)
+				{
+					free(str);
+					cJSON_Delete(child);
+					cJSON_Delete(item);
+					return NULL;
+				}
+				cJSON_AddItemToObject(item, str, child);
+				free(str);
+			}
+			return item;
+		default:
+			return cJSON_CreateNull();
+	}
+}
+
+/* Encode a {"tags":{...}} document into the indexed msgpack store */
+static char *encode_store(const char *json_text, size_t *out_len)
+{
+	cJSON *json, *tags = NULL, *tag;
+	msgpack_sbuffer values;
+	msgpack_packer pk;
+	uint32_t count = 0, index_len = 0, val_start, val_off, u32;
+	uint16_t u16;
+	uint8_t flags = 0;
+	size_t name_len;
+	char *buf = NULL, *p;
+
+	json = cJSON_Parse(json_text);
+	if(json == NULL || (json->type & 0xFF) != cJSON_Object)
+	{
+		ParodusError("CRUD store document is not a JSON object\n");
+		cJSON_Delete(json);
+		return NULL;
+	}
+	for(tag = json->child; tag != NULL; tag = tag->next)
+	{
+		if(strcmp(tag->string, "tags") != 0 || (tag->type & 0xFF) != cJSON_Object)
+		{
+			ParodusError("Unsupported member %s in CRUD store document\n", tag->string);
+			cJSON_Delete(json);
+			return NULL;
+		}
+		tags = tag;
+		flags |= STORE_FLAG_HAS_TAGS;
+	}
+
+	for(tag = (tags ? tags->child : NULL); tag != NULL; tag = tag->next)
+	{
+		name_len = strlen(tag->string);
+		if(name_len > UINT16_MAX)
+		{
+			cJSON_Delete(json);
+			return NULL;
+		}
+		count++;
+		index_len += 2 + name_len + 4 + 4;
+	}
+
+	msgpack_sbuffer_init(&values);
+	msgpack_packer_init(&pk, &values, msgpack_sbuffer_write);
+
+	val_start = STORE_HEADER_LEN + index_len;
+	buf = (char *) malloc(val_start);
+	if(buf != NULL)
+	{
+		memcpy(buf, CRUD_STORE_MAGIC, 4);
+		buf[4] = CRUD_STORE_VERSION;
+		buf[5] = flags;
+		buf[6] = buf[7] = 0;
+		u32 = htonl(count);
+		memcpy(buf + 8, &u32, 4);
+
+		p = buf + STORE_HEADER_LEN;
+		for(tag = (tags ? tags->child : NULL); tag != NULL; tag = tag->next)
+		{
+			val_off = val_start + values.size;
+			pack_json(&pk, tag);
+
+			name_len = strlen(tag->string);
+			u16 = htons((uint16_t) name_len);
+			memcpy(p, &u16, 2);
+			memcpy(p + 2, tag->string, name_len);
+			p += 2 + name_len;
+			u32 = htonl(val_off);
+			memcpy(p, &u32, 4);
+			u32 = htonl((uint32_t) (val_start + values.size - val_off));
+			memcpy(p + 4, &u32, 4);
+			p += 8;
+		}
+
+		p = (char *) realloc(buf, val_start + values.size);
+		if(p != NULL)
+		{
+			buf = p;
+			memcpy(buf + val_start, values.data, values.size);
+			*out_len = val_start + values.size;
+		}
+		else
+		{
+			free(buf);
+			buf = NULL;
+		}
+	}
+	msgpack_sbuffer_destroy(&values);
+	cJSON_Delete(json);
+	return buf;
+}
+
+/*
+ * Walk the index calling fn for each entry until it returns non-zero.
+ * Returns fn's result, 0 when the walk completed, -1 on a corrupt store.
+ */
+static int walk_index(const char *bin, size_t bin_len,
+		      int (*fn)(const char *name, size_t name_len,
+				const char *val, size_t val_len, void *arg),
+		      void *arg)
+{
+	uint32_t count, i, val_off, val_len;
+	uint16_t name_len;
+	size_t pos = STORE_HEADER_LEN;
+	int rv;
+
+	if(!is_binary_store(bin, bin_len) || bin[4] != CRUD_STORE_VERSION)
+	{
+		ParodusError("Unsupported CRUD store version\n");
+		return -1;
+	}
+	memcpy(&count, bin + 8, 4);
+	count = ntohl(count);
+
+	for(i = 0; i < count; i++)
+	{
+		if(pos + 2 > bin_len)
+		{
+			return -1;
+		}
+		memcpy(&name_len, bin + pos, 2);
+		name_len = ntohs(name_len);
+		if(pos + 2 + name_len + 8 > bin_len)
+		{
+			return -1;
+		}
+		memcpy(&val_off, bin + pos + 2 + name_len, 4);
+		memcpy(&val_len, bin + pos + 2 + name_len + 4, 4);
+		val_off = ntohl(val_off);
+		val_len = ntohl(val_len);
+		if((size_t) val_off + val_len > bin_len)
+		{
+			return -1;
+		}
+		rv = fn(bin + pos + 2, name_len, bin + val_off, val_len, arg);
+		if(rv != 0)
+		{
+			return rv;
+		}
+		pos += 2 + name_len + 8;
+	}
+	return 0;
+}
+
+static cJSON *decode_value(const char *val, size_t val_len)
+{
+	msgpack_unpacked result;
+	size_t off = 0;
+	cJSON *item = NULL;
+
+	msgpack_unpacked_init(&result);
+	if(msgpack_unpack_next(&result, val, val_len, &off) == MSGPACK_UNPACK_SUCCESS)
+	{
+		item = unpack_json(&result.data);
+	}
+	msgpack_unpacked_destroy(&result);
+	return item;
+}
+
+static int render_entry(const char *name, size_t name_len,
+			const char *val, size_t val_len, void *arg)
+{
+	cJSON *tags = (cJSON *) arg;
+	cJSON *item;
+	char *key;
+
+	item = decode_value(val, val_len);
+	key = strndup(name, name_len);
+	if(item == NULL || key == NULL)
+	{
+		cJSON_Delete(item);
+		free(key);
+		return -1;
+	}
+	cJSON_AddItemToObject(tags, key, item);
+	free(key);
+	return 0;
+}
+
+/* Render the whole msgpack store back into the JSON document */
+static char *decode_store(const char *bin, size_t bin_len)
+{
+	cJSON *json, *tags;
+	char *out = NULL;
+
+	json = cJSON_CreateObject();
+	if(json == NULL)
+	{
+		return NULL;
+	}
+	if(bin_len >= STORE_HEADER_LEN && (bin[5] & STORE_FLAG_HAS_TAGS))
+	{
+		tags = cJSON_CreateObject();
+		cJSON_AddItemToObject(json, "tags", tags);
+		if(walk_index(bin, bin_len, render_entry, tags) != 0)
+		{
+			ParodusError("Corrupt CRUD store\n");
+			cJSON_Delete(json);
+			return NULL;
+		}
+	}
+	out = cJSON_PrintUnformatted(json);
+	cJSON_Delete(json);
+	return out;
+}
+
+typedef struct
+{
+	const char *name;
+	size_t name_len;
+	cJSON *item;
+} tag_lookup_t;
+
+static int lookup_entry(const char *name, size_t name_len,
+			const char *val, size_t val_len, void *arg)
+{
+	tag_lookup_t *lookup = (tag_lookup_t *) arg;
+
+	if(name_len != lookup->name_len || memcmp(name, lookup->name, name_len) != 0)
+	{
+		return 0;
+	}
+	lookup->item = decode_value(val, val_len);
+	return (lookup->item != NULL) ? 1 : -1;
+}
+
+/*
+ * Return a referenced snapshot of path, reading the file and publishing
+ * a new snapshot if the published one is stale. NULL if unreadable.
+ */
+static crud_snapshot_t *snapshot_load(const char *path)
+{
+	struct stat st;
+	crud_snapshot_t *snap;
+	char *buf;
+	size_t len = 0;
+
+	if(stat(path, &st) != 0)
+	{
+		ParodusError("Failed to open file %s\n", path);
+		return NULL;
+	}
+
+	snap = snapshot_acquire(path, &st);
+	if(snap != NULL)
+	{
+		return snap;
+	}
+
+	buf = read_file(path, &len);
+	if(buf == NULL)
+	{
+		return NULL;
+	}
+	snap = snapshot_new(path, &st);
+	if(snap == NULL)
+	{
+		free(buf);
+		return NULL;
+	}
+	if(is_binary_store(buf, len))
+	{
+		snap->bin = buf;
+		snap->bin_len = len;
+	}
+	else
+	{
+		snap->data = buf;
+		snap->len = len;
+	}
+
+	/* Only publish if the file did not change while it was read */
+	if(len == (size_t) st.st_size)
+	{
+		snap->refcount++;
+		snapshot_publish(snap);
+	}
+	return snap;
+}
+
+/* Make sure a msgpack snapshot carries its JSON rendering */
+static int snapshot_render(crud_snapshot_t *snap)
+{
+	char *out;
+
+	pthread_mutex_lock(&snapshot_mut);
+	out = snap->data;
+	pthread_mutex_unlock(&snapshot_mut);
+	if(out != NULL)
+	{
+		return 1;
+	}
+
+	out = decode_store(snap->bin, snap->bin_len);
+	if(out == NULL)
+	{
+		return 0;
+	}
+	pthread_mutex_lock(&snapshot_mut);
+	if(snap->data == NULL)
+	{
+		snap->data = out;
+		snap->len = strlen(out);
+		out = NULL;
+	}
+	pthread_mutex_unlock(&snapshot_mut);
+	free(out);
+	return 1;
+}
+
+/*----------------------------------------------------------------------------*/
+/*                             External Functions                             */
+/*----------------------------------------------------------------------------*/
+
+int crud_store_write(const char *path, const char *data, int format)
+{
+	char *bin = NULL;
+	char *copy = NULL;
+	size_t len, bin_len = 0;
+	struct stat st;
+	crud_snapshot_t *snap;
+	int rv;
+
+	if(path == NULL || data == NULL)
+	{
+		ParodusError("crud_store_write failed, path or data is NULL\n");
+		return 0;
+	}
+	len = strlen(data);
+
+	if(format == CRUD_STORE_FORMAT_MSGPACK)
+	{
+		bin = encode_store(data, &bin_len);
+		if(bin == NULL)
+		{
+			ParodusError("Failed to encode CRUD store\n");
+			return 0;
+		}
+	}
+
+	pthread_mutex_lock(&write_mut);
+	if(bin != NULL)
+	{
+		rv = write_file(path, bin, bin_len);
+	}
+	else
+	{
+		rv = write_file(path, data, len);
+	}
+
+	/* Publish what was just written so readers don't go back to disk */
+	copy = (char *) malloc(len + 1);
+	if(rv && copy != NULL && stat(path, &st) == 0)
+	{
+		snap = snapshot_new(path, &st);
+		if(snap != NULL)
+		{
+			memcpy(copy, data, len + 1);
+			snap->data = copy;
+			snap->len = len;
+			snap->bin = bin;
+			snap->bin_len = bin_len;
+			snapshot_publish(snap);
+			copy = NULL;
+			bin = NULL;
+		}
+	}
+	pthread_mutex_unlock(&write_mut);
+	free(copy);
+	free(bin);
+	return rv;
+}
+
+int crud_store_read(const char *path, char **data, int format)
+{
+	crud_snapshot_t *snap;
+
+	if(path == NULL || data == NULL)
+	{
+		ParodusError("crud_store_read failed, path or data is NULL\n");
+		return 0;
+	}
+
+	snap = snapshot_load(path);
+	if(snap == NULL)
+	{
+		return 0;
+	}
+	if(snap->bin != NULL && !snapshot_render(snap))
+	{
+		snapshot_release(snap);
+		return 0;
+	}
+
+	*data = (char *) malloc(snap->len + 1);
+	if(*data != NULL)
+	{
+		memcpy(*data, snap->data, snap->len + 1);
+	}
+	snapshot_release(snap);
+	return (*data != NULL) ? 1 : 0;
+}
+
+int crud_store_migrate(const char *path, int format)
+{
+	struct stat st;
+	char *buf, *bin = NULL;
+	size_t len = 0, bin_len = 0;
+	int rv = 0;
+
+	if(path == NULL || format != CRUD_STORE_FORMAT_MSGPACK || stat(path, &st) != 0)
+	{
+		return 0;
+	}
+
+	/* Read and replaced under write_mut, so no write can come in between */
+	pthread_mutex_lock(&write_mut);
+	buf = read_file(path, &len);
+	if(buf != NULL && !is_binary_store(buf, len))
+	{
+		bin = encode_store(buf, &bin_len);
+		rv = (bin != NULL) && write_file(path, bin, bin_len);
+	}
+	pthread_mutex_unlock(&write_mut);
+	free(buf);
+	free(bin);
+	if(rv)
+	{
+		ParodusInfo("Migrated CRUD config %s to msgpack store\n", path);
+	}
+	return rv;
+}
+
+int crud_store_get_tag(const char *path, const char *name, char **value)
+{
+	crud_snapshot_t *snap;
+	tag_lookup_t lookup;
+	cJSON *json, *tags, *tag;
+	int rv;
+
+	if(path == NULL || name == NULL || value == NULL)
+	{
+		return -1;
+	}
+
+	snap = snapshot_load(path);
+	if(snap == NULL)
+	{
+		return -1;
+	}
+
+	*value = NULL;
+	if(snap->bin != NULL)
+	{
+		lookup.name = name;
+		lookup.name_len = strlen(name);
+		lookup.item = NULL;
+		rv = walk_index(snap->bin, snap->bin_len, lookup_entry, &lookup);
+		if(rv > 0)
+		{
+			*value = cJSON_PrintUnformatted(lookup.item);
+			cJSON_Delete(lookup.item);
+		}
+	}
+	else
+	{
+		rv = -1;
+		json = cJSON_Parse(snap->data);
+		if(json != NULL)
+		{
+			rv = 0;
+			tags = cJSON_GetObjectItem(json, "tags");
+			tag = (tags != NULL) ? cJSON_GetObjectItem(tags, name) : NULL;
+			if(tag != NULL)
+			{
+				*value = cJSON_PrintUnformatted(tag);
+				rv = 1;
+			}
+			cJSON_Delete(json);
+		}
+	}
+	snapshot_release(snap);
+
+	if(rv > 0)
+	{
+		return (*value != NULL) ? 1 : -1;
+	}
+	return rv;
+}
+
+void crud_store_reset(void)
+{
+	snapshot_publish(NULL);
+}
@@ -0,0 +1,127 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/**
+ * @file crud_store.h
+ *
+ * @description Snapshot based access to the CRUD config file. Readers
+ *              share an immutable in-memory copy of the file while writers
+ *              are serialized and publish a new copy atomically.
+ *
+ *              The file is either the JSON document itself or a versioned
+ *              msgpack store. The msgpack store starts with an index of tag
+ *              names so a single tag can be decoded without the rest:
+ *
+ *              "PCRD" | version (1) | flags (1) | reserved (2) | count (4)
+ *              count x { name_len (2) | name | value_off (4) | value_len (4) }
+ *              values, each one a msgpack encoding of the tag object
+ *
+ *              All integers are in network byte order and offsets are from
+ *              the start of the file.
+ *
+ */
+
+#ifndef _CRUD_STORE_H_
+#define _CRUD_STORE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*----------------------------------------------------------------------------*/
+/*                                   Macros                                   */
+/*----------------------------------------------------------------------------*/
+
+/* On-disk formats, selects what crud_store_write() produces */
+#define CRUD_STORE_FORMAT_JSON		0
+#define CRUD_STORE_FORMAT_MSGPACK	1
+
+#define CRUD_STORE_MAGIC		"PCRD"
+#define CRUD_STORE_VERSION		1
+
+/*----------------------------------------------------------------------------*/
+/*                             Function Prototypes                            */
+/*----------------------------------------------------------------------------*/
+
+/**
+ * Replace the contents of the store file with data.
+ *
+ * The new contents are written to a temporary file and renamed into place,
+ * so concurrent readers either see the old or the new document, never a
+ * partially written one.
+ *
+ * @param path file to write
+ * @param data NUL terminated JSON document
+ * @param format CRUD_STORE_FORMAT_JSON or CRUD_STORE_FORMAT_MSGPACK
+ *
+ * @return 1 on success, 0 on failure
+ */
+int crud_store_write(const char *path, const char *data, int format);
+
+/**
+ * Get a private copy of the current contents of the store file.
+ *
+ * The copy is served from the published snapshot when the file on disk is
+ * unchanged since it was taken, otherwise the file is read and a new
+ * snapshot is published. Either on-disk format is accepted and returned
+ * as JSON. Readers never write: a JSON file found while format is
+ * CRUD_STORE_FORMAT_MSGPACK is served as is until crud_store_migrate()
+ * or the next write replaces it.
+ *
+ * @param path file to read
+ * @param data returns malloc'd NUL terminated document, caller frees
+ * @param format configured on-disk format
+ *
+ * @return 1 on success, 0 on failure
+ */
+int crud_store_read(const char *path, char **data, int format);
+
+/**
+ * Convert a JSON store file to the msgpack store, once, from the writer's
+ * side: the file is read and replaced while writes are held off.
+ *
+ * @param path file to convert
+ * @param format configured on-disk format, nothing is done unless it is
+ *               CRUD_STORE_FORMAT_MSGPACK
+ *
+ * @return 1 if the file was converted, 0 otherwise
+ */
+int crud_store_migrate(const char *path, int format);
+
+/**
+ * Get a single tag object as JSON.
+ *
+ * With the msgpack store only the index and the requested value are
+ * decoded.
+ *
+ * @param path file to read
+ * @param name tag name
+ * @param value returns malloc'd JSON object, caller frees
+ *
+ * @return 1 if found, 0 if not found, -1 if the store is not readable
+ */
+int crud_store_get_tag(const char *path, const char *name, char **value);
+
+/**
+ * Drop the published snapshot.
+ */
+void crud_store_reset(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _CRUD_STORE_H_ */
@@ -0,0 +1,487 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/**
+ * @file crud_subscribe.c
+ *
+ * @description Change notifications for CRUD objects.
+ *
+ */
+
+#include <time.h>
+#include "ParodusInternal.h"
+#include "config.h"
+#include "client_list.h"
+#include "crud_store.h"
+#include "crud_subscribe.h"
+#include "wrp_locator.h"
+
+/*----------------------------------------------------------------------------*/
+/*                                   Macros                                   */
+/*----------------------------------------------------------------------------*/
+#define CRUD_NOTIFY_NAME_LEN		64
+
+/*----------------------------------------------------------------------------*/
+/*                               Data Structures                              */
+/*----------------------------------------------------------------------------*/
+typedef struct CrudSubscriber__
+{
+	char service[32];
+	char name[CRUD_NOTIFY_NAME_LEN];
+	struct CrudSubscriber__ *next;
+} CrudSubscriber;
+
+/* Services to notify of one change, copied out of the subscriber list */
+typedef struct CrudRecipient__
+{
+	char service[32];
+	struct CrudRecipient__ *next;
+} CrudRecipient;
+
+typedef struct CrudChange__
+{
+	char name[CRUD_NOTIFY_NAME_LEN];
+	char *value;
+	struct CrudChange__ *next;
+} CrudChange;
+
+/*----------------------------------------------------------------------------*/
+/*                            File Scoped Variables                           */
+/*----------------------------------------------------------------------------*/
+static CrudSubscriber *subscribers = NULL;
+static pthread_mutex_t subscribe_mut = PTHREAD_MUTEX_INITIALIZER;
+
+static CrudChange *pendingChanges = NULL;
+static struct timespec pendingSince;
+static pthread_mutex_t notify_mut = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t notify_con = PTHREAD_COND_INITIALIZER;
+
+/*----------------------------------------------------------------------------*/
+/*                             Internal functions                             */
+/*----------------------------------------------------------------------------*/
+
+static int is_tag(const char *name)
+{
+	return strcmp(name, CRUD_NOTIFY_CLOUD_DISCONNECT) != 0;
+}
+
+static int subscription_matches(const CrudSubscriber *sub, const char *name)
+{
+	if(strcmp(sub->name, name) == 0)
+	{
+		return 1;
+	}
+	return is_tag(name) && (strcmp(sub->name, CRUD_SUBSCRIBE_ALL_TAGS) == 0);
+}
+
+/* { "<name>": <value> }, value is null for a deleted tag */
+static char *build_payload(const CrudChange *change)
+{
+	cJSON *payload, *item = NULL;
+	char *value = NULL;
+	char *out;
+
+	if(change->value != NULL)
+	{
+		item = cJSON_Parse(change->value);
+	}
+	else if(crud_store_get_tag(get_parodus_cfg()->crud_config_file, change->name, &value) == 1)
+	{
+		item = cJSON_Parse(value);
+		free(value);
+	}
+	if(item == NULL)
+	{
+		item = cJSON_CreateNull();
+	}
+
+	payload = cJSON_CreateObject();
+	cJSON_AddItemToObject(payload, change->name, item);
+	out = cJSON_PrintUnformatted(payload);
+	cJSON_Delete(payload);
+	return out;
+}
+
+static void send_notification(const char *service, const CrudChange *change, char *payload)
+{
+	wrp_msg_t event;
+	char source[256];
+	char dest[256];
+	void *bytes = NULL;
+	ssize_t size;
+
+	snprintf(source, sizeof(source), "mac:%s/parodus/%s%s", get_parodus_cfg()->hw_mac,
+		is_tag(change->name) ? "tag/" : "", change->name);
+	snprintf(dest, sizeof(dest), "mac:%s/%s", get_parodus_cfg()->hw_mac, service);
+
+	memset(&event, 0, sizeof(wrp_msg_t));
+	event.msg_type = WRP_MSG_TYPE__EVENT;
+	event.u.event.source = source;
+	event.u.event.dest = dest;
+	event.u.event.content_type = "application/json";
+	event.u.event.payload = payload;
+	event.u.event.payload_size = strlen(payload);
+
+	size = wrp_struct_to(&event, WRP_BYTES, &bytes);
+	if(size > 0)
+	{
+		if(sendMsgtoRegisteredClients((char *)service, (const char **)&bytes, size) == 1)
+		{
+			ParodusInfo("Sent %s change notification to %s\n", change->name, service);
+		}
+		else
+		{
+			ParodusError("Failed to send %s change notification to %s\n", change->name, service);
+		}
+	}
+	free(bytes);
+}
+
+/* The services subscribed to name, so the sends happen without subscribe_mut */
+static CrudRecipient *get_recipients(const char *name)
+{
+	CrudRecipient *recipients = NULL, *recipient;
+	CrudSubscriber *sub;
+
+	pthread_mutex_lock(&subscribe_mut);
+	for(sub = subscribers; sub != NULL; sub = sub->next)
+	{
+		if(subscription_matches(sub, name))
+		{
+			recipient = (CrudRecipient *) malloc(sizeof(CrudRecipient));
+			if(recipient == NULL)
+			{
+				ParodusError("Unable to allocate %s change recipient\n", name);
+				break;
+			}
+			parStrncpy(recipient->service, sub->service, sizeof(recipient->service));
+			recipient->next = recipients;
+			recipients = recipient;
+		}
+	}
+	pthread_mutex_unlock(&subscribe_mut);
+	return recipients;
+}
+
+static void deliver_changes(CrudChange *changes)
+{
+	CrudChange *change;
+	CrudRecipient *recipients, *recipient;
+	char *payload;
+
+	while(changes != NULL)
+	{
+		change = changes;
+		changes = changes->next;
+
+		recipients = get_recipients(change->name);
+		payload = (recipients != NULL) ? build_payload(change) : NULL;
+		while(recipients != NULL)
+		{
+			recipient = recipients;
+			recipients = recipient->next;
+			if(payload != NULL)
+			{
+				send_notification(recipient->service, change, payload);
+			}
+			free(recipient);
+		}
+
+		free(payload);
+		free(change->value);
+		free(change);
+	}
+}
+
+static void send_subscribe_response(wrp_msg_t *msg, const char *service, int status)
+{
+	wrp_msg_t resp;
+	void *bytes = NULL;
+	ssize_t size;
+
+	memset(&resp, 0, sizeof(wrp_msg_t));
+	resp.msg_type = msg->msg_type;
+	resp.u.crud.transaction_uuid = msg->u.crud.transaction_uuid;
+	resp.u.crud.source = msg->u.crud.dest;
+	resp.u.crud.dest = msg->u.crud.source;
+	resp.u.crud.status = status;
+
+	size = wrp_struct_to(&resp, WRP_BYTES, &bytes);
+	if(size > 0)
+	{
+		sendMsgtoRegisteredClients((char *)service, (const char **)&bytes, size);
+	}
+	free(bytes);
+}
+
+/*----------------------------------------------------------------------------*/
+/*                             External Functions                             */
+/*----------------------------------------------------------------------------*/
+
+int crud_subscribe(const char *service, const char *name)
+{
+	CrudSubscriber *sub;
+
+	if(service == NULL || name == NULL || *service == '\0' ||
+	   strlen(service) >= sizeof(sub->service) || strlen(name) >= sizeof(sub->name))
+	{
+		return -1;
+	}
+
+	pthread_mutex_lock(&subscribe_mut);
+	for(sub = subscribers; sub != NULL; sub = sub->next)
+	{
+		if(strcmp(sub->service, service) == 0 && strcmp(sub->name, name) == 0)
+		{
+			pthread_mutex_unlock(&subscribe_mut);
+			return 0;
+		}
+	}
+
+	sub = (CrudSubscriber *) malloc(sizeof(CrudSubscriber));
+	if(sub == NULL)
+	{
+		pthread_mutex_unlock(&subscribe_mut);
+		return -1;
+	}
+	parStrncpy(sub->service, service, sizeof(sub->service));
+	parStrncpy(sub->name, name, sizeof(sub->name));
+	sub->next = subscribers;
+	subscribers = sub;
+	pthread_mutex_unlock(&subscribe_mut);
+
+	ParodusInfo("%s subscribed to %s changes\n", service, (*name != '\0') ? name : "all tag");
+	return 1;
+}
+
+int crud_unsubscribe(const char *service, const char *name)
+{
+	CrudSubscriber **prev, *sub;
+	int found = 0;
+
+	if(service == NULL || name == NULL)
+	{
+		return 0;
+	}
+
+	pthread_mutex_lock(&subscribe_mut);
+	for(prev = &subscribers; *prev != NULL; prev = &(*prev)->next)
+	{
+		sub = *prev;
+		if(strcmp(sub->service, service) == 0 && strcmp(sub->name, name) == 0)
+		{
+			*prev = sub->next;
+			free(sub);
+			found = 1;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&subscribe_mut);
+
+	if(found)
+	{
+		ParodusInfo("%s unsubscribed from %s changes\n", service, (*name != '\0') ? name : "all tag");
+	}
+	return found;
+}
+
+int crud_unsubscribe_service(const char *service)
+{
+	CrudSubscriber **prev, *sub;
+	int count = 0;
+
+	if(service == NULL)
+	{
+		return 0;
+	}
+
+	pthread_mutex_lock(&subscribe_mut);
+	prev = &subscribers;
+	while(*prev != NULL)
+	{
+		sub = *prev;
+		if(strcmp(sub->service, service) == 0)
+		{
+			*prev = sub->next;
+			free(sub);
+			count++;
+		}
+		else
+		{
+			prev = &sub->next;
+		}
+	}
+	pthread_mutex_unlock(&subscribe_mut);
+
+	if(count > 0)
+	{
+		ParodusInfo("Dropped %d subscriptions of %s\n", count, service);
+	}
+	return count;
+}
+
+int crud_subscribe_request(wrp_msg_t *msg)
+{
+	wrp_locator_t destLoc, sourceLoc;
+	char service[32];
+	char name[CRUD_NOTIFY_NAME_LEN];
+	int status = 400;
+
+	if((wrp_locator_parse(msg->u.crud.source, &sourceLoc) != 0) || (sourceLoc.service.len == 0) ||
+	   (sourceLoc.service.len >= sizeof(service)))
+	{
+		ParodusError("Invalid subscribe request source\n");
+		return status;
+	}
+	wrp_slice_copy(&sourceLoc.service, service, sizeof(service));
+
+	/* no name is every tag */
+	if((wrp_locator_parse(msg->u.crud.dest, &destLoc) == 0) &&
+	   (destLoc.sub_path.len < sizeof(name)) && ((destLoc.sub_path.len == 0) || (memchr(destLoc.sub_path.ptr, '/', destLoc.sub_path.len) == NULL)))
+	{
+		wrp_slice_copy(&destLoc.sub_path, name, sizeof(name));
+		if(WRP_MSG_TYPE__CREATE == msg->msg_type)
+		{
+			switch(crud_subscribe(service, name))
+			{
+				case 1:  status = 201; break;
+				case 0:  status = 200; break;
+				default: status = 500; break;
+			}
+		}
+		else if(WRP_MSG_TYPE__DELETE == msg->msg_type)
+		{
+			status = crud_unsubscribe(service, name) ? 200 : 400;
+		}
+	}
+	else
+	{
+		ParodusError("Invalid subscribe request dest %s\n", msg->u.crud.dest);
+	}
+
+	send_subscribe_response(msg, service, status);
+	return status;
+}
+
+void crud_notify_change(const char *name, const char *value)
+{
+	CrudChange *change, **last;
+	int listening;
+
+	if(name == NULL || strlen(name) >= CRUD_NOTIFY_NAME_LEN)
+	{
+		return;
+	}
+
+	pthread_mutex_lock(&subscribe_mut);
+	listening = (subscribers != NULL);
+	pthread_mutex_unlock(&subscribe_mut);
+	if(!listening)
+	{
+		// Nobody is listening
+		return;
+	}
+
+	pthread_mutex_lock(&notify_mut);
+	// Coalesce with a change to the same object that has not gone out yet
+	for(last = &pendingChanges; *last != NULL; last = &(*last)->next)
+	{
+		if(strcmp((*last)->name, name) == 0)
+		{
+			free((*last)->value);
+			(*last)->value = (value != NULL) ? strdup(value) : NULL;
+			pthread_mutex_unlock(&notify_mut);
+			return;
+		}
+	}
+
+	change = (CrudChange *) malloc(sizeof(CrudChange));
+	if(change != NULL)
+	{
+		parStrncpy(change->name, name, sizeof(change->name));
+		change->value = (value != NULL) ? strdup(value) : NULL;
+		change->next = NULL;
+		if(pendingChanges == NULL)
+		{
+			clock_gettime(CLOCK_REALTIME, &pendingSince);
+			pthread_cond_signal(&notify_con);
+		}
+		*last = change;
+	}
+	pthread_mutex_unlock(&notify_mut);
+}
+
+void crud_subscribe_reset(void)
+{
+	CrudSubscriber *sub;
+	CrudChange *change;
+
+	pthread_mutex_lock(&subscribe_mut);
+	while(subscribers != NULL)
+	{
+		sub = subscribers;
+		subscribers = sub->next;
+		free(sub);
+	}
+	pthread_mutex_unlock(&subscribe_mut);
+
+	pthread_mutex_lock(&notify_mut);
+	while(pendingChanges != NULL)
+	{
+		change = pendingChanges;
+		pendingChanges = change->next;
+		free(change->value);
+		free(change);
+	}
+	pthread_mutex_unlock(&notify_mut);
+}
+
+void *CRUDNotifyTask()
+{
+	CrudChange *changes;
+	struct timespec deadline;
+
+	while(FOREVER())
+	{
+		pthread_mutex_lock(&notify_mut);
+		ParodusPrint("Mutex lock in CRUD notify thread\n");
+
+		if(pendingChanges != NULL)
+		{
+			// Let changes within the coalescing window pile up
+			deadline = pendingSince;
+			deadline.tv_nsec += (CRUD_NOTIFY_COALESCE_MS % 1000) * 1000000L;
+			deadline.tv_sec += CRUD_NOTIFY_COALESCE_MS / 1000 + deadline.tv_nsec / 1000000000L;
+			deadline.tv_nsec %= 1000000000L;
+			while(pthread_cond_timedwait(&notify_con, &notify_mut, &deadline) == 0)
+			{
+				;
+			}
+
+			changes = pendingChanges;
+			pendingChanges = NULL;
+			pthread_mutex_unlock(&notify_mut);
+
+			deliver_changes(changes);
+		}
+		else
+		{
+			pthread_cond_wait(&notify_con, &notify_mut);
+			pthread_mutex_unlock(&notify_mut);
+		}
+	}
+	return 0;
+}
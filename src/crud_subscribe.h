@@ -0,0 +1,106 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/**
+ * @file crud_subscribe.h
+ *
+ * @description Change notifications for CRUD objects.
+ *
+ *              A registered client subscribes by sending a CREATE (and
+ *              unsubscribes with a DELETE) to
+ *
+ *              mac:<device-id>/parodus/subscribe/<name>
+ *
+ *              where name is a tag name or "cloud-disconnect", or to
+ *              mac:<device-id>/parodus/subscribe for every tag. After a change is committed the client
+ *              gets a WRP event from mac:<device-id>/parodus/tag/<name>
+ *              (or .../parodus/cloud-disconnect) with the current value as a
+ *              JSON payload. Changes to the same object within
+ *              CRUD_NOTIFY_COALESCE_MS of each other produce one event.
+ *
+ */
+
+#ifndef _CRUD_SUBSCRIBE_H_
+#define _CRUD_SUBSCRIBE_H_
+
+#include <wrp-c.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*----------------------------------------------------------------------------*/
+/*                                   Macros                                   */
+/*----------------------------------------------------------------------------*/
+
+#define CRUD_SUBSCRIBE_APPLICATION	"subscribe"
+#define CRUD_SUBSCRIBE_ALL_TAGS		""	/* no tag has an empty name */
+#define CRUD_NOTIFY_CLOUD_DISCONNECT	"cloud-disconnect"
+
+#define CRUD_NOTIFY_COALESCE_MS		100
+
+/*----------------------------------------------------------------------------*/
+/*                             Function Prototypes                            */
+/*----------------------------------------------------------------------------*/
+
+/**
+ * Add a subscription.
+ *
+ * @return 1 if added, 0 if it already existed, -1 on error
+ */
+int crud_subscribe(const char *service, const char *name);
+
+/**
+ * Remove a subscription.
+ *
+ * @return 1 if removed, 0 if not found
+ */
+int crud_unsubscribe(const char *service, const char *name);
+
+/**
+ * Remove every subscription of a service, when its client is removed.
+ *
+ * @return number of subscriptions removed
+ */
+int crud_unsubscribe_service(const char *service);
+
+/**
+ * Handle a CREATE/DELETE to parodus/subscribe/<name> from a registered
+ * client and send it the CRUD response.
+ *
+ * @return status code sent in the response
+ */
+int crud_subscribe_request(wrp_msg_t *msg);
+
+/**
+ * Queue a notification for a committed change. Called from the CRUD writer.
+ *
+ * @param name tag name or CRUD_NOTIFY_CLOUD_DISCONNECT
+ * @param value JSON value to send, NULL to read the tag from the store
+ *              when the notification goes out
+ */
+void crud_notify_change(const char *name, const char *value);
+
+/**
+ * Drop all subscriptions and pending notifications.
+ */
+void crud_subscribe_reset(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _CRUD_SUBSCRIBE_H_ */
@@ -0,0 +1,342 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/**
+ * @file dns_cache.c
+ *
+ * @description Host name resolution cache.
+ *
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "dns_cache.h"
+#include "parodus_log.h"
+
+/*----------------------------------------------------------------------------*/
+/*                               Data Structures                              */
+/*----------------------------------------------------------------------------*/
+
+typedef struct dns_entry {
+	char *host;
+	struct sockaddr_storage addrs[DNS_CACHE_MAX_ADDRS];
+	int count;
+	int resolved;		// addrs/count hold a result, possibly a failure
+	int resolving;		// a lookup for this host is in progress
+	uint64_t expires;	// ms
+	uint64_t refresh_at;	// ms
+	struct dns_entry *next;
+} dns_entry_t;
+
+/*----------------------------------------------------------------------------*/
+/*                            File Scoped Variables                           */
+/*----------------------------------------------------------------------------*/
+
+static dns_entry_t *dnsCache = NULL;
+static unsigned int dnsCacheTtl = 0;
+static pthread_mutex_t dns_cache_mut = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t dns_cache_con = PTHREAD_COND_INITIALIZER;
+
+/*----------------------------------------------------------------------------*/
+/*                             Internal functions                             */
+/*----------------------------------------------------------------------------*/
+
+static uint64_t now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000 + (uint64_t) ts.tv_nsec / 1000000;
+}
+
+/* Blocking lookup, returns the number of addresses */
+static int resolve(const char *host, struct sockaddr_storage *addrs, int max)
+{
+	struct addrinfo hints, *list = NULL, *ai;
+	int err, count = 0;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+
+	err = getaddrinfo(host, NULL, &hints, &list);
+	if(0 != err)
+	{
+		ParodusError("getaddrinfo %s: %s\n", host, gai_strerror(err));
+		return 0;
+	}
+	for(ai = list; (NULL != ai) && (count < max); ai = ai->ai_next)
+	{
+		if((NULL != ai->ai_addr) && (ai->ai_addrlen <= sizeof(struct sockaddr_storage)) &&
+		   ((AF_INET == ai->ai_family) || (AF_INET6 == ai->ai_family)))
+		{
+			memset(&addrs[count], 0, sizeof(struct sockaddr_storage));
+			memcpy(&addrs[count], ai->ai_addr, ai->ai_addrlen);
+			count++;
+		}
+	}
+	freeaddrinfo(list);
+	return count;
+}
+
+static int copy_family(const struct sockaddr_storage *from, int count, int family,
+	struct sockaddr_storage *addrs, int max)
+{
+	int i, n = 0;
+
+	for(i = 0; (i < count) && (n < max); i++)
+	{
+		if((AF_UNSPEC == family) || (from[i].ss_family == family))
+		{
+			addrs[n++] = from[i];
+		}
+	}
+	return n;
+}
+
+static dns_entry_t *find_entry(const char *host)
+{
+	dns_entry_t *entry;
+
+	for(entry = dnsCache; NULL != entry; entry = entry->next)
+	{
+		if(strcmp(entry->host, host) == 0)
+		{
+			return entry;
+		}
+	}
+	return NULL;
+}
+
+/* Called with dns_cache_mut held */
+static dns_entry_t *add_entry(const char *host)
+{
+	dns_entry_t *entry = (dns_entry_t *) calloc(1, sizeof(dns_entry_t));
+
+	if((NULL == entry) || (NULL == (entry->host = strdup(host))))
+	{
+		free(entry);
+		return NULL;
+	}
+	entry->next = dnsCache;
+	dnsCache = entry;
+	return entry;
+}
+
+/* Called with dns_cache_mut held */
+static void store_entry(dns_entry_t *entry, const struct sockaddr_storage *addrs,
+	int count, int refresh)
+{
+	uint64_t now = now_ms();
+	unsigned int ttl = dnsCacheTtl;
+
+	if((0 == count) && refresh && entry->resolved && (entry->count > 0))
+	{
+		// keep serving the last good answer until it expires
+		return;
+	}
+	memcpy(entry->addrs, addrs, count * sizeof(struct sockaddr_storage));
+	entry->count = count;
+	entry->resolved = 1;
+	if(0 == count)
+	{
+		ttl = (ttl < DNS_CACHE_NEGATIVE_TTL) ? ttl : DNS_CACHE_NEGATIVE_TTL;
+		entry->expires = now + (uint64_t) ttl * 1000;
+		entry->refresh_at = entry->expires;
+	}
+	else
+	{
+		entry->expires = now + (uint64_t) ttl * 1000;
+		entry->refresh_at = entry->expires - (uint64_t) ttl * 1000 / DNS_CACHE_REFRESH_AHEAD;
+	}
+}
+
+static void *refresh_thread(void *arg)
+{
+	char *host = (char *) arg;
+	struct sockaddr_storage addrs[DNS_CACHE_MAX_ADDRS];
+	dns_entry_t *entry;
+	int count;
+
+	count = resolve(host, addrs, DNS_CACHE_MAX_ADDRS);
+	ParodusPrint("dns cache refreshed %s, %d addresses\n", host, count);
+
+	pthread_mutex_lock(&dns_cache_mut);
+	entry = find_entry(host);
+	if(NULL != entry)
+	{
+		store_entry(entry, addrs, count, 1);
+		entry->resolving = 0;
+		pthread_cond_broadcast(&dns_cache_con);
+	}
+	pthread_mutex_unlock(&dns_cache_mut);
+	free(host);
+	return NULL;
+}
+
+/* Called with dns_cache_mut held */
+static void start_refresh(dns_entry_t *entry)
+{
+	pthread_attr_t attr;
+	pthread_t threadId;
+	char *host = strdup(entry->host);
+	int err = -1;
+
+	if(NULL != host)
+	{
+		pthread_attr_init(&attr);
+		pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+		err = pthread_create(&threadId, &attr, refresh_thread, host);
+		pthread_attr_destroy(&attr);
+	}
+	if(0 != err)
+	{
+		ParodusError("Unable to start dns refresh for %s\n", entry->host);
+		free(host);
+		return;
+	}
+	entry->resolving = 1;
+}
+
+/*----------------------------------------------------------------------------*/
+/*                             External Functions                             */
+/*----------------------------------------------------------------------------*/
+
+void dns_cache_set_ttl(unsigned int ttl)
+{
+	pthread_mutex_lock(&dns_cache_mut);
+	dnsCacheTtl = ttl;
+	pthread_mutex_unlock(&dns_cache_mut);
+}
+
+unsigned int dns_cache_get_ttl(void)
+{
+	unsigned int ttl;
+
+	pthread_mutex_lock(&dns_cache_mut);
+	ttl = dnsCacheTtl;
+	pthread_mutex_unlock(&dns_cache_mut);
+	return ttl;
+}
+
+int dns_cache_lookup(const char *host, int family,
+	struct sockaddr_storage *addrs, int max)
+{
+	struct sockaddr_storage found[DNS_CACHE_MAX_ADDRS];
+	dns_entry_t *entry;
+	uint64_t now;
+	int count;
+
+	if((NULL == host) || (NULL == addrs) || (max <= 0))
+	{
+		return 0;
+	}
+	if(0 == dns_cache_get_ttl())
+	{
+		count = resolve(host, found, DNS_CACHE_MAX_ADDRS);
+		return copy_family(found, count, family, addrs, max);
+	}
+
+	pthread_mutex_lock(&dns_cache_mut);
+	while(1)
+	{
+		// the entry can be cleared while we wait, so look it up every time
+		entry = find_entry(host);
+		if(NULL == entry)
+		{
+			entry = add_entry(host);
+			if(NULL == entry)
+			{
+				pthread_mutex_unlock(&dns_cache_mut);
+				ParodusError("Unable to allocate dns cache entry\n");
+				return 0;
+			}
+		}
+		now = now_ms();
+		if(entry->resolved && (now < entry->expires))
+		{
+			if((now >= entry->refresh_at) && !entry->resolving)
+			{
+				start_refresh(entry);
+			}
+			count = copy_family(entry->addrs, entry->count, family, addrs, max);
+			pthread_mutex_unlock(&dns_cache_mut);
+			return count;
+		}
+		if(!entry->resolving)
+		{
+			break;
+		}
+		// someone else is already asking
+		pthread_cond_wait(&dns_cache_con, &dns_cache_mut);
+	}
+
+	entry->resolving = 1;
+	pthread_mutex_unlock(&dns_cache_mut);
+	count = resolve(host, found, DNS_CACHE_MAX_ADDRS);
+
+	pthread_mutex_lock(&dns_cache_mut);
+	entry = find_entry(host);
+	if(NULL != entry)
+	{
+		store_entry(entry, found, count, 0);
+		entry->resolving = 0;
+	}
+	pthread_cond_broadcast(&dns_cache_con);
+	pthread_mutex_unlock(&dns_cache_mut);
+	return copy_family(found, count, family, addrs, max);
+}
+
+int dns_cache_lookup_ip(const char *host, int family, char *buf, size_t buflen)
+{
+	struct sockaddr_storage addr;
+
+	if(dns_cache_lookup(host, family, &addr, 1) != 1)
+	{
+		return 0;
+	}
+	if(AF_INET6 == addr.ss_family)
+	{
+		return (NULL != inet_ntop(AF_INET6, &((struct sockaddr_in6 *) &addr)->sin6_addr,
+			buf, buflen));
+	}
+	return (NULL != inet_ntop(AF_INET, &((struct sockaddr_in *) &addr)->sin_addr,
+		buf, buflen));
+}
+
+void dns_cache_clear(void)
+{
+	dns_entry_t *entry;
+
+	pthread_mutex_lock(&dns_cache_mut);
+	while(NULL != dnsCache)
+	{
+		entry = dnsCache;
+		dnsCache = entry->next;
+		free(entry->host);
+		free(entry);
+	}
+	// waiters look their host up again
+	pthread_cond_broadcast(&dns_cache_con);
+	pthread_mutex_unlock(&dns_cache_mut);
+}
@@ -0,0 +1,85 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/**
+ * @file dns_cache.h
+ *
+ * @description Host name resolution cache.
+ *
+ *              getaddrinfo() does not report record TTLs, so entries live for
+ *              a configured ttl (failed lookups for at most
+ *              DNS_CACHE_NEGATIVE_TTL). An entry used in the last
+ *              1/DNS_CACHE_REFRESH_AHEAD of its life is refreshed in the
+ *              background, and callers missing the same name wait for one
+ *              lookup instead of each querying the resolver.
+ *
+ */
+
+#ifndef _DNS_CACHE_H_
+#define _DNS_CACHE_H_
+
+#include <stddef.h>
+#include <sys/socket.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*----------------------------------------------------------------------------*/
+/*                                   Macros                                   */
+/*----------------------------------------------------------------------------*/
+
+#define DNS_CACHE_MAX_ADDRS		8
+#define DNS_CACHE_NEGATIVE_TTL		5	// seconds
+#define DNS_CACHE_REFRESH_AHEAD		5
+
+/*----------------------------------------------------------------------------*/
+/*                             Function Prototypes                            */
+/*----------------------------------------------------------------------------*/
+
+/**
+ * Set how long results are kept, in seconds. 0 (the default) disables the
+ * cache and every lookup goes to the resolver.
+ */
+void dns_cache_set_ttl(unsigned int ttl);
+unsigned int dns_cache_get_ttl(void);
+
+/**
+ * Resolve host, from the cache when possible.
+ *
+ * @param family AF_INET, AF_INET6 or AF_UNSPEC
+ * @return number of addresses copied to addrs, 0 if the host did not resolve
+ */
+int dns_cache_lookup(const char *host, int family,
+	struct sockaddr_storage *addrs, int max);
+
+/**
+ * Resolve host and format its first address of the given family.
+ *
+ * @return 1 if buf holds an address, 0 otherwise
+ */
+int dns_cache_lookup_ip(const char *host, int family, char *buf, size_t buflen);
+
+/**
+ * Drop every entry. Lookups already in progress still return their answer.
+ */
+void dns_cache_clear(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _DNS_CACHE_H_ */
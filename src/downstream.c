@@ -27,6 +27,7 @@
 #include "partners_check.h"
 #include "ParodusInternal.h"
 #include "crud_interface.h"
+#include "wrp_locator.h"
 
 /*----------------------------------------------------------------------------*/
 /*                             External Functions                             */
@@ -42,7 +43,8 @@ void listenerOnMessage(void * msg, size_t msgSize)
 {
     int rv =0;
     wrp_msg_t *message;
-    char* destVal = NULL;
+    const char *destVal = NULL;
+    wrp_locator_t locator;
     char dest[32] = {'\0'};
     int msgType;
     int bytes =0;
@@ -96,20 +98,15 @@ void listenerOnMessage(void * msg, size_t msgSize)
                     } 
 
                       
-                    destVal = strdup(((WRP_MSG_TYPE__EVENT == msgType) ? message->u.event.dest : 
-                              ((WRP_MSG_TYPE__REQ   == msgType) ? message->u.req.dest : message->u.crud.dest)));
+                    destVal = ((WRP_MSG_TYPE__EVENT == msgType) ? message->u.event.dest : 
+                              ((WRP_MSG_TYPE__REQ   == msgType) ? message->u.req.dest : message->u.crud.dest));
 
                     if( (destVal != NULL) && (ret >= 0) )
                     {
-						char *newDest = NULL;
-						char *tempDest = strtok(destVal , "/");
-						if(tempDest != NULL)
+						/* Route on the service element, or the whole dest if it has none */
+						if( (wrp_locator_parse(destVal, &locator) == 0) && (locator.service.len > 0) )
 						{
-							newDest = strtok(NULL , "/");
-						}
-						if(newDest != NULL)
-						{
-							parStrncpy(dest,newDest, sizeof(dest));
+							wrp_slice_copy(&locator.service, dest, sizeof(dest));
 						}
 						else
 						{
@@ -119,7 +116,6 @@ void listenerOnMessage(void * msg, size_t msgSize)
                             ((WRP_MSG_TYPE__REQ   == msgType) ? message->u.req.transaction_uuid : 
                             ((WRP_MSG_TYPE__EVENT == msgType) ? "NA" : message->u.crud.transaction_uuid)));
                         
-                        free(destVal);
 						temp = get_global_node();
                         //Checking for individual clients & Sending to each client
 
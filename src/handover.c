@@ -0,0 +1,319 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/**
+ * @file handover.c
+ *
+ * @description Hand the registered clients over to a new parodus binary.
+ *
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ParodusInternal.h"
+#include "client_list.h"
+#include "connection.h"
+#include "conn_interface.h"
+#include "handover.h"
+
+/*----------------------------------------------------------------------------*/
+/*                                   Macros                                   */
+/*----------------------------------------------------------------------------*/
+
+#define HANDOVER_LINE_MAX	(sizeof(((reg_list_item_t *) 0)->service_name) + \
+				 sizeof(((reg_list_item_t *) 0)->url) + 16)
+
+/*----------------------------------------------------------------------------*/
+/*                            File Scoped Variables                           */
+/*----------------------------------------------------------------------------*/
+
+static pthread_mutex_t handover_mut = PTHREAD_MUTEX_INITIALIZER;
+static int listenSocket = -1;
+static int peerSocket = -1;	// the new parodus, open until exit
+static pthread_t listenThread;
+static int stopping = 0;
+static char listenPath[sizeof(((struct sockaddr_un *) 0)->sun_path)];
+static reg_list_item_t takenClients[HANDOVER_CLIENTS_MAX];
+static int takenCount = 0;
+
+/*----------------------------------------------------------------------------*/
+/*                             Internal functions                             */
+/*----------------------------------------------------------------------------*/
+
+static int unix_addr (const char *path, struct sockaddr_un *addr)
+{
+	if (strlen (path) >= sizeof(addr->sun_path)) {
+		ParodusError ("Handover socket path %s is too long\n", path);
+		return -1;
+	}
+	memset (addr, 0, sizeof(struct sockaddr_un));
+	addr->sun_family = AF_UNIX;
+	strcpy (addr->sun_path, path);
+	return 0;
+}
+
+static int ms_left (const struct timespec *start)
+{
+	struct timespec now;
+	long elapsed_ms;
+
+	clock_gettime (CLOCK_MONOTONIC, &now);
+	elapsed_ms = (now.tv_sec - start->tv_sec) * 1000 +
+		(now.tv_nsec - start->tv_nsec) / 1000000;
+	return (elapsed_ms < HANDOVER_WAIT_MS) ? (int) (HANDOVER_WAIT_MS - elapsed_ms) : 0;
+}
+
+// returns 1 once the end line is seen
+static int parse_registry (char *text)
+{
+	char *line, *save = NULL;
+	reg_list_item_t *client;
+
+	for (line = strtok_r (text, "\n", &save); NULL != line;
+	     line = strtok_r (NULL, "\n", &save)) {
+		if (strcmp (line, "end") == 0)
+			return 1;
+		if (takenCount >= HANDOVER_CLIENTS_MAX) {
+			ParodusError ("Too many clients handed over, dropping %s\n", line);
+			continue;
+		}
+		client = &takenClients[takenCount];
+		memset (client, 0, sizeof(reg_list_item_t));
+		if (sscanf (line, "client %31s %99s", client->service_name, client->url) == 2)
+			takenCount++;
+		else
+			ParodusError ("Ignoring handover line %s\n", line);
+	}
+	return 0;
+}
+
+static void *listen_thread (void *arg)
+{
+	struct pollfd pfd;
+	int fd, stop;
+
+	(void) arg;
+	pfd.fd = listenSocket;
+	pfd.events = POLLIN;
+	while (1) {
+		pthread_mutex_lock (&handover_mut);
+		stop = stopping;
+		pthread_mutex_unlock (&handover_mut);
+		if (stop)
+			break;
+		if (poll (&pfd, 1, HANDOVER_POLL_MS) <= 0)
+			continue;
+		fd = accept4 (listenSocket, NULL, NULL, SOCK_CLOEXEC);
+		if (fd < 0)
+			continue;
+		pthread_mutex_lock (&handover_mut);
+		peerSocket = fd;
+		pthread_mutex_unlock (&handover_mut);
+		ParodusInfo ("A new parodus is taking over, shutting down\n");
+		set_global_reconnect_reason (HANDOVER_REASON);
+		set_global_reconnect_status (true);
+		shutdownSocketConnection ();
+		break;
+	}
+	return NULL;
+}
+
+/*----------------------------------------------------------------------------*/
+/*                             External Functions                             */
+/*----------------------------------------------------------------------------*/
+
+int handover_take (const char *path)
+{
+	struct sockaddr_un addr;
+	struct timespec start;
+	struct pollfd pfd;
+	char *text, skip[256];
+	size_t text_size = HANDOVER_CLIENTS_MAX * HANDOVER_LINE_MAX;
+	size_t used = 0;
+	ssize_t n = -1;
+	int fd, ended;
+
+	takenCount = 0;
+	if ((NULL == path) || (unix_addr (path, &addr) != 0))
+		return -1;
+	fd = socket (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return -1;
+	if (connect (fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+		ParodusPrint ("No parodus to take over from at %s (%s)\n", path, strerror (errno));
+		close (fd);
+		return -1;
+	}
+	text = (char *) malloc (text_size);
+	if (NULL == text) {
+		close (fd);
+		return -1;
+	}
+	ParodusInfo ("Taking over from the running parodus at %s\n", path);
+	clock_gettime (CLOCK_MONOTONIC, &start);
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	// the socket closes when the old parodus exits, after the registry
+	while (poll (&pfd, 1, ms_left (&start)) > 0) {
+		if (used < text_size - 1) {
+			n = read (fd, text + used, text_size - 1 - used);
+			if (n > 0)
+				used += (size_t) n;
+		} else {
+			n = read (fd, skip, sizeof(skip));	// more than fits
+		}
+		if (n <= 0)
+			break;
+	}
+	close (fd);
+	text[used] = '\0';
+	ended = parse_registry (text);
+	free (text);
+	if (0 != n)
+		ParodusError ("The old parodus did not exit within %d ms\n", HANDOVER_WAIT_MS);
+	if (!ended) {
+		ParodusError ("Handover incomplete, clients will register again\n");
+		takenCount = 0;
+		return -1;
+	}
+	ParodusInfo ("Took over %d clients\n", takenCount);
+	set_global_reconnect_reason (HANDOVER_REASON);
+	set_global_reconnect_status (true);
+	return takenCount;
+}
+
+void handover_restore (void)
+{
+	wrp_msg_t reg, *msg = &reg;
+	int i;
+
+	for (i = 0; i < takenCount; i++) {
+		memset (&reg, 0, sizeof(reg));
+		reg.msg_type = WRP_MSG_TYPE__SVC_REGISTRATION;
+		reg.u.reg.service_name = takenClients[i].service_name;
+		reg.u.reg.url = takenClients[i].url;
+		if (addToList (&msg) < 0)
+			ParodusError ("Unable to restore client %s\n", takenClients[i].service_name);
+	}
+	if (0 < takenCount)
+		ParodusInfo ("Restored %d clients from the old parodus\n", takenCount);
+	takenCount = 0;
+}
+
+int handover_listen (const char *path)
+{
+	struct sockaddr_un addr;
+	int fd, err;
+
+	if ((NULL == path) || (unix_addr (path, &addr) != 0))
+		return -1;
+	pthread_mutex_lock (&handover_mut);
+	if (-1 != listenSocket) {
+		pthread_mutex_unlock (&handover_mut);
+		return -1;
+	}
+	fd = socket (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0) {
+		pthread_mutex_unlock (&handover_mut);
+		ParodusError ("Unable to open handover socket: %s\n", strerror (errno));
+		return -1;
+	}
+	unlink (path);	// left by a parodus that did not stop cleanly
+	if ((bind (fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) ||
+	    (chmod (path, 0600) < 0) || (listen (fd, 1) < 0)) {
+		pthread_mutex_unlock (&handover_mut);
+		ParodusError ("Unable to listen on handover socket %s: %s\n", path, strerror (errno));
+		close (fd);
+		unlink (path);
+		return -1;
+	}
+	strcpy (listenPath, path);
+	stopping = 0;
+	listenSocket = fd;
+	err = pthread_create (&listenThread, NULL, listen_thread, NULL);
+	if (0 != err) {
+		listenSocket = -1;
+		pthread_mutex_unlock (&handover_mut);
+		ParodusError ("Error creating handover thread :[%s]\n", strerror (err));
+		close (fd);
+		unlink (path);
+		return -1;
+	}
+	pthread_mutex_unlock (&handover_mut);
+	ParodusInfo ("Listening for a new parodus on %s\n", path);
+	return 0;
+}
+
+bool handover_pending (void)
+{
+	bool pending;
+
+	pthread_mutex_lock (&handover_mut);
+	pending = (-1 != peerSocket);
+	pthread_mutex_unlock (&handover_mut);
+	return pending;
+}
+
+int handover_send (void)
+{
+	char line[HANDOVER_LINE_MAX];
+	reg_list_item_t *temp;
+	int fd, len, count = 0;
+
+	pthread_mutex_lock (&handover_mut);
+	fd = peerSocket;
+	pthread_mutex_unlock (&handover_mut);
+	if (-1 == fd)
+		return -1;
+	for (temp = get_global_node (); NULL != temp; temp = temp->next) {
+		len = snprintf (line, sizeof(line), "client %s %s\n", temp->service_name, temp->url);
+		if (send (fd, line, (size_t) len, MSG_NOSIGNAL) != len)
+			break;
+		count++;
+	}
+	if ((NULL != temp) || (send (fd, "end\n", 4, MSG_NOSIGNAL) != 4)) {
+		ParodusError ("Unable to hand over the clients: %s\n", strerror (errno));
+		return -1;
+	}
+	ParodusInfo ("Handed over %d clients\n", count);
+	return count;
+}
+
+void handover_stop (void)
+{
+	int fd;
+
+	pthread_mutex_lock (&handover_mut);
+	fd = listenSocket;
+	stopping = 1;
+	pthread_mutex_unlock (&handover_mut);
+	if (-1 == fd)
+		return;
+	pthread_join (listenThread, NULL);
+	close (fd);
+	unlink (listenPath);
+	pthread_mutex_lock (&handover_mut);
+	listenSocket = -1;
+	pthread_mutex_unlock (&handover_mut);
+}
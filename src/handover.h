@@ -0,0 +1,103 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/**
+ * @file handover.h
+ *
+ * @description Hand the registered clients over to a new parodus binary.
+ *
+ *              The running parodus listens on a unix socket. A new one
+ *              started with the same socket connects to it before it binds
+ *              anything; the old one then flushes its queues, writes its
+ *              client registry and exits. The new one waits for that exit,
+ *              so the local url is free, and registers the clients again
+ *              itself, so they do not have to.
+ *
+ *              The registry is sent as lines of text:
+ *              client <service_name> <url>
+ *              end
+ *
+ */
+
+#ifndef _HANDOVER_H_
+#define _HANDOVER_H_
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*----------------------------------------------------------------------------*/
+/*                                   Macros                                   */
+/*----------------------------------------------------------------------------*/
+
+#define HANDOVER_WAIT_MS	30000	// for the old parodus to hand over and exit
+#define HANDOVER_POLL_MS	250	// how soon stop is noticed
+#define HANDOVER_CLIENTS_MAX	64
+#define HANDOVER_REASON		"Parodus_Upgrade"
+
+/*----------------------------------------------------------------------------*/
+/*                             Function Prototypes                            */
+/*----------------------------------------------------------------------------*/
+
+/**
+ * Take over from a parodus listening on path, if there is one: receive its
+ * clients and wait for it to exit.
+ *
+ * @param path the unix socket, NULL to skip
+ * @return the number of clients received, -1 if nothing was handed over
+ */
+int handover_take (const char *path);
+
+/**
+ * Register the clients received by handover_take again, as if they had
+ * sent their registration. Called before the upstream threads start.
+ */
+void handover_restore (void);
+
+/**
+ * Listen on path for a new parodus. When one connects, the connection is
+ * shut down with HANDOVER_REASON.
+ *
+ * @param path the unix socket, NULL to not listen
+ * @return 0 on success
+ */
+int handover_listen (const char *path);
+
+/**
+ * @return true once a new parodus is waiting for the clients
+ */
+bool handover_pending (void);
+
+/**
+ * Write the registered clients to the waiting parodus. Its socket stays
+ * open until this process exits, which is what it waits for.
+ *
+ * @return the number of clients sent, -1 on error
+ */
+int handover_send (void);
+
+/**
+ * Stop listening.
+ */
+void handover_stop (void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _HANDOVER_H_ */
@@ -0,0 +1,405 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/**
+ * @file iface_pool.c
+ *
+ * @description Prioritized list of interfaces to connect over.
+ *
+ */
+
+#include <errno.h>
+#include <net/if.h>
+#include <netdb.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "iface_pool.h"
+#include "parodus_log.h"
+
+/*----------------------------------------------------------------------------*/
+/*                                   Macros                                   */
+/*----------------------------------------------------------------------------*/
+
+#define PROBE_IDLE	0
+#define PROBE_RUNNING	1
+#define PROBE_DONE	2	// finished, not joined yet
+
+/*----------------------------------------------------------------------------*/
+/*                               Data Structures                              */
+/*----------------------------------------------------------------------------*/
+
+typedef struct {
+	char name[IF_NAMESIZE];
+	unsigned int connects;
+	unsigned int failures;
+	unsigned int failed_in_row;
+	unsigned int rtt_ms;	// smoothed, 0 until measured
+	unsigned int probes_ok;
+	uint64_t down_until;	// ms, monotonic
+} iface_entry_t;
+
+/*----------------------------------------------------------------------------*/
+/*                            File Scoped Variables                           */
+/*----------------------------------------------------------------------------*/
+
+static iface_entry_t ifacePool[IFACE_POOL_MAX];
+static int ifacePoolCount = 0;
+static pthread_mutex_t iface_pool_mut = PTHREAD_MUTEX_INITIALIZER;
+
+// the probe in progress; set while PROBE_IDLE or PROBE_DONE only
+static pthread_t probeThread;
+static int probeState = PROBE_IDLE;
+static char probeName[IF_NAMESIZE];
+static char *probeHost = NULL;
+static unsigned int probePort = 0;
+
+/*----------------------------------------------------------------------------*/
+/*                             Internal functions                             */
+/*----------------------------------------------------------------------------*/
+
+static uint64_t now_ms (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000 + (uint64_t) ts.tv_nsec / 1000000;
+}
+
+static int valid_index (int index)
+{
+	return (index >= 0) && (index < ifacePoolCount);
+}
+
+static iface_entry_t *find_entry (const char *name)
+{
+	int i;
+
+	for (i = 0; i < ifacePoolCount; i++) {
+		if (strcmp (ifacePool[i].name, name) == 0)
+			return &ifacePool[i];
+	}
+	return NULL;
+}
+
+/* rtt = 7/8 rtt + 1/8 sample, as for tcp srtt */
+static void add_rtt_sample (iface_entry_t *entry, unsigned int rtt_ms)
+{
+	if (0 == rtt_ms)
+		rtt_ms = 1;
+	if (0 == entry->rtt_ms)
+		entry->rtt_ms = rtt_ms;
+	else
+		entry->rtt_ms = (7 * entry->rtt_ms + rtt_ms) / 8;
+}
+
+// 0 once a tcp connect over the interface completes
+static int connect_bound (const struct addrinfo *ai, const char *name)
+{
+	struct pollfd pfd;
+	int fd, err = 0, rtn = -1;
+	socklen_t len = sizeof(err);
+
+	fd = socket (ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC,
+		ai->ai_protocol);
+	if (fd < 0)
+		return -1;
+	if (setsockopt (fd, SOL_SOCKET, SO_BINDTODEVICE, name, strlen (name) + 1) < 0) {
+		ParodusError ("Unable to bind probe to %s: %s\n", name, strerror (errno));
+	} else if ((connect (fd, ai->ai_addr, ai->ai_addrlen) == 0) ||
+		   (EINPROGRESS == errno)) {
+		pfd.fd = fd;
+		pfd.events = POLLOUT;
+		if ((poll (&pfd, 1, IFACE_PROBE_TIMEOUT_MS) == 1) &&
+		    (getsockopt (fd, SOL_SOCKET, SO_ERROR, &err, &len) == 0) && (0 == err))
+			rtn = 0;
+	}
+	close (fd);
+	return rtn;
+}
+
+// returns the connect time in ms, -1 if no address could be reached
+static int probe_connect (const char *name, const char *host, unsigned int port)
+{
+	struct addrinfo hints, *res = NULL, *ai;
+	char service[8];
+	uint64_t start = now_ms ();
+	int rtn = -1;
+
+	memset (&hints, 0, sizeof(hints));
+	hints.ai_socktype = SOCK_STREAM;
+	snprintf (service, sizeof(service), "%u", port);
+	if (getaddrinfo (host, service, &hints, &res) != 0) {
+		ParodusError ("Probe over %s unable to resolve %s\n", name, host);
+		return -1;
+	}
+	for (ai = res; (NULL != ai) && (rtn < 0); ai = ai->ai_next) {
+		if (connect_bound (ai, name) == 0)
+			rtn = (int) (now_ms () - start);
+	}
+	freeaddrinfo (res);
+	return rtn;
+}
+
+static void *probe_thread (void *arg)
+{
+	iface_entry_t *entry;
+	unsigned int probes_ok = 0;
+	int connect_ms;
+
+	(void) arg;
+	connect_ms = probe_connect (probeName, probeHost, probePort);
+	pthread_mutex_lock (&iface_pool_mut);
+	// looked up by name, as the list may have been reloaded meanwhile
+	entry = find_entry (probeName);
+	if (NULL != entry) {
+		if (connect_ms >= 0) {
+			entry->probes_ok++;
+			entry->failed_in_row = 0;
+			entry->down_until = 0;
+			add_rtt_sample (entry, (unsigned int) connect_ms);
+		} else {
+			entry->probes_ok = 0;
+		}
+		probes_ok = entry->probes_ok;
+	}
+	probeState = PROBE_DONE;
+	pthread_mutex_unlock (&iface_pool_mut);
+	if (connect_ms >= 0)
+		ParodusInfo ("Probe over %s connected in %d ms, %u good in a row\n",
+			probeName, connect_ms, probes_ok);
+	else
+		ParodusInfo ("Probe over %s failed\n", probeName);
+	return NULL;
+}
+
+/*----------------------------------------------------------------------------*/
+/*                             External Functions                             */
+/*----------------------------------------------------------------------------*/
+
+int iface_pool_init (const char *names)
+{
+	iface_entry_t old[IFACE_POOL_MAX];
+	iface_entry_t *prev;
+	int old_count, count = 0, i;
+	char *list, *name, *save = NULL;
+
+	pthread_mutex_lock (&iface_pool_mut);
+	memcpy (old, ifacePool, sizeof(old));
+	old_count = ifacePoolCount;
+	memset (ifacePool, 0, sizeof(ifacePool));
+	ifacePoolCount = 0;
+	list = (NULL != names) ? strdup (names) : NULL;
+	for (name = (NULL != list) ? strtok_r (list, ", ", &save) : NULL;
+	     (NULL != name) && (count < IFACE_POOL_MAX);
+	     name = strtok_r (NULL, ", ", &save)) {
+		if (strlen (name) >= IF_NAMESIZE) {
+			ParodusError ("Interface name %s is too long\n", name);
+			continue;
+		}
+		if (NULL != find_entry (name))
+			continue;	// listed twice
+		prev = NULL;
+		for (i = 0; i < old_count; i++) {
+			if (strcmp (old[i].name, name) == 0)
+				prev = &old[i];
+		}
+		if (NULL != prev)
+			ifacePool[count] = *prev;
+		else
+			strcpy (ifacePool[count].name, name);
+		ifacePoolCount = ++count;
+	}
+	free (list);
+	pthread_mutex_unlock (&iface_pool_mut);
+	ParodusInfo ("interface list has %d interfaces\n", count);
+	return count;
+}
+
+int iface_pool_count (void)
+{
+	int count;
+
+	pthread_mutex_lock (&iface_pool_mut);
+	count = ifacePoolCount;
+	pthread_mutex_unlock (&iface_pool_mut);
+	return count;
+}
+
+const char *iface_pool_name (int index)
+{
+	const char *name = NULL;
+
+	// names only change in iface_pool_init/clear, on the connection thread
+	pthread_mutex_lock (&iface_pool_mut);
+	if (valid_index (index))
+		name = ifacePool[index].name;
+	pthread_mutex_unlock (&iface_pool_mut);
+	return name;
+}
+
+int iface_pool_select (unsigned int tried_mask, int up_only)
+{
+	uint64_t now = now_ms ();
+	int best = IFACE_POOL_NONE, i;
+
+	pthread_mutex_lock (&iface_pool_mut);
+	for (i = 0; i < ifacePoolCount; i++) {
+		if (tried_mask & (1U << i))
+			continue;
+		if (now >= ifacePool[i].down_until) {
+			best = i;
+			break;
+		}
+		// cooling down: the one back soonest, if none is up
+		if (!up_only && ((IFACE_POOL_NONE == best) ||
+		    (ifacePool[i].down_until < ifacePool[best].down_until)))
+			best = i;
+	}
+	pthread_mutex_unlock (&iface_pool_mut);
+	return best;
+}
+
+void iface_pool_report_connect (int index, int ok, unsigned int connect_ms)
+{
+	iface_entry_t *entry;
+	unsigned int cooldown, n;
+
+	pthread_mutex_lock (&iface_pool_mut);
+	if (!valid_index (index)) {
+		pthread_mutex_unlock (&iface_pool_mut);
+		return;
+	}
+	entry = &ifacePool[index];
+	if (ok) {
+		entry->connects++;
+		entry->failed_in_row = 0;
+		entry->down_until = 0;
+		add_rtt_sample (entry, connect_ms);
+	} else {
+		entry->failures++;
+		entry->failed_in_row++;
+		entry->probes_ok = 0;
+		cooldown = IFACE_POOL_COOLDOWN;
+		for (n = 1; (n < entry->failed_in_row) && (cooldown < IFACE_POOL_COOLDOWN_MAX); n++)
+			cooldown *= 2;
+		if (cooldown > IFACE_POOL_COOLDOWN_MAX)
+			cooldown = IFACE_POOL_COOLDOWN_MAX;
+		entry->down_until = now_ms () + (uint64_t) cooldown * 1000;
+		ParodusInfo ("interface %s failed %u times, skipped for %u s\n",
+			entry->name, entry->failed_in_row, cooldown);
+	}
+	pthread_mutex_unlock (&iface_pool_mut);
+}
+
+void iface_pool_report_rtt (int index, unsigned int rtt_ms)
+{
+	pthread_mutex_lock (&iface_pool_mut);
+	if (valid_index (index))
+		add_rtt_sample (&ifacePool[index], rtt_ms);
+	pthread_mutex_unlock (&iface_pool_mut);
+}
+
+void iface_pool_get_stats (int index, iface_stats_t *stats)
+{
+	memset (stats, 0, sizeof(iface_stats_t));
+	pthread_mutex_lock (&iface_pool_mut);
+	if (valid_index (index)) {
+		stats->connects = ifacePool[index].connects;
+		stats->failures = ifacePool[index].failures;
+		stats->rtt_ms = ifacePool[index].rtt_ms;
+		stats->probes_ok = ifacePool[index].probes_ok;
+	}
+	pthread_mutex_unlock (&iface_pool_mut);
+}
+
+int iface_pool_probe (int index, const char *host, unsigned int port)
+{
+	int err;
+
+	pthread_mutex_lock (&iface_pool_mut);
+	if (!valid_index (index) || (NULL == host) || (PROBE_RUNNING == probeState)) {
+		pthread_mutex_unlock (&iface_pool_mut);
+		return -1;
+	}
+	if (PROBE_DONE == probeState)
+		pthread_join (probeThread, NULL);	// already past its last lock
+	probeState = PROBE_IDLE;
+	free (probeHost);
+	probeHost = strdup (host);
+	if (NULL == probeHost) {
+		pthread_mutex_unlock (&iface_pool_mut);
+		return -1;
+	}
+	strcpy (probeName, ifacePool[index].name);
+	probePort = port;
+	err = pthread_create (&probeThread, NULL, probe_thread, NULL);
+	if (0 != err) {
+		pthread_mutex_unlock (&iface_pool_mut);
+		ParodusError ("Error creating interface probe thread :[%s]\n", strerror (err));
+		return -1;
+	}
+	probeState = PROBE_RUNNING;
+	pthread_mutex_unlock (&iface_pool_mut);
+	return 0;
+}
+
+int iface_pool_probing (void)
+{
+	int running;
+
+	pthread_mutex_lock (&iface_pool_mut);
+	running = (PROBE_RUNNING == probeState);
+	pthread_mutex_unlock (&iface_pool_mut);
+	return running;
+}
+
+int iface_pool_healthy (int index)
+{
+	int healthy = 0;
+
+	pthread_mutex_lock (&iface_pool_mut);
+	if (valid_index (index))
+		healthy = (ifacePool[index].probes_ok >= IFACE_HEALTHY_PROBES);
+	pthread_mutex_unlock (&iface_pool_mut);
+	return healthy;
+}
+
+void iface_pool_clear (void)
+{
+	int state;
+
+	pthread_mutex_lock (&iface_pool_mut);
+	state = probeState;
+	pthread_mutex_unlock (&iface_pool_mut);
+	if (PROBE_IDLE != state)
+		pthread_join (probeThread, NULL);
+
+	pthread_mutex_lock (&iface_pool_mut);
+	probeState = PROBE_IDLE;
+	free (probeHost);
+	probeHost = NULL;
+	memset (ifacePool, 0, sizeof(ifacePool));
+	ifacePoolCount = 0;
+	pthread_mutex_unlock (&iface_pool_mut);
+}
@@ -0,0 +1,130 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/**
+ * @file iface_pool.h
+ *
+ * @description Prioritized list of interfaces to connect over.
+ *
+ *              Each interface keeps its connect successes and failures, a
+ *              smoothed rtt, and, like the server pool, a cooldown after a
+ *              failure that doubles each time. Unlike the server pool the
+ *              order is fixed: the first interface that is up wins.
+ *
+ *              While the connection is on a backup interface, a probe (a
+ *              tcp connect to the server, bound to the interface) tells when
+ *              a preferred interface is healthy again.
+ *
+ */
+
+#ifndef _IFACE_POOL_H_
+#define _IFACE_POOL_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*----------------------------------------------------------------------------*/
+/*                                   Macros                                   */
+/*----------------------------------------------------------------------------*/
+
+#define IFACE_POOL_MAX			4
+#define IFACE_POOL_NONE			-1
+#define IFACE_POOL_COOLDOWN		10	// seconds after a first failure
+#define IFACE_POOL_COOLDOWN_MAX		300	// seconds
+#define IFACE_PROBE_INTERVAL		30	// seconds between probes
+#define IFACE_PROBE_TIMEOUT_MS		5000
+#define IFACE_HEALTHY_PROBES		2	// probes in a row before moving back
+
+/*----------------------------------------------------------------------------*/
+/*                               Data Structures                              */
+/*----------------------------------------------------------------------------*/
+
+typedef struct {
+	unsigned int connects;		// successful connects
+	unsigned int failures;		// failed connects
+	unsigned int rtt_ms;		// smoothed, 0 until measured
+	unsigned int probes_ok;		// consecutive good probes
+} iface_stats_t;
+
+/*----------------------------------------------------------------------------*/
+/*                             Function Prototypes                            */
+/*----------------------------------------------------------------------------*/
+
+/**
+ * Load the list from comma separated interface names, most preferred
+ * first, keeping the scores of interfaces already in the list.
+ *
+ * @return number of interfaces
+ */
+int iface_pool_init (const char *names);
+
+int iface_pool_count (void);
+
+/**
+ * @return the name of an interface, NULL for a bad index
+ */
+const char *iface_pool_name (int index);
+
+/**
+ * First interface not in tried_mask (bit n for interface n), those up
+ * before those cooling down.
+ *
+ * @param up_only skip interfaces cooling down after a failure
+ * @return interface index, or IFACE_POOL_NONE
+ */
+int iface_pool_select (unsigned int tried_mask, int up_only);
+
+/**
+ * Record a connect attempt; connect_ms (success only) is an rtt sample.
+ */
+void iface_pool_report_connect (int index, int ok, unsigned int connect_ms);
+
+/**
+ * Record a measured round trip, e.g. from a ping.
+ */
+void iface_pool_report_rtt (int index, unsigned int rtt_ms);
+
+void iface_pool_get_stats (int index, iface_stats_t *stats);
+
+/**
+ * Start a probe of an interface on the probe thread, unless one is running.
+ * A good probe ends any cooldown of the interface.
+ *
+ * @return 0 if the probe started
+ */
+int iface_pool_probe (int index, const char *host, unsigned int port);
+
+/**
+ * @return non zero while a probe is running
+ */
+int iface_pool_probing (void);
+
+/**
+ * @return non zero once the last IFACE_HEALTHY_PROBES probes were good
+ */
+int iface_pool_healthy (int index);
+
+/**
+ * Empty the list, waiting for a probe still running.
+ */
+void iface_pool_clear (void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _IFACE_POOL_H_ */
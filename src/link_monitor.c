@@ -0,0 +1,305 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/**
+ * @file link_monitor.c
+ *
+ * @description Link and address changes from rtnetlink.
+ *
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <net/if.h>
+#include <poll.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "link_monitor.h"
+#include "parodus_log.h"
+
+/*----------------------------------------------------------------------------*/
+/*                                   Macros                                   */
+/*----------------------------------------------------------------------------*/
+
+#define LINK_TRACK_MAX		16	// interfaces whose up state is kept
+#define LINK_READ_SIZE		8192
+
+/*----------------------------------------------------------------------------*/
+/*                               Data Structures                              */
+/*----------------------------------------------------------------------------*/
+
+typedef struct {
+	int index;
+	int up;
+} link_state_t;
+
+/*----------------------------------------------------------------------------*/
+/*                            File Scoped Variables                           */
+/*----------------------------------------------------------------------------*/
+
+static pthread_mutex_t link_mut = PTHREAD_MUTEX_INITIALIZER;
+static int nlSocket = -1;
+static pthread_t monitorThread;
+static int stopping = 0;
+static char watchName[IF_NAMESIZE];	// empty for every interface
+static int watchIndex = 0;
+static link_event_fn eventFn = NULL;
+static void *eventArg = NULL;
+static link_state_t linkStates[LINK_TRACK_MAX];
+
+/*----------------------------------------------------------------------------*/
+/*                             Internal functions                             */
+/*----------------------------------------------------------------------------*/
+
+static void report (int event, const char *addr)
+{
+	link_event_fn fn;
+	void *arg;
+
+	pthread_mutex_lock (&link_mut);
+	fn = eventFn;
+	arg = eventArg;
+	pthread_mutex_unlock (&link_mut);
+	if (NULL != fn)
+		fn (event, addr, arg);
+}
+
+static int watched (int index)
+{
+	int rtn;
+
+	pthread_mutex_lock (&link_mut);
+	rtn = ('\0' == watchName[0]) || (index == watchIndex);
+	pthread_mutex_unlock (&link_mut);
+	return rtn;
+}
+
+// returns the previous up state, -1 if unknown
+static int swap_link_state (int index, int up)
+{
+	int i, free_slot = -1, prev;
+
+	pthread_mutex_lock (&link_mut);
+	for (i = 0; i < LINK_TRACK_MAX; i++) {
+		if (linkStates[i].index == index)
+			break;
+		if ((0 == linkStates[i].index) && (free_slot < 0))
+			free_slot = i;
+	}
+	if (i == LINK_TRACK_MAX)
+		i = (free_slot < 0) ? index % LINK_TRACK_MAX : free_slot;
+	prev = (linkStates[i].index == index) ? linkStates[i].up : -1;
+	linkStates[i].index = index;
+	linkStates[i].up = up;
+	pthread_mutex_unlock (&link_mut);
+	return prev;
+}
+
+static void handle_link (const struct nlmsghdr *nh)
+{
+	const struct ifinfomsg *ifi = (const struct ifinfomsg *) NLMSG_DATA (nh);
+	const struct rtattr *rta;
+	int len = (int) nh->nlmsg_len - (int) NLMSG_LENGTH (sizeof(*ifi));
+	int up, prev;
+
+	if (len < 0)
+		return;
+	// a watched interface that was recreated comes back with a new index
+	for (rta = IFLA_RTA (ifi); RTA_OK (rta, len); rta = RTA_NEXT (rta, len)) {
+		if ((IFLA_IFNAME == rta->rta_type) && (RTM_NEWLINK == nh->nlmsg_type)) {
+			pthread_mutex_lock (&link_mut);
+			if (strncmp ((const char *) RTA_DATA (rta), watchName, IF_NAMESIZE) == 0)
+				watchIndex = ifi->ifi_index;
+			pthread_mutex_unlock (&link_mut);
+		}
+	}
+	if (!watched (ifi->ifi_index))
+		return;
+	up = (RTM_NEWLINK == nh->nlmsg_type) &&
+		(ifi->ifi_flags & IFF_UP) && (ifi->ifi_flags & IFF_RUNNING);
+	prev = swap_link_state (ifi->ifi_index, up);
+	if (prev == up)
+		return;
+	ParodusInfo ("Link %d is %s\n", ifi->ifi_index, up ? "up" : "down");
+	report (up ? LINK_EVENT_UP : LINK_EVENT_DOWN, NULL);
+}
+
+static void handle_addr (const struct nlmsghdr *nh)
+{
+	const struct ifaddrmsg *ifa = (const struct ifaddrmsg *) NLMSG_DATA (nh);
+	const struct rtattr *rta;
+	const void *local = NULL, *address = NULL;
+	char text[INET6_ADDRSTRLEN];
+	int len = (int) nh->nlmsg_len - (int) NLMSG_LENGTH (sizeof(*ifa));
+	unsigned int flags;
+
+	if (len < 0)
+		return;
+	if (!watched ((int) ifa->ifa_index) || (RT_SCOPE_UNIVERSE != ifa->ifa_scope))
+		return;
+	if ((AF_INET != ifa->ifa_family) && (AF_INET6 != ifa->ifa_family))
+		return;
+	flags = ifa->ifa_flags;
+	for (rta = IFA_RTA (ifa); RTA_OK (rta, len); rta = RTA_NEXT (rta, len)) {
+		if (IFA_LOCAL == rta->rta_type)
+			local = RTA_DATA (rta);
+		else if (IFA_ADDRESS == rta->rta_type)
+			address = RTA_DATA (rta);
+		else if (IFA_FLAGS == rta->rta_type)
+			flags = *(const unsigned int *) RTA_DATA (rta);
+	}
+	// on point to point links IFA_ADDRESS is the peer
+	if (NULL != local)
+		address = local;
+	if ((NULL == address) ||
+	    (NULL == inet_ntop (ifa->ifa_family, address, text, sizeof(text))))
+		return;
+	if (RTM_DELADDR == nh->nlmsg_type) {
+		ParodusInfo ("Address %s removed\n", text);
+		report (LINK_EVENT_ADDR_REMOVED, text);
+		return;
+	}
+	if (flags & (IFA_F_TENTATIVE | IFA_F_DADFAILED))
+		return;		// reported again once duplicate address detection is done
+	ParodusInfo ("Address %s added\n", text);
+	report (LINK_EVENT_ADDR_ADDED, text);
+}
+
+static void *monitor_thread (void *arg)
+{
+	union {
+		struct nlmsghdr nh;
+		char bytes[LINK_READ_SIZE];
+	} buf;
+	struct pollfd pfd;
+	ssize_t n;
+	int stop;
+
+	(void) arg;
+	pfd.fd = nlSocket;
+	pfd.events = POLLIN;
+	while (1) {
+		pthread_mutex_lock (&link_mut);
+		stop = stopping;
+		pthread_mutex_unlock (&link_mut);
+		if (stop)
+			break;
+		if (poll (&pfd, 1, LINK_MONITOR_POLL_MS) <= 0)
+			continue;
+		n = recv (nlSocket, &buf, sizeof(buf), 0);
+		if (n > 0)
+			link_monitor_process (&buf, (size_t) n);
+		else if ((n < 0) && (ENOBUFS == errno))
+			ParodusError ("Link monitor fell behind, events were lost\n");
+	}
+	return NULL;
+}
+
+/*----------------------------------------------------------------------------*/
+/*                             External Functions                             */
+/*----------------------------------------------------------------------------*/
+
+int link_monitor_start (const char *ifname, link_event_fn fn, void *arg)
+{
+	struct sockaddr_nl addr;
+	int fd, err;
+
+	pthread_mutex_lock (&link_mut);
+	if (-1 != nlSocket) {
+		pthread_mutex_unlock (&link_mut);
+		return -1;
+	}
+	fd = socket (AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+	if (fd < 0) {
+		pthread_mutex_unlock (&link_mut);
+		ParodusError ("Unable to open netlink socket: %s\n", strerror (errno));
+		return -1;
+	}
+	memset (&addr, 0, sizeof(addr));
+	addr.nl_family = AF_NETLINK;
+	addr.nl_groups = RTMGRP_LINK | RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR;
+	if (bind (fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+		pthread_mutex_unlock (&link_mut);
+		ParodusError ("Unable to bind netlink socket: %s\n", strerror (errno));
+		close (fd);
+		return -1;
+	}
+	memset (watchName, 0, sizeof(watchName));
+	if (NULL != ifname)
+		strncpy (watchName, ifname, sizeof(watchName) - 1);
+	watchIndex = ('\0' != watchName[0]) ? (int) if_nametoindex (watchName) : 0;
+	memset (linkStates, 0, sizeof(linkStates));
+	eventFn = fn;
+	eventArg = arg;
+	stopping = 0;
+	nlSocket = fd;
+	err = pthread_create (&monitorThread, NULL, monitor_thread, NULL);
+	if (0 != err) {
+		nlSocket = -1;
+		pthread_mutex_unlock (&link_mut);
+		ParodusError ("Error creating link monitor thread :[%s]\n", strerror (err));
+		close (fd);
+		return -1;
+	}
+	pthread_mutex_unlock (&link_mut);
+	ParodusInfo ("Monitoring %s for link and address changes\n",
+		('\0' != watchName[0]) ? watchName : "every interface");
+	return 0;
+}
+
+void link_monitor_stop (void)
+{
+	int fd;
+
+	pthread_mutex_lock (&link_mut);
+	fd = nlSocket;
+	stopping = 1;
+	pthread_mutex_unlock (&link_mut);
+	if (-1 == fd)
+		return;
+	pthread_join (monitorThread, NULL);
+	close (fd);
+	pthread_mutex_lock (&link_mut);
+	nlSocket = -1;
+	eventFn = NULL;
+	pthread_mutex_unlock (&link_mut);
+}
+
+void link_monitor_process (const void *buf, size_t len)
+{
+	const struct nlmsghdr *nh = (const struct nlmsghdr *) buf;
+	int remaining = (int) len;
+
+	for (; NLMSG_OK (nh, remaining); nh = NLMSG_NEXT (nh, remaining)) {
+		switch (nh->nlmsg_type) {
+		case RTM_NEWLINK:
+		case RTM_DELLINK:
+			handle_link (nh);
+			break;
+		case RTM_NEWADDR:
+		case RTM_DELADDR:
+			handle_addr (nh);
+			break;
+		default:
+			break;
+		}
+	}
+}
@@ -0,0 +1,84 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/**
+ * @file link_monitor.h
+ *
+ * @description Link and address changes on the interface the connection
+ *              uses, from rtnetlink (RTNLGRP_LINK, RTNLGRP_IPV4_IFADDR,
+ *              RTNLGRP_IPV6_IFADDR).
+ *
+ *              Events are reported on the monitor thread. An address only
+ *              counts once it is usable: global scope and, for ipv6, done
+ *              with duplicate address detection.
+ *
+ */
+
+#ifndef _LINK_MONITOR_H_
+#define _LINK_MONITOR_H_
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*----------------------------------------------------------------------------*/
+/*                                   Macros                                   */
+/*----------------------------------------------------------------------------*/
+
+#define LINK_EVENT_UP		1	// the link came up
+#define LINK_EVENT_DOWN		2	// the link went down
+#define LINK_EVENT_ADDR_ADDED	3	// a usable address appeared
+#define LINK_EVENT_ADDR_REMOVED	4
+
+#define LINK_MONITOR_POLL_MS	250	// how soon stop is noticed
+
+/*----------------------------------------------------------------------------*/
+/*                               Data Structures                              */
+/*----------------------------------------------------------------------------*/
+
+/**
+ * A link or address change.
+ * @param event LINK_EVENT_*
+ * @param addr the address, in text, for the address events; otherwise NULL
+ */
+typedef void (*link_event_fn)(int event, const char *addr, void *arg);
+
+/*----------------------------------------------------------------------------*/
+/*                             Function Prototypes                            */
+/*----------------------------------------------------------------------------*/
+
+/**
+ * Open the netlink socket and start the monitor thread.
+ * @param ifname the interface to watch, empty or NULL for all of them
+ * @return 0 on success
+ */
+int link_monitor_start (const char *ifname, link_event_fn fn, void *arg);
+
+void link_monitor_stop (void);
+
+/**
+ * Report the events in a buffer of rtnetlink messages, as read by the
+ * monitor thread.
+ */
+void link_monitor_process (const void *buf, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _LINK_MONITOR_H_ */
@@ -15,6 +15,7 @@
  *
  */
 #include "ParodusInternal.h"
+#include "dns_cache.h"
 
 /*----------------------------------------------------------------------------*/
 /*                                   Macros                                   */
@@ -50,50 +51,32 @@
 int checkHostIp(char * serverIP)
 {
 	int status = -1;
-	struct addrinfo *res, *result;
-	int retVal;
+	struct sockaddr_storage addrs[DNS_CACHE_MAX_ADDRS];
+	int count, i;
 	char addrstr[100];
 	void *ptr;
 	char *localIp = "10.0.0.1";
 
-	struct addrinfo hints;
-
-
 	ParodusPrint("...............Inside checkHostIp..............%s \n", serverIP);
 
-	memset(&hints,0,sizeof(hints));
-	hints.ai_family = AF_INET;
-	hints.ai_socktype = SOCK_STREAM;
-	hints.ai_protocol = 0;
-
-	retVal = getaddrinfo(serverIP, "http", &hints, &result);
-	if (retVal != 0) 
+	count = dns_cache_lookup(serverIP, AF_INET, addrs, DNS_CACHE_MAX_ADDRS);
+	for(i = 0; i < count; i++)
 	{
-		ParodusError("getaddrinfo: %s\n", gai_strerror(retVal));
-	}
-	else
-	{
-		res = result;
-		while(res)
-		{  
-			ptr = &((struct sockaddr_in *) res->ai_addr)->sin_addr;
-			inet_ntop (res->ai_family, ptr, addrstr, 100);
-		
-			ParodusPrint("IPv4 address of %s is %s \n", serverIP, addrstr);
-			if (strcmp(localIp,addrstr) == 0)
-			{
-				ParodusPrint("Host Ip resolved to 10.0.0.1\n");
-				status = -2;
-			}
-			else
-			{
-				ParodusPrint("Host Ip resolved correctly, proceeding with the connection\n");
-				status = 0;
-				break;
-			}
-			res = res->ai_next;
+		ptr = &((struct sockaddr_in *) &addrs[i])->sin_addr;
+		inet_ntop (AF_INET, ptr, addrstr, 100);
+	
+		ParodusPrint("IPv4 address of %s is %s \n", serverIP, addrstr);
+		if (strcmp(localIp,addrstr) == 0)
+		{
+			ParodusPrint("Host Ip resolved to 10.0.0.1\n");
+			status = -2;
+		}
+		else
+		{
+			ParodusPrint("Host Ip resolved correctly, proceeding with the connection\n");
+			status = 0;
+			break;
 		}
-		freeaddrinfo(result);
 	}
 	return status; 
 }  
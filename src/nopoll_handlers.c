@@ -56,14 +56,15 @@ void listenerOnMessage_queue(noPollCtx * ctx, noPollConn * conn, noPollMsg * msg
 {
     UNUSED(ctx);
     UNUSED(conn);
-    UNUSED(user_data);
+    // fragments are joined per connection; the primary uses previous_msg
+    noPollMsg **fragment = (NULL != user_data) ? (noPollMsg **) user_data : &previous_msg;
     noPollMsg  * aux;
 
 	if (nopoll_msg_is_fragment (msg))
 	{
 		ParodusInfo("Found fragment, FIN = %d \n", nopoll_msg_is_final (msg));
-		aux          = previous_msg;
-		previous_msg = nopoll_msg_join (previous_msg, msg);
+		aux          = *fragment;
+		*fragment    = nopoll_msg_join (*fragment, msg);
 		nopoll_msg_unref (aux);
 
 		if (! nopoll_msg_is_final (msg)) {
@@ -78,11 +79,11 @@ void listenerOnMessage_queue(noPollCtx * ctx, noPollConn * conn, noPollMsg * msg
 
     if(message)
     {
-        if(previous_msg)
+        if(*fragment)
         {
-			message->msg = previous_msg;
-		    message->payload = (void *)nopoll_msg_get_payload (previous_msg);
-		    message->len = nopoll_msg_get_payload_size (previous_msg);
+			message->msg = *fragment;
+		    message->payload = (void *)nopoll_msg_get_payload (*fragment);
+		    message->len = nopoll_msg_get_payload_size (*fragment);
 		    message->next = NULL;
         }
         else
@@ -122,7 +123,7 @@ void listenerOnMessage_queue(noPollCtx * ctx, noPollConn * conn, noPollMsg * msg
         //Memory allocation failed
         ParodusError("Memory allocation is failed\n");
     }
-	previous_msg = NULL;
+	*fragment = NULL;
     ParodusPrint("*****Returned from listenerOnMessage_queue*****\n");
 }
 
@@ -141,6 +142,13 @@ void listenerOnPingMessage (noPollCtx * ctx, noPollConn * conn, noPollMsg * msg,
     UNUSED(conn);
 
     noPollPtr payload = NULL;
+
+    // our own pings are answered with an empty pong
+    if (nopoll_msg_opcode(msg) == NOPOLL_PONG_FRAME)
+    {
+        conn_machine_pong();
+        return;
+    }
     payload = (noPollPtr ) nopoll_msg_get_payload(msg);
 
     if ((payload!=NULL)) 
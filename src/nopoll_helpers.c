@@ -38,6 +38,15 @@ struct timespec connStuck_start,connStuck_end;
 struct timespec *connStuck_startPtr = &connStuck_start;
 struct timespec *connStuck_endPtr = &connStuck_end;
 
+/*----------------------------------------------------------------------------*/
+/*                            File Scoped Variables                           */
+/*----------------------------------------------------------------------------*/
+
+// held for a whole message, so the frames of messages sent from different
+// threads (upstream, uplink shard fallbacks and pings) do not interleave;
+// also guards connErr
+static pthread_mutex_t send_mut = PTHREAD_MUTEX_INITIALIZER;
+
 /*----------------------------------------------------------------------------*/
 /*                             External functions                             */
 /*----------------------------------------------------------------------------*/
@@ -49,6 +58,18 @@ void setMessageHandlers()
     nopoll_conn_set_on_close(get_global_conn(), (noPollOnCloseHandler)listenerOnCloseMessage, NULL);
 }
 
+// a shard is not the primary: it joins its own fragments, and its pings
+// and close do not touch the heartbeat or close_retry
+void setShardMessageHandlers(noPollConn *conn, noPollMsg **fragment)
+{
+    if (NULL != *fragment)
+    {
+        nopoll_msg_unref(*fragment);	// left by the shard's last connection
+        *fragment = NULL;
+    }
+    nopoll_conn_set_on_msg(conn, (noPollOnMessageHandler) listenerOnMessage_queue, fragment);
+}
+
 /** To send upstream msgs to server ***/
 
 void sendMessage(noPollConn *conn, void *msg, size_t len)
@@ -59,6 +80,7 @@ void sendMessage(noPollConn *conn, void *msg, size_t len)
 
     ParodusInfo("sendMessage length %zu\n", len);
 
+    pthread_mutex_lock(&send_mut);
     if(nopoll_conn_is_ok(conn) && nopoll_conn_is_ready(conn))
     {
         //bytesWritten = nopoll_conn_send_binary(conn, msg, len);
@@ -93,6 +115,18 @@ void sendMessage(noPollConn *conn, void *msg, size_t len)
 
 		}
     }
+    pthread_mutex_unlock(&send_mut);
+}
+
+// the main loop pings the primary that upstream writes to
+nopoll_bool sendPing(noPollConn *conn)
+{
+    nopoll_bool sent;
+
+    pthread_mutex_lock(&send_mut);
+    sent = nopoll_conn_send_ping(conn);
+    pthread_mutex_unlock(&send_mut);
+    return sent;
 }
 
 int sendResponse(noPollConn * conn, void * buffer, size_t length)
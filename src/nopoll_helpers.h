@@ -41,7 +41,9 @@ extern "C" {
  */
 int sendResponse(noPollConn * conn,void *str, size_t bufferSize);
 void setMessageHandlers();
+void setShardMessageHandlers(noPollConn *conn, noPollMsg **fragment);
 void sendMessage(noPollConn *conn, void *msg, size_t len);
+nopoll_bool sendPing(noPollConn *conn);
 
 /**
  * @brief __report_log Nopoll log handler 
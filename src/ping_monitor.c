@@ -0,0 +1,216 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/**
+ * @file ping_monitor.c
+ *
+ * @description Client side pings on the connection.
+ *
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "ping_monitor.h"
+
+/*----------------------------------------------------------------------------*/
+/*                            File Scoped Variables                           */
+/*----------------------------------------------------------------------------*/
+
+static pthread_mutex_t ping_mut = PTHREAD_MUTEX_INITIALIZER;
+static unsigned int intervalMs = 0;
+static unsigned int maxWaitMs = 0;
+static int inFlight = 0;
+static uint64_t sentAt = 0;		// ms, monotonic
+static uint64_t nextPingAt = 0;
+static unsigned int pingsSent = 0;
+static unsigned int missed = 0;		// pings in a row past their deadline
+static unsigned int pongs = 0;
+static unsigned int srttMs = 0;
+static unsigned int rttvarMs = 0;
+static unsigned int samples[PING_RTT_SAMPLES];	// ring of the latest round trips
+static unsigned int sampleCount = 0;
+
+/*----------------------------------------------------------------------------*/
+/*                             Internal functions                             */
+/*----------------------------------------------------------------------------*/
+
+static uint64_t now_ms (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000 + (uint64_t) ts.tv_nsec / 1000000;
+}
+
+/* rttvar = 3/4 rttvar + 1/4 |srtt - r|, srtt = 7/8 srtt + 1/8 r (rfc 6298) */
+static void add_sample (unsigned int rtt_ms)
+{
+	unsigned int delta;
+
+	if (0 == pongs) {
+		srttMs = rtt_ms;
+		rttvarMs = rtt_ms / 2;
+	} else {
+		delta = (srttMs > rtt_ms) ? srttMs - rtt_ms : rtt_ms - srttMs;
+		rttvarMs = (3 * rttvarMs + delta) / 4;
+		srttMs = (7 * srttMs + rtt_ms) / 8;
+	}
+	samples[sampleCount % PING_RTT_SAMPLES] = rtt_ms;
+	sampleCount++;
+	pongs++;
+}
+
+static unsigned int wait_ms (void)
+{
+	unsigned int wait;
+
+	wait = (0 == pongs) ? PING_WAIT_INITIAL_MS : srttMs + 4 * rttvarMs;
+	if (wait < PING_WAIT_MIN_MS)
+		wait = PING_WAIT_MIN_MS;
+	// a pong is not late before the next ping would be due
+	if (wait < intervalMs)
+		wait = intervalMs;
+	if ((0 != maxWaitMs) && (wait > maxWaitMs))
+		wait = maxWaitMs;
+	return wait;
+}
+
+/* nearest rank of the sorted samples */
+static unsigned int percentile (const unsigned int *sorted, unsigned int count,
+	unsigned int pct)
+{
+	unsigned int rank;
+
+	if (0 == count)
+		return 0;
+	rank = (pct * count + 99) / 100;
+	return sorted[(0 == rank) ? 0 : rank - 1];
+}
+
+/*----------------------------------------------------------------------------*/
+/*                             External Functions                             */
+/*----------------------------------------------------------------------------*/
+
+void ping_monitor_start (unsigned int interval_ms, unsigned int max_wait_ms)
+{
+	pthread_mutex_lock (&ping_mut);
+	intervalMs = interval_ms;
+	maxWaitMs = max_wait_ms;
+	inFlight = 0;
+	nextPingAt = now_ms () + interval_ms;
+	pingsSent = pongs = 0;
+	missed = 0;
+	srttMs = rttvarMs = 0;
+	sampleCount = 0;
+	pthread_mutex_unlock (&ping_mut);
+}
+
+int ping_monitor_next_ms (void)
+{
+	uint64_t now = now_ms ();
+	uint64_t at;
+	int next = -1;
+
+	pthread_mutex_lock (&ping_mut);
+	if (0 != intervalMs) {
+		at = inFlight ? sentAt + wait_ms () : nextPingAt;
+		next = (at > now) ? (int) (at - now) : 0;
+	}
+	pthread_mutex_unlock (&ping_mut);
+	return next;
+}
+
+int ping_monitor_due (void)
+{
+	int due;
+
+	pthread_mutex_lock (&ping_mut);
+	due = (0 != intervalMs) && !inFlight && (now_ms () >= nextPingAt);
+	pthread_mutex_unlock (&ping_mut);
+	return due;
+}
+
+void ping_monitor_sent (void)
+{
+	pthread_mutex_lock (&ping_mut);
+	inFlight = 1;
+	sentAt = now_ms ();
+	nextPingAt = sentAt + intervalMs;
+	pingsSent++;
+	pthread_mutex_unlock (&ping_mut);
+}
+
+int ping_monitor_pong (void)
+{
+	int rtt = -1;
+
+	pthread_mutex_lock (&ping_mut);
+	// late or not, the connection is alive
+	missed = 0;
+	if (inFlight) {
+		rtt = (int) (now_ms () - sentAt);
+		inFlight = 0;
+		add_sample ((unsigned int) rtt);
+	}
+	pthread_mutex_unlock (&ping_mut);
+	return rtt;
+}
+
+int ping_monitor_expired (void)
+{
+	int expired;
+
+	pthread_mutex_lock (&ping_mut);
+	// a miss makes way for the next ping, whose pong still counts
+	if (inFlight && (now_ms () > sentAt + wait_ms ())) {
+		inFlight = 0;
+		missed++;
+	}
+	expired = (missed >= PING_MISS_LIMIT);
+	pthread_mutex_unlock (&ping_mut);
+	return expired;
+}
+
+void ping_monitor_get_stats (ping_stats_t *stats)
+{
+	unsigned int sorted[PING_RTT_SAMPLES];
+	unsigned int count, value;
+	unsigned int i, j;
+
+	pthread_mutex_lock (&ping_mut);
+	count = (sampleCount < PING_RTT_SAMPLES) ? sampleCount : PING_RTT_SAMPLES;
+	memcpy (sorted, samples, count * sizeof(unsigned int));
+	stats->sent = pingsSent;
+	stats->pongs = pongs;
+	stats->missed = missed;
+	stats->srtt_ms = srttMs;
+	stats->rttvar_ms = rttvarMs;
+	stats->wait_ms = wait_ms ();
+	pthread_mutex_unlock (&ping_mut);
+
+	for (i = 1; i < count; i++) {
+		value = sorted[i];
+		for (j = i; (j > 0) && (sorted[j - 1] > value); j--)
+			sorted[j] = sorted[j - 1];
+		sorted[j] = value;
+	}
+	stats->p50_ms = percentile (sorted, count, 50);
+	stats->p90_ms = percentile (sorted, count, 90);
+	stats->p99_ms = percentile (sorted, count, 99);
+}
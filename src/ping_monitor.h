@@ -0,0 +1,108 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/**
+ * @file ping_monitor.h
+ *
+ * @description Client side pings on the connection.
+ *
+ *              One ping is in flight at a time. Pong round trips are
+ *              smoothed as for tcp (srtt, rttvar), and a ping whose pong is
+ *              later than srtt + 4 * rttvar, at least PING_WAIT_MIN_MS and
+ *              the ping interval and at most the configured ceiling, is
+ *              missed. PING_MISS_LIMIT misses in a row, with no pong at
+ *              all between them, mark the connection dead. The last
+ *              PING_RTT_SAMPLES round trips are kept for percentiles.
+ *
+ */
+
+#ifndef _PING_MONITOR_H_
+#define _PING_MONITOR_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*----------------------------------------------------------------------------*/
+/*                                   Macros                                   */
+/*----------------------------------------------------------------------------*/
+
+#define PING_RTT_SAMPLES	64
+#define PING_WAIT_INITIAL_MS	3000	// until the first pong
+#define PING_WAIT_MIN_MS	1000
+#define PING_MISS_LIMIT		3	// missed pings in a row for a dead connection
+#define PING_REPORT_EVERY	60	// pongs between percentile logs
+
+/*----------------------------------------------------------------------------*/
+/*                               Data Structures                              */
+/*----------------------------------------------------------------------------*/
+
+typedef struct {
+	unsigned int sent;
+	unsigned int pongs;
+	unsigned int missed;	// pings in a row without a pong
+	unsigned int srtt_ms;
+	unsigned int rttvar_ms;
+	unsigned int wait_ms;	// current pong deadline
+	unsigned int p50_ms;	// percentiles of the kept samples, 0 if none
+	unsigned int p90_ms;
+	unsigned int p99_ms;
+} ping_stats_t;
+
+/*----------------------------------------------------------------------------*/
+/*                             Function Prototypes                            */
+/*----------------------------------------------------------------------------*/
+
+/**
+ * Start pinging a new connection, forgetting the last one.
+ * @param interval_ms time between pings, 0 to stop pinging
+ * @param max_wait_ms ceiling on the pong deadline
+ */
+void ping_monitor_start (unsigned int interval_ms, unsigned int max_wait_ms);
+
+/**
+ * @return ms until a ping is due or the pong is late, 0 if now,
+ *         -1 when pinging is off
+ */
+int ping_monitor_next_ms (void);
+
+/**
+ * @return non zero if a ping should be sent now
+ */
+int ping_monitor_due (void);
+
+void ping_monitor_sent (void);
+
+/**
+ * Any pong clears the misses.
+ * @return round trip in ms of the ping in flight, -1 for a pong that
+ *         answers no ping of ours, or a late one
+ */
+int ping_monitor_pong (void);
+
+/**
+ * Counts the ping in flight as missed once it is past its deadline.
+ * @return non zero once PING_MISS_LIMIT pings in a row were missed
+ */
+int ping_monitor_expired (void);
+
+void ping_monitor_get_stats (ping_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _PING_MONITOR_H_ */
@@ -0,0 +1,237 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/**
+ * @file server_pool.c
+ *
+ * @description Ranked pool of server urls.
+ *
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "server_pool.h"
+#include "parodus_log.h"
+
+/*----------------------------------------------------------------------------*/
+/*                               Data Structures                              */
+/*----------------------------------------------------------------------------*/
+
+typedef struct {
+	char *url;
+	unsigned int rtt_ms;	// smoothed, 0 until measured
+	unsigned int failures;	// consecutive
+	uint64_t down_until;	// ms, monotonic
+} pool_entry_t;
+
+/*----------------------------------------------------------------------------*/
+/*                            File Scoped Variables                           */
+/*----------------------------------------------------------------------------*/
+
+static pool_entry_t serverPool[SERVER_POOL_MAX];
+static int serverPoolCount = 0;
+static pthread_mutex_t server_pool_mut = PTHREAD_MUTEX_INITIALIZER;
+
+/*----------------------------------------------------------------------------*/
+/*                             Internal functions                             */
+/*----------------------------------------------------------------------------*/
+
+static uint64_t now_ms (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000 + (uint64_t) ts.tv_nsec / 1000000;
+}
+
+static int valid_index (int index)
+{
+	return (index >= 0) && (index < serverPoolCount);
+}
+
+/* rtt = 7/8 rtt + 1/8 sample, as for tcp srtt */
+static void add_rtt_sample (pool_entry_t *entry, unsigned int rtt_ms)
+{
+	if (0 == rtt_ms)
+		rtt_ms = 1;
+	if (0 == entry->rtt_ms)
+		entry->rtt_ms = rtt_ms;
+	else
+		entry->rtt_ms = (7 * entry->rtt_ms + rtt_ms) / 8;
+}
+
+/* is a a better choice than b */
+static int better (pool_entry_t *a, pool_entry_t *b, uint64_t now)
+{
+	int a_up = (now >= a->down_until), b_up = (now >= b->down_until);
+
+	if (a_up != b_up)
+		return a_up;
+	if (!a_up && (a->down_until != b->down_until))
+		return a->down_until < b->down_until;
+	return a->rtt_ms < b->rtt_ms;
+}
+
+/*----------------------------------------------------------------------------*/
+/*                             External Functions                             */
+/*----------------------------------------------------------------------------*/
+
+int server_pool_init (const char *urls)
+{
+	pool_entry_t old[SERVER_POOL_MAX];
+	int old_count, count = 0, i;
+	char *list, *url, *save = NULL;
+
+	pthread_mutex_lock (&server_pool_mut);
+	memcpy (old, serverPool, sizeof(old));
+	old_count = serverPoolCount;
+	memset (serverPool, 0, sizeof(serverPool));
+	list = (NULL != urls) ? strdup (urls) : NULL;
+	for (url = (NULL != list) ? strtok_r (list, ", ", &save) : NULL;
+	     (NULL != url) && (count < SERVER_POOL_MAX);
+	     url = strtok_r (NULL, ", ", &save)) {
+		for (i = 0; i < count; i++) {
+			if (strcmp (serverPool[i].url, url) == 0)
+				break;
+		}
+		if (i < count)
+			continue;	// listed twice
+		for (i = 0; i < old_count; i++) {
+			if ((NULL != old[i].url) && (strcmp (old[i].url, url) == 0))
+				break;
+		}
+		if (i < old_count) {
+			serverPool[count] = old[i];
+			old[i].url = NULL;
+		} else {
+			serverPool[count].url = strdup (url);
+		}
+		if (NULL != serverPool[count].url)
+			count++;
+	}
+	serverPoolCount = count;
+	for (i = 0; i < old_count; i++)
+		free (old[i].url);
+	free (list);
+	pthread_mutex_unlock (&server_pool_mut);
+	ParodusInfo ("server pool has %d endpoints\n", count);
+	return count;
+}
+
+int server_pool_count (void)
+{
+	int count;
+
+	pthread_mutex_lock (&server_pool_mut);
+	count = serverPoolCount;
+	pthread_mutex_unlock (&server_pool_mut);
+	return count;
+}
+
+const char *server_pool_url (int index)
+{
+	const char *url = NULL;
+
+	// urls only change in server_pool_init/clear, on the connection thread
+	pthread_mutex_lock (&server_pool_mut);
+	if (valid_index (index))
+		url = serverPool[index].url;
+	pthread_mutex_unlock (&server_pool_mut);
+	return url;
+}
+
+int server_pool_select (unsigned int tried_mask, int up_only)
+{
+	uint64_t now = now_ms ();
+	int best = SERVER_POOL_NONE, i;
+
+	pthread_mutex_lock (&server_pool_mut);
+	for (i = 0; i < serverPoolCount; i++) {
+		if (tried_mask & (1U << i))
+			continue;
+		if (up_only && (now < serverPool[i].down_until))
+			continue;
+		if ((SERVER_POOL_NONE == best) ||
+		    better (&serverPool[i], &serverPool[best], now))
+			best = i;
+	}
+	pthread_mutex_unlock (&server_pool_mut);
+	return best;
+}
+
+void server_pool_report_connect (int index, int ok, unsigned int connect_ms)
+{
+	pool_entry_t *entry;
+	unsigned int cooldown, n;
+
+	pthread_mutex_lock (&server_pool_mut);
+	if (!valid_index (index)) {
+		pthread_mutex_unlock (&server_pool_mut);
+		return;
+	}
+	entry = &serverPool[index];
+	if (ok) {
+		entry->failures = 0;
+		entry->down_until = 0;
+		add_rtt_sample (entry, connect_ms);
+	} else {
+		entry->failures++;
+		cooldown = SERVER_POOL_COOLDOWN;
+		for (n = 1; (n < entry->failures) && (cooldown < SERVER_POOL_COOLDOWN_MAX); n++)
+			cooldown *= 2;
+		if (cooldown > SERVER_POOL_COOLDOWN_MAX)
+			cooldown = SERVER_POOL_COOLDOWN_MAX;
+		entry->down_until = now_ms () + (uint64_t) cooldown * 1000;
+		ParodusInfo ("server %s failed %u times, skipped for %u s\n",
+			entry->url, entry->failures, cooldown);
+	}
+	pthread_mutex_unlock (&server_pool_mut);
+}
+
+void server_pool_report_rtt (int index, unsigned int rtt_ms)
+{
+	pthread_mutex_lock (&server_pool_mut);
+	if (valid_index (index))
+		add_rtt_sample (&serverPool[index], rtt_ms);
+	pthread_mutex_unlock (&server_pool_mut);
+}
+
+unsigned int server_pool_rtt (int index)
+{
+	unsigned int rtt_ms = 0;
+
+	pthread_mutex_lock (&server_pool_mut);
+	if (valid_index (index))
+		rtt_ms = serverPool[index].rtt_ms;
+	pthread_mutex_unlock (&server_pool_mut);
+	return rtt_ms;
+}
+
+void server_pool_clear (void)
+{
+	int i;
+
+	pthread_mutex_lock (&server_pool_mut);
+	for (i = 0; i < serverPoolCount; i++)
+		free (serverPool[i].url);
+	memset (serverPool, 0, sizeof(serverPool));
+	serverPoolCount = 0;
+	pthread_mutex_unlock (&server_pool_mut);
+}
@@ -0,0 +1,96 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/**
+ * @file server_pool.h
+ *
+ * @description Ranked pool of server urls.
+ *
+ *              Each endpoint keeps a smoothed rtt, fed from connect times
+ *              and pings, and a count of consecutive failures. A failed
+ *              endpoint is left alone for a cooldown that doubles with each
+ *              failure, so a reconnect goes to the best endpoint still up
+ *              instead of backing off against a dead one.
+ *
+ */
+
+#ifndef _SERVER_POOL_H_
+#define _SERVER_POOL_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*----------------------------------------------------------------------------*/
+/*                                   Macros                                   */
+/*----------------------------------------------------------------------------*/
+
+#define SERVER_POOL_MAX			8
+#define SERVER_POOL_NONE		-1
+#define SERVER_POOL_COOLDOWN		10	// seconds after a first failure
+#define SERVER_POOL_COOLDOWN_MAX	300	// seconds
+
+/*----------------------------------------------------------------------------*/
+/*                             Function Prototypes                            */
+/*----------------------------------------------------------------------------*/
+
+/**
+ * Load the pool from a comma separated url list, keeping the scores of
+ * urls already in the pool.
+ *
+ * @return number of endpoints
+ */
+int server_pool_init (const char *urls);
+
+int server_pool_count (void);
+
+/**
+ * @return the url of an endpoint, NULL for a bad index
+ */
+const char *server_pool_url (int index);
+
+/**
+ * Best endpoint not in tried_mask (bit n for endpoint n): endpoints up
+ * before those cooling down, then lowest rtt, then pool order. Unmeasured
+ * endpoints rank as fastest, so each gets tried.
+ *
+ * @param up_only skip endpoints cooling down after a failure
+ * @return endpoint index, or SERVER_POOL_NONE
+ */
+int server_pool_select (unsigned int tried_mask, int up_only);
+
+/**
+ * Record a connect attempt; connect_ms (success only) is an rtt sample.
+ */
+void server_pool_report_connect (int index, int ok, unsigned int connect_ms);
+
+/**
+ * Record a measured round trip, e.g. from a ping.
+ */
+void server_pool_report_rtt (int index, unsigned int rtt_ms);
+
+/**
+ * @return smoothed rtt in ms, 0 if not measured
+ */
+unsigned int server_pool_rtt (int index);
+
+void server_pool_clear (void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SERVER_POOL_H_ */
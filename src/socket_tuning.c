@@ -0,0 +1,204 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/**
+ * @file socket_tuning.c
+ *
+ * @description Kernel options for the sockets of server connections.
+ *
+ */
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include "socket_tuning.h"
+#include "parodus_log.h"
+
+/*----------------------------------------------------------------------------*/
+/*                            File Scoped Variables                           */
+/*----------------------------------------------------------------------------*/
+
+static pthread_mutex_t socket_tuning_mut = PTHREAD_MUTEX_INITIALIZER;
+static socket_tuning_t activeTuning;
+static int tuningSet = 0;
+
+/*----------------------------------------------------------------------------*/
+/*                             Internal functions                             */
+/*----------------------------------------------------------------------------*/
+
+static int parse_uint (const char *value, unsigned int *result)
+{
+	char *end;
+	unsigned long num;
+
+	if ((NULL == value) || ('\0' == *value) || ('-' == *value))
+		return -1;
+	errno = 0;
+	num = strtoul (value, &end, 10);
+	if ((0 != errno) || ('\0' != *end) || (num > 0x7fffffffUL))
+		return -1;
+	*result = (unsigned int) num;
+	return 0;
+}
+
+static int parse_keepalive (const char *value, socket_tuning_t *tuning)
+{
+	char extra;
+
+	if ((NULL == value) || (3 != sscanf (value, "%u:%u:%u%c",
+	      &tuning->keepalive_idle, &tuning->keepalive_interval,
+	      &tuning->keepalive_count, &extra)))
+		return -1;
+	if ((0 == tuning->keepalive_idle) || (0 == tuning->keepalive_interval) ||
+	    (0 == tuning->keepalive_count))
+		return -1;
+	return 0;
+}
+
+static int parse_option (char *option, socket_tuning_t *tuning)
+{
+	char *value = strchr (option, '=');
+
+	if (NULL != value)
+		*value++ = '\0';
+	if (strcmp (option, "keepalive") == 0)
+		return parse_keepalive (value, tuning);
+	if (strcmp (option, "user-timeout") == 0)
+		return parse_uint (value, &tuning->user_timeout_ms);
+	if (strcmp (option, "sndbuf") == 0)
+		return parse_uint (value, &tuning->sndbuf);
+	if (strcmp (option, "rcvbuf") == 0)
+		return parse_uint (value, &tuning->rcvbuf);
+	if (strcmp (option, "notsent-lowat") == 0)
+		return parse_uint (value, &tuning->notsent_lowat);
+	if ((strcmp (option, "nodelay") == 0) && (NULL == value)) {
+		tuning->nodelay = 1;
+		return 0;
+	}
+	return -1;
+}
+
+// returns 1 if the option could not be set
+static int set_option (int fd, int level, int name, unsigned int value,
+	const char *label)
+{
+	int optval = (int) value;
+
+	if (setsockopt (fd, level, name, &optval, sizeof(optval)) < 0) {
+		ParodusError ("Unable to set %s on socket %d: %s\n", label, fd,
+			strerror (errno));
+		return 1;
+	}
+	return 0;
+}
+
+/*----------------------------------------------------------------------------*/
+/*                             External Functions                             */
+/*----------------------------------------------------------------------------*/
+
+int socket_tuning_parse (const char *spec, socket_tuning_t *tuning)
+{
+	char *copy, *option, *save = NULL;
+	int rtn = 0;
+
+	memset (tuning, 0, sizeof(socket_tuning_t));
+	if (NULL == spec)
+		return -1;
+	copy = strdup (spec);
+	if (NULL == copy)
+		return -1;
+	for (option = strtok_r (copy, ",", &save); NULL != option;
+	     option = strtok_r (NULL, ",", &save)) {
+		if (parse_option (option, tuning) < 0) {
+			ParodusError ("Invalid socket tuning option %s\n", option);
+			rtn = -1;
+			break;
+		}
+	}
+	free (copy);
+	return rtn;
+}
+
+int socket_tuning_init (const char *spec)
+{
+	socket_tuning_t tuning;
+	int rtn = 0;
+
+	memset (&tuning, 0, sizeof(tuning));
+	if ((NULL != spec) && (socket_tuning_parse (spec, &tuning) < 0))
+		rtn = -1;
+	pthread_mutex_lock (&socket_tuning_mut);
+	activeTuning = tuning;
+	tuningSet = (NULL != spec) && (0 == rtn);
+	pthread_mutex_unlock (&socket_tuning_mut);
+	return rtn;
+}
+
+int socket_tuning_apply (int fd)
+{
+	socket_tuning_t tuning;
+	int failed = 0;
+
+	pthread_mutex_lock (&socket_tuning_mut);
+	if (!tuningSet) {
+		pthread_mutex_unlock (&socket_tuning_mut);
+		return 0;
+	}
+	tuning = activeTuning;
+	pthread_mutex_unlock (&socket_tuning_mut);
+
+	if (0 != tuning.keepalive_idle) {
+		failed += set_option (fd, SOL_SOCKET, SO_KEEPALIVE, 1, "SO_KEEPALIVE");
+		failed += set_option (fd, IPPROTO_TCP, TCP_KEEPIDLE,
+			tuning.keepalive_idle, "TCP_KEEPIDLE");
+		failed += set_option (fd, IPPROTO_TCP, TCP_KEEPINTVL,
+			tuning.keepalive_interval, "TCP_KEEPINTVL");
+		failed += set_option (fd, IPPROTO_TCP, TCP_KEEPCNT,
+			tuning.keepalive_count, "TCP_KEEPCNT");
+	}
+	if (0 != tuning.user_timeout_ms) {
+#ifdef TCP_USER_TIMEOUT
+		failed += set_option (fd, IPPROTO_TCP, TCP_USER_TIMEOUT,
+			tuning.user_timeout_ms, "TCP_USER_TIMEOUT");
+#else
+		ParodusError ("TCP_USER_TIMEOUT is not supported\n");
+		failed++;
+#endif
+	}
+	if (0 != tuning.sndbuf)
+		failed += set_option (fd, SOL_SOCKET, SO_SNDBUF, tuning.sndbuf, "SO_SNDBUF");
+	if (0 != tuning.rcvbuf)
+		failed += set_option (fd, SOL_SOCKET, SO_RCVBUF, tuning.rcvbuf, "SO_RCVBUF");
+	if (tuning.nodelay)
+		failed += set_option (fd, IPPROTO_TCP, TCP_NODELAY, 1, "TCP_NODELAY");
+	if (0 != tuning.notsent_lowat) {
+#ifdef TCP_NOTSENT_LOWAT
+		failed += set_option (fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT,
+			tuning.notsent_lowat, "TCP_NOTSENT_LOWAT");
+#else
+		ParodusError ("TCP_NOTSENT_LOWAT is not supported\n");
+		failed++;
+#endif
+	}
+	ParodusPrint ("Socket %d tuned, %d options failed\n", fd, failed);
+	return failed;
+}
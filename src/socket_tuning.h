@@ -0,0 +1,85 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/**
+ * @file socket_tuning.h
+ *
+ * @description Kernel options for the sockets of server connections.
+ *
+ *              The profile is a comma separated list, e.g.
+ *              "keepalive=30:10:3,user-timeout=60000,sndbuf=65536,
+ *              rcvbuf=131072,nodelay,notsent-lowat=16384":
+ *
+ *              keepalive=idle:interval:count  SO_KEEPALIVE, seconds
+ *              user-timeout=ms                TCP_USER_TIMEOUT
+ *              sndbuf=bytes, rcvbuf=bytes     SO_SNDBUF, SO_RCVBUF
+ *              nodelay                        TCP_NODELAY
+ *              notsent-lowat=bytes            TCP_NOTSENT_LOWAT
+ *
+ *              Options left out keep the kernel default.
+ *
+ */
+
+#ifndef _SOCKET_TUNING_H_
+#define _SOCKET_TUNING_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*----------------------------------------------------------------------------*/
+/*                               Data Structures                              */
+/*----------------------------------------------------------------------------*/
+
+typedef struct {
+	unsigned int keepalive_idle;	// seconds, 0 leaves keepalive off
+	unsigned int keepalive_interval;	// seconds
+	unsigned int keepalive_count;
+	unsigned int user_timeout_ms;	// 0 for the kernel default
+	unsigned int sndbuf;		// bytes, 0 for the kernel default
+	unsigned int rcvbuf;
+	unsigned int nodelay;
+	unsigned int notsent_lowat;	// bytes, 0 for the kernel default
+} socket_tuning_t;
+
+/*----------------------------------------------------------------------------*/
+/*                             Function Prototypes                            */
+/*----------------------------------------------------------------------------*/
+
+/**
+ * Parse a profile.
+ * @return 0 on success, -1 for a bad profile
+ */
+int socket_tuning_parse (const char *spec, socket_tuning_t *tuning);
+
+/**
+ * Set the profile applied by socket_tuning_apply.
+ * @param spec the profile, NULL to apply none
+ * @return 0 on success, -1 for a bad profile, which applies none
+ */
+int socket_tuning_init (const char *spec);
+
+/**
+ * Apply the profile to a connected socket. Failures are logged.
+ * @return number of options that could not be set
+ */
+int socket_tuning_apply (int fd);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SOCKET_TUNING_H_ */
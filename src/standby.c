@@ -0,0 +1,199 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/**
+ * @file standby.c
+ *
+ * @description Warm standby connection.
+ *
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "standby.h"
+#include "parodus_log.h"
+
+/*----------------------------------------------------------------------------*/
+/*                               Data Structures                              */
+/*----------------------------------------------------------------------------*/
+
+typedef struct {
+	standby_build_fn build;
+	void *arg;
+	unsigned int generation;
+} build_job_t;
+
+/*----------------------------------------------------------------------------*/
+/*                            File Scoped Variables                           */
+/*----------------------------------------------------------------------------*/
+
+static pthread_mutex_t standby_mut = PTHREAD_MUTEX_INITIALIZER;
+static int standbyState = STANDBY_EMPTY;
+static void *standbyHandle = NULL;
+static int standbyTag = 0;
+static standby_release_fn standbyRelease = NULL;
+static unsigned int standbyGeneration = 0;	// bumped to drop a build
+static uint64_t nextBuildMs = 0;		// monotonic
+
+/*----------------------------------------------------------------------------*/
+/*                             Internal functions                             */
+/*----------------------------------------------------------------------------*/
+
+static uint64_t now_ms (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000 + (uint64_t) ts.tv_nsec / 1000000;
+}
+
+static void *build_thread (void *arg)
+{
+	build_job_t *job = (build_job_t *) arg;
+	standby_release_fn release;
+	void *handle;
+	int keep = 0;
+
+	handle = job->build (job->arg);
+	pthread_mutex_lock (&standby_mut);
+	release = standbyRelease;
+	if (job->generation == standbyGeneration) {
+		if (NULL != handle) {
+			standbyHandle = handle;
+			standbyState = STANDBY_READY;
+			keep = 1;
+		} else {
+			standbyState = STANDBY_EMPTY;
+			nextBuildMs = now_ms () + STANDBY_RETRY_MS;
+		}
+	}
+	pthread_mutex_unlock (&standby_mut);
+
+	if (keep) {
+		ParodusInfo ("Warm standby connection ready\n");
+	} else if (NULL != handle) {
+		release (handle);	// discarded while it was being built
+	} else {
+		ParodusError ("Warm standby connection failed, retry in %d s\n",
+			STANDBY_RETRY_MS / 1000);
+	}
+	free (job);
+	return NULL;
+}
+
+/*----------------------------------------------------------------------------*/
+/*                             External Functions                             */
+/*----------------------------------------------------------------------------*/
+
+int standby_build (standby_build_fn build, standby_release_fn release,
+	void *arg, int tag)
+{
+	build_job_t *job;
+	pthread_attr_t attr;
+	pthread_t threadId;
+	int err;
+
+	pthread_mutex_lock (&standby_mut);
+	if ((STANDBY_EMPTY != standbyState) || (now_ms () < nextBuildMs)) {
+		pthread_mutex_unlock (&standby_mut);
+		return -1;
+	}
+	job = (build_job_t *) malloc (sizeof(build_job_t));
+	if (NULL == job) {
+		pthread_mutex_unlock (&standby_mut);
+		ParodusError ("Unable to allocate standby build\n");
+		return -1;
+	}
+	job->build = build;
+	job->arg = arg;
+	job->generation = ++standbyGeneration;
+	standbyRelease = release;
+	standbyTag = tag;
+	standbyState = STANDBY_BUILDING;
+
+	pthread_attr_init (&attr);
+	pthread_attr_setdetachstate (&attr, PTHREAD_CREATE_DETACHED);
+	err = pthread_create (&threadId, &attr, build_thread, job);
+	pthread_attr_destroy (&attr);
+	if (0 != err) {
+		standbyState = STANDBY_EMPTY;
+		pthread_mutex_unlock (&standby_mut);
+		ParodusError ("Error creating standby thread :[%s]\n", strerror (err));
+		free (job);
+		return -1;
+	}
+	pthread_mutex_unlock (&standby_mut);
+	return 0;
+}
+
+int standby_state (void)
+{
+	int state;
+
+	pthread_mutex_lock (&standby_mut);
+	state = standbyState;
+	pthread_mutex_unlock (&standby_mut);
+	return state;
+}
+
+void *standby_peek (void)
+{
+	void *handle;
+
+	pthread_mutex_lock (&standby_mut);
+	handle = (STANDBY_READY == standbyState) ? standbyHandle : NULL;
+	pthread_mutex_unlock (&standby_mut);
+	return handle;
+}
+
+void *standby_take (int *tag)
+{
+	void *handle = NULL;
+
+	pthread_mutex_lock (&standby_mut);
+	if (STANDBY_READY == standbyState) {
+		handle = standbyHandle;
+		*tag = standbyTag;
+		standbyHandle = NULL;
+		standbyState = STANDBY_EMPTY;
+		nextBuildMs = 0;
+	}
+	pthread_mutex_unlock (&standby_mut);
+	return handle;
+}
+
+void standby_discard (int retry)
+{
+	standby_release_fn release;
+	void *handle = NULL;
+
+	pthread_mutex_lock (&standby_mut);
+	standbyGeneration++;
+	if (STANDBY_READY == standbyState)
+		handle = standbyHandle;
+	release = standbyRelease;
+	standbyHandle = NULL;
+	standbyState = STANDBY_EMPTY;
+	nextBuildMs = retry ? 0 : now_ms () + STANDBY_RETRY_MS;
+	pthread_mutex_unlock (&standby_mut);
+
+	if (NULL != handle)
+		release (handle);
+}
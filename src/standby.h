@@ -0,0 +1,100 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/**
+ * @file standby.h
+ *
+ * @description Warm standby connection.
+ *
+ *              One spare connection is built on a detached thread and kept
+ *              idle, so the primary can be replaced without a connect. A
+ *              build that fails is not retried for STANDBY_RETRY_MS.
+ *
+ */
+
+#ifndef _STANDBY_H_
+#define _STANDBY_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*----------------------------------------------------------------------------*/
+/*                                   Macros                                   */
+/*----------------------------------------------------------------------------*/
+
+#define STANDBY_EMPTY		0
+#define STANDBY_BUILDING	1
+#define STANDBY_READY		2
+
+#define STANDBY_RETRY_MS	30000
+
+/*----------------------------------------------------------------------------*/
+/*                               Data Structures                              */
+/*----------------------------------------------------------------------------*/
+
+/**
+ * Build the connection. Runs on its own thread and may block; owns arg.
+ * @return the connection, NULL on failure
+ */
+typedef void *(*standby_build_fn)(void *arg);
+
+/**
+ * Close a connection that is not going to be used.
+ */
+typedef void (*standby_release_fn)(void *handle);
+
+/*----------------------------------------------------------------------------*/
+/*                             Function Prototypes                            */
+/*----------------------------------------------------------------------------*/
+
+/**
+ * Start building a standby, unless one is ready, being built, or the last
+ * build failed less than STANDBY_RETRY_MS ago.
+ * @param tag kept with the standby, e.g. the endpoint it connects to
+ * @return 0 if the build started; otherwise arg is still the caller's
+ */
+int standby_build (standby_build_fn build, standby_release_fn release,
+	void *arg, int tag);
+
+/**
+ * @return STANDBY_EMPTY, STANDBY_BUILDING or STANDBY_READY
+ */
+int standby_state (void);
+
+/**
+ * @return the ready standby, left in place, or NULL
+ */
+void *standby_peek (void);
+
+/**
+ * Take the ready standby; a new one can be built right away.
+ * @param tag set to the tag it was built with
+ * @return the connection, or NULL if none is ready
+ */
+void *standby_take (int *tag);
+
+/**
+ * Release the ready standby and drop any build in progress.
+ * @param retry non zero to allow a new build at once
+ */
+void standby_discard (int retry);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _STANDBY_H_ */
@@ -19,6 +19,14 @@
 #include "ParodusInternal.h"
 #include "client_list.h"
 
+/*----------------------------------------------------------------------------*/
+/*                            File Scoped Variables                           */
+/*----------------------------------------------------------------------------*/
+/* drain bookkeeping, guarded by g_mutex */
+static int downstreamBusy = 0;			// handler is on a message
+static unsigned int downstreamDrainLeft = 0;	// messages a drain still waits for
+static pthread_cond_t downstream_drain_con = PTHREAD_COND_INITIALIZER;
+
 /*----------------------------------------------------------------------------*/
 /*                             External Functions                             */
 /*----------------------------------------------------------------------------*/
@@ -32,6 +40,7 @@ void *messageHandlerTask()
         {
             ParodusMsg *message = ParodusMsgQ;
             ParodusMsgQ = ParodusMsgQ->next;
+            downstreamBusy = 1;
             pthread_mutex_unlock (&g_mutex);
             ParodusPrint("mutex unlock in consumer thread\n");
 
@@ -40,6 +49,15 @@ void *messageHandlerTask()
             nopoll_msg_unref(message->msg);
             free(message);
             message = NULL;
+
+            pthread_mutex_lock (&g_mutex);
+            downstreamBusy = 0;
+            if(downstreamDrainLeft > 0)
+            {
+                downstreamDrainLeft--;
+                pthread_cond_broadcast(&downstream_drain_con);
+            }
+            pthread_mutex_unlock (&g_mutex);
         }
         else
         {
@@ -53,6 +71,31 @@ void *messageHandlerTask()
     return 0;
 }
 
+unsigned int drain_downstream(const struct timespec *deadline, unsigned int *left)
+{
+    ParodusMsg *message;
+    unsigned int pending;
+
+    pthread_mutex_lock (&g_mutex);
+    pending = downstreamBusy;
+    for(message = ParodusMsgQ; message != NULL; message = message->next)
+    {
+        pending++;
+    }
+    downstreamDrainLeft = pending;
+    while(downstreamDrainLeft > 0)
+    {
+        if(ETIMEDOUT == pthread_cond_timedwait(&downstream_drain_con, &g_mutex, deadline))
+        {
+            break;
+        }
+    }
+    *left = downstreamDrainLeft;
+    downstreamDrainLeft = 0;
+    pthread_mutex_unlock (&g_mutex);
+    return pending - *left;
+}
+
 /*----------------------------------------------------------------------------*/
 /*                             Internal functions                             */
 /*----------------------------------------------------------------------------*/
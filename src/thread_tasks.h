@@ -25,6 +25,7 @@
 #define _THREAD_TASKS_H_
 
 #include <pthread.h>
+#include <time.h>
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -40,6 +41,15 @@ extern pthread_cond_t g_cond;
 
 void *messageHandlerTask();
 
+/**
+ * Wait, until deadline (CLOCK_REALTIME), for the handler to dispatch the
+ * messages received from the server so far.
+ *
+ * @param left set to the number still not dispatched at the deadline
+ * @return number dispatched
+ */
+unsigned int drain_downstream(const struct timespec *deadline, unsigned int *left);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,444 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/**
+ * @file tls_session.c
+ *
+ * @description TLS session resumption and kernel TLS for the websocket.
+ *
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <openssl/ssl.h>
+#include <openssl/evp.h>
+
+#include "tls_session.h"
+#include "parodus_log.h"
+
+/*----------------------------------------------------------------------------*/
+/*                                   Macros                                   */
+/*----------------------------------------------------------------------------*/
+
+#define TLS_SESSION_LINE_MAX	8192	// key, blank and base64 der per line
+
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+#define session_resumable(s)	SSL_SESSION_is_resumable (s)
+#else
+#define session_resumable(s)	(NULL != (s))
+#endif
+
+/*----------------------------------------------------------------------------*/
+/*                               Data Structures                              */
+/*----------------------------------------------------------------------------*/
+
+typedef struct tls_entry {
+	char *key;		// server:port
+	SSL_SESSION *session;
+	struct tls_entry *next;
+} tls_entry_t;
+
+/*----------------------------------------------------------------------------*/
+/*                            File Scoped Variables                           */
+/*----------------------------------------------------------------------------*/
+
+static tls_entry_t *tlsSessions = NULL;
+static char *tlsServer = NULL;
+static char *tlsSessionFile = NULL;
+static int tlsAllow13 = 0;
+static int tlsCache = 0;	// resume sessions
+static int tlsKtls = 0;		// offload the record layer to the kernel
+static tls_session_stats_t tlsStats;
+static int ctxKeyIndex = -1;	// SSL_CTX ex data: server key
+static int sslStartIndex = -1;	// SSL ex data: handshake start time
+static pthread_mutex_t tls_session_mut = PTHREAD_MUTEX_INITIALIZER;
+
+/*----------------------------------------------------------------------------*/
+/*                             Internal functions                             */
+/*----------------------------------------------------------------------------*/
+
+static unsigned long long now_ms (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return (unsigned long long) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void free_ex_data (void *parent, void *ptr, CRYPTO_EX_DATA *ad,
+	int idx, long argl, void *argp)
+{
+	(void) parent; (void) ad; (void) idx; (void) argl; (void) argp;
+	free (ptr);
+}
+
+/* Called with tls_session_mut held */
+static int init_indexes (void)
+{
+	if (ctxKeyIndex < 0)
+		ctxKeyIndex = SSL_CTX_get_ex_new_index (0, NULL, NULL, NULL, free_ex_data);
+	if (sslStartIndex < 0)
+		sslStartIndex = SSL_get_ex_new_index (0, NULL, NULL, NULL, free_ex_data);
+	return ((ctxKeyIndex < 0) || (sslStartIndex < 0)) ? -1 : 0;
+}
+
+/* Called with tls_session_mut held */
+static tls_entry_t *find_entry (const char *key)
+{
+	tls_entry_t *entry;
+
+	for (entry = tlsSessions; NULL != entry; entry = entry->next) {
+		if (strcmp (entry->key, key) == 0)
+			return entry;
+	}
+	return NULL;
+}
+
+/* Called with tls_session_mut held, takes over session */
+static void store_session (const char *key, SSL_SESSION *session)
+{
+	tls_entry_t *entry = find_entry (key);
+
+	if (NULL == entry) {
+		entry = (tls_entry_t *) calloc (1, sizeof(tls_entry_t));
+		if ((NULL == entry) || (NULL == (entry->key = strdup (key)))) {
+			ParodusError ("Unable to allocate tls session entry\n");
+			free (entry);
+			SSL_SESSION_free (session);
+			return;
+		}
+		entry->next = tlsSessions;
+		tlsSessions = entry;
+	}
+	if (NULL != entry->session)
+		SSL_SESSION_free (entry->session);
+	entry->session = session;
+}
+
+/* Called with tls_session_mut held */
+static void save_sessions (void)
+{
+	tls_entry_t *entry;
+	unsigned char *der, *p;
+	unsigned char *b64;
+	char *tmp_file;
+	FILE *fp;
+	int fd, len;
+
+	if (NULL == tlsSessionFile)
+		return;
+	tmp_file = (char *) malloc (strlen (tlsSessionFile) + 5);
+	if (NULL == tmp_file)
+		return;
+	sprintf (tmp_file, "%s.tmp", tlsSessionFile);
+	// the file holds session secrets
+	fd = open (tmp_file, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if ((fd < 0) || (NULL == (fp = fdopen (fd, "w")))) {
+		ParodusError ("Unable to write tls session file %s\n", tmp_file);
+		if (fd >= 0)
+			close (fd);
+		free (tmp_file);
+		return;
+	}
+	for (entry = tlsSessions; NULL != entry; entry = entry->next) {
+		if (!session_resumable (entry->session))
+			continue;
+		len = i2d_SSL_SESSION (entry->session, NULL);
+		if ((len <= 0) || (((len + 2) / 3) * 4 + 1 > TLS_SESSION_LINE_MAX))
+			continue;
+		der = (unsigned char *) malloc (len);
+		b64 = (unsigned char *) malloc (((len + 2) / 3) * 4 + 1);
+		if ((NULL != der) && (NULL != b64)) {
+			p = der;
+			i2d_SSL_SESSION (entry->session, &p);
+			EVP_EncodeBlock (b64, der, len);
+			fprintf (fp, "%s %s\n", entry->key, b64);
+		}
+		free (der);
+		free (b64);
+	}
+	if ((fclose (fp) != 0) || (rename (tmp_file, tlsSessionFile) != 0)) {
+		ParodusError ("Unable to save tls session file %s\n", tlsSessionFile);
+		unlink (tmp_file);
+	}
+	free (tmp_file);
+}
+
+/* Called with tls_session_mut held */
+static void load_sessions (void)
+{
+	char *line;
+	unsigned char *der;
+	const unsigned char *p;
+	char *b64, *end;
+	SSL_SESSION *session;
+	FILE *fp;
+	int len, count = 0;
+	time_t now = time (NULL);
+
+	fp = fopen (tlsSessionFile, "r");
+	if (NULL == fp)
+		return;
+	line = (char *) malloc (TLS_SESSION_LINE_MAX);
+	der = (unsigned char *) malloc (TLS_SESSION_LINE_MAX);
+	while ((NULL != line) && (NULL != der) &&
+	       (NULL != fgets (line, TLS_SESSION_LINE_MAX, fp))) {
+		b64 = strchr (line, ' ');
+		if (NULL == b64)
+			continue;
+		*b64++ = '\0';
+		end = strchr (b64, '\n');
+		if (NULL != end)
+			*end = '\0';
+		len = EVP_DecodeBlock (der, (unsigned char *) b64, strlen (b64));
+		if (len <= 0)
+			continue;
+		p = der;
+		session = d2i_SSL_SESSION (NULL, &p, len);
+		if (NULL == session)
+			continue;
+		if (!session_resumable (session) ||
+		    (SSL_SESSION_get_time (session) + SSL_SESSION_get_timeout (session) <= now)) {
+			SSL_SESSION_free (session);
+			continue;
+		}
+		store_session (line, session);
+		count++;
+	}
+	free (line);
+	free (der);
+	fclose (fp);
+	ParodusInfo ("Loaded %d tls sessions from %s\n", count, tlsSessionFile);
+}
+
+static int new_session_cb (SSL *ssl, SSL_SESSION *session)
+{
+	const char *key = (const char *)
+		SSL_CTX_get_ex_data (SSL_get_SSL_CTX (ssl), ctxKeyIndex);
+
+	if (NULL == key)
+		return 0;
+	pthread_mutex_lock (&tls_session_mut);
+	store_session (key, session);
+	save_sessions ();
+	pthread_mutex_unlock (&tls_session_mut);
+	ParodusPrint ("New tls session for %s\n", key);
+	return 1;	// the session is ours now
+}
+
+static void info_cb (const SSL *const_ssl, int where, int ret)
+{
+	SSL *ssl = (SSL *) const_ssl;
+	unsigned long long *start;
+	unsigned int elapsed;
+	const char *key;
+	tls_entry_t *entry;
+	int resumed, ktls_tx = 0, ktls_rx = 0;
+
+	(void) ret;
+	start = (unsigned long long *) SSL_get_ex_data (ssl, sslStartIndex);
+	if (where & SSL_CB_HANDSHAKE_START) {
+		if (NULL != start)	// renegotiation
+			return;
+		start = (unsigned long long *) malloc (sizeof(unsigned long long));
+		if (NULL == start)
+			return;
+		*start = now_ms ();
+		SSL_set_ex_data (ssl, sslStartIndex, start);
+
+		// the ClientHello is not built yet, so the session can still be set
+		key = (const char *) SSL_CTX_get_ex_data (SSL_get_SSL_CTX (ssl), ctxKeyIndex);
+		if (NULL == key)
+			return;
+		pthread_mutex_lock (&tls_session_mut);
+		entry = find_entry (key);
+		if ((NULL != entry) && session_resumable (entry->session))
+			SSL_set_session (ssl, entry->session);
+		pthread_mutex_unlock (&tls_session_mut);
+	} else if (where & SSL_CB_HANDSHAKE_DONE) {
+		if ((NULL == start) || (0 == *start))
+			return;
+		elapsed = (unsigned int) (now_ms () - *start);
+		*start = 0;
+		resumed = SSL_session_reused (ssl);
+#ifdef BIO_get_ktls_send
+		// the keys are in the kernel by now, if it took them
+		ktls_tx = BIO_get_ktls_send (SSL_get_wbio (ssl));
+		ktls_rx = BIO_get_ktls_recv (SSL_get_rbio (ssl));
+#endif
+		pthread_mutex_lock (&tls_session_mut);
+		tlsStats.handshakes++;
+		if (resumed)
+			tlsStats.resumed++;
+		if (ktls_tx)
+			tlsStats.ktls_tx++;
+		if (ktls_rx)
+			tlsStats.ktls_rx++;
+		tlsStats.last_ms = elapsed;
+		tlsStats.total_ms += elapsed;
+		ParodusInfo ("TLS handshake %u ms, %s, %u of %u resumed\n", elapsed,
+			resumed ? "resumed" : "full", tlsStats.resumed, tlsStats.handshakes);
+		if (tlsKtls)
+			ParodusInfo ("kTLS %s, send %s, receive %s\n", SSL_get_cipher_name (ssl),
+				ktls_tx ? "in kernel" : "in openssl", ktls_rx ? "in kernel" : "in openssl");
+		pthread_mutex_unlock (&tls_session_mut);
+	}
+}
+
+static noPollPtr tls_context_creator (noPollCtx *ctx, noPollConn *conn,
+	noPollConnOpts *opts, nopoll_bool is_client, noPollPtr user_data)
+{
+	SSL_CTX *ssl_ctx;
+	char *key = NULL;
+	int cache, ktls;
+
+	(void) ctx; (void) conn; (void) opts; (void) user_data;
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+	ssl_ctx = SSL_CTX_new (is_client ? TLS_client_method () : TLS_server_method ());
+	if (NULL == ssl_ctx)
+		return NULL;
+	SSL_CTX_set_min_proto_version (ssl_ctx, TLS1_2_VERSION);
+#ifdef TLS1_3_VERSION
+	SSL_CTX_set_max_proto_version (ssl_ctx, tlsAllow13 ? TLS1_3_VERSION : TLS1_2_VERSION);
+#else
+	SSL_CTX_set_max_proto_version (ssl_ctx, TLS1_2_VERSION);
+#endif
+#else
+	ssl_ctx = SSL_CTX_new (is_client ? TLSv1_2_client_method () : TLSv1_2_server_method ());
+	if (NULL == ssl_ctx)
+		return NULL;
+#endif
+	if (!is_client)
+		return ssl_ctx;
+
+	pthread_mutex_lock (&tls_session_mut);
+	cache = tlsCache;
+	ktls = tlsKtls;
+	if (cache && (NULL != tlsServer))
+		key = strdup (tlsServer);
+	pthread_mutex_unlock (&tls_session_mut);
+
+#ifdef SSL_OP_ENABLE_KTLS
+	if (ktls)
+		SSL_CTX_set_options (ssl_ctx, SSL_OP_ENABLE_KTLS);
+#else
+	(void) ktls;
+#endif
+	SSL_CTX_set_info_callback (ssl_ctx, info_cb);
+	if (cache) {
+		SSL_CTX_set_session_cache_mode (ssl_ctx,
+			SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+		SSL_CTX_sess_set_new_cb (ssl_ctx, new_session_cb);
+	}
+	SSL_CTX_set_ex_data (ssl_ctx, ctxKeyIndex, key);
+	return ssl_ctx;
+}
+
+/*----------------------------------------------------------------------------*/
+/*                             External Functions                             */
+/*----------------------------------------------------------------------------*/
+
+int tls_session_init (noPollCtx *ctx, const char *file, int allow_tls13)
+{
+	pthread_mutex_lock (&tls_session_mut);
+	if (init_indexes () != 0) {
+		pthread_mutex_unlock (&tls_session_mut);
+		ParodusError ("Unable to set up tls session resumption\n");
+		return -1;
+	}
+	tlsAllow13 = allow_tls13;
+	tlsCache = 1;
+	if ((NULL != file) && ('\0' != file[0]) &&
+	    ((NULL == tlsSessionFile) || (strcmp (tlsSessionFile, file) != 0))) {
+		free (tlsSessionFile);
+		tlsSessionFile = strdup (file);
+		if (NULL != tlsSessionFile)
+			load_sessions ();
+	}
+	pthread_mutex_unlock (&tls_session_mut);
+
+	nopoll_ctx_set_ssl_context_creator (ctx, tls_context_creator, NULL);
+	return 0;
+}
+
+int tls_session_ktls (noPollCtx *ctx, int allow_tls13)
+{
+#ifdef SSL_OP_ENABLE_KTLS
+	pthread_mutex_lock (&tls_session_mut);
+	if (init_indexes () != 0) {
+		pthread_mutex_unlock (&tls_session_mut);
+		ParodusError ("Unable to set up kTLS\n");
+		return -1;
+	}
+	tlsAllow13 = allow_tls13;
+	tlsKtls = 1;
+	pthread_mutex_unlock (&tls_session_mut);
+
+	nopoll_ctx_set_ssl_context_creator (ctx, tls_context_creator, NULL);
+	return 0;
+#else
+	(void) ctx; (void) allow_tls13;
+	ParodusError ("kTLS is not supported by this openssl\n");
+	return -1;
+#endif
+}
+
+void tls_session_set_server (const char *server, unsigned int port)
+{
+	char *key = NULL;
+
+	if (NULL != server) {
+		key = (char *) malloc (strlen (server) + 12);
+		if (NULL != key)
+			sprintf (key, "%s:%u", server, port);
+	}
+	pthread_mutex_lock (&tls_session_mut);
+	free (tlsServer);
+	tlsServer = key;
+	pthread_mutex_unlock (&tls_session_mut);
+}
+
+void tls_session_get_stats (tls_session_stats_t *stats)
+{
+	pthread_mutex_lock (&tls_session_mut);
+	*stats = tlsStats;
+	pthread_mutex_unlock (&tls_session_mut);
+}
+
+void tls_session_clear (void)
+{
+	tls_entry_t *entry;
+
+	pthread_mutex_lock (&tls_session_mut);
+	while (NULL != tlsSessions) {
+		entry = tlsSessions;
+		tlsSessions = entry->next;
+		SSL_SESSION_free (entry->session);
+		free (entry->key);
+		free (entry);
+	}
+	free (tlsSessionFile);
+	tlsSessionFile = NULL;
+	tlsCache = 0;
+	tlsKtls = 0;
+	memset (&tlsStats, 0, sizeof(tlsStats));
+	pthread_mutex_unlock (&tls_session_mut);
+}
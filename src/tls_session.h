@@ -0,0 +1,104 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/**
+ * @file tls_session.h
+ *
+ * @description TLS session resumption across websocket reconnects.
+ *
+ *              Installs an ssl context creator on the nopoll context. Client
+ *              sessions (session ids, tickets, TLS 1.3 psk) are kept per
+ *              server, outside the per connection SSL_CTX, and offered again
+ *              on the next handshake to that server. The cache can be saved
+ *              to a file so it survives a restart.
+ *
+ *              The same creator can have openssl hand the record layer to
+ *              the kernel (kTLS) once the handshake is done, so the reads
+ *              and writes nopoll makes through openssl become plain socket
+ *              calls, with the encryption done in the kernel.
+ *
+ */
+
+#ifndef _TLS_SESSION_H_
+#define _TLS_SESSION_H_
+
+#include <nopoll.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*----------------------------------------------------------------------------*/
+/*                               Data Structures                              */
+/*----------------------------------------------------------------------------*/
+
+typedef struct {
+	unsigned int handshakes;	// completed client handshakes
+	unsigned int resumed;		// of those, resumed sessions
+	unsigned int last_ms;		// duration of the last handshake
+	unsigned long long total_ms;
+	unsigned int ktls_tx;		// handshakes whose sending went to the kernel
+	unsigned int ktls_rx;		// and whose receiving did
+} tls_session_stats_t;
+
+/*----------------------------------------------------------------------------*/
+/*                             Function Prototypes                            */
+/*----------------------------------------------------------------------------*/
+
+/**
+ * Install the ssl context creator on ctx. The first call with a file
+ * loads the sessions saved in it; sessions are written back there
+ * whenever a server issues a new one.
+ *
+ * @param file may be NULL to keep sessions in memory only
+ * @param allow_tls13 negotiate up to TLS 1.3 (resuming with psk tickets)
+ *                    instead of TLS 1.2 only
+ * @return 0 on success, -1 if openssl could not be set up
+ */
+int tls_session_init (noPollCtx *ctx, const char *file, int allow_tls13);
+
+/**
+ * Install the ssl context creator on ctx with kernel TLS enabled. Whether
+ * it is used depends on openssl, the kernel (the tls module) and the
+ * cipher negotiated; it is checked and logged after each handshake.
+ * Sessions are only kept if tls_session_init() is called as well.
+ *
+ * @param allow_tls13 as for tls_session_init(); openssl 3.0 only offloads
+ *                    receiving on TLS 1.2
+ * @return 0 on success, -1 if openssl was built without kTLS
+ */
+int tls_session_ktls (noPollCtx *ctx, int allow_tls13);
+
+/**
+ * Name the server the following connections are made to. Sessions are
+ * kept and looked up by server and port; with no server (NULL) they are
+ * neither offered nor kept.
+ */
+void tls_session_set_server (const char *server, unsigned int port);
+
+void tls_session_get_stats (tls_session_stats_t *stats);
+
+/**
+ * Drop every session, reset the statistics and turn kTLS off again. The
+ * file is left in place and read again by the next tls_session_init().
+ */
+void tls_session_clear (void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _TLS_SESSION_H_ */
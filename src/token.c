@@ -41,6 +41,8 @@
 #include <ctype.h>
 #include <errno.h>
 #include <time.h>
+#include <pthread.h>
+#include <openssl/evp.h>
 
 #include <cjwt/cjwt.h>
 #include "token.h"
@@ -70,10 +72,48 @@
 /*----------------------------------------------------------------------------*/
 #define ENDPOINT_NAME "endpoint"
 
+/* JWTRefreshTask schedule, seconds */
+#define JWT_REFRESH_AHEAD	300	// refetch this long before exp
+#define JWT_REFRESH_MIN		60	// never refetch more often than this
+#define JWT_REFRESH_MAX		3600	// recheck the record at least this often
+#define JWT_RETRY_INTERVAL	30	// after a failed fetch
+
+/*----------------------------------------------------------------------------*/
+/*                               Data Structures                              */
+/*----------------------------------------------------------------------------*/
+#ifdef FEATURE_DNS_QUERY
+typedef struct {
+	int running;		// JWTRefreshTask has started
+	int fetched;		// insecure/server_addr/port hold a result
+	int kick;		// a caller asked for an early refresh
+	int insecure;		// allow_insecure_conn() result
+	char *server_addr;
+	unsigned int port;
+	time_t exp;		// jwt exp of a valid result
+	time_t fetched_at;
+} jwt_prefetch_t;
+
+// the last token whose signature checked out, so the same token seen
+// again is not verified again
+typedef struct {
+	unsigned char digest[EVP_MAX_MD_SIZE];	// of the token and the key
+	unsigned int digest_len;
+	cjwt_t *jwt;		// decoded and verified; NULL if empty
+	unsigned int hits;
+	unsigned int misses;
+} jwt_verified_t;
+#endif
+
 /*----------------------------------------------------------------------------*/
 /*                            File Scoped Variables                           */
 /*----------------------------------------------------------------------------*/
-/* none */
+#ifdef FEATURE_DNS_QUERY
+static jwt_prefetch_t jwtPrefetch = {0, 0, 0, 0, NULL, 0, 0, 0};
+static pthread_mutex_t jwt_prefetch_mut = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t jwt_prefetch_con = PTHREAD_COND_INITIALIZER;
+static jwt_verified_t jwtVerified;
+static pthread_mutex_t jwt_verified_mut = PTHREAD_MUTEX_INITIALIZER;
+#endif
 
 /*----------------------------------------------------------------------------*/
 /*                             Function Prototypes                            */
@@ -471,15 +511,67 @@ static void get_dns_txt_record_id (char *buf)
 	sprintf (buf, "%s.%s", cfg->hw_mac, cfg->dns_txt_url);
 	ParodusInfo("dns_txt_record_id %s\n", buf);
 }
-#endif
 
-int allow_insecure_conn(char **server_addr, unsigned int *port)
+// the key is hashed in too: the same token under another key is verified
+static int jwt_digest (const char *jwt_token, const char *key,
+	unsigned char *digest, unsigned int *digest_len)
+{
+	EVP_MD_CTX *md_ctx = EVP_MD_CTX_create ();
+	int ok;
+
+	if (NULL == md_ctx)
+		return -1;
+	ok = EVP_DigestInit_ex (md_ctx, EVP_sha256 (), NULL) &&
+		EVP_DigestUpdate (md_ctx, jwt_token, strlen (jwt_token) + 1) &&
+		EVP_DigestUpdate (md_ctx, key, strlen (key)) &&
+		EVP_DigestFinal_ex (md_ctx, digest, digest_len);
+	EVP_MD_CTX_destroy (md_ctx);
+	return ok ? 0 : -1;
+}
+
+// Called with jwt_verified_mut held
+static void drop_verified (void)
+{
+	if (NULL != jwtVerified.jwt)
+		cjwt_destroy (&jwtVerified.jwt);
+	jwtVerified.jwt = NULL;
+	jwtVerified.digest_len = 0;
+}
+
+// Called with jwt_verified_mut held.
+// returns the verified jwt for this digest, if it has not expired
+static cjwt_t *find_verified (const unsigned char *digest, unsigned int digest_len)
+{
+	if ((NULL == jwtVerified.jwt) || (digest_len != jwtVerified.digest_len) ||
+	    (memcmp (digest, jwtVerified.digest, digest_len) != 0))
+		return NULL;
+	if (jwtVerified.jwt->exp.tv_sec < time(NULL)) {
+		drop_verified ();
+		return NULL;
+	}
+	return jwtVerified.jwt;
+}
+
+// Called with jwt_verified_mut held. Takes over jwt.
+static void store_verified (cjwt_t *jwt, const unsigned char *digest,
+	unsigned int digest_len)
+{
+	drop_verified ();
+	memcpy (jwtVerified.digest, digest, digest_len);
+	jwtVerified.digest_len = digest_len;
+	jwtVerified.jwt = jwt;
+}
+
+// returns 1 if insecure, 0 if secure, < 0 if error
+// exp, when not NULL, receives the jwt expiry of a valid result
+static int fetch_jwt_endpoint (char **server_addr, unsigned int *port, time_t *exp)
 {
-#ifdef FEATURE_DNS_QUERY	
 	int insecure=0, ret = -1;
 	char *jwt_token, *key;
 	cjwt_t *jwt = NULL;
 	char dns_txt_record_id[TXT_REC_ID_MAXSIZE];
+	unsigned char digest[EVP_MAX_MD_SIZE];
+	unsigned int digest_len = 0;
 	
 	jwt_token = malloc (NS_MAXBUF);
 	if (NULL == jwt_token) {
@@ -503,21 +595,38 @@ int allow_insecure_conn(char **server_addr, unsigned int *port)
 		}
 		goto end;
 	}
-	//Decoding the jwt token
 	key = get_parodus_cfg()->jwt_key;
-	ret = cjwt_decode( jwt_token, 0, &jwt, ( const uint8_t * )key,strlen(key) );
-
-	if(ret) {
-		if (ret == ENOMEM) {
-			ParodusError ("Memory allocation failed in JWT decode\n");
-		} else {
-			ParodusError ("CJWT decode error\n");
+	if (jwt_digest (jwt_token, key, digest, &digest_len) != 0)
+		digest_len = 0;
+
+	// held while the jwt is used, the refresher may replace the entry
+	pthread_mutex_lock (&jwt_verified_mut);
+	if (0 != digest_len)
+		jwt = find_verified (digest, digest_len);
+	if (NULL != jwt) {
+		jwtVerified.hits++;
+		ParodusInfo ("JWT unchanged, skipping verification (%u skipped, %u verified)\n",
+			jwtVerified.hits, jwtVerified.misses);
+	} else {
+		//Decoding the jwt token
+		ret = cjwt_decode( jwt_token, 0, &jwt, ( const uint8_t * )key,strlen(key) );
+
+		if(ret) {
+			pthread_mutex_unlock (&jwt_verified_mut);
+			if (ret == ENOMEM) {
+				ParodusError ("Memory allocation failed in JWT decode\n");
+			} else {
+				ParodusError ("CJWT decode error\n");
+			}
+			insecure = TOKEN_ERR_JWT_DECODE_FAIL;
+			goto end;
 		}
-		insecure = TOKEN_ERR_JWT_DECODE_FAIL;
-		goto end;
-	}
 
-	ParodusPrint("Decoded CJWT successfully\n");
+		ParodusPrint("Decoded CJWT successfully\n");
+		jwtVerified.misses++;
+		if (0 != digest_len)
+			store_verified (jwt, digest, digest_len);
+	}
 
 	//validate algo from --jwt_algo
 	if( validate_algo(jwt) ) {
@@ -528,12 +637,191 @@ int allow_insecure_conn(char **server_addr, unsigned int *port)
 
 	if (insecure >= 0) {
 		ParodusInfo ("JWT claims: %s\n", cJSON_Print (jwt->private_claims));
+		if (NULL != exp)
+			*exp = jwt->exp.tv_sec;
 	}
-	cjwt_destroy(&jwt);
+	if (jwt != jwtVerified.jwt)
+		cjwt_destroy(&jwt);
+	pthread_mutex_unlock (&jwt_verified_mut);
 	
 end:
 	if (NULL != jwt_token)
 		free (jwt_token);
+	return insecure;
+}
+
+// Called with jwt_prefetch_mut held
+static void store_prefetch (int insecure, char *server_addr, unsigned int port,
+	time_t exp)
+{
+	if (NULL != jwtPrefetch.server_addr)
+		free (jwtPrefetch.server_addr);
+	jwtPrefetch.insecure = insecure;
+	jwtPrefetch.server_addr = (insecure >= 0) ? server_addr : NULL;
+	jwtPrefetch.port = port;
+	jwtPrefetch.exp = (insecure >= 0) ? exp : 0;
+	jwtPrefetch.fetched = 1;
+	jwtPrefetch.fetched_at = time(NULL);
+	pthread_cond_broadcast (&jwt_prefetch_con);
+}
+
+// returns 1 and sets *insecure if the cached result can be used
+static int get_prefetched_endpoint (char **server_addr, unsigned int *port,
+	int *insecure)
+{
+	int found = 0;
+
+	pthread_mutex_lock (&jwt_prefetch_mut);
+	if (!jwtPrefetch.running) {
+		pthread_mutex_unlock (&jwt_prefetch_mut);
+		return 0;
+	}
+	// the first fetch is already on its way
+	while (!jwtPrefetch.fetched)
+		pthread_cond_wait (&jwt_prefetch_con, &jwt_prefetch_mut);
+
+	if (jwtPrefetch.insecure < 0) {
+		*insecure = jwtPrefetch.insecure;
+		*server_addr = NULL;
+		found = 1;
+	} else if (jwtPrefetch.exp > time(NULL)) {
+		*server_addr = strdup (jwtPrefetch.server_addr);
+		if (NULL != *server_addr) {
+			*port = jwtPrefetch.port;
+			*insecure = jwtPrefetch.insecure;
+			found = 1;
+		}
+	}
+	// we are (re)connecting, so have the record checked again soon
+	jwtPrefetch.kick = 1;
+	pthread_cond_broadcast (&jwt_prefetch_con);
+	pthread_mutex_unlock (&jwt_prefetch_mut);
+	if (found)
+		ParodusInfo ("Using prefetched JWT endpoint result %d\n", *insecure);
+	return found;
+}
+
+// Called with jwt_prefetch_mut held
+static void wait_for_refresh (void)
+{
+	struct timespec deadline;
+	time_t next, now = time(NULL);
+
+	if (jwtPrefetch.insecure < 0) {
+		next = jwtPrefetch.fetched_at + JWT_RETRY_INTERVAL;
+	} else {
+		next = jwtPrefetch.exp - JWT_REFRESH_AHEAD;
+		if (next < jwtPrefetch.fetched_at + JWT_REFRESH_MIN)
+			next = jwtPrefetch.fetched_at + JWT_REFRESH_MIN;
+		if (next > jwtPrefetch.fetched_at + JWT_REFRESH_MAX)
+			next = jwtPrefetch.fetched_at + JWT_REFRESH_MAX;
+	}
+	while (now < next) {
+		if (jwtPrefetch.kick && (next > jwtPrefetch.fetched_at + JWT_REFRESH_MIN)) {
+			next = jwtPrefetch.fetched_at + JWT_REFRESH_MIN;
+			continue;
+		}
+		deadline.tv_sec = next;
+		deadline.tv_nsec = 0;
+		pthread_cond_timedwait (&jwt_prefetch_con, &jwt_prefetch_mut, &deadline);
+		now = time(NULL);
+	}
+	jwtPrefetch.kick = 0;
+}
+#endif
+
+void *JWTRefreshTask()
+{
+#ifdef FEATURE_DNS_QUERY
+	char *server_addr;
+	unsigned int port;
+	time_t exp;
+	int insecure;
+	int first = 1;
+
+	pthread_mutex_lock (&jwt_prefetch_mut);
+	jwtPrefetch.running = 1;
+	pthread_mutex_unlock (&jwt_prefetch_mut);
+	ParodusInfo ("JWTRefreshTask started\n");
+
+	while (FOREVER()) {
+		if (!first) {
+			pthread_mutex_lock (&jwt_prefetch_mut);
+			wait_for_refresh ();
+			pthread_mutex_unlock (&jwt_prefetch_mut);
+		}
+		first = 0;
+
+		server_addr = NULL;
+		port = 0;
+		exp = 0;
+		insecure = fetch_jwt_endpoint (&server_addr, &port, &exp);
+		ParodusPrint ("JWT refresh result %d\n", insecure);
+
+		pthread_mutex_lock (&jwt_prefetch_mut);
+		store_prefetch (insecure, server_addr, port, exp);
+		pthread_mutex_unlock (&jwt_prefetch_mut);
+	}
+#endif
+	return NULL;
+}
+
+void jwt_prefetch_reset (void)
+{
+#ifdef FEATURE_DNS_QUERY
+	pthread_mutex_lock (&jwt_prefetch_mut);
+	if (NULL != jwtPrefetch.server_addr)
+		free (jwtPrefetch.server_addr);
+	memset (&jwtPrefetch, 0, sizeof(jwtPrefetch));
+	pthread_mutex_unlock (&jwt_prefetch_mut);
+#endif
+}
+
+unsigned int jwt_verified_hits (void)
+{
+	unsigned int hits = 0;
+#ifdef FEATURE_DNS_QUERY
+	pthread_mutex_lock (&jwt_verified_mut);
+	hits = jwtVerified.hits;
+	pthread_mutex_unlock (&jwt_verified_mut);
+#endif
+	return hits;
+}
+
+void jwt_verified_reset (void)
+{
+#ifdef FEATURE_DNS_QUERY
+	pthread_mutex_lock (&jwt_verified_mut);
+	drop_verified ();
+	jwtVerified.hits = 0;
+	jwtVerified.misses = 0;
+	pthread_mutex_unlock (&jwt_verified_mut);
+#endif
+}
+
+int allow_insecure_conn(char **server_addr, unsigned int *port)
+{
+#ifdef FEATURE_DNS_QUERY	
+	int insecure;
+	char *cached_addr = NULL;
+	time_t exp = 0;
+
+	if (get_prefetched_endpoint (server_addr, port, &insecure))
+		goto end;
+
+	insecure = fetch_jwt_endpoint (server_addr, port, &exp);
+
+	// refresher running but its result had expired: share ours
+	pthread_mutex_lock (&jwt_prefetch_mut);
+	if (jwtPrefetch.running) {
+		if ((insecure >= 0) && (NULL != *server_addr))
+			cached_addr = strdup (*server_addr);
+		if ((insecure < 0) || (NULL != cached_addr))
+			store_prefetch (insecure, cached_addr, *port, exp);
+	}
+	pthread_mutex_unlock (&jwt_prefetch_mut);
+
+end:
 #else
   (void) server_addr;
   (void) port;
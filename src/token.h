@@ -86,5 +86,29 @@ Yes			Yes			http		True			Default
 */ 
 int allow_insecure_conn (char **server_addr, unsigned int *port);
 
+/**
+ * Keep the result of the jwt dns query ready for allow_insecure_conn,
+ * so a reconnect does not wait for query_dns. The record is fetched
+ * again ahead of the jwt's exp, after a failure, and soon after a
+ * reconnect has used the cached result.
+ */
+void *JWTRefreshTask();
+
+/**
+ * Forget the prefetched result. For tests.
+ */
+void jwt_prefetch_reset (void);
+
+/**
+ * Number of times a token was used without verifying its signature again,
+ * because it had been verified before and has not expired.
+ */
+unsigned int jwt_verified_hits (void);
+
+/**
+ * Forget the verified token. For tests.
+ */
+void jwt_verified_reset (void);
+
 
 #endif
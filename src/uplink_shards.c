@@ -0,0 +1,429 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/**
+ * @file uplink_shards.c
+ *
+ * @description Extra connections sharing the upstream traffic.
+ *
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "uplink_shards.h"
+#include "parodus_log.h"
+
+/*----------------------------------------------------------------------------*/
+/*                                   Macros                                   */
+/*----------------------------------------------------------------------------*/
+
+#define SHARD_DOWN	0
+#define SHARD_BUILDING	1
+#define SHARD_UP	2
+
+/*----------------------------------------------------------------------------*/
+/*                               Data Structures                              */
+/*----------------------------------------------------------------------------*/
+
+typedef struct shard_msg {
+	void *msg;
+	size_t len;
+	struct shard_msg *next;
+} shard_msg_t;
+
+// lock conn_mut before mut when both are needed
+typedef struct {
+	pthread_mutex_t conn_mut;	// held while writing on handle
+	pthread_mutex_t mut;		// everything else
+	pthread_cond_t con;
+	pthread_cond_t space;		// the queue went below the limit
+	shard_msg_t *head, *tail;
+	unsigned int queued;
+	int state;
+	void *handle;
+	unsigned int generation;	// bumped to drop a build
+	uint64_t next_build_ms;		// monotonic
+	int stopping;
+	pthread_t writer;
+	uplink_shard_stats_t stats;
+} shard_t;
+
+typedef struct {
+	shard_t *shard;
+	void *arg;
+	unsigned int generation;
+} build_job_t;
+
+/*----------------------------------------------------------------------------*/
+/*                            File Scoped Variables                           */
+/*----------------------------------------------------------------------------*/
+
+static pthread_mutex_t shards_mut = PTHREAD_MUTEX_INITIALIZER;
+static shard_t shards[UPLINK_SHARDS_MAX];
+static unsigned int shardCount = 0;
+static int shardsReady = 0;		// shard mutexes initialised
+static uplink_build_fn buildFn = NULL;
+static uplink_release_fn releaseFn = NULL;
+static uplink_send_fn sendFn = NULL;
+static uplink_fallback_fn fallbackFn = NULL;
+
+/*----------------------------------------------------------------------------*/
+/*                             Internal functions                             */
+/*----------------------------------------------------------------------------*/
+
+static uint64_t now_ms (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000 + (uint64_t) ts.tv_nsec / 1000000;
+}
+
+static shard_t *get_shard (unsigned int index)
+{
+	unsigned int count;
+
+	pthread_mutex_lock (&shards_mut);
+	count = shardCount;
+	pthread_mutex_unlock (&shards_mut);
+	return ((0 < index) && (index < count)) ? &shards[index] : NULL;
+}
+
+static void *writer_thread (void *arg)
+{
+	shard_t *shard = (shard_t *) arg;
+	shard_msg_t *item;
+	int up, rc = -1;
+
+	while (1) {
+		pthread_mutex_lock (&shard->mut);
+		while ((NULL == shard->head) && !shard->stopping)
+			pthread_cond_wait (&shard->con, &shard->mut);
+		item = shard->head;
+		if (NULL == item) {
+			pthread_mutex_unlock (&shard->mut);
+			break;
+		}
+		shard->head = item->next;
+		if (NULL == shard->head)
+			shard->tail = NULL;
+		shard->queued--;
+		pthread_cond_signal (&shard->space);
+		up = (SHARD_UP == shard->state);
+		pthread_mutex_unlock (&shard->mut);
+
+		if (up) {
+			pthread_mutex_lock (&shard->conn_mut);
+			up = (NULL != shard->handle);
+			if (up)
+				rc = sendFn (shard->handle, item->msg, item->len);
+			pthread_mutex_unlock (&shard->conn_mut);
+		}
+		if (!up)
+			fallbackFn (item->msg, item->len);
+
+		pthread_mutex_lock (&shard->mut);
+		if (!up)
+			shard->stats.fallback++;
+		else if (0 == rc)
+			shard->stats.sent++;
+		else
+			shard->stats.failed++;
+		pthread_mutex_unlock (&shard->mut);
+		free (item->msg);
+		free (item);
+	}
+	return NULL;
+}
+
+static void *build_thread (void *arg)
+{
+	build_job_t *job = (build_job_t *) arg;
+	shard_t *shard = job->shard;
+	void *handle;
+	int keep = 0;
+
+	handle = buildFn (job->arg);
+	pthread_mutex_lock (&shard->conn_mut);
+	pthread_mutex_lock (&shard->mut);
+	if (job->generation == shard->generation) {
+		if (NULL != handle) {
+			shard->handle = handle;
+			shard->state = SHARD_UP;
+			shard->stats.connects++;
+			keep = 1;
+		} else {
+			shard->state = SHARD_DOWN;
+			shard->next_build_ms = now_ms () + UPLINK_SHARD_RETRY_MS;
+		}
+	}
+	pthread_mutex_unlock (&shard->mut);
+	pthread_mutex_unlock (&shard->conn_mut);
+
+	if (keep) {
+		ParodusInfo ("uplink shard %d connected\n", (int) (shard - shards));
+	} else if (NULL != handle) {
+		releaseFn (handle);	// dropped while it was being built
+	} else {
+		ParodusError ("uplink shard %d failed to connect, retry in %d s\n",
+			(int) (shard - shards), UPLINK_SHARD_RETRY_MS / 1000);
+	}
+	free (job);
+	return NULL;
+}
+
+/*----------------------------------------------------------------------------*/
+/*                             External Functions                             */
+/*----------------------------------------------------------------------------*/
+
+int uplink_shards_init (unsigned int count, uplink_build_fn build,
+	uplink_release_fn release, uplink_send_fn send, uplink_fallback_fn fallback)
+{
+	unsigned int i;
+	int err;
+
+	if (count < 2)
+		return 0;
+	if (count > UPLINK_SHARDS_MAX)
+		count = UPLINK_SHARDS_MAX;
+	pthread_mutex_lock (&shards_mut);
+	if (0 < shardCount) {
+		pthread_mutex_unlock (&shards_mut);
+		return 0;
+	}
+	buildFn = build;
+	releaseFn = release;
+	sendFn = send;
+	fallbackFn = fallback;
+	// kept across shutdown, a dropped build may still finish later
+	if (!shardsReady) {
+		for (i = 0; i < UPLINK_SHARDS_MAX; i++) {
+			pthread_mutex_init (&shards[i].conn_mut, NULL);
+			pthread_mutex_init (&shards[i].mut, NULL);
+			pthread_cond_init (&shards[i].con, NULL);
+			pthread_cond_init (&shards[i].space, NULL);
+		}
+		shardsReady = 1;
+	}
+	for (i = 1; i < count; i++) {
+		pthread_mutex_lock (&shards[i].mut);
+		shards[i].head = shards[i].tail = NULL;
+		shards[i].queued = 0;
+		shards[i].state = SHARD_DOWN;
+		shards[i].handle = NULL;
+		shards[i].next_build_ms = 0;
+		shards[i].stopping = 0;
+		memset (&shards[i].stats, 0, sizeof(shards[i].stats));
+		pthread_mutex_unlock (&shards[i].mut);
+		err = pthread_create (&shards[i].writer, NULL, writer_thread, &shards[i]);
+		if (0 != err) {
+			ParodusError ("Error creating uplink shard writer :[%s]\n", strerror (err));
+			break;
+		}
+	}
+	shardCount = i;
+	pthread_mutex_unlock (&shards_mut);
+	ParodusInfo ("upstream sharded over %u connections\n", i);
+	return (i == count) ? 0 : -1;
+}
+
+unsigned int uplink_shards_count (void)
+{
+	unsigned int count;
+
+	pthread_mutex_lock (&shards_mut);
+	count = (1 < shardCount) ? shardCount : 0;
+	pthread_mutex_unlock (&shards_mut);
+	return count;
+}
+
+/* FNV-1a */
+unsigned int uplink_shard_for (const char *service, size_t len)
+{
+	unsigned int count = uplink_shards_count ();
+	uint32_t hash = 2166136261U;
+	size_t i;
+
+	if ((0 == count) || (NULL == service))
+		return 0;
+	for (i = 0; i < len; i++) {
+		hash ^= (unsigned char) service[i];
+		hash *= 16777619U;
+	}
+	return hash % count;
+}
+
+int uplink_shard_send (unsigned int index, void *msg, size_t len)
+{
+	shard_t *shard = get_shard (index);
+	shard_msg_t *item;
+
+	if (NULL == shard)
+		return -1;
+	item = (shard_msg_t *) malloc (sizeof(shard_msg_t));
+	if (NULL == item)
+		return -1;
+	item->msg = msg;
+	item->len = len;
+	item->next = NULL;
+
+	// queued whatever the state, a message sent around the queue would
+	// overtake those of the same service still in it
+	pthread_mutex_lock (&shard->mut);
+	while ((shard->queued >= UPLINK_SHARD_QUEUE_MAX) && !shard->stopping)
+		pthread_cond_wait (&shard->space, &shard->mut);
+	if (shard->stopping) {
+		pthread_mutex_unlock (&shard->mut);
+		free (item);
+		return -1;
+	}
+	if (NULL == shard->tail)
+		shard->head = item;
+	else
+		shard->tail->next = item;
+	shard->tail = item;
+	shard->queued++;
+	pthread_cond_signal (&shard->con);
+	pthread_mutex_unlock (&shard->mut);
+	return 0;
+}
+
+int uplink_shard_connect (unsigned int index, void *arg)
+{
+	shard_t *shard = get_shard (index);
+	build_job_t *job;
+	pthread_attr_t attr;
+	pthread_t threadId;
+	int err;
+
+	if (NULL == shard)
+		return -1;
+	pthread_mutex_lock (&shard->mut);
+	if ((SHARD_DOWN != shard->state) || shard->stopping ||
+	    (now_ms () < shard->next_build_ms)) {
+		pthread_mutex_unlock (&shard->mut);
+		return -1;
+	}
+	job = (build_job_t *) malloc (sizeof(build_job_t));
+	if (NULL == job) {
+		pthread_mutex_unlock (&shard->mut);
+		ParodusError ("Unable to allocate uplink shard build\n");
+		return -1;
+	}
+	job->shard = shard;
+	job->arg = arg;
+	job->generation = ++shard->generation;
+	shard->state = SHARD_BUILDING;
+
+	pthread_attr_init (&attr);
+	pthread_attr_setdetachstate (&attr, PTHREAD_CREATE_DETACHED);
+	err = pthread_create (&threadId, &attr, build_thread, job);
+	pthread_attr_destroy (&attr);
+	if (0 != err) {
+		shard->state = SHARD_DOWN;
+		pthread_mutex_unlock (&shard->mut);
+		ParodusError ("Error creating uplink shard thread :[%s]\n", strerror (err));
+		free (job);
+		return -1;
+	}
+	pthread_mutex_unlock (&shard->mut);
+	return 0;
+}
+
+void *uplink_shard_handle (unsigned int index)
+{
+	shard_t *shard = get_shard (index);
+	void *handle = NULL;
+
+	if (NULL == shard)
+		return NULL;
+	pthread_mutex_lock (&shard->mut);
+	if (SHARD_UP == shard->state)
+		handle = shard->handle;
+	pthread_mutex_unlock (&shard->mut);
+	return handle;
+}
+
+void uplink_shard_down (unsigned int index, int retry)
+{
+	shard_t *shard = get_shard (index);
+	uplink_shard_stats_t stats;
+	void *handle;
+
+	if (NULL == shard)
+		return;
+	// the writer sends what it takes from now on to the primary
+	pthread_mutex_lock (&shard->mut);
+	shard->generation++;
+	shard->state = SHARD_DOWN;
+	shard->next_build_ms = retry ? 0 : now_ms () + UPLINK_SHARD_RETRY_MS;
+	pthread_mutex_unlock (&shard->mut);
+
+	// then wait for a write in progress
+	pthread_mutex_lock (&shard->conn_mut);
+	pthread_mutex_lock (&shard->mut);
+	handle = shard->handle;
+	shard->handle = NULL;
+	if (NULL != handle)
+		shard->stats.drops++;
+	stats = shard->stats;
+	pthread_mutex_unlock (&shard->mut);
+	pthread_mutex_unlock (&shard->conn_mut);
+
+	if (NULL != handle) {
+		ParodusInfo ("uplink shard %u closed: %u sent, %u failed, %u on the primary, "
+			"%u connects\n", index, stats.sent, stats.failed, stats.fallback,
+			stats.connects);
+		releaseFn (handle);
+	}
+}
+
+void uplink_shard_get_stats (unsigned int index, uplink_shard_stats_t *stats)
+{
+	shard_t *shard = get_shard (index);
+
+	memset (stats, 0, sizeof(*stats));
+	if (NULL == shard)
+		return;
+	pthread_mutex_lock (&shard->mut);
+	*stats = shard->stats;
+	pthread_mutex_unlock (&shard->mut);
+}
+
+void uplink_shards_shutdown (void)
+{
+	unsigned int count, i;
+
+	pthread_mutex_lock (&shards_mut);
+	count = shardCount;
+	pthread_mutex_unlock (&shards_mut);
+	for (i = 1; i < count; i++) {
+		uplink_shard_down (i, 1);
+		pthread_mutex_lock (&shards[i].mut);
+		shards[i].stopping = 1;
+		pthread_cond_signal (&shards[i].con);
+		pthread_cond_broadcast (&shards[i].space);
+		pthread_mutex_unlock (&shards[i].mut);
+		pthread_join (shards[i].writer, NULL);
+	}
+	pthread_mutex_lock (&shards_mut);
+	shardCount = 0;
+	pthread_mutex_unlock (&shards_mut);
+}
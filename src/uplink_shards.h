@@ -0,0 +1,152 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/**
+ * @file uplink_shards.h
+ *
+ * @description Extra connections sharing the upstream traffic.
+ *
+ *              Shard 0 is the primary connection and is not kept here.
+ *              Each other shard has its own connection, built on a
+ *              detached thread, and its own writer thread, so messages
+ *              for different shards are encrypted and written in
+ *              parallel. Messages for a shard that is down stay in its
+ *              queue and its writer sends them on the primary through
+ *              the fallback, so they keep their order.
+ *
+ *              Every shard connects with the device's own name, so the
+ *              server has to accept more than one connection per device;
+ *              each shard says which it is in the X-WebPA-Uplink-Shard
+ *              header. Built only with FEATURE_UPLINK_SHARDS.
+ *
+ */
+
+#ifndef _UPLINK_SHARDS_H_
+#define _UPLINK_SHARDS_H_
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*----------------------------------------------------------------------------*/
+/*                                   Macros                                   */
+/*----------------------------------------------------------------------------*/
+
+#define UPLINK_SHARDS_MAX	8
+#define UPLINK_SHARD_RETRY_MS	30000	// after a failed build or a drop
+#define UPLINK_SHARD_QUEUE_MAX	256	// then the sender waits
+#define UPLINK_SHARD_HEADER	"X-WebPA-Uplink-Shard"	// shard/count
+
+/*----------------------------------------------------------------------------*/
+/*                               Data Structures                              */
+/*----------------------------------------------------------------------------*/
+
+/**
+ * Build a shard connection. Runs on its own thread and may block; owns arg.
+ * @return the connection, NULL on failure
+ */
+typedef void *(*uplink_build_fn)(void *arg);
+
+/**
+ * Close a shard connection.
+ */
+typedef void (*uplink_release_fn)(void *handle);
+
+/**
+ * Write one message on a shard connection.
+ * @return 0 if it was written
+ */
+typedef int (*uplink_send_fn)(void *handle, void *msg, size_t len);
+
+/**
+ * Send one message on the primary connection. Called from the writer
+ * threads, so it has to be safe against the other writers of the primary.
+ */
+typedef void (*uplink_fallback_fn)(void *msg, size_t len);
+
+typedef struct {
+	unsigned int sent;	// written on the shard
+	unsigned int failed;	// writes that failed
+	unsigned int fallback;	// sent on the primary while the shard was down
+	unsigned int connects;
+	unsigned int drops;
+} uplink_shard_stats_t;
+
+/*----------------------------------------------------------------------------*/
+/*                             Function Prototypes                            */
+/*----------------------------------------------------------------------------*/
+
+/**
+ * Start the writer threads. Only the first call has an effect.
+ * @param count shards including the primary, at most UPLINK_SHARDS_MAX;
+ *              less than 2 leaves sharding off
+ * @return 0 on success
+ */
+int uplink_shards_init (unsigned int count, uplink_build_fn build,
+	uplink_release_fn release, uplink_send_fn send, uplink_fallback_fn fallback);
+
+/**
+ * @return number of shards including the primary, 0 when sharding is off
+ */
+unsigned int uplink_shards_count (void);
+
+/**
+ * Pick the shard for a service, so one service's messages stay in order.
+ */
+unsigned int uplink_shard_for (const char *service, size_t len);
+
+/**
+ * Queue a message on a shard, up or not, behind those already queued.
+ * Waits while UPLINK_SHARD_QUEUE_MAX are queued.
+ * @return 0 if queued, the shard then owns msg and frees it; -1 if there is
+ *         no such shard or it is stopping, the caller should send it on the
+ *         primary
+ */
+int uplink_shard_send (unsigned int index, void *msg, size_t len);
+
+/**
+ * Start building the connection of a shard, unless it is up, being built,
+ * or failed less than UPLINK_SHARD_RETRY_MS ago.
+ * @return 0 if the build started; otherwise arg is still the caller's
+ */
+int uplink_shard_connect (unsigned int index, void *arg);
+
+/**
+ * @return the connection of a shard that is up, or NULL
+ */
+void *uplink_shard_handle (unsigned int index);
+
+/**
+ * Close the connection of a shard; it is rebuilt after UPLINK_SHARD_RETRY_MS.
+ * @param retry non zero to allow a rebuild at once
+ */
+void uplink_shard_down (unsigned int index, int retry);
+
+void uplink_shard_get_stats (unsigned int index, uplink_shard_stats_t *stats);
+
+/**
+ * Close every shard connection and stop the writer threads. Queued
+ * messages are sent on the primary first.
+ */
+void uplink_shards_shutdown (void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _UPLINK_SHARDS_H_ */
@@ -29,6 +29,9 @@
 #include "client_list.h"
 #include "nopoll_helpers.h"
 #include "close_retry.h"
+#include "wrp_locator.h"
+#include "crud_subscribe.h"
+#include "uplink_shards.h"
 
 /*----------------------------------------------------------------------------*/
 /*                                   Macros                                   */
@@ -49,6 +52,236 @@ pthread_mutex_t nano_mut=PTHREAD_MUTEX_INITIALIZER;
 
 pthread_cond_t nano_con=PTHREAD_COND_INITIALIZER;
 
+/* drain bookkeeping, guarded by nano_mut */
+static int upstreamBusy = 0;			// consumer is handling a message
+static int upstreamBusyDrain = 0;		// ... that the drain waits for
+static unsigned int upstreamDrainLeft = 0;	// messages a drain still waits for
+static pthread_cond_t upstream_drain_con = PTHREAD_COND_INITIALIZER;
+
+/*----------------------------------------------------------------------------*/
+/*                             Internal functions                             */
+/*----------------------------------------------------------------------------*/
+
+/* mac:xxxxxxxxxxxx/parodus/cloud-status */
+static int is_cloud_status(const wrp_locator_t *loc)
+{
+    return wrp_slice_equals(&loc->service, "parodus") &&
+           wrp_slice_equals(&loc->application, "cloud-status") &&
+           (NULL == loc->sub_path.ptr);
+}
+
+/*
+ * Answer a cloud-status retrieve from a registered client directly, from the
+ * pre-rendered payload, instead of a round trip through the CRUD thread and
+ * the upstream queue.
+ */
+static int sendCloudStatusResponse(wrp_msg_t *msg, const wrp_locator_t *sourceLoc)
+{
+    wrp_msg_t resp;
+    char payload[64];
+    char serviceName[32];
+    void *bytes = NULL;
+    ssize_t size;
+    size_t len;
+    int sendStatus = 0;
+
+    if(!wrp_slice_equals(&sourceLoc->scheme, "mac") || (0 == sourceLoc->service.len) ||
+       (sourceLoc->service.len >= sizeof(serviceName)))
+    {
+        return -1;
+    }
+    wrp_slice_copy(&sourceLoc->service, serviceName, sizeof(serviceName));
+
+    len = get_cloud_status_payload(payload, sizeof(payload));
+    memset(&resp, 0, sizeof(wrp_msg_t));
+    resp.msg_type = msg->msg_type;
+    resp.u.crud.transaction_uuid = msg->u.crud.transaction_uuid;
+    resp.u.crud.source = msg->u.crud.dest;
+    resp.u.crud.dest = msg->u.crud.source;
+    resp.u.crud.status = (len > 0) ? 200 : 400;
+    resp.u.crud.payload = (len > 0) ? payload : NULL;
+    resp.u.crud.payload_size = len;
+
+    size = wrp_struct_to(&resp, WRP_BYTES, &bytes);
+    if(size > 0)
+    {
+        sendStatus = sendMsgtoRegisteredClients(serviceName, (const char **)&bytes, size);
+    }
+    free(bytes);
+
+    if(sendStatus == 1)
+    {
+        ParodusInfo("Sent cloud-status response to %s client\n", serviceName);
+    }
+    else
+    {
+        ParodusError("Failed to send cloud-status response to %s client\n", serviceName);
+    }
+    return 0;
+}
+
+/* mac:xxxxxxxxxxxx/parodus/subscribe/<name> */
+static int is_subscribe(const wrp_locator_t *loc)
+{
+    return wrp_slice_equals(&loc->service, "parodus") &&
+           wrp_slice_equals(&loc->application, CRUD_SUBSCRIBE_APPLICATION);
+}
+
+/* consumer finished a message; a drain counts it */
+static void upstream_msg_done(void)
+{
+    pthread_mutex_lock (&nano_mut);
+    upstreamBusy = 0;
+    upstreamBusyDrain = 0;
+    if(upstreamDrainLeft > 0)
+    {
+        upstreamDrainLeft--;
+        pthread_cond_broadcast(&upstream_drain_con);
+    }
+    pthread_mutex_unlock (&nano_mut);
+}
+
+/* the message the consumer has in hand is one a drain waits for, so it
+   goes out though close_retry is set */
+static int upstream_drained(void)
+{
+    int drained;
+
+    pthread_mutex_lock (&nano_mut);
+    drained = upstreamBusyDrain && (upstreamDrainLeft > 0);
+    pthread_mutex_unlock (&nano_mut);
+    return drained;
+}
+
+/* send response when connection retry is not in progress. Also during cloud_disconnect UPDATE request. Here, close_retry becomes 1 hence check is added to send disconnect response to server.
+   With drain-timeout, drain_upstream() flushes what was queued when it started, the connection is open until it is done. */
+static int upstream_held(bool close_retry, int in_hand)
+{
+    return close_retry && (get_parodus_cfg()->cloud_disconnect == NULL) &&
+           !(in_hand && upstream_drained());
+}
+
+/* The producer classifies a message before queueing it, so a drain
+ * reorders the queue without decoding under nano_mut. */
+static int upstream_msg_type(void *bytes, size_t len)
+{
+    wrp_msg_t *msg = NULL;
+    int msgType = -1;
+
+    if(wrp_to_struct(bytes, len, WRP_BYTES, &msg) > 0)
+    {
+        msgType = msg->msg_type;
+    }
+    if(msg)
+    {
+        wrp_free_struct(msg);
+    }
+    return msgType;
+}
+
+/* Move events behind everything else, keeping the order within each.
+ * Called with nano_mut held. */
+static void responses_first(void)
+{
+    UpStreamMsg *first = NULL, *events = NULL, *message, *next;
+    UpStreamMsg **firstTail = &first, **eventsTail = &events;
+
+    for(message = UpStreamMsgQ; message != NULL; message = next)
+    {
+        next = message->next;
+        message->next = NULL;
+        if(WRP_MSG_TYPE__EVENT == message->msg_type)
+        {
+            *eventsTail = message;
+            eventsTail = &message->next;
+        }
+        else
+        {
+            *firstTail = message;
+            firstTail = &message->next;
+        }
+    }
+    *firstTail = events;
+    UpStreamMsgQ = first;
+}
+
+static const char *wrp_source(const wrp_msg_t *msg)
+{
+    switch(msg->msg_type)
+    {
+        case WRP_MSG_TYPE__EVENT:
+            return msg->u.event.source;
+        case WRP_MSG_TYPE__REQ:
+            return msg->u.req.source;
+        case WRP_MSG_TYPE__CREATE:
+        case WRP_MSG_TYPE__RETREIVE:
+        case WRP_MSG_TYPE__UPDATE:
+        case WRP_MSG_TYPE__DELETE:
+            return msg->u.crud.source;
+        default:
+            return NULL;
+    }
+}
+
+/* With uplink-shards, queue the message on the connection the source's
+ * service hashes to, behind what is already queued there, so one service's
+ * messages stay in order whether that shard is up or not.
+ * Returns 0 if the shard took the message. */
+static int send_on_shard(const char *source, void *msg, size_t len)
+{
+    wrp_locator_t sourceLoc;
+
+    if((NULL == source) || (0 == uplink_shards_count()) ||
+       (wrp_locator_parse(source, &sourceLoc) != 0))
+    {
+        return -1;
+    }
+    return uplink_shard_send(uplink_shard_for(sourceLoc.service.ptr, sourceLoc.service.len),
+                             msg, len);
+}
+
+/* in_hand is set when the consumer sends the message it took off the queue */
+static void send_upstream(const char *source, void **resp_bytes, size_t resp_size, int in_hand)
+{
+	void *appendData;
+	size_t encodedSize;
+	bool close_retry = false;
+	//appending response with metadata 			
+	if(metaPackSize > 0)
+	{
+	   	encodedSize = appendEncodedData( &appendData, *resp_bytes, resp_size, metadataPack, metaPackSize );
+	   	ParodusPrint("metadata appended upstream response %s\n", (char *)appendData);
+	   	ParodusPrint("encodedSize after appending :%zu\n", encodedSize);
+	   		   
+		ParodusInfo("Sending response to server\n");
+		close_retry = get_close_retry();
+
+		if(upstream_held(close_retry, in_hand))
+		{
+			ParodusInfo("close_retry is %d, unable to send response as connection retry is in progress\n", close_retry);
+		}
+		else if(send_on_shard(source, appendData, encodedSize) == 0)
+		{
+			appendData = NULL;	// the shard frees it once written
+		}
+		else
+		{
+			sendMessage(get_global_conn(),appendData, encodedSize);
+		}
+		free(appendData);
+		appendData =NULL;
+	}
+	else
+	{		
+		ParodusError("Failed to send upstream as metadata packing is not successful\n");
+	}
+
+}
+
+/*----------------------------------------------------------------------------*/
+/*                             External Functions                             */
+/*----------------------------------------------------------------------------*/
+
 UpStreamMsg * get_global_UpStreamMsgQ(void)
 {
     return UpStreamMsgQ;
@@ -149,6 +382,8 @@ void *handle_upstream()
                 {
                     message->msg =buf;
                     message->len =bytes;
+                    message->msg_type = upstream_msg_type(buf, bytes);
+                    message->drain = 0;
                     message->next=NULL;
                     pthread_mutex_lock (&nano_mut);
                     //Producer adds the nanoMsg into queue
@@ -197,9 +432,8 @@ void *processUpstreamMessage()
     reg_list_item_t *temp = NULL;
     int matchFlag = 0;
     int status = -1;
-    char *serviceName = NULL;
-    char *destService, *destApplication =NULL;
-    char *sourceService, *sourceApplication =NULL;
+    char serviceName[sizeof(temp->service_name)];
+    wrp_locator_t destLoc, sourceLoc;
     int sendStatus =-1;
 
     while(FOREVER())
@@ -210,6 +444,8 @@ void *processUpstreamMessage()
         {
             UpStreamMsg *message = UpStreamMsgQ;
             UpStreamMsgQ = UpStreamMsgQ->next;
+            upstreamBusy = 1;
+            upstreamBusyDrain = message->drain;
             pthread_mutex_unlock (&nano_mut);
             ParodusPrint("mutex unlock in consumer thread\n");
 
@@ -311,7 +547,7 @@ void *processUpstreamMessage()
                         int size = wrp_struct_to( eventMsg, WRP_BYTES, &bytes );
                         if(size > 0)
                         {
-                            sendUpstreamMsgToServer(&bytes, size);
+                            send_upstream(wrp_source(msg), &bytes, size, 1);
                         }
                         free(eventMsg);
                         free(bytes);
@@ -319,7 +555,7 @@ void *processUpstreamMessage()
                     }
                     else
                     {
-                        sendUpstreamMsgToServer(&message->msg, message->len);
+                        send_upstream(wrp_source(msg), &message->msg, message->len, 1);
                     }
                 }
                 else
@@ -328,22 +564,30 @@ void *processUpstreamMessage()
 					if( WRP_MSG_TYPE__REQ == msgType )
 					{
 						ParodusInfo(" Received upstream data with MsgType: %d dest: '%s' transaction_uuid: %s\n", msgType, msg->u.req.dest, msg->u.req.transaction_uuid );
-						sendUpstreamMsgToServer(&message->msg, message->len);
+						send_upstream(wrp_source(msg), &message->msg, message->len, 1);
 					}
 					else
 					{
 						ParodusInfo(" Received upstream data with MsgType: %d dest: '%s' transaction_uuid: %s status: %d\n",msgType, msg->u.crud.dest, msg->u.crud.transaction_uuid, msg->u.crud.status );
-						if(WRP_MSG_TYPE__RETREIVE == msgType && msg->u.crud.dest !=NULL && msg->u.crud.source != NULL)
+						if((WRP_MSG_TYPE__CREATE == msgType || WRP_MSG_TYPE__DELETE == msgType) &&
+						   (wrp_locator_parse(msg->u.crud.dest, &destLoc) == 0) && is_subscribe(&destLoc))
+						{
+							//Subscriptions are kept by parodus, they never reach the server
+							crud_subscribe_request(msg);
+						}
+						else if(WRP_MSG_TYPE__RETREIVE == msgType && msg->u.crud.dest !=NULL && msg->u.crud.source != NULL)
 						{
-							destService = wrp_get_msg_element(WRP_ID_ELEMENT__SERVICE, msg, DEST);
-							destApplication = wrp_get_msg_element(WRP_ID_ELEMENT__APPLICATION, msg, DEST);
-							sourceService = wrp_get_msg_element(WRP_ID_ELEMENT__SERVICE, msg, SOURCE);
-							sourceApplication = wrp_get_msg_element(WRP_ID_ELEMENT__APPLICATION, msg, SOURCE);
+							wrp_locator_parse(msg->u.crud.dest, &destLoc);
+							wrp_locator_parse(msg->u.crud.source, &sourceLoc);
 							/*  Handle cloud-status retrieve request here
 								Expecting dest format as mac:xxxxxxxxxxxx/parodus/cloud-status
 								Parse dest field and check destService is "parodus" and destApplication is "cloud-status"
 							*/
-							if(destService != NULL && destApplication != NULL && strcmp(destService,"parodus")== 0 && strcmp(destApplication,"cloud-status")== 0)
+							if(is_cloud_status(&destLoc) && (sendCloudStatusResponse(msg, &sourceLoc) == 0))
+							{
+								ParodusPrint("cloud-status retrieve answered inline\n");
+							}
+							else if(is_cloud_status(&destLoc))
 							{
 								retrieve_msg = ( wrp_msg_t *)malloc( sizeof( wrp_msg_t ) );
 								memset(retrieve_msg, 0, sizeof(wrp_msg_t));
@@ -353,15 +597,15 @@ void *processUpstreamMessage()
 								retrieve_msg->u.crud.dest = strdup(msg->u.crud.dest);
 								addCRUDmsgToQueue(retrieve_msg);
 							}
-							else if(sourceService != NULL && sourceApplication != NULL && strcmp(sourceService,"parodus")== 0 && strcmp(sourceApplication,"cloud-status")== 0 && strncmp(msg->u.crud.dest,"mac:", 4)==0)
+							else if(is_cloud_status(&sourceLoc) && wrp_slice_equals(&destLoc.scheme, "mac"))
 							{
 								/*  Handle cloud-status retrieve response here to send it to registered client
 									Expecting src format as mac:xxxxxxxxxxxx/parodus/cloud-status and dest as mac:
 									Parse src field and check sourceService is "parodus" and sourceApplication is "cloud-status"
 								*/
-								serviceName = wrp_get_msg_element(WRP_ID_ELEMENT__SERVICE, msg, DEST);
-								if ( serviceName != NULL)
+								if (destLoc.service.len > 0)
 								{
+									wrp_slice_copy(&destLoc.service, serviceName, sizeof(serviceName));
 									//Send Client cloud-status response back to registered client
 									ParodusInfo("Sending cloud-status response to %s client\n",serviceName);
 									sendStatus=sendMsgtoRegisteredClients(serviceName,(const char **)&message->msg,message->len);
@@ -373,8 +617,6 @@ void *processUpstreamMessage()
 									{
 										ParodusError("Failed to send upstreamMsg to registered client %s\n", serviceName);
 									}
-									free(serviceName);
-									serviceName = NULL;
 								}
 								else
 								{
@@ -384,32 +626,12 @@ void *processUpstreamMessage()
 							else
 							{
 								ParodusInfo("sendUpstreamMsgToServer \n");
-								sendUpstreamMsgToServer(&message->msg, message->len);
-							}
-							if(sourceService !=NULL)
-							{
-								free(sourceService);
-								sourceService = NULL;
-							}
-							if(sourceApplication !=NULL)
-							{
-								free(sourceApplication);
-								sourceApplication = NULL;
-							}
-							if(destService !=NULL)
-							{
-								free(destService);
-								destService = NULL;
-							}
-							if(destApplication !=NULL)
-							{
-								free(destApplication);
-								destApplication = NULL;
+								send_upstream(wrp_source(msg), &message->msg, message->len, 1);
 							}
 						}
 						else
 						{
-							sendUpstreamMsgToServer(&message->msg, message->len);
+							send_upstream(wrp_source(msg), &message->msg, message->len, 1);
 						}
 					}
             	}
@@ -420,7 +642,7 @@ void *processUpstreamMessage()
             }
 
 			//nn_freemsg should not be done for parodus/tags/ CRUD requests as it is not received through nanomsg.
-			if ((msg && (msg->u.crud.source !=NULL) && wrp_does_service_match("parodus", msg->u.crud.source) == 0))
+			if (msg && (wrp_locator_parse(msg->u.crud.source, &sourceLoc) == 0) && wrp_slice_equals(&sourceLoc.service, "parodus"))
 			{
 				free(message->msg);
 			}
@@ -438,6 +660,7 @@ void *processUpstreamMessage()
 			msg = NULL;
 			free(message);
 			message = NULL;
+			upstream_msg_done();
         }
         else
         {
@@ -450,37 +673,53 @@ void *processUpstreamMessage()
     return NULL;
 }
 
+unsigned int drain_upstream(const struct timespec *deadline, unsigned int *left)
+{
+    UpStreamMsg *message;
+    unsigned int pending;
+
+    pthread_mutex_lock (&nano_mut);
+    responses_first();
+    // the message in hand plus those queued now; later ones are not waited for
+    pending = upstreamBusy;
+    upstreamBusyDrain = upstreamBusy;
+    for(message = UpStreamMsgQ; message != NULL; message = message->next)
+    {
+        message->drain = 1;
+        pending++;
+    }
+    upstreamDrainLeft = pending;
+    while(upstreamDrainLeft > 0)
+    {
+        if(ETIMEDOUT == pthread_cond_timedwait(&upstream_drain_con, &nano_mut, deadline))
+        {
+            break;
+        }
+    }
+    *left = upstreamDrainLeft;
+    upstreamDrainLeft = 0;
+    pthread_mutex_unlock (&nano_mut);
+    return pending - *left;
+}
+
 void sendUpstreamMsgToServer(void **resp_bytes, size_t resp_size)
 {
-	void *appendData;
-	size_t encodedSize;
-	bool close_retry = false;
-	//appending response with metadata 			
-	if(metaPackSize > 0)
-	{
-	   	encodedSize = appendEncodedData( &appendData, *resp_bytes, resp_size, metadataPack, metaPackSize );
-	   	ParodusPrint("metadata appended upstream response %s\n", (char *)appendData);
-	   	ParodusPrint("encodedSize after appending :%zu\n", encodedSize);
-	   		   
-		ParodusInfo("Sending response to server\n");
-		close_retry = get_close_retry();
+	sendUpstreamMsgFromSource(NULL, resp_bytes, resp_size);
+}
 
-		/* send response when connection retry is not in progress. Also during cloud_disconnect UPDATE request. Here, close_retry becomes 1 hence check is added to send disconnect response to server. */
-		//TODO: Upstream and downstream messages in queue should be handled and queue should be empty before parodus forcefully disconnect from cloud.
-		if(!close_retry || (get_parodus_cfg()->cloud_disconnect !=NULL))
-		{
-			sendMessage(get_global_conn(),appendData, encodedSize);
-		}
-		else
-		{
-			ParodusInfo("close_retry is %d, unable to send response as connection retry is in progress\n", close_retry);
-		}
-		free(appendData);
-		appendData =NULL;
-	}
-	else
-	{		
-		ParodusError("Failed to send upstream as metadata packing is not successful\n");
-	}
+void sendUpstreamMsgFromSource(const char *source, void **resp_bytes, size_t resp_size)
+{
+	send_upstream(source, resp_bytes, resp_size, 0);
+}
 
+void sendUpstreamMsgOnPrimary(void *msg, size_t len)
+{
+	bool close_retry = get_close_retry();
+
+	if(upstream_held(close_retry, 0))
+	{
+		ParodusInfo("close_retry is %d, unable to send response as connection retry is in progress\n", close_retry);
+		return;
+	}
+	sendMessage(get_global_conn(), msg, len);
 }
@@ -25,6 +25,7 @@
 #define _UPSTREAM_H_
 
 #include <pthread.h>
+#include <time.h>
 #include <wrp-c.h>
 #ifdef __cplusplus
 extern "C" {
@@ -37,6 +38,8 @@ typedef struct UpStreamMsg__
 {
 	void *msg;
 	size_t len;
+	int msg_type;	/* wrp msg_type, decoded before queueing; -1 if it did not */
+	int drain;	/* a drain in progress waits for it, set under nano_mut */
 	struct UpStreamMsg__ *next;
 } UpStreamMsg;
 
@@ -49,6 +52,29 @@ void *handle_upstream();
 void *processUpstreamMessage();
 
 void sendUpstreamMsgToServer(void **resp_bytes, size_t resp_size);
+
+/**
+ * As sendUpstreamMsgToServer, but with uplink-shards the message goes out
+ * on the connection that source's service is assigned to.
+ */
+void sendUpstreamMsgFromSource(const char *source, void **resp_bytes, size_t resp_size);
+
+/**
+ * Write a message already encoded with the metadata on the primary
+ * connection, for an uplink shard that is down. Like the messages above it
+ * is not sent while a connection retry is in progress.
+ */
+void sendUpstreamMsgOnPrimary(void *msg, size_t len);
+
+/**
+ * Wait, until deadline (CLOCK_REALTIME), for the consumer to handle the
+ * messages queued now, with responses moved ahead of events. Only those
+ * messages are sent while close_retry is set; later ones are held as usual.
+ *
+ * @param left set to the number still not handled at the deadline
+ * @return number handled
+ */
+unsigned int drain_upstream(const struct timespec *deadline, unsigned int *left);
 void set_global_UpStreamMsgQ(UpStreamMsg * UpStreamQ);
 UpStreamMsg * get_global_UpStreamMsgQ(void);
 pthread_cond_t *get_global_nano_con(void);
@@ -0,0 +1,117 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/**
+ * @file wrp_locator.c
+ *
+ * @description Splits a WRP locator into its elements without copying.
+ *
+ */
+
+#include <string.h>
+#include "wrp_locator.h"
+
+/*----------------------------------------------------------------------------*/
+/*                             Internal functions                             */
+/*----------------------------------------------------------------------------*/
+
+/* Take the segment starting at p up to the next '/', return what follows the
+   '/' or NULL at the end of the string. */
+static const char *next_segment(const char *p, wrp_slice_t *s)
+{
+	const char *end = strchr(p, '/');
+
+	s->ptr = p;
+	if(end == NULL)
+	{
+		s->len = strlen(p);
+		return NULL;
+	}
+	s->len = (size_t) (end - p);
+	return end + 1;
+}
+
+/*----------------------------------------------------------------------------*/
+/*                             External Functions                             */
+/*----------------------------------------------------------------------------*/
+
+int wrp_locator_parse(const char *locator, wrp_locator_t *loc)
+{
+	const char *p;
+	size_t scheme_len;
+
+	if(loc == NULL)
+	{
+		return -1;
+	}
+	memset(loc, 0, sizeof(wrp_locator_t));
+	if(locator == NULL)
+	{
+		return -1;
+	}
+
+	/* The scheme is optional, "fake-client/iot" has a device and a service */
+	p = locator;
+	scheme_len = strcspn(locator, ":/");
+	if(locator[scheme_len] == ':')
+	{
+		loc->scheme.ptr = locator;
+		loc->scheme.len = scheme_len;
+		p = locator + scheme_len + 1;
+	}
+
+	p = next_segment(p, &loc->device);
+	if(p != NULL)
+	{
+		p = next_segment(p, &loc->service);
+	}
+	if(p != NULL)
+	{
+		p = next_segment(p, &loc->application);
+	}
+	if(p != NULL)
+	{
+		loc->sub_path.ptr = p;
+		loc->sub_path.len = strlen(p);
+	}
+	return 0;
+}
+
+int wrp_slice_equals(const wrp_slice_t *s, const char *str)
+{
+	if(s == NULL || s->ptr == NULL || str == NULL)
+	{
+		return 0;
+	}
+	return (strncmp(s->ptr, str, s->len) == 0) && (str[s->len] == '\0');
+}
+
+size_t wrp_slice_copy(const wrp_slice_t *s, char *buf, size_t buflen)
+{
+	size_t n = 0;
+
+	if(buf == NULL || buflen == 0)
+	{
+		return 0;
+	}
+	if(s != NULL && s->ptr != NULL)
+	{
+		n = (s->len < buflen) ? s->len : buflen - 1;
+		memcpy(buf, s->ptr, n);
+	}
+	buf[n] = '\0';
+	return n;
+}
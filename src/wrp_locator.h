@@ -0,0 +1,89 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+/**
+ * @file wrp_locator.h
+ *
+ * @description Splits a WRP locator into its elements without copying.
+ *
+ *              [scheme:]device[/service[/application[/sub-path]]]
+ *
+ *              Every element is a (ptr,len) slice into the original string.
+ *              An element that is not present has a NULL ptr, one that is
+ *              present but empty ("mac:xxx/") has a zero len.
+ *
+ */
+
+#ifndef _WRP_LOCATOR_H_
+#define _WRP_LOCATOR_H_
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*----------------------------------------------------------------------------*/
+/*                               Data Structures                              */
+/*----------------------------------------------------------------------------*/
+
+typedef struct wrp_slice
+{
+	const char *ptr;
+	size_t len;
+} wrp_slice_t;
+
+typedef struct wrp_locator
+{
+	wrp_slice_t scheme;
+	wrp_slice_t device;
+	wrp_slice_t service;
+	wrp_slice_t application;
+	wrp_slice_t sub_path;	/* everything after the application */
+} wrp_locator_t;
+
+/*----------------------------------------------------------------------------*/
+/*                             Function Prototypes                            */
+/*----------------------------------------------------------------------------*/
+
+/**
+ * Parse a locator. Does not allocate, the slices are only valid as long as
+ * the locator string is.
+ *
+ * @param locator NUL terminated locator
+ * @param loc returns the elements
+ *
+ * @return 0 on success, -1 if locator is NULL
+ */
+int wrp_locator_parse(const char *locator, wrp_locator_t *loc);
+
+/**
+ * @return 1 if the slice is present and equal to str, 0 otherwise
+ */
+int wrp_slice_equals(const wrp_slice_t *s, const char *str);
+
+/**
+ * Copy a slice into buf as a NUL terminated string, truncating to buflen-1.
+ *
+ * @return number of characters copied
+ */
+size_t wrp_slice_copy(const wrp_slice_t *s, char *buf, size_t buflen);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _WRP_LOCATOR_H_ */
@@ -105,7 +105,9 @@ void test_getWebpaConveyHeader()
     char buffer[1024];
     int  size = 1024;
     
-    CU_ASSERT(nopoll_base64_decode(getWebpaConveyHeader(),strlen(getWebpaConveyHeader()), buffer, &size) == nopoll_true);
+    char *header = getWebpaConveyHeader();
+    CU_ASSERT(nopoll_base64_decode(header,strlen(header), buffer, &size) == nopoll_true);
+    free(header);
     cJSON *payload = cJSON_Parse(buffer);
     
     CU_ASSERT_STRING_EQUAL(get_parodus_cfg()->hw_model, cJSON_GetObjectItem(payload, HW_MODELNAME)->valuestring);
@@ -166,7 +168,9 @@ void test_WebpaConveyHeaderWithNullValues()
     memset(cfg, 0, sizeof(ParodusCfg));
     set_parodus_cfg(cfg);
     
-    CU_ASSERT(nopoll_base64_decode(getWebpaConveyHeader(),strlen(getWebpaConveyHeader()), buffer, &size) == nopoll_true);
+    char *header = getWebpaConveyHeader();
+    CU_ASSERT(nopoll_base64_decode(header,strlen(header), buffer, &size) == nopoll_true);
+    free(header);
     printf("buffer : %s\n",buffer);
     cJSON *payload = cJSON_Parse(buffer);
     CU_ASSERT_PTR_NULL(cJSON_GetObjectItem(payload, HW_MODELNAME));
@@ -56,6 +56,7 @@ char *get_global_reconnect_reason()
 void test_getWebpaConveyHeader()
 {
     ParodusCfg cfg;
+    char *header;
     memset(&cfg, 0, sizeof(ParodusCfg));
     parStrncpy(cfg.hw_model, "TG1682", sizeof(cfg.hw_model));
     parStrncpy(cfg.hw_serial_number, "Fer23u948590", sizeof(cfg.hw_serial_number));
@@ -79,7 +80,10 @@ void test_getWebpaConveyHeader()
     
     will_return(nopoll_base64_encode, nopoll_true);
     expect_function_call(nopoll_base64_encode);
-    getWebpaConveyHeader();
+    header = getWebpaConveyHeader();
+    assert_non_null(header);
+    assert_null(strchr(header, '\n'));
+    free(header);
 }
 
 void err_getWebpaConveyHeader()
@@ -92,7 +96,7 @@ void err_getWebpaConveyHeader()
     expect_function_call(get_global_reconnect_reason);
     will_return(nopoll_base64_encode, nopoll_false);
     expect_function_call(nopoll_base64_encode);
-    getWebpaConveyHeader();
+    assert_null(getWebpaConveyHeader());
 }
 
 /*
@@ -0,0 +1,258 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/backoff.h"
+
+/*----------------------------------------------------------------------------*/
+/*                                   Macros                                   */
+/*----------------------------------------------------------------------------*/
+// fleet reconnect simulation
+#define SIM_DEVICES	10000
+#define SIM_CAPACITY	500	// connects the servers accept per second
+#define SIM_MAX_DELAY	60	// webpa-backoff-max
+#define SIM_SECONDS	3600
+#define SIM_TICK_MS	100
+
+/*----------------------------------------------------------------------------*/
+/*                                   Tests                                    */
+/*----------------------------------------------------------------------------*/
+void test_exponential ()
+{
+	backoff_state_t state;
+
+	backoff_init (&state, BACKOFF_EXPONENTIAL, 30000, 1);
+	assert_int_equal (backoff_next (&state), 3000);
+	assert_int_equal (backoff_next (&state), 7000);
+	assert_int_equal (backoff_next (&state), 15000);
+	assert_int_equal (backoff_next (&state), 30000);
+	assert_int_equal (backoff_next (&state), 30000);
+
+	backoff_init (&state, BACKOFF_EXPONENTIAL, 0, 1);
+	assert_int_equal (backoff_next (&state), 0);
+}
+
+void test_full_jitter ()
+{
+	backoff_state_t state;
+	unsigned int envelope[] = {3000, 7000, 15000, 30000, 30000, 30000};
+	unsigned int i, delay;
+
+	backoff_init (&state, BACKOFF_FULL_JITTER, 30000, 7);
+	for (i = 0; i < sizeof(envelope) / sizeof(envelope[0]); i++) {
+		delay = backoff_next (&state);
+		assert_in_range (delay, 0, envelope[i]);
+	}
+}
+
+void test_decorrelated_jitter ()
+{
+	backoff_state_t state;
+	unsigned int i, prev = BACKOFF_BASE_MS, delay;
+	int varied = 0;
+
+	backoff_init (&state, BACKOFF_DECORRELATED_JITTER, 30000, 11);
+	for (i = 0; i < 50; i++) {
+		delay = backoff_next (&state);
+		assert_in_range (delay, BACKOFF_BASE_MS, (3 * prev < 30000) ? 3 * prev : 30000);
+		if (delay != prev)
+			varied = 1;
+		prev = (delay < BACKOFF_BASE_MS) ? BACKOFF_BASE_MS : delay;
+	}
+	assert_true (varied);
+
+	// two devices do not follow the same sequence
+	backoff_state_t a, b;
+	int same = 0;
+	backoff_init (&a, BACKOFF_DECORRELATED_JITTER, 30000, backoff_device_hash ("14cfe2142110"));
+	backoff_init (&b, BACKOFF_DECORRELATED_JITTER, 30000, backoff_device_hash ("14cfe2142111"));
+	for (i = 0; i < 10; i++) {
+		if (backoff_next (&a) == backoff_next (&b))
+			same++;
+	}
+	assert_true (same < 10);
+}
+
+void test_after_hint ()
+{
+	backoff_state_t state;
+	unsigned int delay;
+
+	backoff_init (&state, BACKOFF_EXPONENTIAL, 30000, 1);
+	assert_int_equal (backoff_after_hint (&state, 120), 120000);
+	assert_int_equal (backoff_after_hint (&state, 100000), BACKOFF_RETRY_AFTER_MAX * 1000);
+
+	backoff_init (&state, BACKOFF_FULL_JITTER, 30000, 1);
+	delay = backoff_after_hint (&state, 120);
+	assert_in_range (delay, 120000, 132000);
+}
+
+void test_spread ()
+{
+	unsigned int spread = backoff_spread ("14cfe2142110", 60000);
+
+	assert_in_range (spread, 0, 59999);
+	// fixed for a device
+	assert_int_equal (spread, backoff_spread ("14cfe2142110", 60000));
+	assert_int_equal (backoff_spread ("14cfe2142110", 0), 0);
+}
+
+void test_parse_retry_after ()
+{
+	assert_int_equal (backoff_parse_retry_after (NULL), 0);
+	assert_int_equal (backoff_parse_retry_after (""), 0);
+	assert_int_equal (backoff_parse_retry_after ("Retry-After: 120"), 120);
+	assert_int_equal (backoff_parse_retry_after ("HTTP/1.1 503\r\nretry-after:7\r\n"), 7);
+	assert_int_equal (backoff_parse_retry_after ("Retry-After: Wed, 21 Oct 2015 07:28:00 GMT"), 0);
+	assert_int_equal (backoff_parse_retry_after ("Retry-After: 99999999999"), BACKOFF_RETRY_AFTER_MAX);
+	assert_int_equal (backoff_parse_retry_after ("Redirect:https://mydns.mycom.net"), 0);
+}
+
+/*----------------------------------------------------------------------------*/
+/*                          Fleet reconnect simulation                        */
+/*----------------------------------------------------------------------------*/
+typedef struct {
+	unsigned int peak;		// most attempts in one second
+	unsigned int attempts;
+	unsigned int all_online;	// second the last device connected
+	unsigned int load[SIM_SECONDS];
+} sim_result_t;
+
+// Every device loses its connection in the first second and reconnects with
+// the policy;
+// the servers accept SIM_CAPACITY connects per second, spread over ticks of
+// SIM_TICK_MS, and fail the rest.
+static void simulate (int policy, unsigned int spread_s, sim_result_t *result)
+{
+	static backoff_state_t state[SIM_DEVICES];
+	static unsigned long long next_ms[SIM_DEVICES];
+	char device_id[16];
+	unsigned int per_tick = SIM_CAPACITY * SIM_TICK_MS / 1000;
+	unsigned int online = 0, accepted, tick, t, i;
+
+	memset (result, 0, sizeof(*result));
+	for (i = 0; i < SIM_DEVICES; i++) {
+		sprintf (device_id, "14cfe2%06x", i);
+		backoff_init (&state[i], policy, SIM_MAX_DELAY * 1000,
+			backoff_device_hash (device_id));
+		next_ms[i] = backoff_device_hash (device_id) % 997
+			+ backoff_spread (device_id, spread_s * 1000);
+	}
+	for (tick = 0; (tick < SIM_SECONDS * 1000 / SIM_TICK_MS) && (online < SIM_DEVICES); tick++) {
+		t = tick * SIM_TICK_MS / 1000;
+		accepted = 0;
+		for (i = 0; i < SIM_DEVICES; i++) {
+			if ((next_ms[i] == (unsigned long long) -1) || (next_ms[i] / SIM_TICK_MS != tick))
+				continue;
+			result->load[t]++;
+			result->attempts++;
+			if (accepted < per_tick) {
+				accepted++;
+				online++;
+				next_ms[i] = (unsigned long long) -1;
+			} else {
+				next_ms[i] += backoff_next (&state[i]);
+				// an immediate retry still lands in a later tick
+				if (next_ms[i] / SIM_TICK_MS == tick)
+					next_ms[i] = (tick + 1ULL) * SIM_TICK_MS;
+			}
+		}
+		if (result->load[t] > result->peak)
+			result->peak = result->load[t];
+		result->all_online = t;
+	}
+	assert_int_equal (online, SIM_DEVICES);
+}
+
+static void print_load (const char *name, sim_result_t *result)
+{
+	unsigned int t, sum;
+
+	printf ("%-32s peak %5u/s  attempts %6u  all online at %3us  load/10s:",
+		name, result->peak, result->attempts, result->all_online);
+	for (t = 0; t <= result->all_online; t += 10) {
+		unsigned int j;
+		for (sum = 0, j = t; (j < t + 10) && (j < SIM_SECONDS); j++)
+			sum += result->load[j];
+		printf (" %u", sum);
+	}
+	printf ("\n");
+}
+
+void test_fleet_reconnect_simulation ()
+{
+	static sim_result_t exp_res, full_res, decor_res, spread_res;
+	unsigned int t, exp_retry_peak = 0, full_retry_peak = 0, decor_retry_peak = 0;
+
+	simulate (BACKOFF_EXPONENTIAL, 0, &exp_res);
+	simulate (BACKOFF_FULL_JITTER, 0, &full_res);
+	simulate (BACKOFF_DECORRELATED_JITTER, 0, &decor_res);
+	simulate (BACKOFF_DECORRELATED_JITTER, 60, &spread_res);
+
+	printf ("%u devices, servers accept %u connects/s, backoff max %us\n",
+		SIM_DEVICES, SIM_CAPACITY, SIM_MAX_DELAY);
+	print_load ("exponential", &exp_res);
+	print_load ("full-jitter", &full_res);
+	print_load ("decorrelated-jitter", &decor_res);
+	print_load ("decorrelated-jitter, 60s spread", &spread_res);
+
+	// after the first wave, lockstep retries come back all at once
+	for (t = 1; t < SIM_SECONDS; t++) {
+		if (exp_res.load[t] > exp_retry_peak)
+			exp_retry_peak = exp_res.load[t];
+		if (full_res.load[t] > full_retry_peak)
+			full_retry_peak = full_res.load[t];
+		if (decor_res.load[t] > decor_retry_peak)
+			decor_retry_peak = decor_res.load[t];
+	}
+	assert_true (exp_retry_peak >= SIM_DEVICES - SIM_CAPACITY);
+	assert_true (full_retry_peak < exp_retry_peak);
+	assert_true (decor_retry_peak < exp_retry_peak);
+	// each lockstep wave gets one second of capacity, so it drags on
+	assert_true (full_res.all_online * 4 < exp_res.all_online);
+	assert_true (decor_res.all_online * 4 < exp_res.all_online);
+	assert_true (full_res.attempts * 2 < exp_res.attempts);
+	assert_true (decor_res.attempts * 2 < exp_res.attempts);
+	// the spread keeps every second under capacity
+	assert_true (spread_res.peak <= SIM_CAPACITY);
+	assert_true (spread_res.attempts == SIM_DEVICES);
+	assert_true (spread_res.all_online <= 61);
+}
+
+/*----------------------------------------------------------------------------*/
+/*                             External Functions                             */
+/*----------------------------------------------------------------------------*/
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_exponential),
+        cmocka_unit_test(test_full_jitter),
+        cmocka_unit_test(test_decorrelated_jitter),
+        cmocka_unit_test(test_after_hint),
+        cmocka_unit_test(test_spread),
+        cmocka_unit_test(test_parse_retry_after),
+        cmocka_unit_test(test_fleet_reconnect_simulation),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -22,6 +22,7 @@
 #include "../src/ParodusInternal.h"
 #include "../src/spin_thread.h"
 #include "../src/client_list.h"
+#include "../src/crud_subscribe.h"
 
 #define TEST_CLIENT1_URL "tcp://127.0.0.1:6677"
 #define TEST_CLIENT2_URL "tcp://127.0.0.1:6655"
@@ -216,8 +217,11 @@ void test_addtolist_multiple_clients()
 void test_client_deleteFromlist()
 {
 	int ret =-1;
+	CU_ASSERT_EQUAL( crud_subscribe("test_client1", "tags"), 1 );
 	ret = deleteFromList("test_client1");
 	CU_ASSERT_EQUAL( ret, 0 );
+	// its subscriptions went with it
+	CU_ASSERT_EQUAL( crud_unsubscribe("test_client1", "tags"), 0 );
 	ParodusInfo("test_client_deleteFromlist done..\n");
 
 }
@@ -21,11 +21,13 @@
 #include <stddef.h>
 #include <setjmp.h>
 #include <cmocka.h>
+#include <time.h>
 
 #include <CUnit/Basic.h>
 
 #include "../src/config.h"
 #include "../src/ParodusInternal.h"
+#include "../src/crud_store.h"
 
 extern int parse_mac_address (char *target, const char *arg);
 extern int server_is_http (const char *full_url,
@@ -194,6 +196,26 @@ void test_parseCommandLine()
 		"--jwt-algo=RS256",
 #endif
 		"--crud-config-file=parodus_cfg.json",
+		"--crud-store-format=msgpack",
+		"--connection-attempt-delay=250",
+		"--dns-cache-ttl=60",
+		"--tls-session-cache=1",
+		"--tls-session-file=/tmp/parodus_tls_sessions",
+		"--tls13-resumption",
+		"--backoff-policy=decorrelated-jitter",
+		"--reconnect-spread=30",
+		"--server-pool=https://a.example.net:8080,https://b.example.net:8080",
+		"--drain-timeout=2000",
+		"--warm-standby",
+		"--uplink-shards=4",
+		"--ping-interval=15",
+		"--socket-tuning=keepalive=30:10:3,user-timeout=60000,nodelay",
+		"--link-monitor",
+		"--webpa-interfaces=erouter0,wwan0",
+		"--conn-hints-file=/tmp/parodus_hints",
+		"--conn-hints-ttl=3600",
+		"--handover-socket=/tmp/parodus_handover",
+		"--ktls",
 		NULL
 	};
 	int argc = (sizeof (command) / sizeof (char *)) - 1;
@@ -237,6 +259,26 @@ void test_parseCommandLine()
 	assert_string_equal ( get_parodus_cfg()->jwt_key, jwt_key);
 #endif
 	assert_string_equal(parodusCfg.crud_config_file, "parodus_cfg.json");
+	assert_int_equal( (int) parodusCfg.crud_store_format, CRUD_STORE_FORMAT_MSGPACK);
+	assert_int_equal( (int) parodusCfg.connection_attempt_delay, 250);
+	assert_int_equal( (int) parodusCfg.dns_cache_ttl, 60);
+	assert_int_equal( (int) parodusCfg.tls_session_cache, 1);
+	assert_string_equal(parodusCfg.tls_session_file, "/tmp/parodus_tls_sessions");
+	assert_int_equal( (int) parodusCfg.tls13_resumption, 1);
+	assert_int_equal( (int) parodusCfg.backoff_policy, BACKOFF_DECORRELATED_JITTER);
+	assert_int_equal( (int) parodusCfg.reconnect_spread, 30);
+	assert_string_equal(parodusCfg.server_pool, "https://a.example.net:8080,https://b.example.net:8080");
+	assert_int_equal( (int) parodusCfg.drain_timeout, 2000);
+	assert_int_equal( (int) parodusCfg.warm_standby, 1);
+	assert_int_equal( (int) parodusCfg.uplink_shards, 4);
+	assert_int_equal( (int) parodusCfg.ping_interval, 15);
+	assert_string_equal(parodusCfg.socket_tuning, "keepalive=30:10:3,user-timeout=60000,nodelay");
+	assert_int_equal( (int) parodusCfg.link_monitor, 1);
+	assert_string_equal(parodusCfg.webpa_interfaces, "erouter0,wwan0");
+	assert_string_equal(parodusCfg.conn_hints_file, "/tmp/parodus_hints");
+	assert_int_equal( (int) parodusCfg.conn_hints_ttl, 3600);
+	assert_string_equal(parodusCfg.handover_socket, "/tmp/parodus_handover");
+	assert_int_equal( (int) parodusCfg.ktls, 1);
 }
 
 void test_parseCommandLineNull()
@@ -275,6 +317,8 @@ void err_parseCommandLine()
     assert_int_equal (parseCommandLine(argc,command,&parodusCfg), -1);
 	command[5] = "--boot-time=12x";
     assert_int_equal (parseCommandLine(argc,command,&parodusCfg), -1);
+	command[5] = "--crud-store-format=xml";
+    assert_int_equal (parseCommandLine(argc,command,&parodusCfg), -1);
 #ifdef FEATURE_DNS_QUERY
 	command[5] = "--webpa-url=https://127.0.0.1";
 	command[3] = "--acquire-jwt=1";
@@ -594,6 +638,67 @@ void test_new_auth_token ()
 	
 }
 
+void test_cloud_status_payload()
+{
+    char buf[64];
+    size_t len;
+
+    set_cloud_status(CLOUD_STATUS_ONLINE);
+    assert_string_equal(get_parodus_cfg()->cloud_status, CLOUD_STATUS_ONLINE);
+    len = get_cloud_status_payload(buf, sizeof(buf));
+    buf[len] = '\0';
+    assert_string_equal(buf, "{\"cloud-status\":\"online\"}");
+
+    // Picked up even when cloud_status is assigned directly
+    get_parodus_cfg()->cloud_status = CLOUD_STATUS_OFFLINE;
+    len = get_cloud_status_payload(buf, sizeof(buf));
+    buf[len] = '\0';
+    assert_string_equal(buf, "{\"cloud-status\":\"offline\"}");
+
+    assert_int_equal(get_cloud_status_payload(buf, 8), 0);
+    set_cloud_status(NULL);
+    assert_int_equal(get_cloud_status_payload(buf, sizeof(buf)), 0);
+}
+
+/* Not a pass/fail test, prints the cost of the pre-rendered payload next to
+   building it with cJSON the way retrieveFromMemory() does */
+void bench_cloud_status_payload()
+{
+    struct timespec start, end;
+    char buf[64];
+    char *str;
+    cJSON *json;
+    double ns_cached, ns_cjson;
+    size_t total = 0;
+    int i;
+
+    set_cloud_status(CLOUD_STATUS_ONLINE);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(i = 0; i < 100000; i++)
+    {
+        total += get_cloud_status_payload(buf, sizeof(buf));
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    ns_cached = ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / 100000;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(i = 0; i < 100000; i++)
+    {
+        json = cJSON_CreateObject();
+        cJSON_AddItemToObject(json, CLOUD_STATUS, cJSON_CreateString(get_parodus_cfg()->cloud_status));
+        str = cJSON_PrintUnformatted(json);
+        total += strlen(str);
+        free(str);
+        cJSON_Delete(json);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    ns_cjson = ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / 100000;
+
+    print_message("cloud-status payload: cached %.1f ns/op, cJSON %.1f ns/op\n", ns_cached, ns_cjson);
+    assert_true(total > 0);
+    set_cloud_status(NULL);
+}
+
 /*----------------------------------------------------------------------------*/
 /*                             External Functions                             */
 /*----------------------------------------------------------------------------*/
@@ -619,7 +724,9 @@ int main(void)
         cmocka_unit_test(test_setDefaultValuesToCfg),
         cmocka_unit_test(err_setDefaultValuesToCfg),
         cmocka_unit_test(test_execute_token_script),
-        cmocka_unit_test(test_new_auth_token)
+        cmocka_unit_test(test_new_auth_token),
+        cmocka_unit_test(test_cloud_status_payload),
+        cmocka_unit_test(bench_cloud_status_payload)
     };
 
     return cmocka_run_group_tests(tests, NULL, NULL);
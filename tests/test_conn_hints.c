@@ -0,0 +1,131 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../src/conn_hints.h"
+
+/*----------------------------------------------------------------------------*/
+/*                            File Scoped Variables                           */
+/*----------------------------------------------------------------------------*/
+#define HINTS_FILE	"test_conn_hints.txt"
+#define ORIGIN		"https://mydns.mycom.net:8080"
+
+/*----------------------------------------------------------------------------*/
+/*                                   Helpers                                  */
+/*----------------------------------------------------------------------------*/
+static void make_hint (conn_hint_t *hint, const char *addr, time_t expires)
+{
+    memset (hint, 0, sizeof(conn_hint_t));
+    strcpy (hint->origin, ORIGIN);
+    strcpy (hint->host, "talaria-7.mycom.net");
+    hint->port = 8080;
+    hint->allow_insecure = 0;
+    strcpy (hint->addr, addr);
+    hint->expires = expires;
+}
+
+static void write_file (const char *text)
+{
+    FILE *fp = fopen (HINTS_FILE, "w");
+
+    assert_non_null (fp);
+    fputs (text, fp);
+    fclose (fp);
+}
+
+/*----------------------------------------------------------------------------*/
+/*                                   Tests                                    */
+/*----------------------------------------------------------------------------*/
+void test_save_load ()
+{
+    conn_hint_t saved, loaded;
+    struct stat st;
+
+    unlink (HINTS_FILE);
+    assert_int_equal (conn_hints_load (HINTS_FILE, ORIGIN, &loaded), -1);
+
+    make_hint (&saved, "2001:db8::7", time (NULL) + 60);
+    assert_int_equal (conn_hints_save (HINTS_FILE, &saved), 0);
+    assert_int_equal (stat (HINTS_FILE, &st), 0);
+    assert_int_equal (st.st_mode & 0777, 0600);
+    assert_int_equal (conn_hints_load (HINTS_FILE, ORIGIN, &loaded), 0);
+    assert_string_equal (loaded.origin, ORIGIN);
+    assert_string_equal (loaded.host, "talaria-7.mycom.net");
+    assert_int_equal (loaded.port, 8080);
+    assert_int_equal (loaded.allow_insecure, 0);
+    assert_string_equal (loaded.addr, "2001:db8::7");
+    assert_int_equal (loaded.expires, saved.expires);
+
+    // no address is kept as such
+    make_hint (&saved, "", time (NULL) + 60);
+    saved.allow_insecure = 1;
+    assert_int_equal (conn_hints_save (HINTS_FILE, &saved), 0);
+    assert_int_equal (conn_hints_load (HINTS_FILE, ORIGIN, &loaded), 0);
+    assert_string_equal (loaded.addr, "");
+    assert_int_equal (loaded.allow_insecure, 1);
+
+    conn_hints_drop (HINTS_FILE);
+    assert_int_equal (conn_hints_load (HINTS_FILE, ORIGIN, &loaded), -1);
+    conn_hints_drop (HINTS_FILE);
+}
+
+void test_load_rejects ()
+{
+    conn_hint_t saved, loaded;
+
+    // from another url, or expired
+    make_hint (&saved, "192.0.2.7", time (NULL) + 60);
+    assert_int_equal (conn_hints_save (HINTS_FILE, &saved), 0);
+    assert_int_equal (conn_hints_load (HINTS_FILE, "https://other.mycom.net:8080", &loaded), -1);
+    make_hint (&saved, "192.0.2.7", time (NULL) - 1);
+    assert_int_equal (conn_hints_save (HINTS_FILE, &saved), 0);
+    assert_int_equal (conn_hints_load (HINTS_FILE, ORIGIN, &loaded), -1);
+
+    write_file ("");
+    assert_int_equal (conn_hints_load (HINTS_FILE, ORIGIN, &loaded), -1);
+    write_file (ORIGIN " talaria-7.mycom.net 8080\n");
+    assert_int_equal (conn_hints_load (HINTS_FILE, ORIGIN, &loaded), -1);
+    assert_int_equal (conn_hints_load (NULL, ORIGIN, &loaded), -1);
+
+    // nothing is saved without a host
+    make_hint (&saved, "192.0.2.7", time (NULL) + 60);
+    saved.host[0] = '\0';
+    assert_int_equal (conn_hints_save (HINTS_FILE, &saved), -1);
+    strcpy (saved.host, "talaria-7.mycom.net");
+    assert_int_equal (conn_hints_save ("/nonexistent/dir/hints", &saved), -1);
+    conn_hints_drop (HINTS_FILE);
+}
+
+/*----------------------------------------------------------------------------*/
+/*                             External Functions                             */
+/*----------------------------------------------------------------------------*/
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_save_load),
+        cmocka_unit_test(test_load_rejects),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
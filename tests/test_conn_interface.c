@@ -29,6 +29,7 @@
 #include "../src/config.h"
 #include "../src/heartBeat.h"
 #include "../src/close_retry.h"
+#include "../src/crud_interface.h"
 
 /*----------------------------------------------------------------------------*/
 /*                            File Scoped Variables                           */
@@ -37,18 +38,105 @@ UpStreamMsg *UpStreamMsgQ;
 ParodusMsg *ParodusMsgQ;
 pthread_mutex_t nano_mut;
 pthread_cond_t nano_con;
+extern bool g_shutdown;
+static bool shutdown_in_step = false;
 
  
 /*----------------------------------------------------------------------------*/
 /*                                   Mocks                                    */
 /*----------------------------------------------------------------------------*/
-int createNopollConnection(noPollCtx *ctx)
+void conn_machine_init (noPollCtx *ctx)
 {
     UNUSED(ctx);
     function_called();
+}
+
+void start_registration_clock (void)
+{
+}
+
+int get_numOfClients (void)
+{
+    return 0;
+}
+
+int get_conn_state (void)
+{
     return (int) mock();
 }
 
+int conn_machine_step (void)
+{
+    function_called();
+    if (shutdown_in_step)
+        shutdownSocketConnection();
+    return (int) mock();
+}
+
+void conn_machine_drain (void)
+{
+    function_called();
+}
+
+void free_header_cache (void)
+{
+}
+
+void conn_machine_tend (void)
+{
+}
+
+int conn_machine_ping (void)
+{
+    return -1;
+}
+
+void conn_machine_stop (void)
+{
+}
+
+void close_side_connections (void)
+{
+}
+
+void link_monitor_stop (void)
+{
+}
+
+void conn_machine_flush (void)
+{
+}
+
+int handover_take (const char *path)
+{
+    UNUSED(path);
+    return -1;
+}
+
+void handover_restore (void)
+{
+}
+
+int handover_listen (const char *path)
+{
+    UNUSED(path);
+    return -1;
+}
+
+bool handover_pending (void)
+{
+    return false;
+}
+
+int handover_send (void)
+{
+    return -1;
+}
+
+void handover_stop (void)
+{
+}
+
 void nopoll_log_set_handler	(noPollCtx *ctx, noPollLogHandler handler, noPollPtr user_data)
 {
     UNUSED(ctx); UNUSED(handler); UNUSED(user_data);
@@ -76,18 +164,6 @@ void packMetaData()
 }
 
 
-int get_cloud_disconnect_time(void)
-{
-    function_called();
-    return (int) (intptr_t)mock();
-}
-
-void set_cloud_disconnect_time(int Time)
-{
-    UNUSED(Time);
-    function_called();
-}
-
 void *handle_upstream()
 {
     return NULL;
@@ -150,10 +226,10 @@ noPollConn *get_global_conn(void)
     return (noPollConn *) (intptr_t)mock();
 }
 
-void set_global_conn(noPollConn *conn)
+int sendMsgtoRegisteredClients(char *dest,const char **Msg,size_t msgSize)
 {
-    UNUSED(conn);
-    function_called();
+    UNUSED(dest); UNUSED(Msg); UNUSED(msgSize);
+    return 0;
 }
 
 void StartThread(void *(*start_routine) (void *))
@@ -220,23 +296,23 @@ void test_createSocketConnection()
     will_return(nopoll_ctx_new, (intptr_t)&ctx);
     expect_function_call(nopoll_ctx_new);
     expect_function_call(nopoll_log_set_handler);
-    will_return(createNopollConnection, nopoll_true);
-    expect_function_call(createNopollConnection);
     expect_function_call(packMetaData);
 
-    expect_function_calls(StartThread, 5);
+    expect_function_calls(StartThread, 6 + CRUD_RETRIEVE_THREADS);
     expect_function_call(initKeypress);
+    expect_function_call(conn_machine_init);
+    will_return(get_conn_state, CONN_STATE_ONLINE);
     will_return(nopoll_loop_wait, 1);
     expect_function_call(nopoll_loop_wait);
     
     expect_function_call(set_global_reconnect_reason);
-    will_return(get_global_conn, (intptr_t)NULL);
     expect_function_call(set_global_reconnect_status);
-    expect_function_call(get_global_conn);
-    expect_function_call(close_and_unref_connection);
-    expect_function_call(set_global_conn);
-    will_return(createNopollConnection, nopoll_true);
-    expect_function_call(createNopollConnection);
+    expect_function_call(conn_machine_drain);
+    // reconnecting, until it fails
+    will_return(get_conn_state, CONN_STATE_DRAINING);
+    will_return(conn_machine_step, 0);
+    expect_function_call(conn_machine_step);
+    will_return(get_conn_state, CONN_STATE_FAILED);
     will_return(get_global_conn, (intptr_t)NULL);
     expect_function_call(get_global_conn);
     expect_function_call(close_and_unref_connection);
@@ -256,28 +332,22 @@ void test_createSocketConnection1()
     will_return(nopoll_ctx_new, (intptr_t)&ctx);
     expect_function_call(nopoll_ctx_new);
     expect_function_call(nopoll_log_set_handler);
-    will_return(createNopollConnection, nopoll_true);
-    expect_function_call(createNopollConnection);
     expect_function_call(packMetaData);
 
-    expect_function_calls(StartThread, 5);
+    expect_function_calls(StartThread, 6 + CRUD_RETRIEVE_THREADS);
+    expect_function_call(conn_machine_init);
+    will_return(get_conn_state, CONN_STATE_ONLINE);
     will_return(nopoll_loop_wait, 1);
     expect_function_call(nopoll_loop_wait);
     
-    will_return(get_global_conn, (intptr_t)NULL);
-    expect_function_call(get_global_conn);
-    expect_function_call(close_and_unref_connection);
-    expect_function_call(set_global_conn);
-    will_return(createNopollConnection, nopoll_true);
-    expect_function_call(createNopollConnection);
+    expect_function_call(conn_machine_drain);
+    will_return(get_conn_state, CONN_STATE_FAILED);
     will_return(get_global_conn, (intptr_t)NULL);
     expect_function_call(get_global_conn);
     expect_function_call(close_and_unref_connection);
     expect_function_call(nopoll_ctx_unref);
     expect_function_call(nopoll_cleanup_library);
     createSocketConnection(NULL);
-    assert_string_equal(get_parodus_cfg()->cloud_status, CLOUD_STATUS_OFFLINE);
-    
 }
 
 void test_PingMissIntervalTime()
@@ -306,12 +376,12 @@ void test_PingMissIntervalTime()
     will_return(nopoll_ctx_new, (intptr_t)&ctx);
     expect_function_call(nopoll_ctx_new);
     expect_function_call(nopoll_log_set_handler);
-    will_return(createNopollConnection, nopoll_true);
-    expect_function_call(createNopollConnection);
     expect_function_call(packMetaData);
 
-    expect_function_calls(StartThread, 5);
+    expect_function_calls(StartThread, 6 + CRUD_RETRIEVE_THREADS);
+    expect_function_call(conn_machine_init);
     //Increment ping interval time to 1 sec for each nopoll_loop_wait call
+    will_return_count(get_conn_state, CONN_STATE_ONLINE, 7);
     will_return(nopoll_loop_wait, 1);
     will_return(nopoll_loop_wait, 1);
     will_return(nopoll_loop_wait, 1);
@@ -322,13 +392,9 @@ void test_PingMissIntervalTime()
     expect_function_calls(nopoll_loop_wait, 7);
     //Expecting Ping miss after 6 sec
     expect_function_call(set_global_reconnect_reason);
-    will_return(get_global_conn, (intptr_t)NULL);
     expect_function_call(set_global_reconnect_status);
-    expect_function_call(get_global_conn);
-    expect_function_call(close_and_unref_connection);
-    expect_function_call(set_global_conn);
-    will_return(createNopollConnection, nopoll_true);
-    expect_function_call(createNopollConnection);
+    expect_function_call(conn_machine_drain);
+    will_return(get_conn_state, CONN_STATE_FAILED);
     will_return(get_global_conn, (intptr_t)NULL);
     expect_function_call(get_global_conn);
     expect_function_call(close_and_unref_connection);
@@ -347,20 +413,16 @@ void err_createSocketConnection()
     will_return(nopoll_ctx_new, (intptr_t)NULL);
     expect_function_call(nopoll_ctx_new);
     expect_function_call(nopoll_log_set_handler);
-    will_return(createNopollConnection, nopoll_true);
-    expect_function_call(createNopollConnection);
     expect_function_call(packMetaData);
 
-    expect_function_calls(StartThread, 5);
+    expect_function_calls(StartThread, 6 + CRUD_RETRIEVE_THREADS);
+    expect_function_call(conn_machine_init);
+    will_return(get_conn_state, CONN_STATE_ONLINE);
     will_return(nopoll_loop_wait, 1);
     expect_function_call(nopoll_loop_wait);
     
-    will_return(get_global_conn, (intptr_t)NULL);
-    expect_function_call(get_global_conn);
-    expect_function_call(close_and_unref_connection);
-    expect_function_call(set_global_conn);
-    will_return(createNopollConnection, nopoll_true);
-    expect_function_call(createNopollConnection);
+    expect_function_call(conn_machine_drain);
+    will_return(get_conn_state, CONN_STATE_FAILED);
     will_return(get_global_conn, (intptr_t)NULL);
     expect_function_call(get_global_conn);
     expect_function_call(close_and_unref_connection);
@@ -369,51 +431,75 @@ void err_createSocketConnection()
     createSocketConnection(NULL);
 }
 
-
-void test_createSocketConnection_cloud_disconn()
+// a shutdown during a long backoff (like the cloud-disconnect hold) is not
+// held up by it
+void test_createSocketConnection_shutdown_in_backoff()
 {
-	ParodusCfg cfg;
-	memset(&cfg,0,sizeof(ParodusCfg));
-	cfg.cloud_disconnect = strdup("XPC");
-	set_parodus_cfg(&cfg);
+	struct timespec start, stop;
 
-	set_close_retry();
+	reset_close_retry();
 	reset_heartBeatTimer();
 	expect_function_call(nopoll_thread_handlers);
 
 	will_return(nopoll_ctx_new, (intptr_t)NULL);
 	expect_function_call(nopoll_ctx_new);
 	expect_function_call(nopoll_log_set_handler);
-	will_return(createNopollConnection, nopoll_true);
-	expect_function_call(createNopollConnection);
 	expect_function_call(packMetaData);
 
-	expect_function_calls(StartThread, 5);
-	will_return(nopoll_loop_wait, 1);
-	expect_function_call(nopoll_loop_wait);
+	expect_function_calls(StartThread, 6 + CRUD_RETRIEVE_THREADS);
+	expect_function_call(conn_machine_init);
+	will_return(get_conn_state, CONN_STATE_BACKOFF);
+	will_return(conn_machine_step, 5 * 60 * 1000);
+	expect_function_call(conn_machine_step);
 
 	will_return(get_global_conn, (intptr_t)NULL);
 	expect_function_call(get_global_conn);
 	expect_function_call(close_and_unref_connection);
-	expect_function_call(set_global_conn);
+	expect_function_call(nopoll_ctx_unref);
+	expect_function_call(nopoll_cleanup_library);
+	shutdown_in_step = true;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	createSocketConnection(NULL);
+	clock_gettime(CLOCK_MONOTONIC, &stop);
+	assert_true(stop.tv_sec - start.tv_sec <= 2);
+	shutdown_in_step = false;
+	g_shutdown = false;
+}
+
+// local services are up before the cloud is reached, and the connection
+// is stepped from the main loop until it is
+void test_createSocketConnection_offline_start()
+{
+	noPollCtx *ctx;
 
+	reset_close_retry();
+	reset_heartBeatTimer();
+	expect_function_call(nopoll_thread_handlers);
 
-	expect_function_call(set_cloud_disconnect_time);
-	will_return(get_cloud_disconnect_time, 0);
-	expect_function_call(get_cloud_disconnect_time);
-	will_return(get_cloud_disconnect_time, 0);
-	expect_function_call(get_cloud_disconnect_time);
-	will_return(get_cloud_disconnect_time, 0);
-	expect_function_call(get_cloud_disconnect_time);
+	will_return(nopoll_ctx_new, (intptr_t)&ctx);
+	expect_function_call(nopoll_ctx_new);
+	expect_function_call(nopoll_log_set_handler);
+	expect_function_call(packMetaData);
 
-	will_return(createNopollConnection, nopoll_true);
-	expect_function_call(createNopollConnection);
+	expect_function_calls(StartThread, 6 + CRUD_RETRIEVE_THREADS);
+	expect_function_call(initKeypress);
+	expect_function_call(conn_machine_init);
+	will_return(get_conn_state, CONN_STATE_RESOLVE);
+	will_return(conn_machine_step, 0);
+	expect_function_call(conn_machine_step);
+	will_return(get_conn_state, CONN_STATE_BACKOFF);
+	will_return(conn_machine_step, 10);
+	expect_function_call(conn_machine_step);
+	will_return(get_conn_state, CONN_STATE_ONLINE);
+	will_return(nopoll_loop_wait, 1);
+	expect_function_call(nopoll_loop_wait);
+	will_return(get_conn_state, CONN_STATE_FAILED);
 	will_return(get_global_conn, (intptr_t)NULL);
 	expect_function_call(get_global_conn);
 	expect_function_call(close_and_unref_connection);
 	expect_function_call(nopoll_ctx_unref);
 	expect_function_call(nopoll_cleanup_library);
-	createSocketConnection(NULL);
+	createSocketConnection(initKeypress);
 }
 
 /*----------------------------------------------------------------------------*/
@@ -427,7 +513,8 @@ int main(void)
         cmocka_unit_test(test_createSocketConnection1),
         cmocka_unit_test(test_PingMissIntervalTime),
         cmocka_unit_test(err_createSocketConnection),
-        cmocka_unit_test(test_createSocketConnection_cloud_disconn)
+        cmocka_unit_test(test_createSocketConnection_shutdown_in_backoff),
+        cmocka_unit_test(test_createSocketConnection_offline_start)
     };
 
     return cmocka_run_group_tests(tests, NULL, NULL);
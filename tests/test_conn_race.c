@@ -0,0 +1,405 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include "../src/conn_race.h"
+
+/*----------------------------------------------------------------------------*/
+/*                                   Macros                                   */
+/*----------------------------------------------------------------------------*/
+#define BLACKHOLE_MS	3000
+
+/*----------------------------------------------------------------------------*/
+/*                            File Scoped Variables                           */
+/*----------------------------------------------------------------------------*/
+typedef struct {
+	int delay_ms[CONN_RACE_MAX_ATTEMPTS];
+	int rc[CONN_RACE_MAX_ATTEMPTS];
+	int ignore_cancel;
+	int port;	// local stand-in server, 0 for the scripted attempts
+} race_script_t;
+
+static pthread_mutex_t count_mut = PTHREAD_MUTEX_INITIALIZER;
+static int started = 0;
+static int cancelled_seen = 0;
+static int released = 0;
+static int freed = 0;
+
+/*----------------------------------------------------------------------------*/
+/*                                   Mocks                                    */
+/*----------------------------------------------------------------------------*/
+static void count(int *counter)
+{
+	pthread_mutex_lock(&count_mut);
+	(*counter)++;
+	pthread_mutex_unlock(&count_mut);
+}
+
+static int get_count(int *counter)
+{
+	int n;
+
+	pthread_mutex_lock(&count_mut);
+	n = *counter;
+	pthread_mutex_unlock(&count_mut);
+	return n;
+}
+
+static long elapsed_ms(struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) * 1000 + (now.tv_nsec - start->tv_nsec) / 1000000;
+}
+
+/* Sleeps like a blocking connect, gives up early when cancelled */
+static int wait_or_cancel(int ms, const volatile int *cancelled)
+{
+	for(; ms > 0; ms -= 5)
+	{
+		if((NULL != cancelled) && *cancelled)
+		{
+			count(&cancelled_seen);
+			return 1;
+		}
+		usleep(5000);
+	}
+	return 0;
+}
+
+static int scripted_attempt(void *arg, int index, conn_race_result_t *result,
+	const volatile int *cancelled)
+{
+	race_script_t *script = (race_script_t *) arg;
+
+	count(&started);
+	if(wait_or_cancel(script->delay_ms[index],
+		script->ignore_cancel ? NULL : cancelled))
+	{
+		return CONN_RACE_FAIL;
+	}
+	result->status = 100 + index;
+	if(CONN_RACE_SUCCESS == script->rc[index])
+	{
+		result->handle = (void *) (intptr_t) (index + 1);
+	}
+	if(CONN_RACE_FINAL == script->rc[index])
+	{
+		result->message = strdup("Redirect:https://mydns.mycom.net");
+	}
+	return script->rc[index];
+}
+
+/* Attempt 0 is a blackholed ipv6 address, the rest connect to a local
+   stand-in server */
+static int local_attempt(void *arg, int index, conn_race_result_t *result,
+	const volatile int *cancelled)
+{
+	race_script_t *script = (race_script_t *) arg;
+	struct sockaddr_in addr;
+	int fd;
+
+	count(&started);
+	if(0 == index)
+	{
+		wait_or_cancel(BLACKHOLE_MS, cancelled);
+		return CONN_RACE_FAIL;
+	}
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(script->port);
+	if(connect(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0)
+	{
+		close(fd);
+		return CONN_RACE_FAIL;
+	}
+	result->handle = (void *) (intptr_t) fd;
+	return CONN_RACE_SUCCESS;
+}
+
+static void release_handle(void *arg, void *handle)
+{
+	(void) arg; (void) handle;
+	count(&released);
+}
+
+static void free_script(void *arg)
+{
+	free(arg);
+	count(&freed);
+}
+
+static race_script_t *new_script(int d0, int rc0, int d1, int rc1)
+{
+	race_script_t *script = calloc(1, sizeof(race_script_t));
+
+	script->delay_ms[0] = d0;
+	script->rc[0] = rc0;
+	script->delay_ms[1] = d1;
+	script->rc[1] = rc1;
+	pthread_mutex_lock(&count_mut);
+	started = cancelled_seen = released = freed = 0;
+	pthread_mutex_unlock(&count_mut);
+	return script;
+}
+
+/* Attempts outlive conn_race_run, wait for the last one to clean up */
+static void wait_freed(void)
+{
+	int i;
+
+	for(i = 0; (i < 1000) && (0 == get_count(&freed)); i++)
+	{
+		usleep(5000);
+	}
+	assert_int_equal(get_count(&freed), 1);
+}
+
+/*----------------------------------------------------------------------------*/
+/*                                   Tests                                    */
+/*----------------------------------------------------------------------------*/
+void test_race_first_wins()
+{
+	conn_race_result_t result;
+	struct timespec start;
+
+	// attempt 0 answers before the delay, attempt 1 is never started
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	assert_int_equal(conn_race_run(2, 200, scripted_attempt, release_handle,
+		new_script(10, CONN_RACE_SUCCESS, 10, CONN_RACE_SUCCESS),
+		free_script, &result), CONN_RACE_SUCCESS);
+	assert_true(elapsed_ms(&start) < 200);
+	assert_ptr_equal(result.handle, (void *) 1);
+	wait_freed();
+	assert_int_equal(get_count(&started), 1);
+}
+
+void test_race_stalled_first()
+{
+	conn_race_result_t result;
+	struct timespec start;
+
+	// attempt 0 hangs, attempt 1 starts after the delay and wins
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	assert_int_equal(conn_race_run(2, 50, scripted_attempt, release_handle,
+		new_script(2000, CONN_RACE_SUCCESS, 10, CONN_RACE_SUCCESS),
+		free_script, &result), CONN_RACE_SUCCESS);
+	assert_in_range(elapsed_ms(&start), 50, 1000);
+	assert_ptr_equal(result.handle, (void *) 2);
+	wait_freed();
+	assert_int_equal(get_count(&started), 2);
+	assert_int_equal(get_count(&cancelled_seen), 1);
+	assert_int_equal(get_count(&released), 0);
+}
+
+void test_race_failed_first()
+{
+	conn_race_result_t result;
+	struct timespec start;
+
+	// attempt 0 fails quickly, attempt 1 starts without waiting for the delay
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	assert_int_equal(conn_race_run(2, 1000, scripted_attempt, release_handle,
+		new_script(10, CONN_RACE_FAIL, 10, CONN_RACE_SUCCESS),
+		free_script, &result), CONN_RACE_SUCCESS);
+	assert_true(elapsed_ms(&start) < 500);
+	assert_ptr_equal(result.handle, (void *) 2);
+	wait_freed();
+}
+
+void test_race_late_success_released()
+{
+	conn_race_result_t result;
+	race_script_t *script;
+
+	// attempt 1 misses the cancel and connects after attempt 0 has won
+	script = new_script(30, CONN_RACE_SUCCESS, 60, CONN_RACE_SUCCESS);
+	script->ignore_cancel = 1;
+	assert_int_equal(conn_race_run(2, 10, scripted_attempt, release_handle,
+		script, free_script, &result), CONN_RACE_SUCCESS);
+	assert_ptr_equal(result.handle, (void *) 1);
+	wait_freed();
+	assert_int_equal(get_count(&started), 2);
+	assert_int_equal(get_count(&released), 1);
+}
+
+void test_race_final()
+{
+	conn_race_result_t result;
+
+	assert_int_equal(conn_race_run(2, 1000, scripted_attempt, release_handle,
+		new_script(10, CONN_RACE_FINAL, 10, CONN_RACE_SUCCESS),
+		free_script, &result), CONN_RACE_FINAL);
+	assert_null(result.handle);
+	assert_int_equal(result.status, 100);
+	assert_string_equal(result.message, "Redirect:https://mydns.mycom.net");
+	free(result.message);
+	wait_freed();
+	assert_int_equal(get_count(&started), 1);
+}
+
+void test_race_all_fail()
+{
+	conn_race_result_t result;
+
+	assert_int_equal(conn_race_run(2, 10, scripted_attempt, release_handle,
+		new_script(10, CONN_RACE_FAIL, 30, CONN_RACE_FAIL),
+		free_script, &result), CONN_RACE_FAIL);
+	assert_null(result.handle);
+	assert_null(result.message);
+	assert_int_equal(result.status, 101);
+	wait_freed();
+}
+
+void err_race_run()
+{
+	conn_race_result_t result;
+
+	assert_int_equal(conn_race_run(0, 10, scripted_attempt, release_handle,
+		new_script(0, 0, 0, 0), free_script, &result), CONN_RACE_FAIL);
+	assert_int_equal(get_count(&freed), 1);
+	assert_int_equal(conn_race_run(1, 10, NULL, release_handle,
+		new_script(0, 0, 0, 0), free_script, &result), CONN_RACE_FAIL);
+	assert_int_equal(get_count(&freed), 1);
+}
+
+void test_sort_addrs()
+{
+	struct sockaddr_storage list[6];
+	struct sockaddr_in6 *v6;
+	struct sockaddr_in *v4;
+	conn_race_addr_t addrs[CONN_RACE_MAX_ATTEMPTS];
+	static const int order[6] = {1, 2, 1, -2, 3, -3};	// 2000::n or 10.0.0.n
+	int i;
+
+	// 2000::1, 2000::2, 2000::1 (again), 10.0.0.2, 2000::3, 10.0.0.3
+	memset(list, 0, sizeof(list));
+	for(i = 0; i < 6; i++)
+	{
+		if(order[i] > 0)
+		{
+			v6 = (struct sockaddr_in6 *) &list[i];
+			v6->sin6_family = AF_INET6;
+			v6->sin6_addr.s6_addr[0] = 0x20;
+			v6->sin6_addr.s6_addr[15] = order[i];
+		}
+		else
+		{
+			v4 = (struct sockaddr_in *) &list[i];
+			v4->sin_family = AF_INET;
+			v4->sin_addr.s_addr = htonl(0x0a000000 - order[i]);
+		}
+	}
+
+	assert_int_equal(conn_race_sort_addrs(list, 6, addrs, CONN_RACE_MAX_ATTEMPTS), 4);
+	assert_string_equal(addrs[0].ip, "2000::1");
+	assert_true(addrs[0].is_ipv6);
+	assert_string_equal(addrs[1].ip, "10.0.0.2");
+	assert_false(addrs[1].is_ipv6);
+	assert_string_equal(addrs[2].ip, "2000::2");
+	assert_string_equal(addrs[3].ip, "10.0.0.3");
+
+	// only ipv4 left at the end
+	assert_int_equal(conn_race_sort_addrs(&list[3], 3, addrs, CONN_RACE_MAX_ATTEMPTS), 3);
+	assert_string_equal(addrs[0].ip, "10.0.0.2");
+	assert_string_equal(addrs[1].ip, "2000::3");
+	assert_string_equal(addrs[2].ip, "10.0.0.3");
+
+	assert_int_equal(conn_race_sort_addrs(list, 0, addrs, CONN_RACE_MAX_ATTEMPTS), 0);
+}
+
+void test_resolve()
+{
+	conn_race_addr_t addrs[CONN_RACE_MAX_ATTEMPTS];
+
+	assert_int_equal(conn_race_resolve("127.0.0.1", addrs, CONN_RACE_MAX_ATTEMPTS), 1);
+	assert_string_equal(addrs[0].ip, "127.0.0.1");
+	assert_false(addrs[0].is_ipv6);
+	assert_int_equal(conn_race_resolve("::1", addrs, CONN_RACE_MAX_ATTEMPTS), 1);
+	assert_true(addrs[0].is_ipv6);
+}
+
+/* Time to online with the first address blackholed, racing vs. trying the
+   addresses in turn */
+void test_race_time_to_online()
+{
+	conn_race_result_t result;
+	struct sockaddr_in addr;
+	socklen_t len = sizeof(addr);
+	struct timespec start;
+	race_script_t *script;
+	long race_ms;
+	int server;
+
+	server = socket(AF_INET, SOCK_STREAM, 0);
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	assert_int_equal(bind(server, (struct sockaddr *) &addr, sizeof(addr)), 0);
+	assert_int_equal(listen(server, 4), 0);
+	getsockname(server, (struct sockaddr *) &addr, &len);
+
+	script = new_script(0, 0, 0, 0);
+	script->port = ntohs(addr.sin_port);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	assert_int_equal(conn_race_run(2, 250, local_attempt, release_handle,
+		script, free_script, &result), CONN_RACE_SUCCESS);
+	race_ms = elapsed_ms(&start);
+	assert_true(race_ms < BLACKHOLE_MS);
+	close((int) (intptr_t) result.handle);
+	wait_freed();
+	close(server);
+
+	print_message("time to online, ipv6 blackholed: raced %ld ms, in turn %d+ ms\n",
+		race_ms, BLACKHOLE_MS);
+}
+
+/*----------------------------------------------------------------------------*/
+/*                             External Functions                             */
+/*----------------------------------------------------------------------------*/
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_race_first_wins),
+        cmocka_unit_test(test_race_stalled_first),
+        cmocka_unit_test(test_race_failed_first),
+        cmocka_unit_test(test_race_late_success_released),
+        cmocka_unit_test(test_race_final),
+        cmocka_unit_test(test_race_all_fail),
+        cmocka_unit_test(err_race_run),
+        cmocka_unit_test(test_sort_addrs),
+        cmocka_unit_test(test_resolve),
+        cmocka_unit_test(test_race_time_to_online),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -28,6 +28,15 @@
 #include "../src/ParodusInternal.h"
 #include "../src/connection.h"
 #include "../src/config.h"
+#include "../src/server_pool.h"
+#include "../src/standby.h"
+#include "../src/ping_monitor.h"
+#include "../src/link_monitor.h"
+#include "../src/iface_pool.h"
+#include "../src/conn_hints.h"
+#include <linux/rtnetlink.h>
+#include <net/if.h>
+#include "../src/close_retry.h"
 
 extern void set_server_null (server_t *server);
 extern void set_server_list_null (server_list_t *server_list);
@@ -50,8 +59,6 @@ extern int find_servers (server_list_t *server_list);
 extern int nopoll_connect (create_connection_ctx_t *ctx, int is_ipv6);
 extern int wait_connection_ready (create_connection_ctx_t *ctx);
 extern int connect_and_wait (create_connection_ctx_t *ctx);
-extern int keep_trying_to_connect (create_connection_ctx_t *ctx, 
-	int max_retry_sleep);
 
 
 /*----------------------------------------------------------------------------*/
@@ -67,26 +74,48 @@ char *mock_server_addr;
 unsigned int mock_port;
 int mock_wait_status;
 char *mock_redirect;
+char mock_host_ip[64];
 noPollConn connection1;
 noPollConn connection2;
 noPollConn connection3;
 
+#define CONNECT_POLL_MS	100	// as in connection.c
+
+// steps the machine, waiting out a connect attempt on its thread
+static int step_machine (void)
+{
+  int rtn = conn_machine_step ();
+  int state = get_conn_state ();
+
+  while ((CONNECT_POLL_MS == rtn) &&
+      ((CONN_STATE_CONNECT == state) || (CONN_STATE_UPGRADE == state))) {
+    usleep (1000);
+    rtn = conn_machine_step ();
+    state = get_conn_state ();
+  }
+  return rtn;
+}
+
 /*----------------------------------------------------------------------------*/
 /*                                   Mocks                                    */
 /*----------------------------------------------------------------------------*/
+int convey_header_builds = 0;
+
 char* getWebpaConveyHeader()
 {
-    return (char*) "WebPA-1.6 (TG1682)";
+    convey_header_builds++;
+    return strdup ("WebPA-1.6 (TG1682)");
 }
 
 noPollConn * nopoll_conn_new_opts (noPollCtx  * ctx, noPollConnOpts  * opts, const char  * host_ip, const char  * host_port, const char  * host_name,const char  * get_url,const char  * protocols, const char * origin)
 {
     UNUSED(host_port); UNUSED(host_name); UNUSED(get_url); UNUSED(protocols); 
-    UNUSED(origin); UNUSED(opts); UNUSED(ctx); UNUSED(host_ip);
+    UNUSED(origin); UNUSED(opts); UNUSED(ctx);
     
     function_called();
     //check_expected((intptr_t)ctx);
     //check_expected((intptr_t)host_ip);
+    parStrncpy (mock_host_ip, host_ip, sizeof(mock_host_ip));
     return (noPollConn *) (intptr_t)mock();
 }
 
@@ -129,6 +158,11 @@ nopoll_bool  nopoll_conn_wait_for_status_until_connection_ready (noPollConn * co
       *message = malloc (strlen(mock_redirect) + 10);
       sprintf (*message, "Redirect:%s", mock_redirect);
     }
+    if ((NULL != mock_redirect) &&
+        ((*status == 429) || (*status == 503)) )
+    {
+      *message = strdup (mock_redirect);
+    }
     function_called();
     return (nopoll_bool) mock();
 }
@@ -140,6 +174,7 @@ nopoll_bool nopoll_conn_is_ok (noPollConn * conn)
     return (nopoll_bool) mock();
 }
 
+
 void nopoll_conn_close (noPollConn *conn)
 {
     UNUSED(conn);
@@ -152,6 +187,36 @@ int nopoll_conn_ref_count (noPollConn *conn)
     return (nopoll_bool) mock();
 }
 
+int nopoll_conn_pending_write_bytes (noPollConn *conn)
+{
+    UNUSED(conn);
+    function_called ();
+    return (int) mock();
+}
+
+int nopoll_conn_complete_pending_write (noPollConn *conn)
+{
+    UNUSED(conn);
+    function_called ();
+    return 0;
+}
+
+unsigned int drain_upstream (const struct timespec *deadline, unsigned int *left)
+{
+    UNUSED(deadline);
+    function_called ();
+    *left = (unsigned int) mock();
+    return (unsigned int) mock();
+}
+
+unsigned int drain_downstream (const struct timespec *deadline, unsigned int *left)
+{
+    UNUSED(deadline);
+    function_called ();
+    *left = (unsigned int) mock();
+    return (unsigned int) mock();
+}
+
 int checkHostIp(char * serverIP)
 {
     UNUSED(serverIP);
@@ -170,6 +235,34 @@ void setMessageHandlers()
 {
 }
 
+void setShardMessageHandlers(noPollConn *conn, noPollMsg **fragment)
+{
+    UNUSED(conn); UNUSED(fragment);
+}
+
+int sendResponse(noPollConn * conn, void * buffer, size_t length)
+{
+    UNUSED(conn); UNUSED(buffer);
+    return (int) length;
+}
+
+void sendUpstreamMsgOnPrimary(void *msg, size_t len)
+{
+    UNUSED(msg); UNUSED(len);
+}
+
+void crud_notify_change(const char *name, const char *value)
+{
+    UNUSED(name); UNUSED(value);
+}
+
+nopoll_bool sendPing (noPollConn *conn)
+{
+    UNUSED(conn);
+    function_called ();
+    return (nopoll_bool) mock();
+}
+
 int allow_insecure_conn (char **server_addr, unsigned int *port)
 {
   int rtn;
@@ -307,6 +400,11 @@ void test_backoff_delay_timer()
   assert_int_equal (15, update_backoff_delay (&btimer));
   assert_int_equal (30, update_backoff_delay (&btimer));
   assert_int_equal (30, update_backoff_delay (&btimer));
+
+  // a server hint is used once
+  btimer.retry_after = 120;
+  assert_int_equal (120, update_backoff_delay (&btimer));
+  assert_int_equal (30, update_backoff_delay (&btimer));
 }
 
 
@@ -376,9 +474,11 @@ void test_set_current_server()
 
 void test_set_extra_headers ()
 {
-  int rtn;
+  int rtn, builds;
   create_connection_ctx_t ctx;
+  header_info_t hinfo;
   ParodusCfg cfg;
+  char *headers;
   const char *expected_extra_headers =
       "\r\nAuthorization: Bearer SER_MAC Fer23u948590 123567892366"
       "\r\nX-WebPA-Device-Name: mac:123567892366"
@@ -401,20 +501,47 @@ void test_set_extra_headers ()
   parStrncpy(cfg.webpa_protocol , "WebPA-1.6", sizeof(cfg.webpa_protocol));
 	
   set_parodus_cfg(&cfg);
-  rtn = init_header_info (&ctx.header_info);
+  rtn = init_header_info (&hinfo);
   assert_int_equal (rtn, 0);
-  assert_string_equal (ctx.header_info.device_id, "mac:123567892366");
-  assert_string_equal (ctx.header_info.user_agent,
+  assert_string_equal (hinfo.device_id, "mac:123567892366");
+  assert_string_equal (hinfo.user_agent,
     "WebPA-1.6 (2.364s2; TG1682/ARRISGroup,Inc.;)");
-  assert_string_equal (ctx.header_info.conveyHeader, "WebPA-1.6 (TG1682)");
+  assert_string_equal (hinfo.conveyHeader, "WebPA-1.6 (TG1682)");
+  free_header_info (&hinfo);
   set_extra_headers (&ctx, true);
   
   assert_string_equal (get_parodus_cfg()->webpa_auth_token, 
     "SER_MAC Fer23u948590 123567892366");
   assert_string_equal (ctx.extra_headers, expected_extra_headers);
-  free (ctx.extra_headers);
-  free_header_info (&ctx.header_info);
-	
+
+  // unchanged inputs reuse the cached headers
+  headers = ctx.extra_headers;
+  builds = convey_header_builds;
+  free_extra_headers (&ctx);
+  assert_null (ctx.extra_headers);
+  set_extra_headers (&ctx, false);
+  assert_ptr_equal (ctx.extra_headers, headers);
+  assert_int_equal (convey_header_builds, builds);
+
+  // a new reconnect reason or boot_retry_wait rebuilds them
+  set_global_reconnect_reason ("Ping_Miss");
+  set_extra_headers (&ctx, false);
+  assert_int_equal (convey_header_builds, builds + 1);
+  assert_string_equal (ctx.extra_headers, expected_extra_headers);
+  get_parodus_cfg()->boot_retry_wait = 10;
+  set_extra_headers (&ctx, false);
+  assert_int_equal (convey_header_builds, builds + 2);
+  set_extra_headers (&ctx, false);
+  assert_int_equal (convey_header_builds, builds + 2);
+
+  // and so does a new token
+  parStrncpy (get_parodus_cfg()->webpa_auth_token, "Auth---",
+    sizeof (get_parodus_cfg()->webpa_auth_token));
+  set_extra_headers (&ctx, false);
+  assert_int_equal (convey_header_builds, builds + 3);
+  assert_non_null (strstr (ctx.extra_headers, "Bearer Auth---\r\n"));
+  set_global_reconnect_reason ("webpa_process_starts");
+  free_header_cache ();
 }
 
 void test_find_servers ()
@@ -558,6 +685,7 @@ void test_nopoll_connect ()
 #define WAIT_SUCCESS	0
 #define WAIT_ACTION_RETRY	1	// if wait_status is 307, 302, 303 or 403
 #define WAIT_FAIL 	2
+#define WAIT_RETRY_LATER	3	// if wait_status is 429 or 503
 
 void test_wait_connection_ready ()
 {
@@ -587,7 +715,15 @@ void test_wait_connection_ready ()
   mock_wait_status = 503;
   will_return (nopoll_conn_wait_for_status_until_connection_ready, nopoll_false);
   expect_function_call (nopoll_conn_wait_for_status_until_connection_ready);
-  assert_int_equal (wait_connection_ready (&ctx), WAIT_FAIL);
+  assert_int_equal (wait_connection_ready (&ctx), WAIT_RETRY_LATER);
+  assert_int_equal ((int) ctx.retry_after, 0);
+
+  mock_wait_status = 429;
+  mock_redirect = "Retry-After: 120";
+  will_return (nopoll_conn_wait_for_status_until_connection_ready, nopoll_false);
+  expect_function_call (nopoll_conn_wait_for_status_until_connection_ready);
+  assert_int_equal (wait_connection_ready (&ctx), WAIT_RETRY_LATER);
+  assert_int_equal ((int) ctx.retry_after, 120);
 
   mock_wait_status = 307;
   mock_redirect = "mydns.mycom.net";
@@ -628,14 +764,12 @@ void test_wait_connection_ready ()
     parStrncpy(Cfg.webpa_protocol , "WebPA-1.6", sizeof(Cfg.webpa_protocol));
     set_parodus_cfg(&Cfg);
   
-    init_header_info (&ctx.header_info);
     will_return (nopoll_conn_wait_for_status_until_connection_ready, nopoll_false);
     expect_function_call (nopoll_conn_wait_for_status_until_connection_ready);
     assert_int_equal (wait_connection_ready (&ctx), WAIT_ACTION_RETRY);
     
     assert_string_equal (ctx.extra_headers, expected_extra_headers);
     free_extra_headers (&ctx);
-    free_header_info (&ctx.header_info);
 }
 
 // Return codes for connect_and_wait
@@ -785,36 +919,24 @@ void test_connect_and_wait ()
   assert_int_equal (connect_and_wait (&ctx), CONN_WAIT_ACTION_RETRY);
 }
 
-void test_keep_trying ()
+void test_conn_machine ()
 {
-  int rtn;	
-  create_connection_ctx_t ctx;
+  int rtn;
   noPollCtx test_nopoll_ctx;
-  server_t test_server;
   ParodusCfg Cfg;
-  char *test_extra_headers =
-      "\r\nAuthorization: Bearer SER_MAC Fer23u948590 123567892366"
-      "\r\nX-WebPA-Device-Name: mac:123567892366"
-      "\r\nX-WebPA-Device-Protocols: wrp-0.11,getset-0.1"
-      "\r\nUser-Agent: WebPA-1.6 (2.364s2; TG1682/ARRISGroup,Inc.;)"
-      "\r\nX-WebPA-Convey: WebPA-1.6 (TG1682)";
 
   memset(&Cfg, 0, sizeof(ParodusCfg));
   parStrncpy (Cfg.webpa_url, "http://mydns.mycom.net:8080", sizeof(Cfg.webpa_url));
-
-  mock_wait_status = 0;
-
-  memset(&ctx,0,sizeof(ctx));
-  ctx.nopoll_ctx = &test_nopoll_ctx;
-  ctx.current_server = &test_server;
-  ctx.extra_headers = test_extra_headers;
-
-  test_server.allow_insecure = 1;
-  test_server.server_addr = "mydns.mycom.net";
-  test_server.port = 8080;
-
+  parStrncpy (Cfg.hw_mac, "123567892366", sizeof(Cfg.hw_mac));
+  Cfg.webpa_backoff_max = 30;
   Cfg.flags = 0;
   set_parodus_cfg(&Cfg);
+  mock_wait_status = 0;
+
+  conn_machine_init (&test_nopoll_ctx);
+  assert_int_equal (get_conn_state (), CONN_STATE_RESOLVE);
+  assert_int_equal (step_machine (), 0);
+  assert_int_equal (get_conn_state (), CONN_STATE_CONNECT);
 
   will_return (nopoll_conn_new_opts, &connection1);
   expect_function_call (nopoll_conn_new_opts);
@@ -822,13 +944,20 @@ void test_keep_trying ()
   expect_function_call (nopoll_conn_is_ok);
   will_return (nopoll_conn_wait_for_status_until_connection_ready, nopoll_true);
   expect_function_call (nopoll_conn_wait_for_status_until_connection_ready);
-  rtn = keep_trying_to_connect (&ctx, 30);
-  assert_int_equal (rtn, true);
-
-  test_server.allow_insecure = 0;
+  // the attempt runs on its own thread, the step only starts it
+  assert_int_equal (conn_machine_step (), CONNECT_POLL_MS);
+  assert_int_equal (step_machine (), CONN_STEP_NONE);
+  assert_int_equal (get_conn_state (), CONN_STATE_ONLINE);
+  assert_string_equal (get_conn_state_name (CONN_STATE_ONLINE), "online");
+  // nothing to do while online
+  assert_int_equal (step_machine (), CONN_STEP_NONE);
+
+  // a redirect is followed at once
+  parStrncpy (Cfg.webpa_url, "https://mydns.mycom.net:8080", sizeof(Cfg.webpa_url));
   Cfg.flags = FLAGS_IPV4_ONLY;
   set_parodus_cfg(&Cfg);
-
+  conn_machine_init (&test_nopoll_ctx);
+  assert_int_equal (step_machine (), 0);
   will_return (nopoll_conn_tls_new, &connection1);
   expect_function_call (nopoll_conn_tls_new);
   will_return (nopoll_conn_is_ok, nopoll_true);
@@ -839,57 +968,553 @@ void test_keep_trying ()
   expect_function_call (nopoll_conn_wait_for_status_until_connection_ready);
   will_return (nopoll_conn_ref_count, 0);
   expect_function_call (nopoll_conn_ref_count);
-  will_return (nopoll_conn_tls_new, &connection1);
+  assert_int_equal (step_machine (), 0);
+  assert_int_equal (get_conn_state (), CONN_STATE_CONNECT);
+
+  // a failed connect backs off instead of sleeping
+  mock_wait_status = 0;
+  will_return (nopoll_conn_tls_new, NULL);
   expect_function_call (nopoll_conn_tls_new);
-  will_return (nopoll_conn_is_ok, nopoll_true);
-  expect_function_call (nopoll_conn_is_ok);
-  will_return (nopoll_conn_wait_for_status_until_connection_ready, nopoll_true);
-  expect_function_call (nopoll_conn_wait_for_status_until_connection_ready);
-  rtn = keep_trying_to_connect (&ctx, 30);
-  assert_int_equal (rtn, true);
+  will_return (checkHostIp, 0);
+  expect_function_call (checkHostIp);
+  rtn = step_machine ();
+  assert_int_equal (rtn, 3000);
+  assert_int_equal (get_conn_state (), CONN_STATE_BACKOFF);
+  rtn = step_machine ();
+  assert_in_range (rtn, 1, 3000);
+  assert_int_equal (get_conn_state (), CONN_STATE_BACKOFF);
+
+  // then dns is queried again, and the backoff keeps growing
+  sleep (3);
+  assert_int_equal (step_machine (), 0);
+  assert_int_equal (get_conn_state (), CONN_STATE_RESOLVE);
+  assert_int_equal (step_machine (), 0);
+  will_return (nopoll_conn_tls_new, NULL);
+  expect_function_call (nopoll_conn_tls_new);
+  will_return (checkHostIp, 0);
+  expect_function_call (checkHostIp);
+  assert_int_equal (step_machine (), 7000);
 
+  // a busy server's Retry-After sets the wait, then dns is queried again
+  conn_machine_init (&test_nopoll_ctx);
+  assert_int_equal (step_machine (), 0);
   will_return (nopoll_conn_tls_new, &connection1);
   expect_function_call (nopoll_conn_tls_new);
   will_return (nopoll_conn_is_ok, nopoll_true);
   expect_function_call (nopoll_conn_is_ok);
-  mock_wait_status = 302503;
-  mock_redirect = "https://mydns.mycom.net";
+  mock_wait_status = 429;
+  mock_redirect = "Retry-After: 1";
   will_return (nopoll_conn_wait_for_status_until_connection_ready, nopoll_false);
   expect_function_call (nopoll_conn_wait_for_status_until_connection_ready);
   will_return (nopoll_conn_ref_count, 0);
   expect_function_call (nopoll_conn_ref_count);
-  will_return (nopoll_conn_tls_new, &connection1);
-  expect_function_call (nopoll_conn_tls_new);
+  rtn = step_machine ();
+  assert_int_equal (rtn, 1000);
+  sleep (1);
+  assert_int_equal (step_machine (), 0);
+  assert_int_equal (get_conn_state (), CONN_STATE_RESOLVE);
+  mock_wait_status = 0;
+  mock_redirect = NULL;
+}
+
+void test_conn_machine_pool ()
+{
+  noPollCtx test_nopoll_ctx;
+  ParodusCfg Cfg;
+  int rtn;
+
+  memset(&Cfg, 0, sizeof(ParodusCfg));
+  parStrncpy (Cfg.webpa_url, "http://mydns.mycom.net:8080", sizeof(Cfg.webpa_url));
+  Cfg.server_pool = "http://mydns2.mycom.net:8080";
+  Cfg.webpa_backoff_max = 30;
+  set_parodus_cfg(&Cfg);
+  mock_wait_status = 0;
+
+  conn_machine_init (&test_nopoll_ctx);
+  assert_int_equal (server_pool_count (), 2);
+  assert_int_equal (step_machine (), 0);
+
+  // a failed endpoint fails over at once, without a backoff
+  will_return (nopoll_conn_new_opts, NULL);
+  expect_function_call (nopoll_conn_new_opts);
+  will_return (checkHostIp, 0);
+  expect_function_call (checkHostIp);
+  assert_int_equal (step_machine (), 0);
+  assert_int_equal (get_conn_state (), CONN_STATE_RESOLVE);
+  assert_int_equal (server_pool_select (0, 1), 1);
+  assert_int_equal (step_machine (), 0);
+  will_return (nopoll_conn_new_opts, NULL);
+  expect_function_call (nopoll_conn_new_opts);
+  will_return (checkHostIp, 0);
+  expect_function_call (checkHostIp);
+  // with every endpoint down, back off as before
+  rtn = step_machine ();
+  assert_int_equal (rtn, 3000);
+  assert_int_equal (get_conn_state (), CONN_STATE_BACKOFF);
+  assert_int_equal (server_pool_select (0, 1), SERVER_POOL_NONE);
+
+  // a reconnect keeps the scores
+  conn_machine_init (&test_nopoll_ctx);
+  assert_int_equal (server_pool_count (), 2);
+  assert_int_equal (server_pool_select (0, 1), SERVER_POOL_NONE);
+  assert_int_equal (step_machine (), 0);
+  will_return (nopoll_conn_new_opts, &connection1);
+  expect_function_call (nopoll_conn_new_opts);
   will_return (nopoll_conn_is_ok, nopoll_true);
   expect_function_call (nopoll_conn_is_ok);
-  will_return (nopoll_conn_wait_for_status_until_connection_ready, nopoll_false);
+  will_return (nopoll_conn_wait_for_status_until_connection_ready, nopoll_true);
   expect_function_call (nopoll_conn_wait_for_status_until_connection_ready);
-  will_return (nopoll_conn_ref_count, 0);
-  expect_function_call (nopoll_conn_ref_count);
-  rtn = keep_trying_to_connect (&ctx, 30);
-  assert_int_equal (rtn, false);
+  assert_int_equal (step_machine (), CONN_STEP_NONE);
+  assert_int_equal (get_conn_state (), CONN_STATE_ONLINE);
+  assert_int_equal (server_pool_select (0, 1), 0);
+
+  Cfg.server_pool = NULL;
+  set_parodus_cfg(&Cfg);
+  conn_machine_init (&test_nopoll_ctx);
+  assert_int_equal (server_pool_count (), 0);
+}
 
+void test_conn_machine_ifaces ()
+{
+  noPollCtx test_nopoll_ctx;
+  ParodusCfg Cfg;
+  iface_stats_t stats;
+
+  memset(&Cfg, 0, sizeof(ParodusCfg));
+  parStrncpy (Cfg.webpa_url, "http://mydns.mycom.net:8080", sizeof(Cfg.webpa_url));
+  Cfg.webpa_interfaces = "erouter0,wwan0";
+  Cfg.webpa_backoff_max = 30;
+  set_parodus_cfg(&Cfg);
   mock_wait_status = 0;
-  will_return (nopoll_conn_tls_new, NULL);
-  expect_function_call (nopoll_conn_tls_new);
+
+  conn_machine_init (&test_nopoll_ctx);
+  assert_int_equal (iface_pool_count (), 2);
+  assert_int_equal (step_machine (), 0);
+  assert_string_equal (get_parodus_cfg()->webpa_interface_used, "erouter0");
+
+  // the primary failing moves to the next interface at once
+  will_return (nopoll_conn_new_opts, NULL);
+  expect_function_call (nopoll_conn_new_opts);
   will_return (checkHostIp, 0);
   expect_function_call (checkHostIp);
-  rtn = keep_trying_to_connect (&ctx, 30);
-  assert_int_equal (rtn, false);
+  assert_int_equal (step_machine (), 0);
+  assert_int_equal (get_conn_state (), CONN_STATE_RESOLVE);
+  assert_string_equal (get_parodus_cfg()->webpa_interface_used, "wwan0");
+  assert_int_equal (step_machine (), 0);
+  will_return (nopoll_conn_new_opts, &connection1);
+  expect_function_call (nopoll_conn_new_opts);
+  will_return (nopoll_conn_is_ok, nopoll_true);
+  expect_function_call (nopoll_conn_is_ok);
+  will_return (nopoll_conn_wait_for_status_until_connection_ready, nopoll_true);
+  expect_function_call (nopoll_conn_wait_for_status_until_connection_ready);
+  assert_int_equal (step_machine (), CONN_STEP_NONE);
+  assert_int_equal (get_conn_state (), CONN_STATE_ONLINE);
+  iface_pool_get_stats (0, &stats);
+  assert_int_equal (stats.failures, 1);
+  iface_pool_get_stats (1, &stats);
+  assert_int_equal (stats.connects, 1);
+
+  // the primary is not probed right after failing, so no move back yet
+  conn_machine_tend ();
+  assert_false (iface_pool_probing ());
+  assert_false (get_close_retry ());
+
+  // a reconnect stays off the primary while it cools down
+  conn_machine_init (&test_nopoll_ctx);
+  assert_int_equal (step_machine (), 0);
+  assert_string_equal (get_parodus_cfg()->webpa_interface_used, "wwan0");
+  // with every interface down, back off as before
+  will_return (nopoll_conn_new_opts, NULL);
+  expect_function_call (nopoll_conn_new_opts);
+  will_return (checkHostIp, 0);
+  expect_function_call (checkHostIp);
+  assert_int_equal (step_machine (), 3000);
+  assert_int_equal (get_conn_state (), CONN_STATE_BACKOFF);
 
-  mock_wait_status = 302;
-  mock_redirect = "mydns.mycom.net";
+  Cfg.webpa_interfaces = NULL;
+  set_parodus_cfg(&Cfg);
+  conn_machine_init (&test_nopoll_ctx);
+  assert_int_equal (iface_pool_count (), 0);
+}
 
-  will_return (nopoll_conn_tls_new, &connection1);
-  expect_function_call (nopoll_conn_tls_new);
+#define TEST_HINTS_FILE "test_connection_hints.txt"
+
+static void expect_connect_ok (void)
+{
+  will_return (nopoll_conn_new_opts, &connection1);
+  expect_function_call (nopoll_conn_new_opts);
   will_return (nopoll_conn_is_ok, nopoll_true);
   expect_function_call (nopoll_conn_is_ok);
-  will_return (nopoll_conn_wait_for_status_until_connection_ready, nopoll_false);
+  will_return (nopoll_conn_wait_for_status_until_connection_ready, nopoll_true);
   expect_function_call (nopoll_conn_wait_for_status_until_connection_ready);
+}
+
+void test_conn_machine_hints ()
+{
+  noPollCtx test_nopoll_ctx;
+  ParodusCfg Cfg;
+  conn_hint_t hint;
+  time_t expires;
+
+  unlink (TEST_HINTS_FILE);
+  memset(&Cfg, 0, sizeof(ParodusCfg));
+  parStrncpy (Cfg.webpa_url, "http://mydns.mycom.net:8080", sizeof(Cfg.webpa_url));
+  Cfg.webpa_backoff_max = 30;
+  Cfg.conn_hints_file = TEST_HINTS_FILE;
+  Cfg.conn_hints_ttl = 3600;
+  set_parodus_cfg(&Cfg);
+  mock_wait_status = 0;
+
+  // with no hint yet, connect as before and keep where it went
+  conn_machine_init (&test_nopoll_ctx);
+  assert_int_equal (step_machine (), 0);
+  expect_connect_ok ();
+  assert_int_equal (step_machine (), CONN_STEP_NONE);
+  assert_string_equal (mock_host_ip, "mydns.mycom.net");
+  assert_int_equal (conn_hints_load (TEST_HINTS_FILE, Cfg.webpa_url, &hint), 0);
+  assert_string_equal (hint.host, "mydns.mycom.net");
+  assert_int_equal (hint.port, 8080);
+  assert_int_equal (hint.allow_insecure, 1);
+  assert_true (hint.expires > time (NULL) + 3500);
+
+  // a hint goes straight to its server and address, and keeps its expiry
+  strcpy (hint.host, "talaria-7.mycom.net");
+  strcpy (hint.addr, "10.1.2.3");
+  expires = hint.expires = time (NULL) + 60;
+  assert_int_equal (conn_hints_save (TEST_HINTS_FILE, &hint), 0);
+  conn_machine_init (&test_nopoll_ctx);
+  assert_int_equal (step_machine (), 0);
+  assert_int_equal (get_conn_state (), CONN_STATE_CONNECT);
+  expect_connect_ok ();
+  assert_int_equal (step_machine (), CONN_STEP_NONE);
+  assert_string_equal (mock_host_ip, "10.1.2.3");
+  assert_int_equal (conn_hints_load (TEST_HINTS_FILE, Cfg.webpa_url, &hint), 0);
+  assert_string_equal (hint.host, "talaria-7.mycom.net");
+  assert_int_equal (hint.expires, expires);
+
+  // a hint that fails is dropped, and the server found again at once
+  conn_machine_init (&test_nopoll_ctx);
+  assert_int_equal (step_machine (), 0);
+  will_return (nopoll_conn_new_opts, NULL);
+  expect_function_call (nopoll_conn_new_opts);
+  will_return (checkHostIp, 0);
+  expect_function_call (checkHostIp);
+  assert_int_equal (step_machine (), 0);
+  assert_int_equal (get_conn_state (), CONN_STATE_RESOLVE);
+  assert_int_equal (conn_hints_load (TEST_HINTS_FILE, Cfg.webpa_url, &hint), -1);
+  assert_int_equal (step_machine (), 0);
+  expect_connect_ok ();
+  assert_int_equal (step_machine (), CONN_STEP_NONE);
+  assert_string_equal (mock_host_ip, "mydns.mycom.net");
+
+  // a reconnect does not go back to the hint
+  assert_int_equal (conn_hints_load (TEST_HINTS_FILE, Cfg.webpa_url, &hint), 0);
+  strcpy (hint.addr, "10.1.2.3");
+  assert_int_equal (conn_hints_save (TEST_HINTS_FILE, &hint), 0);
+  set_global_conn (NULL);
+  conn_machine_drain ();
+  assert_int_equal (step_machine (), 0);
+  assert_int_equal (get_conn_state (), CONN_STATE_RESOLVE);
+  assert_int_equal (step_machine (), 0);
+  expect_connect_ok ();
+  assert_int_equal (step_machine (), CONN_STEP_NONE);
+  assert_string_equal (mock_host_ip, "mydns.mycom.net");
+
+  unlink (TEST_HINTS_FILE);
+}
+
+void test_conn_machine_drain ()
+{
+  noPollCtx test_nopoll_ctx;
+  ParodusCfg Cfg;
+
+  memset(&Cfg, 0, sizeof(ParodusCfg));
+  parStrncpy (Cfg.webpa_url, "http://mydns.mycom.net:8080", sizeof(Cfg.webpa_url));
+  set_parodus_cfg(&Cfg);
+  mock_wait_status = 0;
+
+  // only an online connection drains
+  conn_machine_init (&test_nopoll_ctx);
+  conn_machine_drain ();
+  assert_int_equal (get_conn_state (), CONN_STATE_RESOLVE);
+
+  assert_int_equal (step_machine (), 0);
+  will_return (nopoll_conn_new_opts, &connection1);
+  expect_function_call (nopoll_conn_new_opts);
+  will_return (nopoll_conn_is_ok, nopoll_true);
+  expect_function_call (nopoll_conn_is_ok);
+  will_return (nopoll_conn_wait_for_status_until_connection_ready, nopoll_true);
+  expect_function_call (nopoll_conn_wait_for_status_until_connection_ready);
+  assert_int_equal (step_machine (), CONN_STEP_NONE);
+  assert_int_equal (get_conn_state (), CONN_STATE_ONLINE);
+
+  // only the first attempt is spread, a reconnect goes at once
+  get_parodus_cfg()->reconnect_spread = 30;
+  set_global_conn (NULL);
+  conn_machine_drain ();
+  assert_int_equal (get_conn_state (), CONN_STATE_DRAINING);
+  assert_int_equal (step_machine (), 0);
+  assert_int_equal (get_conn_state (), CONN_STATE_RESOLVE);
+  assert_string_equal (get_parodus_cfg()->cloud_status, CLOUD_STATUS_OFFLINE);
+  get_parodus_cfg()->reconnect_spread = 0;
+
+  // cloud-disconnect holds off reconnecting, without blocking
+  assert_int_equal (step_machine (), 0);
+  will_return (nopoll_conn_new_opts, &connection1);
+  expect_function_call (nopoll_conn_new_opts);
+  will_return (nopoll_conn_is_ok, nopoll_true);
+  expect_function_call (nopoll_conn_is_ok);
+  will_return (nopoll_conn_wait_for_status_until_connection_ready, nopoll_true);
+  expect_function_call (nopoll_conn_wait_for_status_until_connection_ready);
+  assert_int_equal (step_machine (), CONN_STEP_NONE);
+  set_global_conn (NULL);
+  get_parodus_cfg()->cloud_disconnect = strdup ("XPC");
+  conn_machine_drain ();
+  assert_int_equal (step_machine (), 5 * 60 * 1000);
+  assert_int_equal (get_conn_state (), CONN_STATE_BACKOFF);
+  assert_in_range (step_machine (), 1, 5 * 60 * 1000);
+  assert_string_equal (get_parodus_cfg()->cloud_disconnect, "XPC");
+  free (get_parodus_cfg()->cloud_disconnect);
+  get_parodus_cfg()->cloud_disconnect = NULL;
+}
+
+void test_conn_machine_drain_queues ()
+{
+  noPollCtx test_nopoll_ctx;
+  ParodusCfg Cfg;
+
+  memset(&Cfg, 0, sizeof(ParodusCfg));
+  parStrncpy (Cfg.webpa_url, "http://mydns.mycom.net:8080", sizeof(Cfg.webpa_url));
+  Cfg.drain_timeout = 500;
+  set_parodus_cfg(&Cfg);
+  mock_wait_status = 0;
+
+  conn_machine_init (&test_nopoll_ctx);
+  assert_int_equal (step_machine (), 0);
+  will_return (nopoll_conn_new_opts, &connection1);
+  expect_function_call (nopoll_conn_new_opts);
+  will_return (nopoll_conn_is_ok, nopoll_true);
+  expect_function_call (nopoll_conn_is_ok);
+  will_return (nopoll_conn_wait_for_status_until_connection_ready, nopoll_true);
+  expect_function_call (nopoll_conn_wait_for_status_until_connection_ready);
+  assert_int_equal (step_machine (), CONN_STEP_NONE);
+
+  // queues flush downstream first, then pending writes complete
+  set_global_conn (&connection1);
+  conn_machine_drain ();
+  will_return (nopoll_conn_is_ok, nopoll_true);
+  expect_function_call (nopoll_conn_is_ok);
+  will_return (drain_downstream, 0);
+  will_return (drain_downstream, 3);
+  expect_function_call (drain_downstream);
+  will_return (drain_upstream, 1);
+  will_return (drain_upstream, 4);
+  expect_function_call (drain_upstream);
+  will_return (nopoll_conn_pending_write_bytes, 120);
+  expect_function_call (nopoll_conn_pending_write_bytes);
+  expect_function_call (nopoll_conn_complete_pending_write);
+  will_return (nopoll_conn_pending_write_bytes, 0);
+  expect_function_call (nopoll_conn_pending_write_bytes);
   will_return (nopoll_conn_ref_count, 0);
   expect_function_call (nopoll_conn_ref_count);
-  rtn = keep_trying_to_connect (&ctx, 30);
-  assert_int_equal (rtn, false);
+  assert_int_equal (step_machine (), 0);
+  assert_int_equal (get_conn_state (), CONN_STATE_RESOLVE);
+  assert_null (get_global_conn ());
+
+  // a dead connection is not drained
+  assert_int_equal (step_machine (), 0);
+  will_return (nopoll_conn_new_opts, &connection1);
+  expect_function_call (nopoll_conn_new_opts);
+  will_return (nopoll_conn_is_ok, nopoll_true);
+  expect_function_call (nopoll_conn_is_ok);
+  will_return (nopoll_conn_wait_for_status_until_connection_ready, nopoll_true);
+  expect_function_call (nopoll_conn_wait_for_status_until_connection_ready);
+  assert_int_equal (step_machine (), CONN_STEP_NONE);
+  set_global_conn (&connection1);
+  conn_machine_drain ();
+  will_return (nopoll_conn_is_ok, nopoll_false);
+  expect_function_call (nopoll_conn_is_ok);
+  will_return (nopoll_conn_ref_count, 0);
+  expect_function_call (nopoll_conn_ref_count);
+  assert_int_equal (step_machine (), 0);
+  assert_int_equal (get_conn_state (), CONN_STATE_RESOLVE);
+
+  // nor one that missed its pongs, though it may look open
+  assert_int_equal (step_machine (), 0);
+  will_return (nopoll_conn_new_opts, &connection1);
+  expect_function_call (nopoll_conn_new_opts);
+  will_return (nopoll_conn_is_ok, nopoll_true);
+  expect_function_call (nopoll_conn_is_ok);
+  will_return (nopoll_conn_wait_for_status_until_connection_ready, nopoll_true);
+  expect_function_call (nopoll_conn_wait_for_status_until_connection_ready);
+  assert_int_equal (step_machine (), CONN_STEP_NONE);
+  set_global_conn (&connection1);
+  set_global_reconnect_reason ("Ping_Miss");
+  conn_machine_drain ();
+  will_return (nopoll_conn_ref_count, 0);
+  expect_function_call (nopoll_conn_ref_count);
+  assert_int_equal (step_machine (), 0);
+  assert_int_equal (get_conn_state (), CONN_STATE_RESOLVE);
+  set_global_reconnect_reason ("webpa_process_starts");
+}
+
+void *build_standby (void *arg)
+{
+  return arg;
+}
+
+static int standby_released;
+
+void release_standby (void *handle)
+{
+  UNUSED(handle);
+  standby_released++;
+}
+
+static void inject_standby (noPollConn *conn)
+{
+  int i;
+
+  assert_int_equal (standby_build (build_standby, release_standby, conn,
+    SERVER_POOL_NONE), 0);
+  for (i = 0; (i < 200) && (standby_state () != STANDBY_READY); i++)
+    usleep (5000);
+  assert_int_equal (standby_state (), STANDBY_READY);
+}
+
+void test_conn_machine_standby ()
+{
+  noPollCtx test_nopoll_ctx;
+  ParodusCfg Cfg;
+
+  memset(&Cfg, 0, sizeof(ParodusCfg));
+  // http, so no standby is built here; the test injects them
+  parStrncpy (Cfg.webpa_url, "http://mydns.mycom.net:8080", sizeof(Cfg.webpa_url));
+  Cfg.warm_standby = 1;
+  set_parodus_cfg(&Cfg);
+  mock_wait_status = 0;
+  standby_released = 0;
+
+  conn_machine_init (&test_nopoll_ctx);
+  assert_int_equal (step_machine (), 0);
+  will_return (nopoll_conn_new_opts, &connection1);
+  expect_function_call (nopoll_conn_new_opts);
+  will_return (nopoll_conn_is_ok, nopoll_true);
+  expect_function_call (nopoll_conn_is_ok);
+  will_return (nopoll_conn_wait_for_status_until_connection_ready, nopoll_true);
+  expect_function_call (nopoll_conn_wait_for_status_until_connection_ready);
+  assert_int_equal (step_machine (), CONN_STEP_NONE);
+  assert_int_equal (standby_state (), STANDBY_EMPTY);
+
+  // a dropped primary is replaced by the standby, without reconnecting
+  inject_standby (&connection2);
+  will_return (nopoll_conn_is_ok, nopoll_true);
+  expect_function_call (nopoll_conn_is_ok);
+  conn_machine_tend ();
+  set_global_conn (NULL);
+  set_global_reconnect_reason ("Ping_Miss");
+  set_global_reconnect_status (true);
+  conn_machine_drain ();
+  will_return (nopoll_conn_is_ok, nopoll_true);
+  expect_function_call (nopoll_conn_is_ok);
+  assert_int_equal (step_machine (), CONN_STEP_NONE);
+  assert_int_equal (get_conn_state (), CONN_STATE_ONLINE);
+  assert_ptr_equal (get_global_conn (), &connection2);
+  assert_int_equal (standby_state (), STANDBY_EMPTY);
+  // the standby connected before the drop, so its reason is still to report
+  assert_string_equal (get_global_reconnect_reason (), "Ping_Miss");
+  assert_false (get_global_reconnect_status ());
+
+  // a standby that closed is let go
+  inject_standby (&connection1);
+  will_return (nopoll_conn_is_ok, nopoll_false);
+  expect_function_call (nopoll_conn_is_ok);
+  conn_machine_tend ();
+  assert_int_equal (standby_released, 1);
+  assert_int_equal (standby_state (), STANDBY_EMPTY);
+
+  // with none ready, the primary reconnects
+  set_global_conn (NULL);
+  conn_machine_drain ();
+  assert_int_equal (step_machine (), 0);
+  assert_int_equal (get_conn_state (), CONN_STATE_RESOLVE);
+  standby_discard (true);
+}
+
+void test_conn_machine_ping ()
+{
+  ParodusCfg Cfg;
+  int i;
+
+  memset(&Cfg, 0, sizeof(ParodusCfg));
+  set_parodus_cfg(&Cfg);
+  reset_close_retry ();
+
+  // off unless ping-interval is set
+  ping_monitor_start (0, 0);
+  assert_int_equal (conn_machine_ping (), -1);
+
+  ping_monitor_start (10, 30);
+  usleep (20000);
+  will_return (sendPing, nopoll_true);
+  expect_function_call (sendPing);
+  assert_true (conn_machine_ping () > 0);
+  conn_machine_pong ();
+  assert_false (get_close_retry ());
+
+  // pings missed in a row flag the connection for a reconnect
+  usleep (20000);
+  for (i = 0; i < PING_MISS_LIMIT; i++) {
+    will_return (sendPing, nopoll_true);
+    expect_function_call (sendPing);
+    conn_machine_ping ();
+    usleep (50000);
+    assert_false (get_close_retry ());
+    assert_int_equal (conn_machine_ping (), 0);
+  }
+  assert_true (get_close_retry ());
+  assert_string_equal (get_global_reconnect_reason (), "Ping_Miss");
+  reset_close_retry ();
+  ping_monitor_start (0, 0);
+}
+
+void test_conn_machine_link_change ()
+{
+  noPollCtx test_nopoll_ctx;
+  ParodusCfg Cfg;
+  struct {
+    struct nlmsghdr nh;
+    struct ifaddrmsg ifa;
+    struct rtattr rta;
+    unsigned char addr[4];
+  } msg;
+
+  memset(&Cfg, 0, sizeof(ParodusCfg));
+  parStrncpy (Cfg.webpa_url, "http://mydns.mycom.net:8080", sizeof(Cfg.webpa_url));
+  parStrncpy (Cfg.hw_mac, "123567892366", sizeof(Cfg.hw_mac));
+  parStrncpy (Cfg.webpa_interface_used, "lo", sizeof(Cfg.webpa_interface_used));
+  Cfg.reconnect_spread = 30;
+  Cfg.link_monitor = 1;
+  set_parodus_cfg(&Cfg);
+
+  conn_machine_init (&test_nopoll_ctx);
+  assert_int_equal (get_conn_state (), CONN_STATE_BACKOFF);
+  assert_true (step_machine () > 0);
+
+  // a usable address on the interface ends the wait
+  memset (&msg, 0, sizeof(msg));
+  msg.nh.nlmsg_type = RTM_NEWADDR;
+  msg.nh.nlmsg_len = sizeof(msg);
+  msg.ifa.ifa_family = AF_INET;
+  msg.ifa.ifa_index = if_nametoindex ("lo");
+  msg.ifa.ifa_scope = RT_SCOPE_UNIVERSE;
+  msg.rta.rta_type = IFA_LOCAL;
+  msg.rta.rta_len = RTA_LENGTH (sizeof(msg.addr));
+  inet_pton (AF_INET, "192.0.2.10", msg.addr);
+  link_monitor_process (&msg, sizeof(msg));
+  assert_int_equal (step_machine (), 0);
+  assert_int_equal (get_conn_state (), CONN_STATE_RESOLVE);
+  link_monitor_stop ();
 }
 
 void test_create_nopoll_connection()
@@ -1054,7 +1679,15 @@ int main(void)
         cmocka_unit_test(test_nopoll_connect),
         cmocka_unit_test(test_wait_connection_ready),
         cmocka_unit_test(test_connect_and_wait),
-        cmocka_unit_test(test_keep_trying),
+        cmocka_unit_test(test_conn_machine),
+        cmocka_unit_test(test_conn_machine_pool),
+        cmocka_unit_test(test_conn_machine_ifaces),
+        cmocka_unit_test(test_conn_machine_hints),
+        cmocka_unit_test(test_conn_machine_drain),
+        cmocka_unit_test(test_conn_machine_drain_queues),
+        cmocka_unit_test(test_conn_machine_standby),
+        cmocka_unit_test(test_conn_machine_ping),
+        cmocka_unit_test(test_conn_machine_link_change),
 	cmocka_unit_test(test_create_nopoll_connection)
     };
 
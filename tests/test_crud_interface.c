@@ -107,6 +107,11 @@ int pthread_cond_wait(pthread_cond_t *restrict cond, pthread_mutex_t *restrict m
 }
 
 
+int migrateCrudStore(void)
+{
+    return 0;
+}
+
 int processCrudRequest(wrp_msg_t *reqMsg, wrp_msg_t **responseMsg )
 {
 	UNUSED(reqMsg);
@@ -364,7 +369,7 @@ void test_addCRUDresponseToUpstreamQ()
     will_return(pthread_mutex_unlock, 0);
     expect_function_call(pthread_mutex_unlock);
     
-	addCRUDresponseToUpstreamQ(resp_bytes, resp_size);
+	addCRUDresponseToUpstreamQ(resp_bytes, resp_size, resp_msg->msg_type);
 	
     wrp_free_struct(resp_msg);
 	
@@ -29,6 +29,7 @@
 #include "../src/crud_tasks.h"
 #include "../src/config.h"
 #include "../src/crud_internal.h"
+#include "../src/crud_store.h"
 #include "../src/connection.h"
 #include "../src/close_retry.h"
 
@@ -45,6 +46,11 @@ void set_global_reconnect_status(bool status)
 	UNUSED(status);
 }
 
+void crud_notify_change(const char *name, const char *value)
+{
+	UNUSED(name); UNUSED(value);
+}
+
 void test_writeToJSON_Failure()
 {
 	int ret = -1;
@@ -1378,6 +1384,57 @@ void test_retrieveObject_nonexistObj()
 
 }
 
+void test_retrieveObject_msgpackStore()
+{
+	int ret = 0;
+	int write_ret = -1;
+	FILE *fp;
+	char *testdata = NULL;
+	wrp_msg_t *reqMsg = NULL;
+	reqMsg = ( wrp_msg_t *)malloc( sizeof( wrp_msg_t ) );
+	memset(reqMsg, 0, sizeof(wrp_msg_t));
+	wrp_msg_t *respMsg = NULL;
+	respMsg = ( wrp_msg_t *)malloc( sizeof( wrp_msg_t ) );
+	memset(respMsg, 0, sizeof(wrp_msg_t));
+
+	ParodusCfg cfg;
+	memset(&cfg,0,sizeof(cfg));
+	cfg.crud_config_file = strdup("parodus_cfg.json");
+	cfg.crud_store_format = CRUD_STORE_FORMAT_MSGPACK;
+	set_parodus_cfg(&cfg);
+	testdata=strdup("{\"tags\":{\"test\":{\"expires\":152245}, \"test1\":{\"expires\":152, \"data\" : \"key\"}}}");
+	write_ret = writeToJSON(testdata);
+	assert_int_equal (write_ret, 1);
+	reqMsg->msg_type = 6;
+	reqMsg->u.crud.transaction_uuid = strdup("1234");
+	reqMsg->u.crud.source = strdup("tag-update");
+	reqMsg->u.crud.dest = strdup("mac:14xxx/parodus/tag/test1");
+	respMsg->msg_type = 6;
+	ret = retrieveObject(reqMsg, &respMsg);
+	assert_int_equal (respMsg->u.crud.status, 200);
+	assert_int_equal (ret, 0);
+	assert_string_equal (respMsg->u.crud.payload, "{\"expires\":152,\"data\":\"key\"}");
+
+	free(reqMsg->u.crud.dest);
+	reqMsg->u.crud.dest = strdup("mac:14xxx/parodus/tag/test2");
+	ret = retrieveObject(reqMsg, &respMsg);
+	assert_int_equal (respMsg->u.crud.status, 400);
+	assert_int_equal (ret, -1);
+
+	fp = fopen(cfg.crud_config_file, "r");
+	if (fp != NULL)
+	{
+		system("rm parodus_cfg.json");
+		fclose(fp);
+	}
+	if(cfg.crud_config_file !=NULL)
+		free(cfg.crud_config_file);
+	free(testdata);
+
+	wrp_free_struct(reqMsg);
+	wrp_free_struct(respMsg);
+}
+
 void test_retrieveObject_tagsFailure()
 {
 	int ret = 0;
@@ -2976,6 +3033,7 @@ int main(void)
         cmocka_unit_test(test_retrieveObject_withTagsEmpty),
         cmocka_unit_test(test_retrieveObject_testObj),
         cmocka_unit_test(test_retrieveObject_nonexistObj),
+        cmocka_unit_test(test_retrieveObject_msgpackStore),
         cmocka_unit_test(test_retrieveObject_tagsFailure),
         cmocka_unit_test(test_retrieveObject_invalid),
         cmocka_unit_test(test_retrieveObject_readOnlyObj),
@@ -0,0 +1,353 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../src/crud_store.h"
+
+/*----------------------------------------------------------------------------*/
+/*                                   Macros                                   */
+/*----------------------------------------------------------------------------*/
+#define STORE_FILE	"test_crud_store.json"
+#define DOC_A		"{\"tags\":{\"test1\":{\"expires\":1522451870}}}"
+#define DOC_B		"{\"tags\":{\"test2\":{\"expires\":1522451871}}}"
+#define DOC_C		"{\"tags\":{\"test1\":{\"expires\":1522451870},\"test2\":{\"expires\":-5,\"name\":\"two\"}}}"
+#define READERS		4
+#define ITERATIONS	200
+#define BENCH_SAMPLES	20000
+
+/*----------------------------------------------------------------------------*/
+/*                            File Scoped Variables                           */
+/*----------------------------------------------------------------------------*/
+static volatile int torn_reads = 0;
+static volatile int bench_writing = 0;
+static volatile unsigned int bench_writes = 0;
+
+/*----------------------------------------------------------------------------*/
+/*                                   Tests                                    */
+/*----------------------------------------------------------------------------*/
+void test_crud_store_write_read()
+{
+	char *data = NULL;
+
+	assert_int_equal(crud_store_write(STORE_FILE, DOC_A, CRUD_STORE_FORMAT_JSON), 1);
+	assert_int_equal(crud_store_read(STORE_FILE, &data, CRUD_STORE_FORMAT_JSON), 1);
+	assert_string_equal(data, DOC_A);
+	free(data);
+
+	/* Served from the published snapshot the second time */
+	assert_int_equal(crud_store_read(STORE_FILE, &data, CRUD_STORE_FORMAT_JSON), 1);
+	assert_string_equal(data, DOC_A);
+	free(data);
+
+	unlink(STORE_FILE);
+	crud_store_reset();
+}
+
+void test_crud_store_external_change()
+{
+	FILE *fp;
+	char *data = NULL;
+
+	assert_int_equal(crud_store_write(STORE_FILE, DOC_A, CRUD_STORE_FORMAT_JSON), 1);
+
+	/* Replace the file behind the store's back */
+	unlink(STORE_FILE);
+	fp = fopen(STORE_FILE, "w");
+	assert_non_null(fp);
+	fputs("testData", fp);
+	fclose(fp);
+
+	assert_int_equal(crud_store_read(STORE_FILE, &data, CRUD_STORE_FORMAT_JSON), 1);
+	assert_string_equal(data, "testData");
+	free(data);
+
+	unlink(STORE_FILE);
+	crud_store_reset();
+}
+
+void test_crud_store_missing_file()
+{
+	char *data = NULL;
+
+	assert_int_equal(crud_store_write(STORE_FILE, DOC_A, CRUD_STORE_FORMAT_JSON), 1);
+	unlink(STORE_FILE);
+	assert_int_equal(crud_store_read(STORE_FILE, &data, CRUD_STORE_FORMAT_JSON), 0);
+	assert_null(data);
+	crud_store_reset();
+}
+
+void err_crud_store()
+{
+	char *data = NULL;
+
+	assert_int_equal(crud_store_write(NULL, DOC_A, CRUD_STORE_FORMAT_JSON), 0);
+	assert_int_equal(crud_store_write(STORE_FILE, NULL, CRUD_STORE_FORMAT_JSON), 0);
+	assert_int_equal(crud_store_read(NULL, &data, CRUD_STORE_FORMAT_JSON), 0);
+	assert_int_equal(crud_store_read(STORE_FILE, NULL, CRUD_STORE_FORMAT_JSON), 0);
+	assert_int_equal(crud_store_write("/nonexistent/dir/store.json", DOC_A, CRUD_STORE_FORMAT_JSON), 0);
+}
+
+static int file_is_msgpack_store(const char *path)
+{
+	FILE *fp;
+	char magic[4] = {0};
+	size_t n;
+
+	fp = fopen(path, "r");
+	if(fp == NULL)
+	{
+		return 0;
+	}
+	n = fread(magic, 1, sizeof(magic), fp);
+	fclose(fp);
+	return (n == sizeof(magic)) && (memcmp(magic, CRUD_STORE_MAGIC, 4) == 0);
+}
+
+void test_crud_store_msgpack()
+{
+	char *data = NULL;
+
+	assert_int_equal(crud_store_write(STORE_FILE, DOC_C, CRUD_STORE_FORMAT_MSGPACK), 1);
+	assert_true(file_is_msgpack_store(STORE_FILE));
+
+	/* Rendered back to the same JSON, from the snapshot and from disk */
+	assert_int_equal(crud_store_read(STORE_FILE, &data, CRUD_STORE_FORMAT_MSGPACK), 1);
+	assert_string_equal(data, DOC_C);
+	free(data);
+	crud_store_reset();
+	assert_int_equal(crud_store_read(STORE_FILE, &data, CRUD_STORE_FORMAT_JSON), 1);
+	assert_string_equal(data, DOC_C);
+	free(data);
+
+	unlink(STORE_FILE);
+	crud_store_reset();
+}
+
+void test_crud_store_get_tag()
+{
+	char *value = NULL;
+
+	assert_int_equal(crud_store_write(STORE_FILE, DOC_C, CRUD_STORE_FORMAT_MSGPACK), 1);
+	crud_store_reset();
+	assert_int_equal(crud_store_get_tag(STORE_FILE, "test2", &value), 1);
+	assert_string_equal(value, "{\"expires\":-5,\"name\":\"two\"}");
+	free(value);
+	assert_int_equal(crud_store_get_tag(STORE_FILE, "test", &value), 0);
+
+	/* Same answers from a JSON file */
+	assert_int_equal(crud_store_write(STORE_FILE, DOC_C, CRUD_STORE_FORMAT_JSON), 1);
+	assert_int_equal(crud_store_get_tag(STORE_FILE, "test1", &value), 1);
+	assert_string_equal(value, "{\"expires\":1522451870}");
+	free(value);
+	assert_int_equal(crud_store_get_tag(STORE_FILE, "test3", &value), 0);
+
+	unlink(STORE_FILE);
+	crud_store_reset();
+	assert_int_equal(crud_store_get_tag(STORE_FILE, "test1", &value), -1);
+}
+
+void test_crud_store_migrate()
+{
+	FILE *fp;
+	char *data = NULL;
+
+	fp = fopen(STORE_FILE, "w");
+	assert_non_null(fp);
+	fputs(DOC_C, fp);
+	fclose(fp);
+
+	/* a read serves the JSON file and leaves it alone */
+	assert_int_equal(crud_store_read(STORE_FILE, &data, CRUD_STORE_FORMAT_MSGPACK), 1);
+	assert_string_equal(data, DOC_C);
+	free(data);
+	assert_false(file_is_msgpack_store(STORE_FILE));
+
+	assert_int_equal(crud_store_migrate(STORE_FILE, CRUD_STORE_FORMAT_JSON), 0);
+	assert_false(file_is_msgpack_store(STORE_FILE));
+	assert_int_equal(crud_store_migrate(STORE_FILE, CRUD_STORE_FORMAT_MSGPACK), 1);
+	assert_true(file_is_msgpack_store(STORE_FILE));
+	assert_int_equal(crud_store_migrate(STORE_FILE, CRUD_STORE_FORMAT_MSGPACK), 0);
+	assert_int_equal(crud_store_read(STORE_FILE, &data, CRUD_STORE_FORMAT_MSGPACK), 1);
+	assert_string_equal(data, DOC_C);
+	free(data);
+
+	unlink(STORE_FILE);
+	crud_store_reset();
+	assert_int_equal(crud_store_migrate(STORE_FILE, CRUD_STORE_FORMAT_MSGPACK), 0);
+}
+
+void err_crud_store_msgpack()
+{
+	FILE *fp;
+	char *data = NULL;
+
+	/* Only {"tags":{...}} documents can be stored as msgpack */
+	assert_int_equal(crud_store_write(STORE_FILE, "testData", CRUD_STORE_FORMAT_MSGPACK), 0);
+	assert_int_equal(crud_store_write(STORE_FILE, "{\"other\":1}", CRUD_STORE_FORMAT_MSGPACK), 0);
+
+	/* Truncated index */
+	fp = fopen(STORE_FILE, "w");
+	assert_non_null(fp);
+	fwrite(CRUD_STORE_MAGIC "\x01\x01\x00\x00\x00\x00\x00\x05", 1, 12, fp);
+	fclose(fp);
+	assert_int_equal(crud_store_read(STORE_FILE, &data, CRUD_STORE_FORMAT_MSGPACK), 0);
+
+	unlink(STORE_FILE);
+	crud_store_reset();
+}
+
+static void *reader_task(void *arg)
+{
+	int i;
+	char *data;
+
+	(void) arg;
+	for(i = 0; i < ITERATIONS; i++)
+	{
+		data = NULL;
+		if(crud_store_read(STORE_FILE, &data, CRUD_STORE_FORMAT_JSON) &&
+		   strcmp(data, DOC_A) != 0 && strcmp(data, DOC_B) != 0)
+		{
+			torn_reads++;
+		}
+		free(data);
+	}
+	return NULL;
+}
+
+void test_crud_store_concurrent()
+{
+	pthread_t readers[READERS];
+	int i;
+
+	torn_reads = 0;
+	assert_int_equal(crud_store_write(STORE_FILE, DOC_A, CRUD_STORE_FORMAT_JSON), 1);
+
+	for(i = 0; i < READERS; i++)
+	{
+		pthread_create(&readers[i], NULL, reader_task, NULL);
+	}
+	for(i = 0; i < ITERATIONS; i++)
+	{
+		assert_int_equal(crud_store_write(STORE_FILE, (i % 2) ? DOC_A : DOC_B, CRUD_STORE_FORMAT_JSON), 1);
+	}
+	for(i = 0; i < READERS; i++)
+	{
+		pthread_join(readers[i], NULL);
+	}
+
+	/* Readers only ever see one complete document or the other */
+	assert_int_equal(torn_reads, 0);
+
+	unlink(STORE_FILE);
+	crud_store_reset();
+}
+
+static void *writer_task(void *arg)
+{
+	(void) arg;
+	while(bench_writing)
+	{
+		crud_store_write(STORE_FILE, (bench_writes % 2) ? DOC_A : DOC_C, CRUD_STORE_FORMAT_JSON);
+		bench_writes++;
+	}
+	return NULL;
+}
+
+static int cmp_ns(const void *a, const void *b)
+{
+	long x = *(const long *) a, y = *(const long *) b;
+
+	return (x > y) - (x < y);
+}
+
+/* p50 and p99 of BENCH_SAMPLES reads, in ns */
+static void measure_reads(long *samples, long *p50, long *p99)
+{
+	struct timespec start, end;
+	char *data;
+	int i;
+
+	for(i = 0; i < BENCH_SAMPLES; i++)
+	{
+		data = NULL;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		assert_int_equal(crud_store_read(STORE_FILE, &data, CRUD_STORE_FORMAT_JSON), 1);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		free(data);
+		samples[i] = (end.tv_sec - start.tv_sec) * 1000000000L + (end.tv_nsec - start.tv_nsec);
+	}
+	qsort(samples, BENCH_SAMPLES, sizeof(long), cmp_ns);
+	*p50 = samples[BENCH_SAMPLES / 2];
+	*p99 = samples[(BENCH_SAMPLES * 99) / 100];
+}
+
+/* Not a pass/fail test, prints retrieve latency with the store idle and
+   while a writer rewrites the file back to back */
+void bench_crud_store_retrieve()
+{
+	long *samples = (long *) malloc(BENCH_SAMPLES * sizeof(long));
+	long idle_p50, idle_p99, busy_p50, busy_p99;
+	pthread_t writer;
+
+	assert_non_null(samples);
+	assert_int_equal(crud_store_write(STORE_FILE, DOC_A, CRUD_STORE_FORMAT_JSON), 1);
+	measure_reads(samples, &idle_p50, &idle_p99);
+
+	bench_writes = 0;
+	bench_writing = 1;
+	pthread_create(&writer, NULL, writer_task, NULL);
+	measure_reads(samples, &busy_p50, &busy_p99);
+	bench_writing = 0;
+	pthread_join(writer, NULL);
+
+	print_message("retrieve p50/p99: idle %ld/%ld ns, during %u writes %ld/%ld ns\n",
+		idle_p50, idle_p99, bench_writes, busy_p50, busy_p99);
+	free(samples);
+	unlink(STORE_FILE);
+	crud_store_reset();
+}
+
+/*----------------------------------------------------------------------------*/
+/*                             External Functions                             */
+/*----------------------------------------------------------------------------*/
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_crud_store_write_read),
+        cmocka_unit_test(test_crud_store_external_change),
+        cmocka_unit_test(test_crud_store_missing_file),
+        cmocka_unit_test(err_crud_store),
+        cmocka_unit_test(test_crud_store_msgpack),
+        cmocka_unit_test(test_crud_store_get_tag),
+        cmocka_unit_test(test_crud_store_migrate),
+        cmocka_unit_test(err_crud_store_msgpack),
+        cmocka_unit_test(test_crud_store_concurrent),
+        cmocka_unit_test(bench_crud_store_retrieve)
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,309 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../src/ParodusInternal.h"
+#include "../src/config.h"
+#include "../src/crud_store.h"
+#include "../src/crud_subscribe.h"
+
+/*----------------------------------------------------------------------------*/
+/*                                   Macros                                   */
+/*----------------------------------------------------------------------------*/
+#define STORE_FILE	"test_crud_subscribe.json"
+#define STORE_DOC	"{\"tags\":{\"test1\":{\"expires\":1522451870}}}"
+
+/*----------------------------------------------------------------------------*/
+/*                            File Scoped Variables                           */
+/*----------------------------------------------------------------------------*/
+int numLoops;
+static ParodusCfg parodusCfg;
+static int sent = 0;
+static char lastService[32];
+static char lastSource[128];
+static char lastPayload[256];
+static int lastStatus = 0;
+static int subscribeOnSend = 0;
+
+/*----------------------------------------------------------------------------*/
+/*                                   Mocks                                    */
+/*----------------------------------------------------------------------------*/
+ParodusCfg *get_parodus_cfg(void)
+{
+	return &parodusCfg;
+}
+
+ssize_t wrp_struct_to( const wrp_msg_t *msg, const enum wrp_format fmt, void **bytes )
+{
+	(void) fmt;
+	if(WRP_MSG_TYPE__EVENT == msg->msg_type)
+	{
+		parStrncpy(lastSource, msg->u.event.source, sizeof(lastSource));
+		parStrncpy(lastPayload, (const char *) msg->u.event.payload, sizeof(lastPayload));
+	}
+	else
+	{
+		lastStatus = msg->u.crud.status;
+	}
+	*bytes = strdup("x");
+	return 1;
+}
+
+int sendMsgtoRegisteredClients(char *dest,const char **Msg,size_t msgSize)
+{
+	(void) Msg; (void) msgSize;
+	parStrncpy(lastService, dest, sizeof(lastService));
+	sent++;
+	if(subscribeOnSend)
+	{
+		/* A client subscribing while a notification is being sent */
+		assert_int_equal(crud_subscribe("other", "test1"), 1);
+	}
+	return 1;
+}
+
+/*----------------------------------------------------------------------------*/
+/*                                   Tests                                    */
+/*----------------------------------------------------------------------------*/
+static void setup_cfg()
+{
+	memset(&parodusCfg, 0, sizeof(ParodusCfg));
+	parStrncpy(parodusCfg.hw_mac, "14cfe2142xxx", sizeof(parodusCfg.hw_mac));
+	parodusCfg.crud_config_file = STORE_FILE;
+	sent = 0;
+	lastStatus = 0;
+	subscribeOnSend = 0;
+	lastService[0] = lastSource[0] = lastPayload[0] = '\0';
+}
+
+void test_crud_subscribe()
+{
+	setup_cfg();
+	assert_int_equal(crud_subscribe("config", "test1"), 1);
+	assert_int_equal(crud_subscribe("config", "test1"), 0);
+	assert_int_equal(crud_subscribe("config", "tags"), 1);
+	assert_int_equal(crud_unsubscribe("config", "test1"), 1);
+	assert_int_equal(crud_unsubscribe("config", "test1"), 0);
+	assert_int_equal(crud_unsubscribe("other", "tags"), 0);
+	crud_subscribe_reset();
+}
+
+void test_crud_unsubscribe_service()
+{
+	setup_cfg();
+	assert_int_equal(crud_subscribe("config", "test1"), 1);
+	assert_int_equal(crud_subscribe("other", "test1"), 1);
+	assert_int_equal(crud_subscribe("config", CRUD_SUBSCRIBE_ALL_TAGS), 1);
+	assert_int_equal(crud_unsubscribe_service("config"), 2);
+	assert_int_equal(crud_unsubscribe_service("config"), 0);
+	assert_int_equal(crud_unsubscribe_service(NULL), 0);
+
+	/* Only the other service is notified */
+	crud_notify_change("test1", "1");
+	numLoops = 1;
+	CRUDNotifyTask();
+	assert_int_equal(sent, 1);
+	assert_string_equal(lastService, "other");
+
+	crud_subscribe_reset();
+}
+
+void err_crud_subscribe()
+{
+	assert_int_equal(crud_subscribe(NULL, "test1"), -1);
+	assert_int_equal(crud_subscribe("config", NULL), -1);
+	assert_int_equal(crud_subscribe("", "test1"), -1);
+	assert_int_equal(crud_subscribe("a-service-name-that-is-far-too-long", "test1"), -1);
+	assert_int_equal(crud_unsubscribe(NULL, "test1"), 0);
+}
+
+void test_crud_notify_coalesced()
+{
+	setup_cfg();
+	assert_int_equal(crud_store_write(STORE_FILE, STORE_DOC, CRUD_STORE_FORMAT_JSON), 1);
+	assert_int_equal(crud_subscribe("config", CRUD_SUBSCRIBE_ALL_TAGS), 1);
+
+	crud_notify_change("test1", NULL);
+	crud_notify_change("test1", NULL);
+	crud_notify_change("test1", NULL);
+
+	numLoops = 1;
+	CRUDNotifyTask();
+	assert_int_equal(sent, 1);
+	assert_string_equal(lastService, "config");
+	assert_string_equal(lastSource, "mac:14cfe2142xxx/parodus/tag/test1");
+	assert_string_equal(lastPayload, "{\"test1\":{\"expires\":1522451870}}");
+
+	/* A deleted tag is sent as null */
+	crud_notify_change("test2", NULL);
+	numLoops = 1;
+	CRUDNotifyTask();
+	assert_int_equal(sent, 2);
+	assert_string_equal(lastPayload, "{\"test2\":null}");
+
+	crud_subscribe_reset();
+	unlink(STORE_FILE);
+	crud_store_reset();
+}
+
+void test_crud_notify_unlocked()
+{
+	setup_cfg();
+	assert_int_equal(crud_subscribe("config", "test1"), 1);
+
+	/* The subscriber list is not locked while sending */
+	subscribeOnSend = 1;
+	crud_notify_change("test1", "1");
+	numLoops = 1;
+	CRUDNotifyTask();
+	assert_int_equal(sent, 1);
+	assert_string_equal(lastService, "config");
+	assert_int_equal(crud_unsubscribe("other", "test1"), 1);
+
+	crud_subscribe_reset();
+}
+
+void test_crud_notify_cloud_disconnect()
+{
+	setup_cfg();
+	assert_int_equal(crud_subscribe("config", CRUD_NOTIFY_CLOUD_DISCONNECT), 1);
+
+	crud_notify_change("test1", NULL);
+	crud_notify_change(CRUD_NOTIFY_CLOUD_DISCONNECT, "\"one\"");
+	crud_notify_change(CRUD_NOTIFY_CLOUD_DISCONNECT, "\"two\"");
+
+	numLoops = 1;
+	CRUDNotifyTask();
+	assert_int_equal(sent, 1);
+	assert_string_equal(lastSource, "mac:14cfe2142xxx/parodus/cloud-disconnect");
+	assert_string_equal(lastPayload, "{\"cloud-disconnect\":\"two\"}");
+
+	crud_subscribe_reset();
+}
+
+void test_crud_notify_tag_named_tags()
+{
+	setup_cfg();
+	assert_int_equal(crud_subscribe("config", "tags"), 1);
+
+	/* Only the tag called tags */
+	crud_notify_change("test1", "1");
+	crud_notify_change("tags", "2");
+	numLoops = 1;
+	CRUDNotifyTask();
+	assert_int_equal(sent, 1);
+	assert_string_equal(lastSource, "mac:14cfe2142xxx/parodus/tag/tags");
+
+	crud_subscribe_reset();
+}
+
+void test_crud_notify_no_subscribers()
+{
+	setup_cfg();
+	crud_notify_change("test1", NULL);
+
+	/* Nothing was queued, subscribing later does not replay it */
+	assert_int_equal(crud_subscribe("config", "test2"), 1);
+	crud_notify_change("test2", NULL);
+	numLoops = 1;
+	CRUDNotifyTask();
+	assert_int_equal(sent, 1);
+	assert_string_equal(lastSource, "mac:14cfe2142xxx/parodus/tag/test2");
+
+	crud_subscribe_reset();
+}
+
+void test_crud_subscribe_request()
+{
+	wrp_msg_t msg;
+
+	setup_cfg();
+	memset(&msg, 0, sizeof(wrp_msg_t));
+	msg.msg_type = WRP_MSG_TYPE__CREATE;
+	msg.u.crud.transaction_uuid = "123";
+	msg.u.crud.source = "mac:14cfe2142xxx/config";
+	msg.u.crud.dest = "mac:14cfe2142xxx/parodus/subscribe/test1";
+
+	assert_int_equal(crud_subscribe_request(&msg), 201);
+	assert_int_equal(lastStatus, 201);
+	assert_string_equal(lastService, "config");
+	assert_int_equal(crud_subscribe_request(&msg), 200);
+
+	msg.msg_type = WRP_MSG_TYPE__DELETE;
+	assert_int_equal(crud_subscribe_request(&msg), 200);
+	assert_int_equal(crud_subscribe_request(&msg), 400);
+	assert_int_equal(sent, 4);
+
+	/* Without a name it is every tag; "tags" is just a tag */
+	msg.msg_type = WRP_MSG_TYPE__CREATE;
+	msg.u.crud.dest = "mac:14cfe2142xxx/parodus/subscribe";
+	assert_int_equal(crud_subscribe_request(&msg), 201);
+	msg.u.crud.dest = "mac:14cfe2142xxx/parodus/subscribe/tags";
+	assert_int_equal(crud_subscribe_request(&msg), 201);
+	assert_int_equal(crud_unsubscribe("config", CRUD_SUBSCRIBE_ALL_TAGS), 1);
+	assert_int_equal(crud_unsubscribe("config", "tags"), 1);
+
+	crud_subscribe_reset();
+}
+
+void err_crud_subscribe_request()
+{
+	wrp_msg_t msg;
+
+	setup_cfg();
+	memset(&msg, 0, sizeof(wrp_msg_t));
+	msg.msg_type = WRP_MSG_TYPE__CREATE;
+	msg.u.crud.source = "mac:14cfe2142xxx/config";
+
+	msg.u.crud.dest = "mac:14cfe2142xxx/parodus/subscribe/tag/test1";
+	assert_int_equal(crud_subscribe_request(&msg), 400);
+	assert_int_equal(sent, 1);
+
+	/* No client to answer */
+	msg.u.crud.source = "mac:14cfe2142xxx";
+	msg.u.crud.dest = "mac:14cfe2142xxx/parodus/subscribe/test1";
+	assert_int_equal(crud_subscribe_request(&msg), 400);
+	assert_int_equal(sent, 1);
+}
+
+/*----------------------------------------------------------------------------*/
+/*                             External Functions                             */
+/*----------------------------------------------------------------------------*/
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_crud_subscribe),
+        cmocka_unit_test(test_crud_unsubscribe_service),
+        cmocka_unit_test(err_crud_subscribe),
+        cmocka_unit_test(test_crud_notify_coalesced),
+        cmocka_unit_test(test_crud_notify_unlocked),
+        cmocka_unit_test(test_crud_notify_cloud_disconnect),
+        cmocka_unit_test(test_crud_notify_tag_named_tags),
+        cmocka_unit_test(test_crud_notify_no_subscribers),
+        cmocka_unit_test(test_crud_subscribe_request),
+        cmocka_unit_test(err_crud_subscribe_request),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,290 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "../src/dns_cache.h"
+
+/*----------------------------------------------------------------------------*/
+/*                            File Scoped Variables                           */
+/*----------------------------------------------------------------------------*/
+static pthread_mutex_t mock_mut = PTHREAD_MUTEX_INITIALIZER;
+static int lookups = 0;
+static int lookup_delay_ms = 0;
+static const char *mock_ipv4 = "192.0.2.1";
+static int mock_fail = 0;
+
+/*----------------------------------------------------------------------------*/
+/*                                   Mocks                                    */
+/*----------------------------------------------------------------------------*/
+/* One ipv6 and one ipv4 address per name */
+int getaddrinfo(const char *node, const char *service,
+	const struct addrinfo *hints, struct addrinfo **res)
+{
+	struct addrinfo *ai;
+	struct sockaddr_in6 *v6;
+	struct sockaddr_in *v4;
+	int fail;
+
+	(void) node; (void) service; (void) hints;
+	pthread_mutex_lock(&mock_mut);
+	lookups++;
+	fail = mock_fail;
+	pthread_mutex_unlock(&mock_mut);
+	usleep(lookup_delay_ms * 1000);
+	if(fail)
+	{
+		return EAI_NONAME;
+	}
+
+	ai = calloc(2, sizeof(struct addrinfo));
+	v6 = calloc(1, sizeof(struct sockaddr_in6));
+	v4 = calloc(1, sizeof(struct sockaddr_in));
+	v6->sin6_family = AF_INET6;
+	inet_pton(AF_INET6, "2001:db8::1", &v6->sin6_addr);
+	v4->sin_family = AF_INET;
+	inet_pton(AF_INET, mock_ipv4, &v4->sin_addr);
+	ai[0].ai_family = AF_INET6;
+	ai[0].ai_addr = (struct sockaddr *) v6;
+	ai[0].ai_addrlen = sizeof(struct sockaddr_in6);
+	ai[0].ai_next = &ai[1];
+	ai[1].ai_family = AF_INET;
+	ai[1].ai_addr = (struct sockaddr *) v4;
+	ai[1].ai_addrlen = sizeof(struct sockaddr_in);
+	*res = ai;
+	return 0;
+}
+
+void freeaddrinfo(struct addrinfo *res)
+{
+	free(res[0].ai_addr);
+	free(res[1].ai_addr);
+	free(res);
+}
+
+const char *gai_strerror(int errcode)
+{
+	(void) errcode;
+	return "mock failure";
+}
+
+static int get_lookups(void)
+{
+	int n;
+
+	pthread_mutex_lock(&mock_mut);
+	n = lookups;
+	pthread_mutex_unlock(&mock_mut);
+	return n;
+}
+
+static void reset(unsigned int ttl)
+{
+	dns_cache_clear();
+	dns_cache_set_ttl(ttl);
+	lookups = 0;
+	lookup_delay_ms = 0;
+	mock_fail = 0;
+	mock_ipv4 = "192.0.2.1";
+}
+
+/*----------------------------------------------------------------------------*/
+/*                                   Tests                                    */
+/*----------------------------------------------------------------------------*/
+void test_dns_cache_disabled()
+{
+	struct sockaddr_storage addrs[DNS_CACHE_MAX_ADDRS];
+
+	reset(0);
+	assert_int_equal(dns_cache_lookup("fabric.webpa.net", AF_UNSPEC, addrs, DNS_CACHE_MAX_ADDRS), 2);
+	assert_int_equal(dns_cache_lookup("fabric.webpa.net", AF_UNSPEC, addrs, DNS_CACHE_MAX_ADDRS), 2);
+	assert_int_equal(get_lookups(), 2);
+}
+
+void test_dns_cache_hit()
+{
+	struct sockaddr_storage addrs[DNS_CACHE_MAX_ADDRS];
+	char ip[INET6_ADDRSTRLEN];
+
+	reset(60);
+	assert_int_equal(dns_cache_lookup("fabric.webpa.net", AF_UNSPEC, addrs, DNS_CACHE_MAX_ADDRS), 2);
+	assert_int_equal(addrs[0].ss_family, AF_INET6);
+	assert_int_equal(addrs[1].ss_family, AF_INET);
+	assert_int_equal(dns_cache_lookup("fabric.webpa.net", AF_INET, addrs, DNS_CACHE_MAX_ADDRS), 1);
+	assert_int_equal(addrs[0].ss_family, AF_INET);
+	assert_int_equal(dns_cache_lookup("fabric.webpa.net", AF_INET6, addrs, 1), 1);
+	assert_int_equal(get_lookups(), 1);
+
+	assert_int_equal(dns_cache_lookup_ip("fabric.webpa.net", AF_INET, ip, sizeof(ip)), 1);
+	assert_string_equal(ip, "192.0.2.1");
+	assert_int_equal(dns_cache_lookup_ip("fabric.webpa.net", AF_INET6, ip, sizeof(ip)), 1);
+	assert_string_equal(ip, "2001:db8::1");
+	assert_int_equal(get_lookups(), 1);
+
+	// another name is another lookup
+	assert_int_equal(dns_cache_lookup("other.webpa.net", AF_UNSPEC, addrs, DNS_CACHE_MAX_ADDRS), 2);
+	assert_int_equal(get_lookups(), 2);
+}
+
+void test_dns_cache_expiry_and_refresh()
+{
+	char ip[INET6_ADDRSTRLEN];
+	int i;
+
+	reset(1);
+	lookup_delay_ms = 50;
+	assert_int_equal(dns_cache_lookup_ip("fabric.webpa.net", AF_INET, ip, sizeof(ip)), 1);
+	assert_int_equal(get_lookups(), 1);
+
+	// inside the refresh window: answered from the cache, refreshed behind
+	mock_ipv4 = "192.0.2.2";
+	usleep(850 * 1000);
+	assert_int_equal(dns_cache_lookup_ip("fabric.webpa.net", AF_INET, ip, sizeof(ip)), 1);
+	assert_string_equal(ip, "192.0.2.1");
+	for(i = 0; (i < 100) && (get_lookups() < 2); i++)
+	{
+		usleep(5000);
+	}
+	usleep(100 * 1000);
+	assert_int_equal(get_lookups(), 2);
+	assert_int_equal(dns_cache_lookup_ip("fabric.webpa.net", AF_INET, ip, sizeof(ip)), 1);
+	assert_string_equal(ip, "192.0.2.2");
+	assert_int_equal(get_lookups(), 2);
+
+	// expired: looked up again before answering
+	mock_ipv4 = "192.0.2.3";
+	usleep(1100 * 1000);
+	assert_int_equal(dns_cache_lookup_ip("fabric.webpa.net", AF_INET, ip, sizeof(ip)), 1);
+	assert_string_equal(ip, "192.0.2.3");
+	assert_int_equal(get_lookups(), 3);
+}
+
+void test_dns_cache_negative()
+{
+	struct sockaddr_storage addrs[DNS_CACHE_MAX_ADDRS];
+
+	reset(60);
+	mock_fail = 1;
+	assert_int_equal(dns_cache_lookup("fabric.webpa.net", AF_UNSPEC, addrs, DNS_CACHE_MAX_ADDRS), 0);
+	assert_int_equal(dns_cache_lookup("fabric.webpa.net", AF_UNSPEC, addrs, DNS_CACHE_MAX_ADDRS), 0);
+	assert_int_equal(get_lookups(), 1);
+
+	// failures are kept for at most DNS_CACHE_NEGATIVE_TTL
+	reset(1);
+	mock_fail = 1;
+	assert_int_equal(dns_cache_lookup("fabric.webpa.net", AF_UNSPEC, addrs, DNS_CACHE_MAX_ADDRS), 0);
+	mock_fail = 0;
+	usleep(1100 * 1000);
+	assert_int_equal(dns_cache_lookup("fabric.webpa.net", AF_UNSPEC, addrs, DNS_CACHE_MAX_ADDRS), 2);
+	assert_int_equal(get_lookups(), 2);
+}
+
+static void *lookup_thread(void *arg)
+{
+	struct sockaddr_storage addrs[DNS_CACHE_MAX_ADDRS];
+
+	*(int *) arg = dns_cache_lookup("fabric.webpa.net", AF_UNSPEC, addrs, DNS_CACHE_MAX_ADDRS);
+	return NULL;
+}
+
+void test_dns_cache_single_lookup()
+{
+	pthread_t threads[8];
+	int counts[8];
+	int i;
+
+	// a reconnect storm asks once
+	reset(60);
+	lookup_delay_ms = 100;
+	for(i = 0; i < 8; i++)
+	{
+		pthread_create(&threads[i], NULL, lookup_thread, &counts[i]);
+	}
+	for(i = 0; i < 8; i++)
+	{
+		pthread_join(threads[i], NULL);
+		assert_int_equal(counts[i], 2);
+	}
+	assert_int_equal(get_lookups(), 1);
+}
+
+void test_dns_cache_clear_during_lookup()
+{
+	pthread_t threads[2];
+	int counts[2];
+	int i;
+
+	// the resolving entry goes away under both the asker and the waiter
+	reset(60);
+	lookup_delay_ms = 200;
+	for(i = 0; i < 2; i++)
+	{
+		pthread_create(&threads[i], NULL, lookup_thread, &counts[i]);
+	}
+	usleep(50 * 1000);
+	dns_cache_clear();
+	for(i = 0; i < 2; i++)
+	{
+		pthread_join(threads[i], NULL);
+		assert_int_equal(counts[i], 2);
+	}
+	assert_int_equal(get_lookups(), 2);
+	dns_cache_clear();
+}
+
+void err_dns_cache_lookup()
+{
+	struct sockaddr_storage addrs[DNS_CACHE_MAX_ADDRS];
+	char ip[4];
+
+	reset(60);
+	assert_int_equal(dns_cache_lookup(NULL, AF_UNSPEC, addrs, DNS_CACHE_MAX_ADDRS), 0);
+	assert_int_equal(dns_cache_lookup("fabric.webpa.net", AF_UNSPEC, NULL, DNS_CACHE_MAX_ADDRS), 0);
+	assert_int_equal(dns_cache_lookup("fabric.webpa.net", AF_UNSPEC, addrs, 0), 0);
+	assert_int_equal(get_lookups(), 0);
+	// too small for the address
+	assert_int_equal(dns_cache_lookup_ip("fabric.webpa.net", AF_INET, ip, sizeof(ip)), 0);
+	dns_cache_clear();
+}
+
+/*----------------------------------------------------------------------------*/
+/*                             External Functions                             */
+/*----------------------------------------------------------------------------*/
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_dns_cache_disabled),
+        cmocka_unit_test(test_dns_cache_hit),
+        cmocka_unit_test(test_dns_cache_expiry_and_refresh),
+        cmocka_unit_test(test_dns_cache_negative),
+        cmocka_unit_test(test_dns_cache_single_lookup),
+        cmocka_unit_test(test_dns_cache_clear_during_lookup),
+        cmocka_unit_test(err_dns_cache_lookup),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
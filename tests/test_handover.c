@@ -0,0 +1,216 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../src/ParodusInternal.h"
+#include "../src/client_list.h"
+#include "../src/handover.h"
+
+/*----------------------------------------------------------------------------*/
+/*                            File Scoped Variables                           */
+/*----------------------------------------------------------------------------*/
+#define HANDOVER_PATH	"test_handover.sock"
+
+static reg_list_item_t clients[2] = {
+    {0, "config", "tcp://127.0.0.1:6668", &clients[1]},
+    {0, "iot", "tcp://127.0.0.1:6669", NULL},
+};
+static bool shutdown_called = false;
+static char *last_reason = NULL;
+static char restored[2][32];
+static int restored_count = 0;
+
+/*----------------------------------------------------------------------------*/
+/*                                   Mocks                                    */
+/*----------------------------------------------------------------------------*/
+reg_list_item_t * get_global_node(void)
+{
+    return &clients[0];
+}
+
+int addToList( wrp_msg_t **msg)
+{
+    assert_int_equal ((*msg)->msg_type, WRP_MSG_TYPE__SVC_REGISTRATION);
+    if (restored_count < 2)
+        strcpy (restored[restored_count], (*msg)->u.reg.service_name);
+    if (strcmp ((*msg)->u.reg.service_name, "iot") == 0)
+        assert_string_equal ((*msg)->u.reg.url, "tcp://127.0.0.1:6669");
+    restored_count++;
+    return 0;
+}
+
+void set_global_reconnect_reason(char *reason)
+{
+    last_reason = reason;
+}
+
+void set_global_reconnect_status(bool status)
+{
+    (void) status;
+}
+
+void shutdownSocketConnection(void)
+{
+    shutdown_called = true;
+}
+
+/*----------------------------------------------------------------------------*/
+/*                                   Helpers                                  */
+/*----------------------------------------------------------------------------*/
+// runs the running parodus in a child, once it listens
+static pid_t start_old (void (*old_fn)(int ready_fd))
+{
+    int ready[2];
+    char c;
+    pid_t pid;
+
+    assert_int_equal (pipe (ready), 0);
+    pid = fork ();
+    assert_true (pid >= 0);
+    if (0 == pid) {
+        close (ready[0]);
+        old_fn (ready[1]);
+        _exit (1);
+    }
+    close (ready[1]);
+    assert_int_equal (read (ready[0], &c, 1), 1);
+    close (ready[0]);
+    return pid;
+}
+
+static void wait_old (pid_t pid)
+{
+    int status;
+
+    assert_int_equal (waitpid (pid, &status, 0), pid);
+    assert_true (WIFEXITED (status));
+    assert_int_equal (WEXITSTATUS (status), 0);
+}
+
+// what a parodus being upgraded does; exits 0 if all went as expected
+static void old_parodus (int ready_fd)
+{
+    int n;
+
+    if (handover_listen (HANDOVER_PATH) != 0)
+        _exit (2);
+    if (handover_listen (HANDOVER_PATH) != -1)
+        _exit (3);
+    n = write (ready_fd, "r", 1);
+    for (n = 0; (n < 500) && !handover_pending (); n++)
+        usleep (10000);
+    if (!handover_pending () || !shutdown_called ||
+        (strcmp (last_reason, HANDOVER_REASON) != 0))
+        _exit (4);
+    if (handover_send () != 2)
+        _exit (5);
+    handover_stop ();
+    _exit (0);
+}
+
+// hands over part of the registry and dies
+static void old_parodus_dies (int ready_fd)
+{
+    struct sockaddr_un addr;
+    int fd, peer, n;
+
+    memset (&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy (addr.sun_path, HANDOVER_PATH);
+    unlink (HANDOVER_PATH);
+    fd = socket (AF_UNIX, SOCK_STREAM, 0);
+    if ((bind (fd, (struct sockaddr *) &addr, sizeof(addr)) != 0) || (listen (fd, 1) != 0))
+        _exit (2);
+    n = write (ready_fd, "r", 1);
+    peer = accept (fd, NULL, NULL);
+    n = write (peer, "client config tcp://127.0.0.1:6668\n", 35);
+    (void) n;
+    unlink (HANDOVER_PATH);
+    _exit (0);
+}
+
+/*----------------------------------------------------------------------------*/
+/*                                   Tests                                    */
+/*----------------------------------------------------------------------------*/
+void test_take_nothing ()
+{
+    unlink (HANDOVER_PATH);
+    assert_int_equal (handover_take (NULL), -1);
+    assert_int_equal (handover_take (HANDOVER_PATH), -1);
+    assert_int_equal (handover_take ("/tmp/a_handover_socket_path_that_is_much_too_long"
+        "_to_fit_in_the_sun_path_field_of_a_sockaddr_un_which_holds_108_bytes.sock"), -1);
+    assert_int_equal (handover_listen (NULL), -1);
+    assert_false (handover_pending ());
+    assert_int_equal (handover_send (), -1);
+    handover_restore ();
+    assert_int_equal (restored_count, 0);
+    handover_stop ();
+}
+
+void test_handover ()
+{
+    pid_t pid = start_old (old_parodus);
+
+    last_reason = NULL;
+    assert_int_equal (handover_take (HANDOVER_PATH), 2);
+    // the old parodus has exited by now
+    wait_old (pid);
+    assert_string_equal (last_reason, HANDOVER_REASON);
+    assert_int_equal (access (HANDOVER_PATH, F_OK), -1);
+
+    restored_count = 0;
+    handover_restore ();
+    assert_int_equal (restored_count, 2);
+    assert_string_equal (restored[0], "config");
+    assert_string_equal (restored[1], "iot");
+    // only once
+    handover_restore ();
+    assert_int_equal (restored_count, 2);
+}
+
+void test_handover_incomplete ()
+{
+    pid_t pid = start_old (old_parodus_dies);
+
+    assert_int_equal (handover_take (HANDOVER_PATH), -1);
+    wait_old (pid);
+    restored_count = 0;
+    handover_restore ();
+    assert_int_equal (restored_count, 0);
+}
+
+/*----------------------------------------------------------------------------*/
+/*                             External Functions                             */
+/*----------------------------------------------------------------------------*/
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_take_nothing),
+        cmocka_unit_test(test_handover),
+        cmocka_unit_test(test_handover_incomplete),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
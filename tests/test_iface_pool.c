@@ -0,0 +1,169 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "../src/iface_pool.h"
+
+/*----------------------------------------------------------------------------*/
+/*                                   Helpers                                  */
+/*----------------------------------------------------------------------------*/
+static int open_listener (unsigned int *port)
+{
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    int fd;
+
+    memset (&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+    fd = socket (AF_INET, SOCK_STREAM, 0);
+    assert_true (fd >= 0);
+    assert_int_equal (bind (fd, (struct sockaddr *) &addr, sizeof(addr)), 0);
+    assert_int_equal (getsockname (fd, (struct sockaddr *) &addr, &len), 0);
+    assert_int_equal (listen (fd, 4), 0);
+    *port = ntohs (addr.sin_port);
+    return fd;
+}
+
+// runs a probe to the end
+static void probe (int index, unsigned int port)
+{
+    int n;
+
+    assert_int_equal (iface_pool_probe (index, "127.0.0.1", port), 0);
+    assert_int_equal (iface_pool_probe (index, "127.0.0.1", port), -1);
+    for (n = 0; (n < 200) && iface_pool_probing (); n++)
+        usleep (10000);
+    assert_false (iface_pool_probing ());
+}
+
+/*----------------------------------------------------------------------------*/
+/*                                   Tests                                    */
+/*----------------------------------------------------------------------------*/
+void test_init ()
+{
+    assert_int_equal (iface_pool_init ("erouter0, wwan0,erouter0,"
+        "a_name_much_too_long,eth0,eth1,eth2"), 4);
+    assert_string_equal (iface_pool_name (0), "erouter0");
+    assert_string_equal (iface_pool_name (1), "wwan0");
+    assert_string_equal (iface_pool_name (2), "eth0");
+    assert_string_equal (iface_pool_name (3), "eth1");
+    assert_null (iface_pool_name (4));
+    assert_null (iface_pool_name (IFACE_POOL_NONE));
+    iface_pool_clear ();
+    assert_int_equal (iface_pool_count (), 0);
+    assert_int_equal (iface_pool_select (0, 0), IFACE_POOL_NONE);
+}
+
+void test_select_in_order ()
+{
+    iface_stats_t stats;
+
+    iface_pool_init ("erouter0,wwan0,eth0");
+    // priority, not rtt, picks the interface
+    iface_pool_report_connect (0, 1, 80);
+    iface_pool_report_connect (1, 1, 20);
+    assert_int_equal (iface_pool_select (0, 1), 0);
+    assert_int_equal (iface_pool_select (1, 1), 1);
+    assert_int_equal (iface_pool_select (3, 1), 2);
+    assert_int_equal (iface_pool_select (7, 0), IFACE_POOL_NONE);
+
+    // a failed interface cools down, the next one takes over
+    iface_pool_report_connect (0, 0, 0);
+    assert_int_equal (iface_pool_select (0, 1), 1);
+    iface_pool_report_connect (1, 0, 0);
+    iface_pool_report_connect (1, 0, 0);
+    assert_int_equal (iface_pool_select (0, 1), 2);
+    iface_pool_report_connect (2, 0, 0);
+    assert_int_equal (iface_pool_select (0, 1), IFACE_POOL_NONE);
+    // all cooling: the one back soonest
+    assert_int_equal (iface_pool_select (0, 0), 0);
+
+    iface_pool_report_rtt (1, 40);
+    iface_pool_get_stats (1, &stats);
+    assert_int_equal (stats.connects, 1);
+    assert_int_equal (stats.failures, 2);
+    assert_int_equal (stats.rtt_ms, (7 * 20 + 40) / 8);
+
+    // scores carry over a reload
+    iface_pool_init ("wwan0,erouter0");
+    iface_pool_get_stats (0, &stats);
+    assert_int_equal (stats.failures, 2);
+    iface_pool_report_connect (1, 1, 10);
+    assert_int_equal (iface_pool_select (0, 1), 1);
+    iface_pool_clear ();
+}
+
+void test_probe ()
+{
+    unsigned int port, closed_port;
+    iface_stats_t stats;
+    int listener;
+
+    // binding to an interface needs CAP_NET_RAW
+    if (0 != geteuid ())
+        skip ();
+    listener = open_listener (&port);
+    close (open_listener (&closed_port));
+    iface_pool_init ("lo,wwan0");
+    assert_int_equal (iface_pool_probe (5, "127.0.0.1", port), -1);
+    assert_int_equal (iface_pool_probe (0, NULL, port), -1);
+
+    iface_pool_report_connect (0, 0, 0);
+    assert_int_equal (iface_pool_select (0, 1), 1);
+    probe (0, port);
+    // a good probe ends the cooldown, two make the interface healthy
+    assert_int_equal (iface_pool_select (0, 1), 0);
+    assert_false (iface_pool_healthy (0));
+    probe (0, port);
+    assert_true (iface_pool_healthy (0));
+    iface_pool_get_stats (0, &stats);
+    assert_int_equal (stats.probes_ok, 2);
+    assert_true (stats.rtt_ms > 0);
+
+    // a failed probe starts the count again
+    probe (0, closed_port);
+    assert_false (iface_pool_healthy (0));
+    // the interface that does not exist cannot be probed
+    probe (1, port);
+    assert_false (iface_pool_healthy (1));
+
+    close (listener);
+    iface_pool_clear ();
+}
+
+/*----------------------------------------------------------------------------*/
+/*                             External Functions                             */
+/*----------------------------------------------------------------------------*/
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_init),
+        cmocka_unit_test(test_select_in_order),
+        cmocka_unit_test(test_probe),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
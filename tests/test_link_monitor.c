@@ -0,0 +1,266 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <arpa/inet.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <net/if.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../src/link_monitor.h"
+
+/*----------------------------------------------------------------------------*/
+/*                            File Scoped Variables                           */
+/*----------------------------------------------------------------------------*/
+#define MAX_EVENTS	16
+
+static pthread_mutex_t events_mut = PTHREAD_MUTEX_INITIALIZER;
+static int events[MAX_EVENTS];
+static char addrs[MAX_EVENTS][INET6_ADDRSTRLEN];
+static int event_count;
+
+typedef union {
+    struct nlmsghdr nh;
+    char bytes[256];
+} nl_buf_t;
+
+/*----------------------------------------------------------------------------*/
+/*                                   Mocks                                    */
+/*----------------------------------------------------------------------------*/
+static void on_event (int event, const char *addr, void *arg)
+{
+    (void) arg;
+    pthread_mutex_lock (&events_mut);
+    if (event_count < MAX_EVENTS) {
+        events[event_count] = event;
+        strcpy (addrs[event_count], (NULL != addr) ? addr : "");
+        event_count++;
+    }
+    pthread_mutex_unlock (&events_mut);
+}
+
+/*----------------------------------------------------------------------------*/
+/*                                   Helpers                                  */
+/*----------------------------------------------------------------------------*/
+static void reset_events (void)
+{
+    pthread_mutex_lock (&events_mut);
+    event_count = 0;
+    pthread_mutex_unlock (&events_mut);
+}
+
+static int count_events (void)
+{
+    int count;
+
+    pthread_mutex_lock (&events_mut);
+    count = event_count;
+    pthread_mutex_unlock (&events_mut);
+    return count;
+}
+
+// waits for an event, skipping others
+static int wait_event (int event, const char *addr)
+{
+    int i, n, seen = 0;
+
+    for (n = 0; (n < 400) && !seen; n++) {
+        pthread_mutex_lock (&events_mut);
+        for (i = 0; i < event_count; i++) {
+            if ((events[i] == event) &&
+                ((NULL == addr) || (strcmp (addrs[i], addr) == 0)))
+                seen = 1;
+        }
+        pthread_mutex_unlock (&events_mut);
+        if (!seen)
+            usleep (5000);
+    }
+    return seen;
+}
+
+static void add_attr (struct nlmsghdr *nh, int type, const void *data, int len)
+{
+    struct rtattr *rta = (struct rtattr *) (((char *) nh) + NLMSG_ALIGN (nh->nlmsg_len));
+
+    rta->rta_type = type;
+    rta->rta_len = RTA_LENGTH (len);
+    memcpy (RTA_DATA (rta), data, len);
+    nh->nlmsg_len = NLMSG_ALIGN (nh->nlmsg_len) + RTA_ALIGN (rta->rta_len);
+}
+
+static void addr_msg (nl_buf_t *buf, int type, int index, int family,
+    const char *text, int scope, unsigned int flags)
+{
+    struct ifaddrmsg *ifa;
+    unsigned char addr[16];
+
+    memset (buf, 0, sizeof(*buf));
+    buf->nh.nlmsg_type = type;
+    buf->nh.nlmsg_len = NLMSG_LENGTH (sizeof(struct ifaddrmsg));
+    ifa = (struct ifaddrmsg *) NLMSG_DATA (&buf->nh);
+    ifa->ifa_family = family;
+    ifa->ifa_index = index;
+    ifa->ifa_scope = scope;
+    ifa->ifa_flags = flags;
+    inet_pton (family, text, addr);
+    add_attr (&buf->nh, (AF_INET == family) ? IFA_LOCAL : IFA_ADDRESS, addr,
+        (AF_INET == family) ? 4 : 16);
+}
+
+static void link_msg (nl_buf_t *buf, int type, int index, unsigned int flags)
+{
+    struct ifinfomsg *ifi;
+
+    memset (buf, 0, sizeof(*buf));
+    buf->nh.nlmsg_type = type;
+    buf->nh.nlmsg_len = NLMSG_LENGTH (sizeof(struct ifinfomsg));
+    ifi = (struct ifinfomsg *) NLMSG_DATA (&buf->nh);
+    ifi->ifi_index = index;
+    ifi->ifi_flags = flags;
+}
+
+static void process (nl_buf_t *buf)
+{
+    link_monitor_process (buf, buf->nh.nlmsg_len);
+}
+
+static int run (const char *cmd)
+{
+    char line[256];
+
+    snprintf (line, sizeof(line), "%s >/dev/null 2>&1", cmd);
+    return system (line);
+}
+
+/*----------------------------------------------------------------------------*/
+/*                                   Tests                                    */
+/*----------------------------------------------------------------------------*/
+void test_address_events ()
+{
+    int lo = (int) if_nametoindex ("lo");
+    nl_buf_t buf;
+
+    assert_int_equal (link_monitor_start ("lo", on_event, NULL), 0);
+    assert_int_equal (link_monitor_start ("lo", on_event, NULL), -1);
+    reset_events ();
+
+    addr_msg (&buf, RTM_NEWADDR, lo, AF_INET, "192.0.2.10", RT_SCOPE_UNIVERSE, 0);
+    process (&buf);
+    assert_int_equal (count_events (), 1);
+    assert_int_equal (events[0], LINK_EVENT_ADDR_ADDED);
+    assert_string_equal (addrs[0], "192.0.2.10");
+
+    // other interfaces, link scope and tentative addresses are left out
+    addr_msg (&buf, RTM_NEWADDR, lo + 100, AF_INET, "192.0.2.11", RT_SCOPE_UNIVERSE, 0);
+    process (&buf);
+    addr_msg (&buf, RTM_NEWADDR, lo, AF_INET6, "fe80::1", RT_SCOPE_LINK, 0);
+    process (&buf);
+    addr_msg (&buf, RTM_NEWADDR, lo, AF_INET6, "2001:db8::1", RT_SCOPE_UNIVERSE,
+        IFA_F_TENTATIVE);
+    process (&buf);
+    assert_int_equal (count_events (), 1);
+
+    addr_msg (&buf, RTM_NEWADDR, lo, AF_INET6, "2001:db8::1", RT_SCOPE_UNIVERSE, 0);
+    process (&buf);
+    addr_msg (&buf, RTM_DELADDR, lo, AF_INET, "192.0.2.10", RT_SCOPE_UNIVERSE, 0);
+    process (&buf);
+    assert_int_equal (count_events (), 3);
+    assert_int_equal (events[1], LINK_EVENT_ADDR_ADDED);
+    assert_string_equal (addrs[1], "2001:db8::1");
+    assert_int_equal (events[2], LINK_EVENT_ADDR_REMOVED);
+    assert_string_equal (addrs[2], "192.0.2.10");
+    link_monitor_stop ();
+}
+
+void test_link_events ()
+{
+    int lo = (int) if_nametoindex ("lo");
+    nl_buf_t buf;
+
+    assert_int_equal (link_monitor_start ("lo", on_event, NULL), 0);
+    reset_events ();
+
+    link_msg (&buf, RTM_NEWLINK, lo, IFF_UP | IFF_RUNNING);
+    process (&buf);
+    // only changes are reported
+    process (&buf);
+    link_msg (&buf, RTM_NEWLINK, lo, IFF_UP);
+    process (&buf);
+    link_msg (&buf, RTM_NEWLINK, lo + 100, IFF_UP | IFF_RUNNING);
+    process (&buf);
+    assert_int_equal (count_events (), 2);
+    assert_int_equal (events[0], LINK_EVENT_UP);
+    assert_int_equal (events[1], LINK_EVENT_DOWN);
+    link_monitor_stop ();
+
+    // with no interface named, every one is watched
+    assert_int_equal (link_monitor_start ("", on_event, NULL), 0);
+    reset_events ();
+    link_msg (&buf, RTM_NEWLINK, lo + 100, IFF_UP | IFF_RUNNING);
+    process (&buf);
+    assert_int_equal (count_events (), 1);
+    link_monitor_stop ();
+}
+
+// a veth pair in a network namespace of its own; needs CAP_NET_ADMIN
+void test_veth_namespace ()
+{
+    if ((0 != geteuid ()) || (0 != unshare (CLONE_NEWNET)) ||
+        (0 != run ("ip link add pd0 type veth peer name pd1"))) {
+        skip ();
+    }
+    assert_int_equal (link_monitor_start ("pd0", on_event, NULL), 0);
+    reset_events ();
+
+    assert_int_equal (run ("ip link set pd1 up"), 0);
+    assert_int_equal (run ("ip link set pd0 up"), 0);
+    assert_true (wait_event (LINK_EVENT_UP, NULL));
+    assert_int_equal (run ("ip addr add 192.0.2.1/24 dev pd0"), 0);
+    assert_true (wait_event (LINK_EVENT_ADDR_ADDED, "192.0.2.1"));
+    // addresses on the peer are not watched
+    assert_int_equal (run ("ip addr add 192.0.2.2/24 dev pd1"), 0);
+    assert_int_equal (run ("ip addr del 192.0.2.1/24 dev pd0"), 0);
+    assert_true (wait_event (LINK_EVENT_ADDR_REMOVED, "192.0.2.1"));
+    assert_false (wait_event (LINK_EVENT_ADDR_ADDED, "192.0.2.2"));
+    assert_int_equal (run ("ip link set pd1 down"), 0);
+    assert_true (wait_event (LINK_EVENT_DOWN, NULL));
+
+    link_monitor_stop ();
+    run ("ip link del pd0");
+}
+
+/*----------------------------------------------------------------------------*/
+/*                             External Functions                             */
+/*----------------------------------------------------------------------------*/
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_address_events),
+        cmocka_unit_test(test_link_events),
+        cmocka_unit_test(test_veth_namespace),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -32,6 +32,8 @@ bool LastReasonStatus;
 int closeReason = 0;
 pthread_mutex_t close_mut;
 bool close_retry;
+int pongs = 0;
+noPollMsg pong;
 /*----------------------------------------------------------------------------*/
 /*                                   Mocks                                    */
 /*----------------------------------------------------------------------------*/
@@ -51,6 +53,11 @@ void set_global_reconnect_status(bool status)
     (void) status ;
 }
 
+void conn_machine_pong(void)
+{
+    pongs++;
+}
+
 const unsigned char *nopoll_msg_get_payload(noPollMsg *msg)
 {
     if( NULL != msg ) {
@@ -62,6 +69,10 @@ const unsigned char *nopoll_msg_get_payload(noPollMsg *msg)
 
 noPollOpCode nopoll_msg_opcode (noPollMsg * msg)
 {
+    if(&pong == msg)
+    {
+        return NOPOLL_PONG_FRAME;
+    }
     if(NULL != msg)
     {
         return NOPOLL_PING_FRAME;
@@ -177,6 +188,9 @@ void test_listenerOnPingMessage()
     listenerOnPingMessage(NULL, &c, &m, NULL);
 
     listenerOnPingMessage(NULL, NULL, NULL, NULL);
+
+    listenerOnPingMessage(NULL, &c, &pong, NULL);
+    CU_ASSERT_EQUAL(pongs, 1);
 }
 
 void add_suites( CU_pSuite *suite )
@@ -53,6 +53,10 @@ void set_global_reconnect_status(bool status)
     (void) status ;
 }
 
+void conn_machine_pong(void)
+{
+}
+
 nopoll_bool nopoll_msg_is_fragment(noPollMsg *msg)
 {
    (void)msg;
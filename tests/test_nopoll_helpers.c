@@ -76,6 +76,13 @@ int nopoll_conn_flush_writes(noPollConn * conn, long timeout, int previous_resul
     return (int)mock();
 }
 
+nopoll_bool nopoll_conn_send_ping( noPollConn *conn )
+{
+    function_called();
+    check_expected((intptr_t)conn);
+    return (nopoll_bool)mock();
+}
+
 noPollConn *get_global_conn()
 {
      return conn;   
@@ -323,6 +330,19 @@ void err_sendMessageConnNull()
     sendMessage(NULL, "Hello Parodus!", len);
 }
 
+void test_sendPing()
+{
+    expect_value(nopoll_conn_send_ping, (intptr_t)conn, (intptr_t)conn);
+    will_return(nopoll_conn_send_ping, nopoll_true);
+    expect_function_call(nopoll_conn_send_ping);
+    assert_true(sendPing(conn));
+
+    expect_value(nopoll_conn_send_ping, (intptr_t)conn, (intptr_t)conn);
+    will_return(nopoll_conn_send_ping, nopoll_false);
+    expect_function_call(nopoll_conn_send_ping);
+    assert_false(sendPing(conn));
+}
+
 void test_reportLog()
 {
     __report_log(NULL, NOPOLL_LEVEL_DEBUG, "Debug", NULL);
@@ -346,6 +366,7 @@ int main(void)
         cmocka_unit_test(connStuck_sendMessage),
         cmocka_unit_test(err_sendMessage),
         cmocka_unit_test(err_sendMessageConnNull),
+        cmocka_unit_test(test_sendPing),
         cmocka_unit_test(test_reportLog),
     };
 
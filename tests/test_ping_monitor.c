@@ -0,0 +1,156 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <unistd.h>
+
+#include "../src/ping_monitor.h"
+
+/*----------------------------------------------------------------------------*/
+/*                                   Helpers                                  */
+/*----------------------------------------------------------------------------*/
+static int ping_with_rtt (unsigned int rtt_ms)
+{
+    ping_monitor_sent ();
+    usleep (rtt_ms * 1000);
+    return ping_monitor_pong ();
+}
+
+/*----------------------------------------------------------------------------*/
+/*                                   Tests                                    */
+/*----------------------------------------------------------------------------*/
+void test_ping_off ()
+{
+    ping_monitor_start (0, 0);
+    assert_int_equal (ping_monitor_next_ms (), -1);
+    assert_false (ping_monitor_due ());
+    assert_false (ping_monitor_expired ());
+    assert_int_equal (ping_monitor_pong (), -1);
+}
+
+void test_ping_cadence ()
+{
+    int next;
+
+    ping_monitor_start (50, 0);
+    assert_false (ping_monitor_due ());
+    next = ping_monitor_next_ms ();
+    assert_true ((next > 0) && (next <= 50));
+    usleep (60000);
+    assert_true (ping_monitor_due ());
+    assert_int_equal (ping_monitor_next_ms (), 0);
+
+    // one ping in flight, waiting out the initial deadline
+    ping_monitor_sent ();
+    assert_false (ping_monitor_due ());
+    next = ping_monitor_next_ms ();
+    assert_true ((next > 50) && (next <= PING_WAIT_INITIAL_MS));
+    assert_true (ping_monitor_pong () >= 0);
+    // an unsolicited pong is ignored
+    assert_int_equal (ping_monitor_pong (), -1);
+}
+
+void test_ping_expired ()
+{
+    ping_stats_t stats;
+    int i;
+
+    // the ceiling caps the deadline below the minimum and the interval
+    ping_monitor_start (1000, 30);
+    for (i = 0; i < PING_MISS_LIMIT; i++) {
+        assert_false (ping_monitor_expired ());
+        ping_monitor_sent ();
+        assert_false (ping_monitor_expired ());
+        usleep (50000);
+    }
+    assert_true (ping_monitor_expired ());
+    ping_monitor_get_stats (&stats);
+    assert_int_equal (stats.sent, PING_MISS_LIMIT);
+    assert_int_equal (stats.pongs, 0);
+    assert_int_equal (stats.missed, PING_MISS_LIMIT);
+    assert_int_equal (stats.wait_ms, 30);
+    assert_int_equal (stats.p50_ms, 0);
+
+    // a new connection starts over
+    ping_monitor_start (1000, 30);
+    assert_false (ping_monitor_expired ());
+}
+
+void test_ping_late_pong ()
+{
+    ping_stats_t stats;
+    int i;
+
+    // one late pong is a miss, and still shows the connection is alive
+    ping_monitor_start (1000, 30);
+    ping_monitor_sent ();
+    usleep (50000);
+    assert_false (ping_monitor_expired ());
+    assert_int_equal (ping_monitor_pong (), -1);
+    for (i = 1; i < PING_MISS_LIMIT; i++) {
+        ping_monitor_sent ();
+        usleep (50000);
+        assert_false (ping_monitor_expired ());
+    }
+    ping_monitor_get_stats (&stats);
+    assert_int_equal (stats.missed, PING_MISS_LIMIT - 1);
+
+    // fast pongs leave the deadline at the interval
+    ping_monitor_start (5000, 60000);
+    assert_true (ping_with_rtt (2) >= 2);
+    ping_monitor_get_stats (&stats);
+    assert_int_equal (stats.wait_ms, 5000);
+}
+
+void test_ping_adaptive ()
+{
+    ping_stats_t stats;
+    int i;
+
+    ping_monitor_start (1000, 60000);
+    for (i = 0; i < 9; i++)
+        assert_true (ping_with_rtt (2) >= 2);
+    assert_true (ping_with_rtt (40) >= 40);
+    ping_monitor_get_stats (&stats);
+    assert_int_equal (stats.sent, 10);
+    assert_int_equal (stats.pongs, 10);
+    assert_true (stats.srtt_ms >= 2);
+    // fast, steady pongs keep the deadline at the floor
+    assert_int_equal (stats.wait_ms, PING_WAIT_MIN_MS);
+    assert_true (stats.p50_ms < 20);
+    assert_true (stats.p90_ms < 20);
+    assert_true (stats.p99_ms >= 40);
+    assert_true (stats.p50_ms <= stats.p90_ms);
+}
+
+/*----------------------------------------------------------------------------*/
+/*                             External Functions                             */
+/*----------------------------------------------------------------------------*/
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_ping_off),
+        cmocka_unit_test(test_ping_cadence),
+        cmocka_unit_test(test_ping_expired),
+        cmocka_unit_test(test_ping_late_pong),
+        cmocka_unit_test(test_ping_adaptive),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,126 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/server_pool.h"
+
+#define URL_A	"https://a.example.net:8080"
+#define URL_B	"https://b.example.net:8080"
+#define URL_C	"https://c.example.net:8080"
+
+/*----------------------------------------------------------------------------*/
+/*                                   Tests                                    */
+/*----------------------------------------------------------------------------*/
+void test_init ()
+{
+	assert_int_equal (server_pool_init (URL_A ", " URL_B "," URL_A "," URL_C), 3);
+	assert_int_equal (server_pool_count (), 3);
+	assert_string_equal (server_pool_url (0), URL_A);
+	assert_string_equal (server_pool_url (1), URL_B);
+	assert_string_equal (server_pool_url (2), URL_C);
+	assert_null (server_pool_url (3));
+	assert_null (server_pool_url (SERVER_POOL_NONE));
+
+	// a reload keeps the scores of urls still listed
+	server_pool_report_connect (1, 1, 80);
+	assert_int_equal (server_pool_init (URL_C "," URL_B), 2);
+	assert_string_equal (server_pool_url (1), URL_B);
+	assert_int_equal (server_pool_rtt (1), 80);
+	assert_int_equal (server_pool_rtt (0), 0);
+
+	server_pool_clear ();
+	assert_int_equal (server_pool_count (), 0);
+	assert_int_equal (server_pool_select (0, 0), SERVER_POOL_NONE);
+	assert_int_equal (server_pool_init (NULL), 0);
+}
+
+void test_select_by_rtt ()
+{
+	server_pool_init (URL_A "," URL_B "," URL_C);
+	// unmeasured endpoints go first, in pool order
+	assert_int_equal (server_pool_select (0, 1), 0);
+	server_pool_report_connect (0, 1, 300);
+	assert_int_equal (server_pool_select (0, 1), 1);
+	server_pool_report_connect (1, 1, 100);
+	server_pool_report_connect (2, 1, 200);
+	assert_int_equal (server_pool_select (0, 1), 1);
+	assert_int_equal (server_pool_select (1U << 1, 1), 2);
+	assert_int_equal (server_pool_select (7, 1), SERVER_POOL_NONE);
+	server_pool_clear ();
+}
+
+void test_rtt_smoothing ()
+{
+	server_pool_init (URL_A);
+	server_pool_report_rtt (0, 800);
+	assert_int_equal (server_pool_rtt (0), 800);
+	server_pool_report_rtt (0, 0);
+	assert_int_equal (server_pool_rtt (0), 700);
+	// one slow sample does not swamp the average
+	server_pool_report_rtt (0, 8700);
+	assert_int_equal (server_pool_rtt (0), 1700);
+	server_pool_report_rtt (5, 10);
+	assert_int_equal (server_pool_rtt (5), 0);
+	server_pool_clear ();
+}
+
+void test_failover ()
+{
+	server_pool_init (URL_A "," URL_B "," URL_C);
+	server_pool_report_connect (0, 1, 50);
+	server_pool_report_connect (1, 1, 100);
+	server_pool_report_connect (2, 1, 150);
+
+	// a failed endpoint cools down while the others are up
+	server_pool_report_connect (0, 0, 0);
+	assert_int_equal (server_pool_select (0, 1), 1);
+	assert_int_equal (server_pool_select (0, 0), 1);
+	server_pool_report_connect (1, 0, 0);
+	server_pool_report_connect (1, 0, 0);
+	assert_int_equal (server_pool_select (0, 1), 2);
+	server_pool_report_connect (2, 0, 0);
+	assert_int_equal (server_pool_select (0, 1), SERVER_POOL_NONE);
+	// with all down, the one back soonest
+	assert_int_equal (server_pool_select (0, 0), 0);
+	assert_int_equal (server_pool_select (1U << 0, 0), 2);
+
+	// a connect clears the cooldown
+	server_pool_report_connect (1, 1, 100);
+	assert_int_equal (server_pool_select (0, 1), 1);
+	server_pool_clear ();
+}
+
+/*----------------------------------------------------------------------------*/
+/*                             External Functions                             */
+/*----------------------------------------------------------------------------*/
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_init),
+        cmocka_unit_test(test_select_by_rtt),
+        cmocka_unit_test(test_rtt_smoothing),
+        cmocka_unit_test(test_failover),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -48,6 +48,33 @@ void *CRUDHandlerTask()
 {
 	return NULL;
 }
+
+void *CRUDRetrieveTask()
+{
+	return NULL;
+}
+
+void *CRUDNotifyTask()
+{
+	return NULL;
+}
+
+int crud_subscribe_request(wrp_msg_t *msg)
+{
+	(void)msg;
+	return 0;
+}
+
+int crud_unsubscribe_service(const char *service)
+{
+	(void)service;
+	return 0;
+}
+
+void crud_notify_change(const char *name, const char *value)
+{
+	(void)name; (void)value;
+}
 static void add_client()
 {
 	const wrp_msg_t reg = { .msg_type = WRP_MSG_TYPE__SVC_REGISTRATION,
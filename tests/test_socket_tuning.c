@@ -0,0 +1,206 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../src/socket_tuning.h"
+
+/*----------------------------------------------------------------------------*/
+/*                                   Helpers                                  */
+/*----------------------------------------------------------------------------*/
+static long now_ms (void)
+{
+    struct timespec ts;
+
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int get_option (int fd, int level, int name)
+{
+    int optval = -1;
+    socklen_t len = sizeof(optval);
+
+    assert_int_equal (getsockopt (fd, level, name, &optval, &len), 0);
+    return optval;
+}
+
+// a local server that accepts and never reads; the client is tuned
+static void open_pair (int *client, int *server, int *listener, int rcvbuf)
+{
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+
+    memset (&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+    *listener = socket (AF_INET, SOCK_STREAM, 0);
+    assert_true (*listener >= 0);
+    if (0 != rcvbuf)
+        setsockopt (*listener, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    assert_int_equal (bind (*listener, (struct sockaddr *) &addr, sizeof(addr)), 0);
+    assert_int_equal (getsockname (*listener, (struct sockaddr *) &addr, &len), 0);
+    assert_int_equal (listen (*listener, 1), 0);
+    *client = socket (AF_INET, SOCK_STREAM, 0);
+    assert_int_equal (connect (*client, (struct sockaddr *) &addr, sizeof(addr)), 0);
+    *server = accept (*listener, NULL, NULL);
+    assert_true (*server >= 0);
+}
+
+static void close_pair (int client, int server, int listener)
+{
+    close (client);
+    close (server);
+    close (listener);
+}
+
+/*----------------------------------------------------------------------------*/
+/*                                   Tests                                    */
+/*----------------------------------------------------------------------------*/
+void test_parse ()
+{
+    socket_tuning_t tuning;
+
+    assert_int_equal (socket_tuning_parse ("keepalive=30:10:3,user-timeout=60000,"
+        "sndbuf=65536,rcvbuf=131072,nodelay,notsent-lowat=16384", &tuning), 0);
+    assert_int_equal (tuning.keepalive_idle, 30);
+    assert_int_equal (tuning.keepalive_interval, 10);
+    assert_int_equal (tuning.keepalive_count, 3);
+    assert_int_equal (tuning.user_timeout_ms, 60000);
+    assert_int_equal (tuning.sndbuf, 65536);
+    assert_int_equal (tuning.rcvbuf, 131072);
+    assert_int_equal (tuning.nodelay, 1);
+    assert_int_equal (tuning.notsent_lowat, 16384);
+
+    assert_int_equal (socket_tuning_parse ("nodelay", &tuning), 0);
+    assert_int_equal (tuning.keepalive_idle, 0);
+    assert_int_equal (tuning.user_timeout_ms, 0);
+
+    assert_int_equal (socket_tuning_parse (NULL, &tuning), -1);
+    assert_int_equal (socket_tuning_parse ("keepalive=30:10", &tuning), -1);
+    assert_int_equal (socket_tuning_parse ("keepalive=0:10:3", &tuning), -1);
+    assert_int_equal (socket_tuning_parse ("keepalive=30:10:3x", &tuning), -1);
+    assert_int_equal (socket_tuning_parse ("user-timeout=-1", &tuning), -1);
+    assert_int_equal (socket_tuning_parse ("sndbuf=", &tuning), -1);
+    assert_int_equal (socket_tuning_parse ("rcvbuf=12k", &tuning), -1);
+    assert_int_equal (socket_tuning_parse ("nodelay=1", &tuning), -1);
+    assert_int_equal (socket_tuning_parse ("cork", &tuning), -1);
+}
+
+void test_apply ()
+{
+    int client, server, listener;
+
+    open_pair (&client, &server, &listener, 0);
+    // nothing is applied without a profile
+    assert_int_equal (socket_tuning_init (NULL), 0);
+    assert_int_equal (socket_tuning_apply (client), 0);
+    assert_int_equal (get_option (client, SOL_SOCKET, SO_KEEPALIVE), 0);
+    assert_int_equal (socket_tuning_init ("bogus"), -1);
+    assert_int_equal (socket_tuning_apply (client), 0);
+    assert_int_equal (get_option (client, IPPROTO_TCP, TCP_NODELAY), 0);
+
+    assert_int_equal (socket_tuning_init ("keepalive=30:10:3,user-timeout=60000,"
+        "sndbuf=65536,rcvbuf=131072,nodelay,notsent-lowat=16384"), 0);
+    assert_int_equal (socket_tuning_apply (client), 0);
+    assert_int_equal (get_option (client, SOL_SOCKET, SO_KEEPALIVE), 1);
+    assert_int_equal (get_option (client, IPPROTO_TCP, TCP_KEEPIDLE), 30);
+    assert_int_equal (get_option (client, IPPROTO_TCP, TCP_KEEPINTVL), 10);
+    assert_int_equal (get_option (client, IPPROTO_TCP, TCP_KEEPCNT), 3);
+    assert_int_equal (get_option (client, IPPROTO_TCP, TCP_USER_TIMEOUT), 60000);
+    assert_int_equal (get_option (client, IPPROTO_TCP, TCP_NODELAY), 1);
+    assert_int_equal (get_option (client, IPPROTO_TCP, TCP_NOTSENT_LOWAT), 16384);
+    // the kernel doubles the buffer sizes for its bookkeeping
+    assert_true (get_option (client, SOL_SOCKET, SO_SNDBUF) >= 65536);
+    assert_true (get_option (client, SOL_SOCKET, SO_RCVBUF) >= 131072);
+
+    // a closed socket counts every option as failed
+    close_pair (client, server, listener);
+    assert_int_equal (socket_tuning_apply (client), 9);
+    socket_tuning_init (NULL);
+}
+
+// a peer that stops taking data is dropped after user-timeout, instead of
+// the writes hanging for the kernel's ~15 minutes of retries
+void test_dead_peer_detection ()
+{
+    int client, server, listener;
+    struct pollfd pfd;
+    char buf[1024];
+    int err = 0;
+    socklen_t len = sizeof(err);
+    long idle_since, detected_ms;
+
+    open_pair (&client, &server, &listener, 4096);
+    assert_int_equal (socket_tuning_init ("user-timeout=1000,sndbuf=4096"), 0);
+    assert_int_equal (socket_tuning_apply (client), 0);
+
+    // fill both buffers until the writes stall
+    memset (buf, 0, sizeof(buf));
+    fcntl (client, F_SETFL, O_NONBLOCK);
+    idle_since = now_ms ();
+    while (now_ms () - idle_since < 200) {
+        if (write (client, buf, sizeof(buf)) > 0) {
+            idle_since = now_ms ();
+        } else {
+            assert_int_equal (errno, EAGAIN);
+            pfd.fd = client;
+            pfd.events = POLLOUT;
+            poll (&pfd, 1, 50);
+        }
+    }
+
+    pfd.fd = client;
+    pfd.events = 0;
+    assert_int_equal (poll (&pfd, 1, 10000), 1);
+    detected_ms = now_ms () - idle_since;
+    assert_true (pfd.revents & POLLERR);
+    assert_int_equal (getsockopt (client, SOL_SOCKET, SO_ERROR, &err, &len), 0);
+    assert_int_equal (err, ETIMEDOUT);
+    // user-timeout counts from the last progress, the probes add some slack
+    assert_true (detected_ms >= 500);
+    assert_true (detected_ms <= 3000);
+
+    close_pair (client, server, listener);
+    socket_tuning_init (NULL);
+}
+
+/*----------------------------------------------------------------------------*/
+/*                             External Functions                             */
+/*----------------------------------------------------------------------------*/
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_parse),
+        cmocka_unit_test(test_apply),
+        cmocka_unit_test(test_dead_peer_detection),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
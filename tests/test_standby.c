@@ -0,0 +1,190 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../src/standby.h"
+
+/*----------------------------------------------------------------------------*/
+/*                            File Scoped Variables                           */
+/*----------------------------------------------------------------------------*/
+static int conn_a, conn_b;
+static pthread_mutex_t gate_mut = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t gate_con = PTHREAD_COND_INITIALIZER;
+static int gate_open;
+static volatile int build_done;
+static volatile int released;
+static void *released_handle;
+
+/*----------------------------------------------------------------------------*/
+/*                                   Mocks                                    */
+/*----------------------------------------------------------------------------*/
+static void *build_now (void *arg)
+{
+    build_done = 1;
+    return arg;
+}
+
+static void *build_gated (void *arg)
+{
+    pthread_mutex_lock (&gate_mut);
+    while (!gate_open)
+        pthread_cond_wait (&gate_con, &gate_mut);
+    pthread_mutex_unlock (&gate_mut);
+    build_done = 1;
+    return arg;
+}
+
+static void release_conn (void *handle)
+{
+    released_handle = handle;
+    released++;
+}
+
+/*----------------------------------------------------------------------------*/
+/*                                   Helpers                                  */
+/*----------------------------------------------------------------------------*/
+static void reset (void)
+{
+    standby_discard (1);
+    gate_open = 0;
+    build_done = 0;
+    released = 0;
+    released_handle = NULL;
+}
+
+static void open_gate (void)
+{
+    pthread_mutex_lock (&gate_mut);
+    gate_open = 1;
+    pthread_cond_broadcast (&gate_con);
+    pthread_mutex_unlock (&gate_mut);
+}
+
+static int wait_state (int state)
+{
+    int i;
+
+    for (i = 0; (i < 200) && (standby_state () != state); i++)
+        usleep (5000);
+    return standby_state ();
+}
+
+/*----------------------------------------------------------------------------*/
+/*                                   Tests                                    */
+/*----------------------------------------------------------------------------*/
+void test_build_and_take ()
+{
+    int tag = -1;
+
+    reset ();
+    assert_null (standby_take (&tag));
+    assert_int_equal (standby_build (build_now, release_conn, &conn_a, 2), 0);
+    assert_int_equal (wait_state (STANDBY_READY), STANDBY_READY);
+    assert_ptr_equal (standby_peek (), &conn_a);
+    // only one standby at a time
+    assert_int_equal (standby_build (build_now, release_conn, &conn_b, 3), -1);
+    assert_ptr_equal (standby_take (&tag), &conn_a);
+    assert_int_equal (tag, 2);
+    assert_int_equal (standby_state (), STANDBY_EMPTY);
+    assert_null (standby_peek ());
+    assert_int_equal (released, 0);
+}
+
+void test_build_in_progress ()
+{
+    int tag;
+
+    reset ();
+    assert_int_equal (standby_build (build_gated, release_conn, &conn_a, 0), 0);
+    assert_int_equal (standby_state (), STANDBY_BUILDING);
+    assert_null (standby_peek ());
+    assert_null (standby_take (&tag));
+    assert_int_equal (standby_build (build_now, release_conn, &conn_b, 0), -1);
+    open_gate ();
+    assert_int_equal (wait_state (STANDBY_READY), STANDBY_READY);
+    assert_ptr_equal (standby_peek (), &conn_a);
+
+    standby_discard (1);
+    assert_int_equal (released, 1);
+    assert_ptr_equal (released_handle, &conn_a);
+    assert_int_equal (standby_state (), STANDBY_EMPTY);
+}
+
+void test_discard_while_building ()
+{
+    int i;
+
+    reset ();
+    assert_int_equal (standby_build (build_gated, release_conn, &conn_a, 0), 0);
+    standby_discard (1);
+    assert_int_equal (standby_state (), STANDBY_EMPTY);
+    // a new build may start while the dropped one is still running
+    assert_int_equal (standby_build (build_now, release_conn, &conn_b, 1), 0);
+    assert_int_equal (wait_state (STANDBY_READY), STANDBY_READY);
+    open_gate ();
+    for (i = 0; (i < 200) && (0 == released); i++)
+        usleep (5000);
+    assert_int_equal (released, 1);
+    assert_ptr_equal (released_handle, &conn_a);
+    assert_ptr_equal (standby_peek (), &conn_b);
+    reset ();
+}
+
+void test_build_failed ()
+{
+    int tag;
+
+    reset ();
+    assert_int_equal (standby_build (build_now, release_conn, NULL, 0), 0);
+    assert_int_equal (wait_state (STANDBY_EMPTY), STANDBY_EMPTY);
+    assert_true (build_done);
+    assert_null (standby_take (&tag));
+    // not retried until STANDBY_RETRY_MS have passed
+    assert_int_equal (standby_build (build_now, release_conn, &conn_a, 0), -1);
+    standby_discard (1);
+    assert_int_equal (standby_build (build_now, release_conn, &conn_a, 0), 0);
+    assert_int_equal (wait_state (STANDBY_READY), STANDBY_READY);
+
+    // a standby that closed waits out the interval too
+    standby_discard (0);
+    assert_int_equal (released, 1);
+    assert_int_equal (standby_build (build_now, release_conn, &conn_a, 0), -1);
+    reset ();
+}
+
+/*----------------------------------------------------------------------------*/
+/*                             External Functions                             */
+/*----------------------------------------------------------------------------*/
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_build_and_take),
+        cmocka_unit_test(test_build_in_progress),
+        cmocka_unit_test(test_discard_while_building),
+        cmocka_unit_test(test_build_failed),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
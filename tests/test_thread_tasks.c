@@ -17,6 +17,8 @@
 #include <errno.h>
 #include <pthread.h>
 #include <malloc.h>
+#include <time.h>
+#include <unistd.h>
 #include <stdarg.h>
 #include <stddef.h>
 #include <setjmp.h>
@@ -91,6 +93,63 @@ void err_messageHandlerTask()
     
     messageHandlerTask();
 }
+
+static unsigned int drained, drain_left;
+
+static void *drain_thread(void *arg)
+{
+    struct timespec deadline;
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += *(int *) arg;
+    drained = drain_downstream(&deadline, &drain_left);
+    return NULL;
+}
+
+void test_drain_downstream()
+{
+    pthread_t tid;
+    int timeout_s = 5;
+    ParodusMsg *second = (ParodusMsg *) malloc (sizeof(ParodusMsg));
+
+    ParodusMsgQ = (ParodusMsg *) malloc (sizeof(ParodusMsg));
+    ParodusMsgQ->payload = "First message";
+    ParodusMsgQ->len = 9;
+    ParodusMsgQ->next = second;
+    ParodusMsgQ->msg = NULL;
+    second->msg = NULL;
+    second->payload = "Second message";
+    second->len = 10;
+    second->next = NULL;
+
+    // the drain waits for both messages, then returns before its deadline
+    pthread_create(&tid, NULL, drain_thread, &timeout_s);
+    usleep(100000);
+    numLoops = 2;
+    expect_value(listenerOnMessage, (intptr_t)msg, (intptr_t)"First message");
+    expect_value(listenerOnMessage, msgSize, 9);
+    expect_function_call(listenerOnMessage);
+    expect_value(listenerOnMessage, (intptr_t)msg, (intptr_t)"Second message");
+    expect_value(listenerOnMessage, msgSize, 10);
+    expect_function_call(listenerOnMessage);
+    messageHandlerTask();
+    pthread_join(tid, NULL);
+    assert_int_equal(drained, 2);
+    assert_int_equal(drain_left, 0);
+
+    // nothing handled by the deadline
+    ParodusMsgQ = (ParodusMsg *) malloc (sizeof(ParodusMsg));
+    ParodusMsgQ->payload = "Third message";
+    ParodusMsgQ->len = 9;
+    ParodusMsgQ->next = NULL;
+    ParodusMsgQ->msg = NULL;
+    timeout_s = 0;
+    drain_thread(&timeout_s);
+    assert_int_equal(drained, 0);
+    assert_int_equal(drain_left, 1);
+    free(ParodusMsgQ);
+    ParodusMsgQ = NULL;
+}
 /*----------------------------------------------------------------------------*/
 /*                             External Functions                             */
 /*----------------------------------------------------------------------------*/
@@ -100,6 +159,7 @@ int main(void)
     const struct CMUnitTest tests[] = {
         cmocka_unit_test(test_messageHandlerTask),
         cmocka_unit_test(err_messageHandlerTask),
+        cmocka_unit_test(test_drain_downstream),
     };
 
     return cmocka_run_group_tests(tests, NULL, NULL);
@@ -0,0 +1,412 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+#include <openssl/evp.h>
+#include <openssl/ec.h>
+
+#include "../src/tls_session.h"
+
+/*----------------------------------------------------------------------------*/
+/*                            File Scoped Variables                           */
+/*----------------------------------------------------------------------------*/
+static noPollSslContextCreator creator = NULL;
+static SSL_CTX *server_ctx = NULL;
+static int listen_fd = -1;
+static int listen_port = 0;
+static char session_file[] = "/tmp/test_tls_sessionXXXXXX";
+
+#define BENCH_BYTES	(64 * 1024 * 1024)
+#define BENCH_FRAME	(16 * 1024)
+
+/*----------------------------------------------------------------------------*/
+/*                                   Mocks                                    */
+/*----------------------------------------------------------------------------*/
+void nopoll_ctx_set_ssl_context_creator (noPollCtx *ctx,
+	noPollSslContextCreator context_creator, noPollPtr user_data)
+{
+	(void) ctx; (void) user_data;
+	creator = context_creator;
+}
+
+/*----------------------------------------------------------------------------*/
+/*                              Stand-in server                               */
+/*----------------------------------------------------------------------------*/
+static X509 *make_cert (EVP_PKEY *key)
+{
+	X509 *cert = X509_new ();
+	X509_NAME *name;
+
+	X509_set_version (cert, 2);
+	ASN1_INTEGER_set (X509_get_serialNumber (cert), 1);
+	X509_gmtime_adj (X509_getm_notBefore (cert), 0);
+	X509_gmtime_adj (X509_getm_notAfter (cert), 3600);
+	X509_set_pubkey (cert, key);
+	name = X509_get_subject_name (cert);
+	X509_NAME_add_entry_by_txt (name, "CN", MBSTRING_ASC,
+		(const unsigned char *) "localhost", -1, -1, 0);
+	X509_set_issuer_name (cert, name);
+	X509_sign (cert, key, EVP_sha256 ());
+	return cert;
+}
+
+static EVP_PKEY *make_key (void)
+{
+	EVP_PKEY_CTX *pctx = EVP_PKEY_CTX_new_id (EVP_PKEY_EC, NULL);
+	EVP_PKEY *key = NULL;
+
+	EVP_PKEY_keygen_init (pctx);
+	EVP_PKEY_CTX_set_ec_paramgen_curve_nid (pctx, NID_X9_62_prime256v1);
+	EVP_PKEY_keygen (pctx, &key);
+	EVP_PKEY_CTX_free (pctx);
+	return key;
+}
+
+static int setup (void **state)
+{
+	struct sockaddr_in addr;
+	socklen_t len = sizeof(addr);
+	EVP_PKEY *key;
+	X509 *cert;
+	int fd;
+
+	(void) state;
+	key = make_key ();
+	cert = make_cert (key);
+	server_ctx = SSL_CTX_new (TLS_server_method ());
+	SSL_CTX_use_certificate (server_ctx, cert);
+	SSL_CTX_use_PrivateKey (server_ctx, key);
+	X509_free (cert);
+	EVP_PKEY_free (key);
+
+	listen_fd = socket (AF_INET, SOCK_STREAM, 0);
+	memset (&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+	bind (listen_fd, (struct sockaddr *) &addr, sizeof(addr));
+	listen (listen_fd, 8);
+	getsockname (listen_fd, (struct sockaddr *) &addr, &len);
+	listen_port = ntohs (addr.sin_port);
+
+	fd = mkstemp (session_file);
+	close (fd);
+	unlink (session_file);
+	return 0;
+}
+
+static int teardown (void **state)
+{
+	(void) state;
+	close (listen_fd);
+	SSL_CTX_free (server_ctx);
+	tls_session_clear ();
+	unlink (session_file);
+	return 0;
+}
+
+// serve one connection: handshake, one byte, close
+static void *serve_one (void *arg)
+{
+	SSL *ssl;
+	int fd;
+
+	(void) arg;
+	fd = accept (listen_fd, NULL, NULL);
+	ssl = SSL_new (server_ctx);
+	SSL_set_fd (ssl, fd);
+	if (SSL_accept (ssl) == 1) {
+		SSL_write (ssl, "x", 1);
+		SSL_shutdown (ssl);
+	}
+	SSL_free (ssl);
+	close (fd);
+	return NULL;
+}
+
+// serve one connection: handshake, read until the client closes
+static void *serve_drain (void *arg)
+{
+	long long *total = (long long *) arg;
+	char buf[BENCH_FRAME];
+	SSL *ssl;
+	int fd, n;
+
+	*total = 0;
+	fd = accept (listen_fd, NULL, NULL);
+	ssl = SSL_new (server_ctx);
+	SSL_set_fd (ssl, fd);
+	if (SSL_accept (ssl) == 1) {
+		while ((n = SSL_read (ssl, buf, sizeof(buf))) > 0)
+			*total += n;
+	}
+	SSL_free (ssl);
+	close (fd);
+	return NULL;
+}
+
+static int connect_local (void)
+{
+	struct sockaddr_in addr;
+	int fd;
+
+	fd = socket (AF_INET, SOCK_STREAM, 0);
+	memset (&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+	addr.sin_port = htons (listen_port);
+	assert_int_equal (connect (fd, (struct sockaddr *) &addr, sizeof(addr)), 0);
+	return fd;
+}
+
+static double elapsed_s (const struct timespec *start, const struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+// connect the way nopoll does: creator, SSL_new, SSL_connect
+static int connect_once (void)
+{
+	pthread_t server;
+	SSL_CTX *ctx;
+	SSL *ssl;
+	char buf[1];
+	int fd, ok;
+
+	pthread_create (&server, NULL, serve_one, NULL);
+	fd = connect_local ();
+
+	assert_non_null (creator);
+	ctx = (SSL_CTX *) creator (NULL, NULL, NULL, nopoll_true, NULL);
+	assert_non_null (ctx);
+	ssl = SSL_new (ctx);
+	SSL_set_fd (ssl, fd);
+	ok = (SSL_connect (ssl) == 1);
+	// tls 1.3 tickets arrive after the handshake
+	if (ok)
+		ok = (SSL_read (ssl, buf, 1) == 1);
+	SSL_shutdown (ssl);
+	SSL_free (ssl);
+	SSL_CTX_free (ctx);
+	close (fd);
+	pthread_join (server, NULL);
+	return ok;
+}
+
+/*----------------------------------------------------------------------------*/
+/*                                   Tests                                    */
+/*----------------------------------------------------------------------------*/
+static void check_resumption (int allow_tls13)
+{
+	tls_session_stats_t stats;
+
+	tls_session_clear ();
+	assert_int_equal (tls_session_init (NULL, NULL, allow_tls13), 0);
+	tls_session_set_server ("fabric.webpa.net", 443);
+
+	assert_true (connect_once ());
+	assert_true (connect_once ());
+	assert_true (connect_once ());
+	tls_session_get_stats (&stats);
+	assert_int_equal (stats.handshakes, 3);
+	assert_int_equal (stats.resumed, 2);
+	printf ("%s: %u of %u resumed, %llu ms in handshakes\n",
+		allow_tls13 ? "TLS 1.3" : "TLS 1.2", stats.resumed, stats.handshakes,
+		stats.total_ms);
+}
+
+void test_tls12_resumption ()
+{
+	check_resumption (0);
+}
+
+void test_tls13_resumption ()
+{
+	check_resumption (1);
+}
+
+void test_other_server ()
+{
+	tls_session_stats_t stats;
+
+	tls_session_clear ();
+	assert_int_equal (tls_session_init (NULL, NULL, 0), 0);
+	tls_session_set_server ("fabric.webpa.net", 443);
+	assert_true (connect_once ());
+	tls_session_set_server ("fabric.webpa.net", 8080);
+	assert_true (connect_once ());
+	tls_session_get_stats (&stats);
+	assert_int_equal (stats.handshakes, 2);
+	assert_int_equal (stats.resumed, 0);
+
+	// no server named, nothing to resume or keep
+	tls_session_clear ();
+	tls_session_set_server (NULL, 0);
+	assert_int_equal (tls_session_init (NULL, NULL, 0), 0);
+	assert_true (connect_once ());
+	assert_true (connect_once ());
+	tls_session_get_stats (&stats);
+	assert_int_equal (stats.handshakes, 2);
+	assert_int_equal (stats.resumed, 0);
+}
+
+void test_persisted_sessions ()
+{
+	tls_session_stats_t stats;
+	struct stat st;
+
+	tls_session_clear ();
+	assert_int_equal (tls_session_init (NULL, session_file, 0), 0);
+	tls_session_set_server ("fabric.webpa.net", 443);
+	assert_true (connect_once ());
+	assert_int_equal (stat (session_file, &st), 0);
+	assert_int_equal (st.st_mode & 0777, 0600);
+
+	// as after a restart
+	tls_session_clear ();
+	assert_int_equal (tls_session_init (NULL, session_file, 0), 0);
+	assert_true (connect_once ());
+	tls_session_get_stats (&stats);
+	assert_int_equal (stats.handshakes, 1);
+	assert_int_equal (stats.resumed, 1);
+}
+
+void test_ktls ()
+{
+	tls_session_stats_t stats;
+
+	tls_session_clear ();
+	assert_int_equal (tls_session_ktls (NULL, 0), 0);
+	// sessions are not kept without tls_session_init
+	tls_session_set_server ("fabric.webpa.net", 443);
+	assert_true (connect_once ());
+	assert_true (connect_once ());
+	tls_session_get_stats (&stats);
+	assert_int_equal (stats.handshakes, 2);
+	assert_int_equal (stats.resumed, 0);
+	assert_true (stats.ktls_tx <= 2);
+	assert_true (stats.ktls_rx <= 2);
+
+	// both at once
+	tls_session_clear ();
+	assert_int_equal (tls_session_init (NULL, NULL, 0), 0);
+	assert_int_equal (tls_session_ktls (NULL, 0), 0);
+	assert_true (connect_once ());
+	assert_true (connect_once ());
+	tls_session_get_stats (&stats);
+	assert_int_equal (stats.handshakes, 2);
+	assert_int_equal (stats.resumed, 1);
+	print_message ("kTLS: %u of %u handshakes sent in the kernel, %u received\n",
+		stats.ktls_tx, stats.handshakes, stats.ktls_rx);
+}
+
+// sends BENCH_BYTES in websocket sized writes, returns MB/s and cpu
+static void bench_send (int ktls, double *mb_s, double *cpu_s, int *in_kernel)
+{
+	struct timespec start, end, cpu_start, cpu_end;
+	tls_session_stats_t stats;
+	pthread_t server;
+	long long received, sent = 0;
+	SSL_CTX *ctx;
+	SSL *ssl;
+	char *frame;
+	int fd, n;
+
+	tls_session_clear ();
+	if (ktls)
+		assert_int_equal (tls_session_ktls (NULL, 0), 0);
+	else
+		assert_int_equal (tls_session_init (NULL, NULL, 0), 0);
+	frame = (char *) malloc (BENCH_FRAME);
+	assert_non_null (frame);
+	memset (frame, 'x', BENCH_FRAME);
+
+	pthread_create (&server, NULL, serve_drain, &received);
+	fd = connect_local ();
+	ctx = (SSL_CTX *) creator (NULL, NULL, NULL, nopoll_true, NULL);
+	assert_non_null (ctx);
+	ssl = SSL_new (ctx);
+	SSL_set_fd (ssl, fd);
+	assert_int_equal (SSL_connect (ssl), 1);
+
+	clock_gettime (CLOCK_MONOTONIC, &start);
+	clock_gettime (CLOCK_THREAD_CPUTIME_ID, &cpu_start);
+	while (sent < BENCH_BYTES) {
+		n = SSL_write (ssl, frame, BENCH_FRAME);
+		assert_true (n > 0);
+		sent += n;
+	}
+	clock_gettime (CLOCK_THREAD_CPUTIME_ID, &cpu_end);
+	SSL_shutdown (ssl);
+	SSL_free (ssl);
+	SSL_CTX_free (ctx);
+	close (fd);
+	pthread_join (server, NULL);
+	clock_gettime (CLOCK_MONOTONIC, &end);
+	free (frame);
+
+	assert_int_equal (received, sent);
+	tls_session_get_stats (&stats);
+	*mb_s = sent / (1024.0 * 1024.0) / elapsed_s (&start, &end);
+	*cpu_s = elapsed_s (&cpu_start, &cpu_end);
+	*in_kernel = (stats.ktls_tx > 0);
+}
+
+/* Not a pass/fail test, prints the sending throughput and the cpu the
+   sending thread spends, with openssl encrypting and with kTLS */
+void bench_ktls ()
+{
+	double mb_s, cpu_s, ktls_mb_s, ktls_cpu_s;
+	int in_kernel;
+
+	bench_send (0, &mb_s, &cpu_s, &in_kernel);
+	bench_send (1, &ktls_mb_s, &ktls_cpu_s, &in_kernel);
+	print_message ("openssl: %.0f MB/s, %.3f s cpu; kTLS%s: %.0f MB/s, %.3f s cpu\n",
+		mb_s, cpu_s, in_kernel ? "" : " (not available, still openssl)",
+		ktls_mb_s, ktls_cpu_s);
+	tls_session_clear ();
+}
+
+/*----------------------------------------------------------------------------*/
+/*                             External Functions                             */
+/*----------------------------------------------------------------------------*/
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_tls12_resumption),
+        cmocka_unit_test(test_tls13_resumption),
+        cmocka_unit_test(test_other_server),
+        cmocka_unit_test(test_persisted_sessions),
+        cmocka_unit_test(test_ktls),
+        cmocka_unit_test(bench_ktls),
+    };
+
+    return cmocka_run_group_tests(tests, setup, teardown);
+}
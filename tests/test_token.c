@@ -169,6 +169,33 @@ void *CRUDHandlerTask()
 	return NULL;
 }
 
+void *CRUDRetrieveTask()
+{
+	return NULL;
+}
+
+void *CRUDNotifyTask()
+{
+	return NULL;
+}
+
+int crud_subscribe_request(wrp_msg_t *msg)
+{
+	(void)msg;
+	return 0;
+}
+
+int crud_unsubscribe_service(const char *service)
+{
+	(void)service;
+	return 0;
+}
+
+void crud_notify_change(const char *name, const char *value)
+{
+	(void)name; (void)value;
+}
+
 int setup_test_jwts (void)
 {
 	memset (&jwt1, 0, sizeof(cjwt_t));
@@ -668,6 +695,118 @@ void test_allow_insecure_conn ()
 
 }
 
+void test_jwt_prefetch ()
+{
+	int insecure;
+	char *server_addr = NULL;
+	unsigned int port = 0;
+	ParodusCfg *cfg = get_parodus_cfg();
+
+	parStrncpy (cfg->hw_mac, "aabbccddeeff", sizeof(cfg->hw_mac));
+	parStrncpy (cfg->dns_txt_url, "test.mydns.mycom.net", sizeof(cfg->dns_txt_url));
+	cfg->jwt_algo = 1025;
+	read_key_from_file ("../../tests/pubkey4.pem", cfg->jwt_key, 4096);
+
+	// the refresher queries once
+	will_return (__res_ninit, 0);
+	expect_function_call (__res_ninit);
+	expect_function_call (__res_nclose);
+
+	numLoops = 1;
+	JWTRefreshTask ();
+
+	// reconnects use its result without querying
+	insecure = allow_insecure_conn (&server_addr, &port);
+	assert_int_equal (insecure, 0);
+	assert_string_equal (server_addr, "mydns.mycom.net");
+	assert_int_equal ((int) port, 8080);
+	free (server_addr);
+
+	insecure = allow_insecure_conn (&server_addr, &port);
+	assert_int_equal (insecure, 0);
+	free (server_addr);
+
+	// failures are kept too, until the refresher retries
+	parStrncpy (cfg->dns_txt_url, "err5.mydns.mycom.net", sizeof(cfg->dns_txt_url));
+	will_return (__res_ninit, 0);
+	expect_function_call (__res_ninit);
+	expect_function_call (__res_nclose);
+
+	numLoops = 1;
+	JWTRefreshTask ();
+
+	insecure = allow_insecure_conn (&server_addr, &port);
+	assert_int_equal (insecure, TOKEN_ERR_QUERY_DNS_FAIL);
+	assert_ptr_equal (server_addr, NULL);
+
+	// without the refresher every call queries
+	jwt_prefetch_reset ();
+	parStrncpy (cfg->dns_txt_url, "test.mydns.mycom.net", sizeof(cfg->dns_txt_url));
+	will_return (__res_ninit, 0);
+	expect_function_call (__res_ninit);
+	expect_function_call (__res_nclose);
+
+	insecure = allow_insecure_conn (&server_addr, &port);
+	assert_int_equal (insecure, 0);
+	free (server_addr);
+}
+
+void test_jwt_verified ()
+{
+	int insecure;
+	char *server_addr = NULL;
+	unsigned int port = 0;
+	ParodusCfg *cfg = get_parodus_cfg();
+
+	jwt_prefetch_reset ();
+	jwt_verified_reset ();
+	parStrncpy (cfg->hw_mac, "aabbccddeeff", sizeof(cfg->hw_mac));
+	parStrncpy (cfg->dns_txt_url, "test.mydns.mycom.net", sizeof(cfg->dns_txt_url));
+	cfg->jwt_algo = 1025;
+	read_key_from_file ("../../tests/pubkey4.pem", cfg->jwt_key, 4096);
+
+	will_return (__res_ninit, 0);
+	expect_function_call (__res_ninit);
+	expect_function_call (__res_nclose);
+	insecure = allow_insecure_conn (&server_addr, &port);
+	assert_int_equal (insecure, 0);
+	assert_int_equal (jwt_verified_hits (), 0);
+	free (server_addr);
+
+	// the same token is not verified again, its claims are used
+	will_return (__res_ninit, 0);
+	expect_function_call (__res_ninit);
+	expect_function_call (__res_nclose);
+	insecure = allow_insecure_conn (&server_addr, &port);
+	assert_int_equal (insecure, 0);
+	assert_int_equal (jwt_verified_hits (), 1);
+	assert_string_equal (server_addr, "mydns.mycom.net");
+	assert_int_equal ((int) port, 8080);
+	free (server_addr);
+
+	// under another key it is
+	parStrncpy (cfg->jwt_key, "xxxxxxxxxx", sizeof(cfg->jwt_key));
+	will_return (__res_ninit, 0);
+	expect_function_call (__res_ninit);
+	expect_function_call (__res_nclose);
+	insecure = allow_insecure_conn (&server_addr, &port);
+	assert_int_equal (insecure, TOKEN_ERR_JWT_DECODE_FAIL);
+	assert_int_equal (jwt_verified_hits (), 1);
+
+	// the allowed algorithms still apply to a verified token
+	read_key_from_file ("../../tests/pubkey4.pem", cfg->jwt_key, 4096);
+	cfg->jwt_algo = 4097;
+	will_return (__res_ninit, 0);
+	expect_function_call (__res_ninit);
+	expect_function_call (__res_nclose);
+	insecure = allow_insecure_conn (&server_addr, &port);
+	assert_int_equal (insecure, TOKEN_ERR_ALGO_NOT_ALLOWED);
+	assert_int_equal (jwt_verified_hits (), 2);
+
+	jwt_verified_reset ();
+	assert_int_equal (jwt_verified_hits (), 0);
+}
+
 void test_get_tok()
 {
 	const char *str0 = "";
@@ -720,6 +859,8 @@ int main(void)
 	cmocka_unit_test(test_assemble_jwt_from_dns),
         cmocka_unit_test(test_query_dns),
         cmocka_unit_test(test_allow_insecure_conn),
+        cmocka_unit_test(test_jwt_prefetch),
+        cmocka_unit_test(test_jwt_verified),
         cmocka_unit_test(test_get_tok),
         cmocka_unit_test(test_get_algo_mask),
     };
@@ -0,0 +1,289 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../src/uplink_shards.h"
+
+/*----------------------------------------------------------------------------*/
+/*                            File Scoped Variables                           */
+/*----------------------------------------------------------------------------*/
+static int conn_a;
+static pthread_mutex_t gate_mut = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t gate_con = PTHREAD_COND_INITIALIZER;
+static int gate_closed;
+static volatile int in_send;
+static volatile int sent;
+static volatile int fallen_back;
+static volatile int released;
+static volatile int queued_late;
+
+/*----------------------------------------------------------------------------*/
+/*                                   Mocks                                    */
+/*----------------------------------------------------------------------------*/
+static void *build_conn (void *arg)
+{
+    return arg;
+}
+
+static void release_conn (void *handle)
+{
+    (void) handle;
+    released++;
+}
+
+static int send_msg (void *handle, void *msg, size_t len)
+{
+    (void) msg; (void) len;
+    assert_ptr_equal (handle, &conn_a);
+    in_send = 1;
+    pthread_mutex_lock (&gate_mut);
+    while (gate_closed)
+        pthread_cond_wait (&gate_con, &gate_mut);
+    pthread_mutex_unlock (&gate_mut);
+    sent++;
+    return 0;
+}
+
+static void send_fallback (void *msg, size_t len)
+{
+    (void) msg; (void) len;
+    fallen_back++;
+}
+
+/*----------------------------------------------------------------------------*/
+/*                                   Helpers                                  */
+/*----------------------------------------------------------------------------*/
+static void start (unsigned int count)
+{
+    gate_closed = 0;
+    in_send = sent = fallen_back = released = 0;
+    assert_int_equal (uplink_shards_init (count, build_conn, release_conn,
+        send_msg, send_fallback), 0);
+}
+
+static void connect_shard (unsigned int index)
+{
+    int i;
+
+    assert_int_equal (uplink_shard_connect (index, &conn_a), 0);
+    for (i = 0; (i < 200) && (NULL == uplink_shard_handle (index)); i++)
+        usleep (5000);
+    assert_ptr_equal (uplink_shard_handle (index), &conn_a);
+}
+
+static int send_copy (unsigned int index)
+{
+    char *msg = strdup ("upstream");
+    int rtn = uplink_shard_send (index, msg, strlen (msg));
+
+    if (0 != rtn)
+        free (msg);
+    return rtn;
+}
+
+static void wait_for (volatile int *count, int n)
+{
+    int i;
+
+    for (i = 0; (i < 200) && (*count < n); i++)
+        usleep (5000);
+}
+
+static void *down_shard (void *arg)
+{
+    (void) arg;
+    uplink_shard_down (1, 1);
+    return NULL;
+}
+
+static void *send_late (void *arg)
+{
+    (void) arg;
+    assert_int_equal (send_copy (1), 0);
+    queued_late = 1;
+    return NULL;
+}
+
+/*----------------------------------------------------------------------------*/
+/*                                   Tests                                    */
+/*----------------------------------------------------------------------------*/
+void test_shard_for ()
+{
+    unsigned int seen = 0, index;
+    char service[16];
+    int i;
+
+    // off until there are two shards
+    assert_int_equal (uplink_shards_init (1, build_conn, release_conn,
+        send_msg, send_fallback), 0);
+    assert_int_equal (uplink_shards_count (), 0);
+    assert_int_equal (uplink_shard_for ("config", 6), 0);
+
+    start (4);
+    assert_int_equal (uplink_shards_count (), 4);
+    for (i = 0; i < 32; i++) {
+        sprintf (service, "service%d", i);
+        index = uplink_shard_for (service, strlen (service));
+        assert_true (index < 4);
+        assert_int_equal (uplink_shard_for (service, strlen (service)), index);
+        seen |= 1U << index;
+    }
+    assert_int_equal (seen, 0xf);
+    assert_int_equal (uplink_shard_for (NULL, 0), 0);
+    uplink_shards_shutdown ();
+    assert_int_equal (uplink_shards_count (), 0);
+}
+
+void test_shard_send ()
+{
+    uplink_shard_stats_t stats;
+
+    start (3);
+    // the primary and shards that do not exist are left to the caller
+    assert_int_equal (send_copy (0), -1);
+    assert_int_equal (send_copy (3), -1);
+    // a shard that is down still queues, its writer sends on the primary
+    assert_int_equal (send_copy (1), 0);
+    wait_for (&fallen_back, 1);
+    assert_int_equal (fallen_back, 1);
+
+    connect_shard (1);
+    assert_int_equal (uplink_shard_connect (1, &conn_a), -1);
+    assert_int_equal (send_copy (1), 0);
+    assert_int_equal (send_copy (1), 0);
+    wait_for (&sent, 2);
+    uplink_shard_get_stats (1, &stats);
+    assert_int_equal (stats.sent, 2);
+    assert_int_equal (stats.fallback, 1);
+    assert_int_equal (stats.connects, 1);
+    assert_int_equal (send_copy (2), 0);
+    wait_for (&fallen_back, 2);
+    assert_int_equal (fallen_back, 2);
+
+    // a dropped shard is rebuilt after the retry interval
+    uplink_shard_down (1, 0);
+    assert_int_equal (released, 1);
+    assert_null (uplink_shard_handle (1));
+    assert_int_equal (send_copy (1), 0);
+    wait_for (&fallen_back, 3);
+    assert_int_equal (fallen_back, 3);
+    assert_int_equal (uplink_shard_connect (1, &conn_a), -1);
+    uplink_shard_get_stats (1, &stats);
+    assert_int_equal (stats.drops, 1);
+    uplink_shards_shutdown ();
+}
+
+void test_shard_down_falls_back ()
+{
+    uplink_shard_stats_t stats;
+    pthread_t thread;
+
+    start (2);
+    connect_shard (1);
+    gate_closed = 1;
+    assert_int_equal (send_copy (1), 0);
+    wait_for (&in_send, 1);
+    assert_int_equal (send_copy (1), 0);
+
+    // the write in progress finishes, what is still queued goes to the primary
+    pthread_create (&thread, NULL, down_shard, NULL);
+    usleep (20000);
+    pthread_mutex_lock (&gate_mut);
+    gate_closed = 0;
+    pthread_cond_broadcast (&gate_con);
+    pthread_mutex_unlock (&gate_mut);
+    pthread_join (thread, NULL);
+    wait_for (&fallen_back, 1);
+    assert_int_equal (sent, 1);
+    assert_int_equal (fallen_back, 1);
+    uplink_shard_get_stats (1, &stats);
+    assert_int_equal (stats.fallback, 1);
+    assert_int_equal (released, 1);
+
+    connect_shard (1);
+    uplink_shards_shutdown ();
+    assert_int_equal (released, 2);
+}
+
+void test_shard_full_waits ()
+{
+    pthread_t thread;
+    int i;
+
+    start (2);
+    connect_shard (1);
+    gate_closed = 1;
+    queued_late = 0;
+    assert_int_equal (send_copy (1), 0);
+    wait_for (&in_send, 1);
+    for (i = 0; i < UPLINK_SHARD_QUEUE_MAX; i++)
+        assert_int_equal (send_copy (1), 0);
+
+    // a full queue holds the sender, it does not go around it
+    pthread_create (&thread, NULL, send_late, NULL);
+    usleep (20000);
+    assert_int_equal (queued_late, 0);
+    assert_int_equal (fallen_back, 0);
+    pthread_mutex_lock (&gate_mut);
+    gate_closed = 0;
+    pthread_cond_broadcast (&gate_con);
+    pthread_mutex_unlock (&gate_mut);
+    pthread_join (thread, NULL);
+    assert_int_equal (queued_late, 1);
+    wait_for (&sent, UPLINK_SHARD_QUEUE_MAX + 2);
+    assert_int_equal (sent, UPLINK_SHARD_QUEUE_MAX + 2);
+    uplink_shards_shutdown ();
+}
+
+void test_shard_build_failed ()
+{
+    int i;
+
+    start (2);
+    assert_int_equal (uplink_shard_connect (1, NULL), 0);
+    for (i = 0; i < 50; i++)
+        usleep (2000);
+    assert_null (uplink_shard_handle (1));
+    assert_int_equal (uplink_shard_connect (1, &conn_a), -1);
+    uplink_shard_down (1, 1);
+    connect_shard (1);
+    uplink_shards_shutdown ();
+}
+
+/*----------------------------------------------------------------------------*/
+/*                             External Functions                             */
+/*----------------------------------------------------------------------------*/
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_shard_for),
+        cmocka_unit_test(test_shard_send),
+        cmocka_unit_test(test_shard_down_falls_back),
+        cmocka_unit_test(test_shard_full_waits),
+        cmocka_unit_test(test_shard_build_failed),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -19,6 +19,8 @@
 #include <malloc.h>
 #include <stdarg.h>
 #include <stddef.h>
+#include <time.h>
+#include <unistd.h>
 #include <setjmp.h>
 #include <cmocka.h>
 
@@ -32,6 +34,7 @@
 #include "../src/ParodusInternal.h"
 #include "../src/partners_check.h"
 #include "../src/close_retry.h"
+#include "../src/uplink_shards.h"
 
 /*----------------------------------------------------------------------------*/
 /*                            File Scoped Variables                           */
@@ -46,6 +49,11 @@ wrp_msg_t *temp = NULL;
 extern pthread_mutex_t nano_mut;
 extern pthread_cond_t nano_con;
 static int crud_test = 0;
+static unsigned int shard_count = 0;
+static char shard_service[32];
+static int drain_on_append = 0;
+static pthread_t drain_thread;
+static unsigned int drain_done, drain_left;
 /*----------------------------------------------------------------------------*/
 /*                                   Mocks                                    */
 /*----------------------------------------------------------------------------*/
@@ -79,6 +87,22 @@ void addCRUDmsgToQueue(wrp_msg_t *crudMsg)
 	return;
 }
 
+size_t get_cloud_status_payload(char *buf, size_t buflen)
+{
+	const char *payload = "{\"cloud-status\":\"online\"}";
+	UNUSED(buflen);
+	function_called();
+	memcpy(buf, payload, strlen(payload));
+	return strlen(payload);
+}
+
+int crud_subscribe_request(wrp_msg_t *msg)
+{
+	(void)msg;
+	function_called();
+	return (int)mock();
+}
+
 int sendMsgtoRegisteredClients(char *dest,const char **Msg,size_t msgSize)
 {
 	UNUSED(dest); UNUSED(Msg); UNUSED(msgSize);
@@ -92,6 +116,32 @@ void sendMessage(noPollConn *conn, void *msg, size_t len)
     function_called();
 }
 
+unsigned int uplink_shards_count(void)
+{
+    return shard_count;
+}
+
+unsigned int uplink_shard_for(const char *service, size_t len)
+{
+    parStrncpy(shard_service, service, (len < sizeof(shard_service)) ? len + 1 : sizeof(shard_service));
+    return 1;
+}
+
+int uplink_shard_send(unsigned int index, void *msg, size_t len)
+{
+    int rtn;
+
+    UNUSED(len);
+    assert_int_equal(index, 1);
+    function_called();
+    rtn = (int)mock();
+    if(0 == rtn)
+    {
+        free(msg);
+    }
+    return rtn;
+}
+
 ParodusCfg *get_parodus_cfg(void) 
 {
     return &parodusCfg;
@@ -105,10 +155,28 @@ ssize_t wrp_pack_metadata( const data_t *packData, void **data )
     return (ssize_t)mock();
 }
 
+static void *drain_task(void *arg)
+{
+    struct timespec deadline;
+
+    UNUSED(arg);
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += 5;
+    drain_done = drain_upstream(&deadline, &drain_left);
+    return NULL;
+}
+
 size_t appendEncodedData( void **appendData, void *encodedBuffer, size_t encodedSize, void *metadataPack, size_t metadataSize )
 {
     (void) encodedBuffer; (void) encodedSize; (void) metadataPack; (void) metadataSize;
     function_called();
+    if(drain_on_append)
+    {
+        // a drain starts while the consumer has the message in hand
+        drain_on_append = 0;
+        pthread_create(&drain_thread, NULL, drain_task, NULL);
+        usleep(100000);
+    }
     char *data = (char *) malloc (sizeof(char) * 100);
     parStrncpy(data, "AAAAAAAAYYYYIGkYTUYFJH", 100);
     *appendData = data;
@@ -245,16 +313,20 @@ void test_handleUpstreamNull()
     expect_function_call(nn_bind);
     will_return(nn_recv, 12);
     expect_function_call(nn_recv);
+    // classified before it is queued
+    temp = NULL;
+    will_return(wrp_to_struct, -1);
+    expect_function_call(wrp_to_struct);
     handle_upstream();
 }
 
 void test_handle_upstream()
 {
     numLoops = 1;
-    UpStreamMsgQ = (UpStreamMsg *) malloc(sizeof(UpStreamMsg));
+    UpStreamMsgQ = (UpStreamMsg *) calloc(1, sizeof(UpStreamMsg));
     UpStreamMsgQ->msg = "First Message";
     UpStreamMsgQ->len = 13;
-    UpStreamMsgQ->next = (UpStreamMsg *) malloc(sizeof(UpStreamMsg));
+    UpStreamMsgQ->next = (UpStreamMsg *) calloc(1, sizeof(UpStreamMsg));
     UpStreamMsgQ->next->msg = "Second Message";
     UpStreamMsgQ->next->len = 15;
     UpStreamMsgQ->next->next = NULL;
@@ -264,6 +336,10 @@ void test_handle_upstream()
     expect_function_call(nn_bind);
     will_return(nn_recv, 12);
     expect_function_call(nn_recv);
+    // classified before it is queued
+    temp = NULL;
+    will_return(wrp_to_struct, -1);
+    expect_function_call(wrp_to_struct);
     handle_upstream();
     free(UpStreamMsgQ->next);
     free(UpStreamMsgQ);
@@ -289,10 +365,10 @@ void test_processUpstreamMessage()
 {
     numLoops = 1;
     metaPackSize = 20;
-    UpStreamMsgQ = (UpStreamMsg *) malloc(sizeof(UpStreamMsg));
+    UpStreamMsgQ = (UpStreamMsg *) calloc(1, sizeof(UpStreamMsg));
     UpStreamMsgQ->msg = "First Message";
     UpStreamMsgQ->len = 13;
-    UpStreamMsgQ->next = (UpStreamMsg *) malloc(sizeof(UpStreamMsg));
+    UpStreamMsgQ->next = (UpStreamMsg *) calloc(1, sizeof(UpStreamMsg));
     UpStreamMsgQ->next->msg = "Second Message";
     UpStreamMsgQ->next->len = 15;
     UpStreamMsgQ->next->next = NULL;
@@ -325,10 +401,10 @@ void test_processUpstreamReqMessage()
 {
     numLoops = 1;
     metaPackSize = 20;
-    UpStreamMsgQ = (UpStreamMsg *) malloc(sizeof(UpStreamMsg));
+    UpStreamMsgQ = (UpStreamMsg *) calloc(1, sizeof(UpStreamMsg));
     UpStreamMsgQ->msg = "First Message";
     UpStreamMsgQ->len = 13;
-    UpStreamMsgQ->next = (UpStreamMsg *) malloc(sizeof(UpStreamMsg));
+    UpStreamMsgQ->next = (UpStreamMsg *) calloc(1, sizeof(UpStreamMsg));
     UpStreamMsgQ->next->msg = "Second Message";
     UpStreamMsgQ->next->len = 15;
     UpStreamMsgQ->next->next = NULL;
@@ -358,10 +434,10 @@ void test_processUpstreamMessageInvalidPartner()
 {
     numLoops = 1;
     metaPackSize = 20;
-    UpStreamMsgQ = (UpStreamMsg *) malloc(sizeof(UpStreamMsg));
+    UpStreamMsgQ = (UpStreamMsg *) calloc(1, sizeof(UpStreamMsg));
     UpStreamMsgQ->msg = "First Message";
     UpStreamMsgQ->len = 13;
-    UpStreamMsgQ->next = (UpStreamMsg *) malloc(sizeof(UpStreamMsg));
+    UpStreamMsgQ->next = (UpStreamMsg *) calloc(1, sizeof(UpStreamMsg));
     UpStreamMsgQ->next->msg = "Second Message";
     UpStreamMsgQ->next->len = 15;
     UpStreamMsgQ->next->next = NULL;
@@ -392,10 +468,10 @@ void test_processUpstreamMessageInvalidPartner()
 void test_processUpstreamMessageRegMsg()
 {
     numLoops = 1;
-    UpStreamMsgQ = (UpStreamMsg *) malloc(sizeof(UpStreamMsg));
+    UpStreamMsgQ = (UpStreamMsg *) calloc(1, sizeof(UpStreamMsg));
     UpStreamMsgQ->msg = "First Message";
     UpStreamMsgQ->len = 13;
-    UpStreamMsgQ->next = (UpStreamMsg *) malloc(sizeof(UpStreamMsg));
+    UpStreamMsgQ->next = (UpStreamMsg *) calloc(1, sizeof(UpStreamMsg));
     UpStreamMsgQ->next->msg = "Second Message";
     UpStreamMsgQ->next->len = 15;
     UpStreamMsgQ->next->next = NULL;
@@ -451,10 +527,10 @@ void test_processUpstreamMessageRegMsg()
 void test_processUpstreamMessageRegMsgNoClients()
 {
     numLoops = 1;
-    UpStreamMsgQ = (UpStreamMsg *) malloc(sizeof(UpStreamMsg));
+    UpStreamMsgQ = (UpStreamMsg *) calloc(1, sizeof(UpStreamMsg));
     UpStreamMsgQ->msg = "First Message";
     UpStreamMsgQ->len = 13;
-    UpStreamMsgQ->next = (UpStreamMsg *) malloc(sizeof(UpStreamMsg));
+    UpStreamMsgQ->next = (UpStreamMsg *) calloc(1, sizeof(UpStreamMsg));
     UpStreamMsgQ->next->msg = "Second Message";
     UpStreamMsgQ->next->len = 15;
     UpStreamMsgQ->next->next = NULL;
@@ -501,7 +577,7 @@ void err_processUpstreamMessage()
 void err_processUpstreamMessageDecodeErr()
 {
     numLoops = 1;
-    UpStreamMsgQ = (UpStreamMsg *) malloc(sizeof(UpStreamMsg));
+    UpStreamMsgQ = (UpStreamMsg *) calloc(1, sizeof(UpStreamMsg));
     UpStreamMsgQ->msg = "First Message";
     UpStreamMsgQ->len = 13;
     UpStreamMsgQ->next = NULL;
@@ -523,7 +599,7 @@ void err_processUpstreamMessageMetapackFailure()
 {
     numLoops = 1;
     metaPackSize = 0;
-    UpStreamMsgQ = (UpStreamMsg *) malloc(sizeof(UpStreamMsg));
+    UpStreamMsgQ = (UpStreamMsg *) calloc(1, sizeof(UpStreamMsg));
     UpStreamMsgQ->msg = "First Message";
     UpStreamMsgQ->len = 13;
     UpStreamMsgQ->next = NULL;
@@ -545,10 +621,10 @@ void err_processUpstreamMessageMetapackFailure()
 void err_processUpstreamMessageRegMsg()
 {
     numLoops = 1;
-    UpStreamMsgQ = (UpStreamMsg *) malloc(sizeof(UpStreamMsg));
+    UpStreamMsgQ = (UpStreamMsg *) calloc(1, sizeof(UpStreamMsg));
     UpStreamMsgQ->msg = "First Message";
     UpStreamMsgQ->len = 13;
-    UpStreamMsgQ->next = (UpStreamMsg *) malloc(sizeof(UpStreamMsg));
+    UpStreamMsgQ->next = (UpStreamMsg *) calloc(1, sizeof(UpStreamMsg));
     UpStreamMsgQ->next->msg = "Second Message";
     UpStreamMsgQ->next->len = 15;
     UpStreamMsgQ->next->next = NULL;
@@ -640,6 +716,150 @@ void test_sendUpstreamMsg_close_retry()
 	free(bytes);
 }
 
+void test_processUpstreamMsg_drain()
+{
+    numLoops = 1;
+    metaPackSize = 20;
+    set_close_retry();
+    UpStreamMsgQ = (UpStreamMsg *) calloc(1, sizeof(UpStreamMsg));
+    UpStreamMsgQ->msg = "First Message";
+    UpStreamMsgQ->len = 13;
+    UpStreamMsgQ->next = NULL;
+    temp = (wrp_msg_t *) malloc(sizeof(wrp_msg_t));
+    memset(temp,0,sizeof(wrp_msg_t));
+    temp->msg_type = 3;
+
+    will_return(wrp_to_struct, 12);
+    expect_function_call(wrp_to_struct);
+    will_return(appendEncodedData, 100);
+    expect_function_call(appendEncodedData);
+    // close_retry is set, but the drain waits for it, so it is sent
+    drain_on_append = 1;
+    expect_function_call(sendMessage);
+    will_return(nn_freemsg, 0);
+    expect_function_call(nn_freemsg);
+    expect_function_call(wrp_free_struct);
+    processUpstreamMessage();
+    pthread_join(drain_thread, NULL);
+    assert_int_equal(drain_done, 1);
+    assert_int_equal(drain_left, 0);
+    reset_close_retry();
+    free(temp);
+}
+
+void test_sendUpstreamMsg_drain_held()
+{
+    void *bytes = NULL;
+
+    numLoops = 1;
+    metaPackSize = 20;
+    set_close_retry();
+    UpStreamMsgQ = (UpStreamMsg *) calloc(1, sizeof(UpStreamMsg));
+    UpStreamMsgQ->msg = "First Message";
+    UpStreamMsgQ->len = 13;
+    temp = (wrp_msg_t *) malloc(sizeof(wrp_msg_t));
+    memset(temp,0,sizeof(wrp_msg_t));
+    temp->msg_type = 3;
+    pthread_create(&drain_thread, NULL, drain_task, NULL);
+    usleep(100000);
+
+    // the drain does not wait for a response sent from another thread
+    will_return(appendEncodedData, 100);
+    expect_function_call(appendEncodedData);
+    sendUpstreamMsgToServer(&bytes, 110);
+
+    // the message it counted goes out
+    will_return(wrp_to_struct, 12);
+    expect_function_call(wrp_to_struct);
+    will_return(appendEncodedData, 100);
+    expect_function_call(appendEncodedData);
+    expect_function_call(sendMessage);
+    will_return(nn_freemsg, 0);
+    expect_function_call(nn_freemsg);
+    expect_function_call(wrp_free_struct);
+    processUpstreamMessage();
+    pthread_join(drain_thread, NULL);
+    assert_int_equal(drain_done, 1);
+    assert_int_equal(drain_left, 0);
+    reset_close_retry();
+    free(temp);
+}
+
+void test_drain_responses_first()
+{
+    struct timespec deadline;
+    unsigned int left;
+
+    // msg_type was set when they were queued, nothing is decoded here
+    UpStreamMsgQ = (UpStreamMsg *) calloc(1, sizeof(UpStreamMsg));
+    UpStreamMsgQ->msg = "Event";
+    UpStreamMsgQ->msg_type = WRP_MSG_TYPE__EVENT;
+    UpStreamMsgQ->next = (UpStreamMsg *) calloc(1, sizeof(UpStreamMsg));
+    UpStreamMsgQ->next->msg = "Response";
+    UpStreamMsgQ->next->msg_type = WRP_MSG_TYPE__REQ;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    assert_int_equal(drain_upstream(&deadline, &left), 0);
+    assert_int_equal(left, 2);
+    assert_string_equal((char *) UpStreamMsgQ->msg, "Response");
+    assert_string_equal((char *) UpStreamMsgQ->next->msg, "Event");
+    free(UpStreamMsgQ->next);
+    free(UpStreamMsgQ);
+    UpStreamMsgQ = NULL;
+}
+
+void test_sendUpstreamMsg_shards()
+{
+    void *bytes = NULL;
+    wrp_msg_t msg;
+
+    reset_close_retry();
+    memset(&msg, 0, sizeof(wrp_msg_t));
+    msg.msg_type = WRP_MSG_TYPE__EVENT;
+    wrp_struct_to( &msg, WRP_BYTES, &bytes );
+    metaPackSize = 10;
+
+    // the shard takes it, not the primary
+    shard_count = 2;
+    will_return(appendEncodedData, 100);
+    expect_function_call(appendEncodedData);
+    will_return(uplink_shard_send, 0);
+    expect_function_call(uplink_shard_send);
+    sendUpstreamMsgFromSource("mac:112233445566/config", &bytes, 110);
+    assert_string_equal(shard_service, "config");
+
+    // a shard that is gone leaves it to the primary
+    will_return(appendEncodedData, 100);
+    expect_function_call(appendEncodedData);
+    will_return(uplink_shard_send, -1);
+    expect_function_call(uplink_shard_send);
+    expect_function_call(sendMessage);
+    sendUpstreamMsgFromSource("mac:112233445566/iot", &bytes, 110);
+
+    // nothing is queued on a shard while a reconnect is pending
+    set_close_retry();
+    will_return(appendEncodedData, 100);
+    expect_function_call(appendEncodedData);
+    sendUpstreamMsgFromSource("mac:112233445566/config", &bytes, 110);
+    sendUpstreamMsgOnPrimary(bytes, 110);
+    reset_close_retry();
+
+    // a shard's fallback goes out on the primary
+    expect_function_call(sendMessage);
+    sendUpstreamMsgOnPrimary(bytes, 110);
+
+    // no source, or sharding off
+    will_return(appendEncodedData, 100);
+    expect_function_call(appendEncodedData);
+    expect_function_call(sendMessage);
+    sendUpstreamMsgToServer(&bytes, 110);
+    shard_count = 0;
+    will_return(appendEncodedData, 100);
+    expect_function_call(appendEncodedData);
+    expect_function_call(sendMessage);
+    sendUpstreamMsgFromSource("mac:112233445566/config", &bytes, 110);
+    free(bytes);
+}
+
 void err_sendUpstreamMsgToServer()
 {
     metaPackSize = 0;
@@ -654,7 +874,7 @@ void test_get_global_UpStreamMsgQ()
 void test_set_global_UpStreamMsgQ()
 {
 	static UpStreamMsg *UpStreamQ;
-    UpStreamQ = (UpStreamMsg *) malloc(sizeof(UpStreamMsg));
+    UpStreamQ = (UpStreamMsg *) calloc(1, sizeof(UpStreamMsg));
     UpStreamQ->msg = "First Message";
     UpStreamQ->len = 13;
     UpStreamQ->next = NULL;
@@ -680,7 +900,7 @@ void test_processUpstreamMsgCrud_nnfree()
     numLoops = 1;
     crud_test = 1;
     metaPackSize = 0;
-    UpStreamMsgQ = (UpStreamMsg *) malloc(sizeof(UpStreamMsg));
+    UpStreamMsgQ = (UpStreamMsg *) calloc(1, sizeof(UpStreamMsg));
     UpStreamMsgQ->msg = "First Message";
     UpStreamMsgQ->len = 13;
     UpStreamMsgQ->next = NULL;
@@ -699,7 +919,7 @@ void test_processUpstreamMsg_cloud_status()
 {
     numLoops = 1;
     metaPackSize = 20;
-	UpStreamMsgQ = (UpStreamMsg *) malloc(sizeof(UpStreamMsg));
+	UpStreamMsgQ = (UpStreamMsg *) calloc(1, sizeof(UpStreamMsg));
 	UpStreamMsgQ->msg = "First Message";
 	UpStreamMsgQ->len = 13;
 	UpStreamMsgQ->next= NULL;
@@ -713,6 +933,38 @@ void test_processUpstreamMsg_cloud_status()
 	will_return(wrp_to_struct, 12);
 	expect_function_call(wrp_to_struct);
 
+	expect_function_call(get_cloud_status_payload);
+	will_return(sendMsgtoRegisteredClients, 1);
+	expect_function_call(sendMsgtoRegisteredClients);
+
+	will_return(nn_freemsg, 0);
+	expect_function_call(nn_freemsg);
+	expect_function_call(wrp_free_struct);
+    processUpstreamMessage();
+    free(temp);
+    free(UpStreamMsgQ);
+    UpStreamMsgQ = NULL;
+}
+
+void test_processUpstreamMsg_cloud_status_queued()
+{
+    numLoops = 1;
+    metaPackSize = 20;
+	UpStreamMsgQ = (UpStreamMsg *) calloc(1, sizeof(UpStreamMsg));
+	UpStreamMsgQ->msg = "First Message";
+	UpStreamMsgQ->len = 13;
+	UpStreamMsgQ->next= NULL;
+	temp = (wrp_msg_t *) malloc(sizeof(wrp_msg_t));
+	memset(temp,0,sizeof(wrp_msg_t));
+	temp->msg_type = 6;
+	temp->u.crud.dest = "mac:14cfe2142xxx/parodus/cloud-status";
+	temp->u.crud.source = "dns:config.example.com/config";
+	temp->u.crud.transaction_uuid = "123";
+
+	will_return(wrp_to_struct, 12);
+	expect_function_call(wrp_to_struct);
+
+	// Not a local client, goes through the CRUD thread as before
 	expect_function_call(addCRUDmsgToQueue);
 
 	will_return(nn_freemsg, 0);
@@ -724,15 +976,45 @@ void test_processUpstreamMsg_cloud_status()
     UpStreamMsgQ = NULL;
 }
 
+void test_processUpstreamMsg_subscribe()
+{
+    numLoops = 1;
+    metaPackSize = 20;
+	UpStreamMsgQ = (UpStreamMsg *) calloc(1, sizeof(UpStreamMsg));
+	UpStreamMsgQ->msg = "First Message";
+	UpStreamMsgQ->len = 13;
+	UpStreamMsgQ->next= NULL;
+	temp = (wrp_msg_t *) malloc(sizeof(wrp_msg_t));
+	memset(temp,0,sizeof(wrp_msg_t));
+	temp->msg_type = 5;
+	temp->u.crud.dest = "mac:14cfe2142xxx/parodus/subscribe/test1";
+	temp->u.crud.source = "mac:14cfe2142xxx/config";
+	temp->u.crud.transaction_uuid = "123";
+
+	will_return(wrp_to_struct, 12);
+	expect_function_call(wrp_to_struct);
+
+	will_return(crud_subscribe_request, 201);
+	expect_function_call(crud_subscribe_request);
+
+	will_return(nn_freemsg, 0);
+	expect_function_call(nn_freemsg);
+	expect_function_call(wrp_free_struct);
+    processUpstreamMessage();
+    free(temp);
+    free(UpStreamMsgQ);
+    UpStreamMsgQ = NULL;
+}
+
 void test_processUpstreamMsg_sendToClient()
 {
     numLoops = 2;
     metaPackSize = 20;
-	UpStreamMsgQ = (UpStreamMsg *) malloc(sizeof(UpStreamMsg));
+	UpStreamMsgQ = (UpStreamMsg *) calloc(1, sizeof(UpStreamMsg));
 	UpStreamMsgQ->msg = strdup("First Message");
 	UpStreamMsgQ->len = 13;
 	UpStreamMsgQ->next= NULL;
-	UpStreamMsgQ->next = (UpStreamMsg *) malloc(sizeof(UpStreamMsg));
+	UpStreamMsgQ->next = (UpStreamMsg *) calloc(1, sizeof(UpStreamMsg));
     UpStreamMsgQ->next->msg = strdup("Second Message");
     UpStreamMsgQ->next->len = 15;
     UpStreamMsgQ->next->next = NULL;
@@ -787,6 +1069,10 @@ int main(void)
         cmocka_unit_test(err_processUpstreamMessageRegMsg),
         cmocka_unit_test(test_sendUpstreamMsgToServer),
         cmocka_unit_test(test_sendUpstreamMsg_close_retry),
+        cmocka_unit_test(test_processUpstreamMsg_drain),
+        cmocka_unit_test(test_sendUpstreamMsg_drain_held),
+        cmocka_unit_test(test_drain_responses_first),
+        cmocka_unit_test(test_sendUpstreamMsg_shards),
         cmocka_unit_test(err_sendUpstreamMsgToServer),
         cmocka_unit_test(test_get_global_UpStreamMsgQ),
         cmocka_unit_test(test_set_global_UpStreamMsgQ),
@@ -794,6 +1080,8 @@ int main(void)
         cmocka_unit_test(test_get_global_nano_mut),
         cmocka_unit_test(test_processUpstreamMsgCrud_nnfree),
         cmocka_unit_test(test_processUpstreamMsg_cloud_status),
+        cmocka_unit_test(test_processUpstreamMsg_cloud_status_queued),
+        cmocka_unit_test(test_processUpstreamMsg_subscribe),
         cmocka_unit_test(test_processUpstreamMsg_sendToClient),
     };
 
@@ -0,0 +1,282 @@
+/**
+ *  Copyright 2010-2016 Comcast Cable Communications Management, LLC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+#include <errno.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <limits.h>
+#include <time.h>
+#include <cmocka.h>
+
+#include <nopoll.h>
+#include <wrp-c.h>
+#include <nng/compat/nanomsg/nn.h>
+
+#include "../src/upstream.h"
+#include "../src/config.h"
+#include "../src/client_list.h"
+#include "../src/ParodusInternal.h"
+#include "../src/partners_check.h"
+#include "../src/crud_interface.h"
+
+/*----------------------------------------------------------------------------*/
+/*                                   Macros                                   */
+/*----------------------------------------------------------------------------*/
+#define BENCH_ROUNDS      2000
+#define CLOUD_STATUS_DEST "mac:14cfe2142xxx/parodus/cloud-status"
+
+/*----------------------------------------------------------------------------*/
+/*                            File Scoped Variables                           */
+/*----------------------------------------------------------------------------*/
+int numLoops = INT_MAX;
+static pthread_mutex_t reply_mut = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t reply_con = PTHREAD_COND_INITIALIZER;
+static unsigned int replies = 0;
+static unsigned int client_replies = 0;
+static unsigned int server_replies = 0;
+
+/*----------------------------------------------------------------------------*/
+/*                                   Mocks                                    */
+/*----------------------------------------------------------------------------*/
+
+static void reply_sent(unsigned int *counter)
+{
+    pthread_mutex_lock(&reply_mut);
+    (*counter)++;
+    replies++;
+    pthread_cond_signal(&reply_con);
+    pthread_mutex_unlock(&reply_mut);
+}
+
+noPollConn *get_global_conn(void)
+{
+    return NULL;
+}
+
+char *get_global_reconnect_reason(void)
+{
+    return "webpa_process_starts";
+}
+
+void set_global_reconnect_reason(char *reason)
+{
+    UNUSED(reason);
+}
+
+void set_global_reconnect_status(bool status)
+{
+    UNUSED(status);
+}
+
+int get_numOfClients(void)
+{
+    return 0;
+}
+
+reg_list_item_t *get_global_node(void)
+{
+    return NULL;
+}
+
+int addToList(wrp_msg_t **msg)
+{
+    UNUSED(msg);
+    return 0;
+}
+
+int sendAuthStatus(reg_list_item_t *new_node)
+{
+    UNUSED(new_node);
+    return 0;
+}
+
+int validate_partner_id(wrp_msg_t *msg, partners_t **partnerIds)
+{
+    UNUSED(msg); UNUSED(partnerIds);
+    return 0;
+}
+
+int crud_subscribe_request(wrp_msg_t *msg)
+{
+    UNUSED(msg);
+    return 0;
+}
+
+void crud_notify_change(const char *name, const char *value)
+{
+    UNUSED(name); UNUSED(value);
+}
+
+unsigned int uplink_shards_count(void)
+{
+    return 0;
+}
+
+unsigned int uplink_shard_for(const char *service, size_t len)
+{
+    UNUSED(service); UNUSED(len);
+    return 0;
+}
+
+int uplink_shard_send(unsigned int index, void *msg, size_t len)
+{
+    UNUSED(index); UNUSED(msg); UNUSED(len);
+    return -1;
+}
+
+size_t appendEncodedData(void **appendData, void *encodedBuffer, size_t encodedSize, void *metadataPack, size_t metadataSize)
+{
+    UNUSED(metadataPack); UNUSED(metadataSize);
+    *appendData = malloc(encodedSize);
+    memcpy(*appendData, encodedBuffer, encodedSize);
+    return encodedSize;
+}
+
+int sendMsgtoRegisteredClients(char *dest, const char **Msg, size_t msgSize)
+{
+    UNUSED(dest); UNUSED(Msg); UNUSED(msgSize);
+    reply_sent(&client_replies);
+    return 1;
+}
+
+void sendMessage(noPollConn *conn, void *msg, size_t len)
+{
+    UNUSED(conn); UNUSED(msg); UNUSED(len);
+    reply_sent(&server_replies);
+}
+
+/*----------------------------------------------------------------------------*/
+/*                                   Tests                                    */
+/*----------------------------------------------------------------------------*/
+
+/* hand a retrieve to the upstream consumer, the way handle_upstream does */
+static void push_upstream(const void *bytes, size_t len)
+{
+    UpStreamMsg *message, *tail;
+
+    message = (UpStreamMsg *) calloc(1, sizeof(UpStreamMsg));
+    message->msg = nn_allocmsg(len, 0);
+    memcpy(message->msg, bytes, len);
+    message->len = (int) len;
+    message->next = NULL;
+
+    pthread_mutex_lock(get_global_nano_mut());
+    tail = get_global_UpStreamMsgQ();
+    if(tail == NULL)
+    {
+        set_global_UpStreamMsgQ(message);
+    }
+    else
+    {
+        while(tail->next)
+        {
+            tail = tail->next;
+        }
+        tail->next = message;
+    }
+    pthread_cond_signal(get_global_nano_con());
+    pthread_mutex_unlock(get_global_nano_mut());
+}
+
+static int cmp_ns(const void *a, const void *b)
+{
+    long x = *(const long *) a, y = *(const long *) b;
+    return (x > y) - (x < y);
+}
+
+/* request handed to the consumer until its reply is sent */
+static void measure_retrieve(const char *source, long *p50, long *p99)
+{
+    static long samples[BENCH_ROUNDS];
+    struct timespec start, end;
+    wrp_msg_t req;
+    void *bytes = NULL;
+    ssize_t size;
+    int i;
+
+    memset(&req, 0, sizeof(wrp_msg_t));
+    req.msg_type = WRP_MSG_TYPE__RETREIVE;
+    req.u.crud.transaction_uuid = "bench";
+    req.u.crud.source = (char *) source;
+    req.u.crud.dest = CLOUD_STATUS_DEST;
+    size = wrp_struct_to(&req, WRP_BYTES, &bytes);
+    assert_true(size > 0);
+
+    for(i = 0; i < BENCH_ROUNDS; i++)
+    {
+        pthread_mutex_lock(&reply_mut);
+        replies = 0;
+        pthread_mutex_unlock(&reply_mut);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        push_upstream(bytes, size);
+        pthread_mutex_lock(&reply_mut);
+        while(replies == 0)
+        {
+            pthread_cond_wait(&reply_con, &reply_mut);
+        }
+        pthread_mutex_unlock(&reply_mut);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        samples[i] = (end.tv_sec - start.tv_sec) * 1000000000L + (end.tv_nsec - start.tv_nsec);
+    }
+    free(bytes);
+
+    qsort(samples, BENCH_ROUNDS, sizeof(long), cmp_ns);
+    *p50 = samples[BENCH_ROUNDS / 2];
+    *p99 = samples[(BENCH_ROUNDS * 99) / 100];
+}
+
+/*
+ * Not a pass/fail test, prints the latency of a cloud-status retrieve
+ * through processUpstreamMessage. A registered client is answered inline.
+ * A non-mac source still takes crudMsgQ, the CRUD retrieve thread and a
+ * second pass through the upstream queue, as every retrieve did before.
+ */
+void bench_cloud_status_retrieve()
+{
+    pthread_t upstream, crud;
+    long inline_p50, inline_p99, queued_p50, queued_p99;
+
+    set_cloud_status(CLOUD_STATUS_ONLINE);
+    pthread_create(&upstream, NULL, processUpstreamMessage, NULL);
+    pthread_create(&crud, NULL, CRUDRetrieveTask, NULL);
+
+    measure_retrieve("mac:14cfe2142xxx/config", &inline_p50, &inline_p99);
+    assert_int_equal(client_replies, BENCH_ROUNDS);
+
+    measure_retrieve("dns:config.example.com/config", &queued_p50, &queued_p99);
+    assert_int_equal(server_replies, BENCH_ROUNDS);
+
+    print_message("cloud-status retrieve p50/p99: inline %ld/%ld ns, crudMsgQ %ld/%ld ns\n",
+                  inline_p50, inline_p99, queued_p50, queued_p99);
+    // both consumers stay parked on their queues until the process exits
+    pthread_detach(upstream);
+    pthread_detach(crud);
+}
+
+/*----------------------------------------------------------------------------*/
+/*                             External Functions                             */
+/*----------------------------------------------------------------------------*/
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(bench_cloud_status_retrieve),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,292 @@
+/**
+ * Copyright 2018 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/wrp_locator.h"
+
+/*----------------------------------------------------------------------------*/
+/*                                   Macros                                   */
+/*----------------------------------------------------------------------------*/
+#define BENCH_LOOPS	100000
+
+/*----------------------------------------------------------------------------*/
+/*                            File Scoped Variables                           */
+/*----------------------------------------------------------------------------*/
+static int count_allocs = 0;
+static int allocs = 0;
+
+/*----------------------------------------------------------------------------*/
+/*                                   Mocks                                    */
+/*----------------------------------------------------------------------------*/
+/* Linked with --wrap so every allocation made while count_allocs is set is
+   counted */
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+char *__real_strdup(const char *s);
+char *__real_strndup(const char *s, size_t n);
+
+void *__wrap_malloc(size_t size)
+{
+	allocs += count_allocs;
+	return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size)
+{
+	allocs += count_allocs;
+	return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+	allocs += count_allocs;
+	return __real_realloc(ptr, size);
+}
+
+char *__wrap_strdup(const char *s)
+{
+	allocs += count_allocs;
+	return __real_strdup(s);
+}
+
+char *__wrap_strndup(const char *s, size_t n)
+{
+	allocs += count_allocs;
+	return __real_strndup(s, n);
+}
+
+/*----------------------------------------------------------------------------*/
+/*                                   Tests                                    */
+/*----------------------------------------------------------------------------*/
+static void assert_slice(const wrp_slice_t *s, const char *expected)
+{
+	char buf[64];
+
+	if(expected == NULL)
+	{
+		assert_null(s->ptr);
+		assert_int_equal(s->len, 0);
+	}
+	else
+	{
+		assert_non_null(s->ptr);
+		wrp_slice_copy(s, buf, sizeof(buf));
+		assert_string_equal(buf, expected);
+	}
+}
+
+void test_wrp_locator_parse()
+{
+	const char *dest = "mac:14cfe2142xxx/parodus/tag/test1";
+	wrp_locator_t loc;
+
+	assert_int_equal(wrp_locator_parse(dest, &loc), 0);
+	assert_slice(&loc.scheme, "mac");
+	assert_slice(&loc.device, "14cfe2142xxx");
+	assert_slice(&loc.service, "parodus");
+	assert_slice(&loc.application, "tag");
+	assert_slice(&loc.sub_path, "test1");
+
+	/* Slices point into the original string */
+	assert_ptr_equal(loc.scheme.ptr, dest);
+	assert_ptr_equal(loc.service.ptr, dest + 17);
+}
+
+void test_wrp_locator_parse_short()
+{
+	wrp_locator_t loc;
+
+	assert_int_equal(wrp_locator_parse("mac:14cfe2142xxx/parodus/cloud-status", &loc), 0);
+	assert_slice(&loc.application, "cloud-status");
+	assert_slice(&loc.sub_path, NULL);
+
+	assert_int_equal(wrp_locator_parse("mac:14cfe2142xxx/config", &loc), 0);
+	assert_slice(&loc.service, "config");
+	assert_slice(&loc.application, NULL);
+
+	assert_int_equal(wrp_locator_parse("mac:14cfe2142xxx", &loc), 0);
+	assert_slice(&loc.device, "14cfe2142xxx");
+	assert_slice(&loc.service, NULL);
+
+	/* Present but empty */
+	assert_int_equal(wrp_locator_parse("mac:14cfe2142xxx/", &loc), 0);
+	assert_non_null(loc.service.ptr);
+	assert_int_equal(loc.service.len, 0);
+}
+
+void test_wrp_locator_parse_sub_path()
+{
+	wrp_locator_t loc;
+
+	assert_int_equal(wrp_locator_parse("event:device-status/mac:14cfe2142xxx/online/now", &loc), 0);
+	assert_slice(&loc.scheme, "event");
+	assert_slice(&loc.device, "device-status");
+	assert_slice(&loc.service, "mac:14cfe2142xxx");
+	assert_slice(&loc.application, "online");
+	assert_slice(&loc.sub_path, "now");
+
+	assert_int_equal(wrp_locator_parse("mac:14cfe2142xxx/parodus/tag/a/b", &loc), 0);
+	assert_slice(&loc.sub_path, "a/b");
+}
+
+void test_wrp_locator_parse_no_scheme()
+{
+	wrp_locator_t loc;
+
+	assert_int_equal(wrp_locator_parse("fake-client1/iot", &loc), 0);
+	assert_slice(&loc.scheme, NULL);
+	assert_slice(&loc.device, "fake-client1");
+	assert_slice(&loc.service, "iot");
+
+	assert_int_equal(wrp_locator_parse("fake-server1", &loc), 0);
+	assert_slice(&loc.device, "fake-server1");
+	assert_slice(&loc.service, NULL);
+}
+
+void test_wrp_slice_equals()
+{
+	wrp_locator_t loc;
+
+	assert_int_equal(wrp_locator_parse("mac:14cfe2142xxx/parodus/cloud-status", &loc), 0);
+	assert_true(wrp_slice_equals(&loc.service, "parodus"));
+	assert_false(wrp_slice_equals(&loc.service, "parodu"));
+	assert_false(wrp_slice_equals(&loc.service, "parodus2"));
+	assert_false(wrp_slice_equals(&loc.sub_path, ""));
+	assert_false(wrp_slice_equals(&loc.service, NULL));
+}
+
+void test_wrp_slice_copy()
+{
+	wrp_locator_t loc;
+	char buf[5];
+
+	assert_int_equal(wrp_locator_parse("mac:14cfe2142xxx/parodus", &loc), 0);
+	assert_int_equal(wrp_slice_copy(&loc.service, buf, sizeof(buf)), 4);
+	assert_string_equal(buf, "paro");
+	assert_int_equal(wrp_slice_copy(&loc.application, buf, sizeof(buf)), 0);
+	assert_string_equal(buf, "");
+	assert_int_equal(wrp_slice_copy(&loc.service, NULL, 0), 0);
+}
+
+void err_wrp_locator_parse()
+{
+	wrp_locator_t loc;
+
+	assert_int_equal(wrp_locator_parse(NULL, &loc), -1);
+	assert_slice(&loc.scheme, NULL);
+	assert_int_equal(wrp_locator_parse("mac:14cfe2142xxx", NULL), -1);
+}
+
+void test_wrp_locator_no_allocs()
+{
+	static const char *dests[] = {
+		"mac:14cfe2142xxx/parodus/tag/test1",
+		"mac:14cfe2142xxx/parodus/cloud-status",
+		"event:device-status/mac:14cfe2142xxx/online",
+		"fake-client1/iot",
+		"",
+	};
+	wrp_locator_t loc;
+	char buf[32];
+	size_t i;
+
+	allocs = 0;
+	count_allocs = 1;
+	for(i = 0; i < sizeof(dests)/sizeof(dests[0]); i++)
+	{
+		wrp_locator_parse(dests[i], &loc);
+		wrp_slice_equals(&loc.service, "parodus");
+		wrp_slice_copy(&loc.service, buf, sizeof(buf));
+	}
+	count_allocs = 0;
+	assert_int_equal(allocs, 0);
+
+	/* Make sure the counter works */
+	count_allocs = 1;
+	free(strdup(dests[0]));
+	count_allocs = 0;
+	assert_int_equal(allocs, 1);
+}
+
+/* Not a pass/fail test, prints the cost of a parse next to the strdup and
+   strtok split it replaces in listenerOnMessage() */
+void bench_wrp_locator()
+{
+	const char *dest = "mac:14cfe2142xxx/parodus/tag/test1";
+	wrp_locator_t loc;
+	struct timespec start, end;
+	volatile size_t sink = 0;
+	char *copy, *tok;
+	double ns_locator, ns_strtok;
+	int i;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(i = 0; i < BENCH_LOOPS; i++)
+	{
+		wrp_locator_parse(dest, &loc);
+		sink += loc.service.len;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	ns_locator = ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / BENCH_LOOPS;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(i = 0; i < BENCH_LOOPS; i++)
+	{
+		copy = strdup(dest);
+		tok = strtok(copy, "/");
+		if(tok != NULL)
+		{
+			tok = strtok(NULL, "/");
+		}
+		sink += (tok != NULL) ? strlen(tok) : 0;
+		free(copy);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	ns_strtok = ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / BENCH_LOOPS;
+
+	print_message("wrp_locator_parse: %.1f ns/op, strdup+strtok: %.1f ns/op\n",
+		ns_locator, ns_strtok);
+	assert_true(sink > 0);
+}
+
+/*----------------------------------------------------------------------------*/
+/*                             External Functions                             */
+/*----------------------------------------------------------------------------*/
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_wrp_locator_parse),
+        cmocka_unit_test(test_wrp_locator_parse_short),
+        cmocka_unit_test(test_wrp_locator_parse_sub_path),
+        cmocka_unit_test(test_wrp_locator_parse_no_scheme),
+        cmocka_unit_test(test_wrp_slice_equals),
+        cmocka_unit_test(test_wrp_slice_copy),
+        cmocka_unit_test(err_wrp_locator_parse),
+        cmocka_unit_test(test_wrp_locator_no_allocs),
+        cmocka_unit_test(bench_wrp_locator),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}